@@ -0,0 +1,376 @@
+#pragma once
+
+/*
+Compiled handlers catalog: the installer walks handler folders once and writes down what is there, with handler
+icons already rendered, so the extension can build menus from one memory-mapped file instead of listing folders
+and extracting icons on the first right-click.
+
+Shared by the installer (writer) and the extension (reader), so it is plain C++ with no Windows types in it.
+Everything is little endian and read byte by byte, so the layout doesn't depend on the compiler or the platform:
+
+    header
+    folders     sorted by path, ordinally
+    handlers    grouped by folder
+    subfolders  string refs, grouped by folder
+    strings     UTF-16 code units
+    pixels      32 bit BGRA, top-down rows
+
+All offsets are from the beginning of the file, string offsets and lengths are in code units of the string table.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace catalog_format {
+
+    constexpr uint32_t MAGIC = 0x43574F4D; // "MOWC"
+    constexpr uint32_t VERSION = 1;
+
+    // the catalog is "%LOCALAPPDATA%\My Open With\handlers.catalog"
+    constexpr const wchar_t* CATALOG_FOLDER_NAME = L"\\My Open With";
+    constexpr const wchar_t* CATALOG_FILE_NAME = L"\\handlers.catalog";
+
+    struct StringRef {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct FolderRecord {
+        StringRef path;             // relative to the root, empty for the root itself
+        uint64_t lastWriteTime = 0; // FILETIME of the folder as a number, when it was listed
+        uint32_t firstHandler = 0;
+        uint32_t nHandlers = 0;
+        uint32_t firstSubfolder = 0;
+        uint32_t nSubfolders = 0;
+    };
+
+    struct HandlerRecord {
+        StringRef name;
+        uint64_t lastWriteTime = 0;
+        uint32_t iconOffset = 0;    // in bytes
+        uint32_t iconWidth = 0;     // 0 if the handler has no icon
+        uint32_t iconHeight = 0;
+    };
+
+    constexpr size_t HEADER_SIZE = 64;
+    constexpr size_t FOLDER_RECORD_SIZE = 32;
+    constexpr size_t HANDLER_RECORD_SIZE = 28;
+    constexpr size_t STRING_REF_SIZE = 8;
+
+    inline void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int i = 0; i < 4; i += 1) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    inline void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+        put_u32(out, static_cast<uint32_t>(value));
+        put_u32(out, static_cast<uint32_t>(value >> 32));
+    }
+
+    inline uint32_t get_u32(const uint8_t* at) {
+        return uint32_t(at[0]) | (uint32_t(at[1]) << 8) | (uint32_t(at[2]) << 16) | (uint32_t(at[3]) << 24);
+    }
+
+    inline uint64_t get_u64(const uint8_t* at) {
+        return uint64_t(get_u32(at)) | (uint64_t(get_u32(at + 4)) << 32);
+    }
+
+    // FNV-1a, enough to tell a truncated or scribbled over file
+    inline uint32_t checksum(const uint8_t* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i += 1) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    // What the writer is given: one entry per listed folder, paths relative to the root
+    struct HandlerEntry {
+        std::u16string name;
+        uint64_t lastWriteTime = 0;
+        uint32_t iconWidth = 0;
+        uint32_t iconHeight = 0;
+        std::vector<uint8_t> iconPixels; // iconWidth * iconHeight * 4 bytes
+    };
+
+    struct FolderEntry {
+        std::u16string path;
+        uint64_t lastWriteTime = 0;
+        std::vector<HandlerEntry> handlers;
+        std::vector<std::u16string> subfolders;
+    };
+
+    inline std::vector<uint8_t> write_catalog(const std::u16string& root, std::vector<FolderEntry> folders) {
+        std::sort(folders.begin(), folders.end(), [](const FolderEntry& a, const FolderEntry& b) {
+            return a.path < b.path;
+        });
+
+        std::u16string strings;
+        auto addString = [&strings](const std::u16string& text) {
+            StringRef ref;
+            ref.offset = static_cast<uint32_t>(strings.size());
+            ref.length = static_cast<uint32_t>(text.size());
+            strings.append(text);
+            return ref;
+        };
+
+        std::vector<uint8_t> folderRecords;
+        std::vector<uint8_t> handlerRecords;
+        std::vector<uint8_t> subfolderRefs;
+        std::vector<uint8_t> pixels;
+        uint32_t nHandlers = 0;
+        uint32_t nSubfolders = 0;
+
+        const StringRef rootRef = addString(root);
+        for (const auto& folder : folders) {
+            const StringRef path = addString(folder.path);
+            put_u32(folderRecords, path.offset);
+            put_u32(folderRecords, path.length);
+            put_u64(folderRecords, folder.lastWriteTime);
+            put_u32(folderRecords, nHandlers);
+            put_u32(folderRecords, static_cast<uint32_t>(folder.handlers.size()));
+            put_u32(folderRecords, nSubfolders);
+            put_u32(folderRecords, static_cast<uint32_t>(folder.subfolders.size()));
+
+            for (const auto& handler : folder.handlers) {
+                const StringRef name = addString(handler.name);
+                const bool haveIcon = handler.iconWidth != 0 && handler.iconHeight != 0
+                    && handler.iconPixels.size() == size_t(handler.iconWidth) * handler.iconHeight * 4;
+                put_u32(handlerRecords, name.offset);
+                put_u32(handlerRecords, name.length);
+                put_u64(handlerRecords, handler.lastWriteTime);
+                put_u32(handlerRecords, static_cast<uint32_t>(pixels.size()));
+                put_u32(handlerRecords, haveIcon ? handler.iconWidth : 0);
+                put_u32(handlerRecords, haveIcon ? handler.iconHeight : 0);
+                if (haveIcon) {
+                    pixels.insert(pixels.end(), handler.iconPixels.begin(), handler.iconPixels.end());
+                }
+                nHandlers += 1;
+            }
+
+            for (const auto& subfolder : folder.subfolders) {
+                const StringRef name = addString(subfolder);
+                put_u32(subfolderRefs, name.offset);
+                put_u32(subfolderRefs, name.length);
+                nSubfolders += 1;
+            }
+        }
+
+        const uint32_t foldersOffset = static_cast<uint32_t>(HEADER_SIZE);
+        const uint32_t handlersOffset = foldersOffset + static_cast<uint32_t>(folderRecords.size());
+        const uint32_t subfoldersOffset = handlersOffset + static_cast<uint32_t>(handlerRecords.size());
+        const uint32_t stringsOffset = subfoldersOffset + static_cast<uint32_t>(subfolderRefs.size());
+        const uint32_t pixelsOffset = stringsOffset + static_cast<uint32_t>(strings.size() * 2);
+        const uint32_t fileSize = pixelsOffset + static_cast<uint32_t>(pixels.size());
+
+        std::vector<uint8_t> body;
+        body.reserve(fileSize - HEADER_SIZE);
+        body.insert(body.end(), folderRecords.begin(), folderRecords.end());
+        body.insert(body.end(), handlerRecords.begin(), handlerRecords.end());
+        body.insert(body.end(), subfolderRefs.begin(), subfolderRefs.end());
+        for (const char16_t unit : strings) {
+            body.push_back(static_cast<uint8_t>(unit));
+            body.push_back(static_cast<uint8_t>(unit >> 8));
+        }
+        body.insert(body.end(), pixels.begin(), pixels.end());
+
+        std::vector<uint8_t> file;
+        file.reserve(fileSize);
+        put_u32(file, MAGIC);
+        put_u32(file, VERSION);
+        put_u32(file, fileSize);
+        put_u32(file, checksum(body.data(), body.size()));
+        put_u32(file, rootRef.offset);
+        put_u32(file, rootRef.length);
+        put_u32(file, foldersOffset);
+        put_u32(file, static_cast<uint32_t>(folders.size()));
+        put_u32(file, handlersOffset);
+        put_u32(file, nHandlers);
+        put_u32(file, subfoldersOffset);
+        put_u32(file, nSubfolders);
+        put_u32(file, stringsOffset);
+        put_u32(file, static_cast<uint32_t>(strings.size()));
+        put_u32(file, pixelsOffset);
+        put_u32(file, static_cast<uint32_t>(pixels.size()));
+        file.insert(file.end(), body.begin(), body.end());
+        return file;
+    }
+
+    /*
+    Reads a catalog in place, without copying or decoding more than asked for.
+    Every offset and length is checked against the data, so a damaged file reads as an empty catalog
+    or as missing records, never out of bounds.
+    */
+    class CatalogReader final {
+    public:
+        // data has to outlive the reader
+        bool Open(const uint8_t* data, size_t size) {
+            m_data = nullptr;
+            if (size < HEADER_SIZE
+                || get_u32(data) != MAGIC
+                || get_u32(data + 4) != VERSION
+                || get_u32(data + 8) != size
+                || get_u32(data + 12) != checksum(data + HEADER_SIZE, size - HEADER_SIZE)) {
+                return false;
+            }
+
+            m_size = size;
+            m_root = { get_u32(data + 16), get_u32(data + 20) };
+            m_foldersOffset = get_u32(data + 24);
+            m_nFolders = get_u32(data + 28);
+            m_handlersOffset = get_u32(data + 32);
+            m_nHandlers = get_u32(data + 36);
+            m_subfoldersOffset = get_u32(data + 40);
+            m_nSubfolders = get_u32(data + 44);
+            m_stringsOffset = get_u32(data + 48);
+            m_nStringUnits = get_u32(data + 52);
+            m_pixelsOffset = get_u32(data + 56);
+            m_nPixelBytes = get_u32(data + 60);
+
+            if (!IsInside(m_foldersOffset, uint64_t(m_nFolders) * FOLDER_RECORD_SIZE)
+                || !IsInside(m_handlersOffset, uint64_t(m_nHandlers) * HANDLER_RECORD_SIZE)
+                || !IsInside(m_subfoldersOffset, uint64_t(m_nSubfolders) * STRING_REF_SIZE)
+                || !IsInside(m_stringsOffset, uint64_t(m_nStringUnits) * 2)
+                || !IsInside(m_pixelsOffset, m_nPixelBytes)
+                || !IsValid(m_root)) {
+                return false;
+            }
+
+            m_data = data;
+            return true;
+        }
+
+        bool IsOpen() const {
+            return m_data != nullptr;
+        }
+
+        const StringRef& GetRoot() const {
+            return m_root;
+        }
+
+        // path is relative to the root; binary search, as folders are sorted by path
+        template <typename Char>
+        bool FindFolder(const Char* path, size_t length, FolderRecord& folder) const {
+            size_t low = 0;
+            size_t high = IsOpen() ? m_nFolders : 0;
+            while (low < high) {
+                const size_t middle = low + (high - low) / 2;
+                const FolderRecord candidate = GetFolder(middle);
+                const int order = Compare(candidate.path, path, length);
+                if (order == 0) {
+                    folder = candidate;
+                    return IsValid(folder.path);
+                }
+                if (order < 0) {
+                    low = middle + 1;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            return false;
+        }
+
+        // false if the record points out of the catalog
+        bool GetHandler(const FolderRecord& folder, size_t i, HandlerRecord& handler) const {
+            if (i >= folder.nHandlers || uint64_t(folder.firstHandler) + i >= m_nHandlers) {
+                return false;
+            }
+            const uint8_t* at = m_data + m_handlersOffset + (folder.firstHandler + i) * HANDLER_RECORD_SIZE;
+            handler.name = { get_u32(at), get_u32(at + 4) };
+            handler.lastWriteTime = get_u64(at + 8);
+            handler.iconOffset = get_u32(at + 16);
+            handler.iconWidth = get_u32(at + 20);
+            handler.iconHeight = get_u32(at + 24);
+            return IsValid(handler.name)
+                && uint64_t(handler.iconOffset) + uint64_t(handler.iconWidth) * handler.iconHeight * 4 <= m_nPixelBytes;
+        }
+
+        bool GetSubfolder(const FolderRecord& folder, size_t i, StringRef& name) const {
+            if (i >= folder.nSubfolders || uint64_t(folder.firstSubfolder) + i >= m_nSubfolders) {
+                return false;
+            }
+            const uint8_t* at = m_data + m_subfoldersOffset + (folder.firstSubfolder + i) * STRING_REF_SIZE;
+            name = { get_u32(at), get_u32(at + 4) };
+            return IsValid(name);
+        }
+
+        // the string has to be valid, as everything the getters above return true for
+        template <typename String>
+        void AppendString(const StringRef& ref, String& to) const {
+            const uint8_t* at = m_data + m_stringsOffset + size_t(ref.offset) * 2;
+            for (uint32_t i = 0; i < ref.length; i += 1) {
+                to.push_back(static_cast<typename String::value_type>(at[2 * i] | (at[2 * i + 1] << 8)));
+            }
+        }
+
+        template <typename Char>
+        bool IsEqual(const StringRef& ref, const Char* text, size_t length) const {
+            return ref.length == length && Compare(ref, text, length) == 0;
+        }
+
+        // the handler has to be valid
+        const uint8_t* GetIconPixels(const HandlerRecord& handler) const {
+            return m_data + m_pixelsOffset + handler.iconOffset;
+        }
+
+    private:
+        bool IsInside(uint64_t offset, uint64_t length) const {
+            return offset >= HEADER_SIZE && offset + length <= m_size;
+        }
+
+        bool IsValid(const StringRef& ref) const {
+            return uint64_t(ref.offset) + ref.length <= m_nStringUnits;
+        }
+
+        FolderRecord GetFolder(size_t i) const {
+            const uint8_t* at = m_data + m_foldersOffset + i * FOLDER_RECORD_SIZE;
+            FolderRecord folder;
+            folder.path = { get_u32(at), get_u32(at + 4) };
+            folder.lastWriteTime = get_u64(at + 8);
+            folder.firstHandler = get_u32(at + 16);
+            folder.nHandlers = get_u32(at + 20);
+            folder.firstSubfolder = get_u32(at + 24);
+            folder.nSubfolders = get_u32(at + 28);
+            return folder;
+        }
+
+        // ordinal, by UTF-16 code units, the same order write_catalog sorts folders in
+        template <typename Char>
+        int Compare(const StringRef& ref, const Char* text, size_t length) const {
+            if (!IsValid(ref)) {
+                return -1;
+            }
+            const uint8_t* at = m_data + m_stringsOffset + size_t(ref.offset) * 2;
+            const size_t common = std::min<size_t>(ref.length, length);
+            for (size_t i = 0; i < common; i += 1) {
+                const uint32_t unit = at[2 * i] | (at[2 * i + 1] << 8);
+                const uint32_t other = static_cast<uint16_t>(text[i]);
+                if (unit != other) {
+                    return unit < other ? -1 : 1;
+                }
+            }
+            return ref.length < length ? -1 : (ref.length > length ? 1 : 0);
+        }
+
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        StringRef m_root;
+        uint32_t m_foldersOffset = 0;
+        uint32_t m_nFolders = 0;
+        uint32_t m_handlersOffset = 0;
+        uint32_t m_nHandlers = 0;
+        uint32_t m_subfoldersOffset = 0;
+        uint32_t m_nSubfolders = 0;
+        uint32_t m_stringsOffset = 0;
+        uint32_t m_nStringUnits = 0;
+        uint32_t m_pixelsOffset = 0;
+        uint32_t m_nPixelBytes = 0;
+    };
+
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+/*
+Command lines for handlers: how much room a handler's command line leaves for the selected paths, the paths quoted
+the way CommandLineToArgvW reads them back, split into as few command lines as fit, and the UTF-8 list file
+written instead for handlers tagged {list}.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Paths are any container of wide strings with size()
+and operator[]; the list file is built in memory, writing it is left to the caller.
+*/
+
+#include "shell_link.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace command_line {
+
+    // Limit of CreateProcess's command line, including the program path and a link's own arguments
+    constexpr size_t MAX_COMMAND_LINE_LENGTH = 32767 - 1;
+    // Limit of cmd.exe's, which is what runs .cmd and .bat handlers whatever CreateProcess would take
+    constexpr size_t MAX_BATCH_COMMAND_LINE_LENGTH = 8191 - 1;
+    // cmd.exe gets `/c ""handler" arguments"`
+    constexpr size_t BATCH_COMMAND_RESERVE = 8;
+    constexpr size_t LINK_ARGUMENTS_RESERVE = 2048;
+    // a target with %VARIABLES% in it is taken to expand to as long a path as there can be
+    constexpr size_t MAX_PATH_LENGTH = 260;
+
+    template <typename Char>
+    bool ends_with_ascii_nocase(std::basic_string_view<Char> text, const char* suffix) {
+        const size_t length = std::char_traits<char>::length(suffix);
+        if (text.size() < length) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i += 1) {
+            Char c = text[text.size() - length + i];
+            c = (c >= 'A' && c <= 'Z') ? Char(c + ('a' - 'A')) : c;
+            if (c != Char(suffix[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // run by cmd.exe, and so held to its shorter command line
+    template <typename Char>
+    bool is_batch_file(std::basic_string_view<Char> path) {
+        return ends_with_ascii_nocase(path, ".cmd") || ends_with_ascii_nocase(path, ".bat");
+    }
+
+    // Room left for our arguments in a command line for the handler. A link is started as its target with the link's
+    // own arguments ahead of ours, so when we know what's in it there is no need to guess.
+    inline size_t get_max_arguments_length(std::wstring_view fullPathToHandler, const shell_link::ShellLink* link) {
+        bool isBatch = false;
+        size_t used = 0;
+        if (link) {
+            isBatch = is_batch_file(std::u16string_view(link->targetPath));
+            used = (link->targetHasVariables || link->targetPath.empty() ? MAX_PATH_LENGTH : link->targetPath.length()) + 3 + link->arguments.length() + 1;
+        }
+        else {
+            isBatch = is_batch_file(fullPathToHandler);
+            used = fullPathToHandler.length() + 3 + (isBatch ? 0 : LINK_ARGUMENTS_RESERVE);
+        }
+        const size_t limit = isBatch ? MAX_BATCH_COMMAND_LINE_LENGTH - BATCH_COMMAND_RESERVE : MAX_COMMAND_LINE_LENGTH;
+        return used < limit ? limit - used : 0;
+    }
+
+    inline size_t count_trailing_backslashes(std::wstring_view argument) {
+        size_t count = 0;
+        for (auto current = argument.rbegin(); current != argument.rend() && *current == L'\\'; ++current) {
+            count += 1;
+        }
+        return count;
+    }
+
+    // length of the argument appended by append_quoted_argument
+    inline size_t get_quoted_argument_length(std::wstring_view argument) {
+        return argument.length() + count_trailing_backslashes(argument) + 3;
+    }
+
+    // Appends space separated, quoted argument. Paths can't contain quotes, but trailing backslashes
+    // (as in "C:\") have to be doubled, otherwise CommandLineToArgvW would take the closing quote as escaped.
+    inline void append_quoted_argument(std::wstring& arguments, std::wstring_view argument) {
+        arguments.append(L" \""); //note space prefix
+        arguments.append(argument);
+        arguments.append(count_trailing_backslashes(argument), L'\\');
+        arguments.append(L"\"");
+    }
+
+    /*
+    Splits selected items into as few command lines as possible, each one not longer than maxLength.
+    Item that doesn't fit even alone gets a command line of its own, there is nothing better to do with it.
+    There is always at least one (maybe empty) command line.
+    */
+    template <typename Paths>
+    std::vector<std::wstring> build_argument_batches(const Paths& paths, size_t maxLength) {
+        std::vector<std::wstring> batches;
+        size_t batchStart = 0;
+        do {
+            // measure first, so every command line is allocated once
+            size_t batchLength = 0;
+            size_t batchEnd = batchStart;
+            while (batchEnd < paths.size()) {
+                const size_t length = get_quoted_argument_length(paths[batchEnd]);
+                if (batchEnd > batchStart && batchLength + length > maxLength) {
+                    break;
+                }
+                batchLength += length;
+                batchEnd += 1;
+            }
+
+            std::wstring arguments;
+            arguments.reserve(batchLength);
+            for (auto i = batchStart; i < batchEnd; i += 1) {
+                append_quoted_argument(arguments, paths[i]);
+            }
+            batches.push_back(std::move(arguments));
+            batchStart = batchEnd;
+        } while (batchStart < paths.size());
+
+        return batches;
+    }
+
+    // Appends the text in UTF-8. Wide strings are UTF-16 on Windows and UTF-32 elsewhere; a lone surrogate
+    // becomes U+FFFD, as WideCharToMultiByte makes it.
+    inline void append_utf8(std::string& to, std::wstring_view text) {
+        for (size_t i = 0; i < text.size(); i += 1) {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            if constexpr (sizeof(wchar_t) == 2) {
+                if (c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(text[i + 1]) - 0xDC00);
+                    i += 1;
+                }
+            }
+            if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+                c = 0xFFFD;
+            }
+
+            if (c < 0x80) {
+                to.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800) {
+                to.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                to.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000) {
+                to.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                to.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                to.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else {
+                to.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                to.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                to.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                to.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+    }
+
+    // Contents of a list file: selected items, one per line in UTF-8
+    template <typename Paths>
+    std::string build_list_file(const Paths& paths) {
+        std::string contents;
+        for (size_t i = 0; i < paths.size(); i += 1) {
+            append_utf8(contents, paths[i]);
+            contents.append("\r\n");
+        }
+        return contents;
+    }
+}
@@ -2,10 +2,53 @@
 #include <GuidDef.h>
 #include <Shobjidl.h>
 #include <Shlobj.h>
+#include <wincodec.h>
 
 #include <vector>
 #include <string>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <list>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <string_view>
+#include <deque>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cwchar>
+#include <chrono>
+#include <cmath>
+
+#include "catalog_format.h"
+#include "command_line.h"
+#include "drop_files.h"
+#include "extension_atoms.h"
+#include "extension_index.h"
+#include "file_signatures.h"
+#include "fingerprint_set.h"
+#include "handler_catalog.h"
+#include "handler_groups.h"
+#include "icon_cache.h"
+#include "shell_link.h"
+#include "usage_log.h"
+#include "icon_atlas.h"
+#include "icon_decode.h"
+#include "icon_loader.h"
+#include "launch_queue.h"
+#include "launch_scheduler.h"
+#include "menu_layout.h"
+#include "path_arena.h"
+#include "path_kernels.h"
+#include "pattern_matcher.h"
+#include "prewarmer.h"
+#include "selection_classifier.h"
+#include "suffix_trie.h"
+#include "worker_pool.h"
 
 namespace {
     const wchar_t* EXTENSION_GUID_TEXT{ L"{7BA11196-950C-4CC8-81E8-9853F514127F}" };
@@ -13,12 +56,45 @@ namespace {
 
     constexpr int MAX_WIDE_PATH_LENGTH = 32767;
 
+    // how many command ids QueryContextMenu reserves for handlers that aren't known yet
+    constexpr UINT MAX_RESERVED_COMMANDS = 1024;
+
+    // Most a menu fill waits in all: for the warm-up, type sniffing and icons together, each within its own limit.
+    // Whatever takes longer goes on without the menu, or shows up in it later (icons).
+    constexpr ULONGLONG MAX_MENU_FILL_MS = 250;
+
+    template <typename T>
+    T min_of(T a, T b) {
+        return a < b ? a : b;
+    }
+
+    bool operator == (const FILETIME& a, const FILETIME& b) {
+        return a.dwLowDateTime == b.dwLowDateTime && a.dwHighDateTime == b.dwHighDateTime;
+    }
+
+    uint64_t to_u64(const FILETIME& time) {
+        return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    }
+
+    FILETIME to_filetime(uint64_t time) {
+        FILETIME result;
+        result.dwLowDateTime = static_cast<DWORD>(time);
+        result.dwHighDateTime = static_cast<DWORD>(time >> 32);
+        return result;
+    }
+
     std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*> GetUserDocumentsFolderPath() {
         wchar_t* pMyDocuments = nullptr;
         SHGetKnownFolderPath(FOLDERID_Documents, KF_FLAG_CREATE, 0, &pMyDocuments);
         return std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*>(pMyDocuments, CoTaskMemFree);
     }
 
+    std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*> GetUserLocalAppDataFolderPath() {
+        wchar_t* pLocalAppData = nullptr;
+        SHGetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_CREATE, 0, &pLocalAppData);
+        return std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*>(pLocalAppData, CoTaskMemFree);
+    }
+
     bool is_two_dots(const wchar_t* string) {
         return string[0] == L'.' && string[1] == L'.' && string[2] == 0;
     }
@@ -29,93 +105,2306 @@ namespace {
         Folders = 2,            // L"\\Folders"
         ExtensionlessFiles = 4, // L"\\Extensionless Files"
         SpecificExtension = 8,  // L"\\Files by Extension"
-        AllFiles = 16           // L"\\All files"
+        AllFiles = 16,          // L"\\All files"
+        Patterns = 32,          // L"\\Files by Pattern"
+        SpecificType = 64       // L"\\Files by Type"
+    };
+
+    Handlers operator | (Handlers a, Handlers b) {
+        return static_cast<Handlers>(static_cast<unsigned>(a) | static_cast<unsigned>(b));
+    }
+
+    Handlers operator & (Handlers a, Handlers b) {
+        return static_cast<Handlers>(static_cast<unsigned>(a) & static_cast<unsigned>(b));
+    }
+
+    // sections of the menu, from the top to the bottom
+    constexpr Handlers SECTIONS_ORDER[] = {
+        Handlers::Patterns,
+        Handlers::SpecificExtension,
+        Handlers::SpecificType,
+        Handlers::ExtensionlessFiles,
+        Handlers::AllFiles,
+        Handlers::Folders,
+        Handlers::Everything
+    };
+
+    using PathMarks = path_kernels::PathMarks;
+
+    PathMarks find_path_marks(std::wstring_view path) {
+        return path_kernels::find_path_marks(path);
+    }
+
+    std::wstring get_handlers_root() {
+        auto myDocuments = GetUserDocumentsFolderPath();
+        std::wstring root(myDocuments ? myDocuments.get() : L"");
+        root.append(L"\\Open With Handlers for");
+        return root;
+    }
+
+    std::wstring get_section_folder(const std::wstring& handlersRoot, Handlers section) {
+        switch (section) {
+        case Handlers::SpecificExtension: return handlersRoot + L"\\Files by Extension";
+        case Handlers::ExtensionlessFiles: return handlersRoot + L"\\Extensionless Files";
+        case Handlers::AllFiles: return handlersRoot + L"\\All files";
+        case Handlers::Folders: return handlersRoot + L"\\Folders";
+        case Handlers::Everything: return handlersRoot + L"\\Everything";
+        case Handlers::Patterns: return handlersRoot + L"\\Files by Pattern";
+        case Handlers::SpecificType: return handlersRoot + L"\\Files by Type";
+        default: return handlersRoot;
+        }
+    }
+
+    std::wstring get_filename_without_extension(const std::wstring& fullPath) {
+        const auto marks = find_path_marks(fullPath);
+        if (marks.lastDot == std::wstring::npos) {
+            // there is no extension
+            return fullPath.substr(marks.lastSeparator == std::wstring::npos ? 0 : marks.lastSeparator + 1);
+        }
+
+        // name starts after the last backslash, forward slashes don't count here
+        auto startPos = marks.lastSeparator;
+        if (startPos != std::wstring::npos && fullPath[startPos] != L'\\') {
+            startPos = fullPath.rfind(L'\\', startPos);
+        }
+        startPos = startPos == std::wstring::npos ? 0 : startPos + 1; // no \\ please
+        return fullPath.substr(startPos, marks.lastDot - startPos); //no dots please
+    }
+
+    using path_arena::PathArena;
+
+    bool fold_ascii(wchar_t* text, size_t length) {
+        return path_kernels::fold_ascii(text, length);
+    }
+
+    // Upper-cases the text in place the way case insensitive file names compare
+    void fold_text(wchar_t* text, size_t length) {
+        // extensions and handler names are almost always plain ASCII
+        if (!fold_ascii(text, length)) {
+            ::CharUpperBuffW(text, static_cast<DWORD>(length));
+        }
+    }
+
+    std::wstring fold_case(std::wstring_view text) {
+        std::wstring folded(text);
+        if (!folded.empty()) {
+            fold_text(&folded.front(), folded.size());
+        }
+        return folded;
+    }
+
+    wchar_t fold_char(wchar_t c) {
+        if (c < 0x80) {
+            return (c >= L'a' && c <= L'z') ? c - (L'a' - L'A') : c;
+        }
+        ::CharUpperBuffW(&c, 1);
+        return c;
+    }
+
+    using suffix_trie::SuffixTrie;
+
+    // extension is a view into the path
+    bool GetFileExtension(std::wstring_view path, std::wstring_view& extension) {
+        const auto dot = find_path_marks(path).lastDot;
+        if (dot == std::wstring_view::npos) {
+            return false;
+        }
+        extension = path.substr(dot); //I want that dot too
+        return true;
+    }
+
+    using extension_atoms::ExtensionAtoms;
+    using ExtensionAtom = extension_atoms::Atom;
+
+    // Process-wide table of case folded extensions
+    ExtensionAtoms& get_extension_atoms() {
+        static ExtensionAtoms atoms(fold_text);
+        return atoms;
+    }
+
+    // with the calling thread that makes the 4 threads everything else runs on
+    constexpr size_t MAX_PARALLEL_HELPERS = 3;
+
+    // The one pool that classifying selections and walking handler groups run on, kept between right-clicks:
+    // starting threads costs more than the lookups they do.
+    // Never destroyed: on process exit its threads are killed already, joining them would hang.
+    worker_pool::WorkerPool& get_worker_pool() {
+        static worker_pool::WorkerPool* pool = new worker_pool::WorkerPool(MAX_PARALLEL_HELPERS);
+        return *pool;
+    }
+
+    size_t find_filename_start(std::wstring_view path) {
+        return path_kernels::find_filename_start(path);
+    }
+
+    /*
+    Folder listing, so attributes of many selected siblings cost one FindFirstFile/FindNextFile pass.
+    Listed on first use, and only up to maxEntries: a handful of items selected in a folder of millions
+    aren't worth listing all of it, names past the limit are looked up one by one.
+    */
+    class SiblingsListing final {
+    public:
+        // folder is expected to end with a path separator
+        SiblingsListing(std::wstring folder, size_t maxEntries)
+            : m_folder(std::move(folder))
+            , m_maxEntries(maxEntries)
+        {}
+
+        // returns false if the name wasn't listed
+        bool IsDirectory(std::wstring_view name, bool& isDirectory) {
+            std::call_once(m_listed, &SiblingsListing::List, this);
+            const auto found = m_isDirectory.find(name);
+            if (found == m_isDirectory.end()) {
+                return false;
+            }
+            isDirectory = found->second;
+            return true;
+        }
+
+    private:
+        void List() {
+            WIN32_FIND_DATAW findData;
+            HANDLE searchHandle = FindFirstFileExW((m_folder + L"*").c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+            if (INVALID_HANDLE_VALUE == searchHandle) {
+                return;
+            }
+
+            std::vector<Entry> entries;
+            do {
+                entries.push_back({ m_names.size(), wcslen(findData.cFileName), (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY });
+                m_names.append(findData.cFileName);
+            } while (entries.size() < m_maxEntries && FindNextFileW(searchHandle, &findData));
+            FindClose(searchHandle);
+
+            // m_names doesn't move from now on, so views into it are safe
+            m_isDirectory.reserve(entries.size());
+            for (const auto& entry : entries) {
+                m_isDirectory.emplace(std::wstring_view(m_names.data() + entry.offset, entry.length), entry.isDirectory);
+            }
+        }
+
+    private:
+        struct Entry {
+            size_t offset;
+            size_t length;
+            bool isDirectory;
+        };
+
+        const std::wstring m_folder;
+        const size_t m_maxEntries;
+        std::once_flag m_listed;
+        std::wstring m_names;
+        std::unordered_map<std::wstring_view, bool> m_isDirectory;
+    };
+
+    using selection_classifier::SelectionKinds;
+    using selection_classifier::SelectionClassifier;
+
+    // What SelectionClassifier knows of the disk
+    struct WindowsFileSystem {
+        bool IsDirectory(const wchar_t* path) const {
+            return FILE_ATTRIBUTE_DIRECTORY == (FILE_ATTRIBUTE_DIRECTORY & GetFileAttributesW(path));
+        }
+
+        std::unique_ptr<SiblingsListing> ListSiblings(std::wstring folder, size_t maxEntries) const {
+            return std::make_unique<SiblingsListing>(std::move(folder), maxEntries);
+        }
+    };
+
+    const wchar_t* SETTINGS_REGKEY_TEXT{ L"Software\\My Open With" };
+
+    enum class MixedExtensionsMode : DWORD {
+        // files with different extensions get no extension specific handlers
+        Off = 0,
+        // handlers that all of the extensions have
+        CommonHandlers = 1,
+        // common handlers, plus a submenu with handlers of every extension
+        CommonAndGroupedHandlers = 2
+    };
+
+    DWORD read_setting(const wchar_t* name, DWORD defaultValue) {
+        DWORD value = 0;
+        DWORD size = sizeof(value);
+        if (ERROR_SUCCESS == ::RegGetValueW(HKEY_CURRENT_USER, SETTINGS_REGKEY_TEXT, name, RRF_RT_REG_DWORD, NULL, &value, &size)) {
+            return value;
+        }
+        return defaultValue;
+    }
+
+    // Optional tweaks, as DWORD values under HKEY_CURRENT_USER\Software\My Open With
+    struct Settings {
+        MixedExtensionsMode mixedExtensions = MixedExtensionsMode::CommonHandlers;
+        // look into extensionless files to tell their type
+        bool sniffContent = false;
+        // order handlers by how often and how recently they were used
+        bool rankByUsage = false;
+
+        static Settings Load() {
+            Settings settings;
+            settings.mixedExtensions = static_cast<MixedExtensionsMode>(read_setting(L"MixedExtensions", static_cast<DWORD>(settings.mixedExtensions)));
+            settings.sniffContent = 0 != read_setting(L"ContentSniffing", settings.sniffContent);
+            settings.rankByUsage = 0 != read_setting(L"UsageRanking", settings.rankByUsage);
+            return settings;
+        }
+    };
+
+    using file_signatures::SNIFFED_BYTES;
+
+    const file_signatures::SignatureTable& get_signature_table() {
+        static const file_signatures::SignatureTable signatures;
+        return signatures;
+    }
+
+    // returns index of file's signature, -1 if it's unknown or the file can't be read
+    int sniff_file_type(const wchar_t* path) {
+        // reading a cloud placeholder would download it, an offline file might not be readable at all
+        const DWORD attributes = ::GetFileAttributesW(path);
+        if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS))) {
+            return -1;
+        }
+
+        HANDLE file = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return -1;
+        }
+
+        unsigned char head[SNIFFED_BYTES];
+        DWORD nRead = 0;
+        const bool haveRead = ::ReadFile(file, head, sizeof(head), &nRead, NULL);
+        ::CloseHandle(file);
+
+        return haveRead ? get_signature_table().Match(head, nRead) : -1;
+    }
+
+    /*
+    Finds the type that all of the files share. Reads at most SNIFFED_BYTES of every file, on a few threads,
+    and gives up on selections too big or too slow to sniff through. A deadline can't interrupt a read stalled
+    on a dead share, so the threads are never joined by the menu: a late one finishes on its own, and while
+    too many of those are stuck nothing more is sniffed.
+    */
+    class TypeSniffer final {
+    public:
+        static TypeSniffer& Instance() {
+            static TypeSniffer sniffer;
+            return sniffer;
+        }
+
+        TypeSniffer(const TypeSniffer&) = delete;
+        TypeSniffer& operator=(const TypeSniffer&) = delete;
+
+        ~TypeSniffer() {
+            // Can only get here on process exit with the threads still around, they're already killed by then.
+            for (auto& worker : m_workers) {
+                worker.thread.detach();
+            }
+        }
+
+        // Empty if there is no common type, or it wasn't found in time: by the deadline (GetTickCount64) the menu
+        // has left for it, and never later than TIME_LIMIT_MS from now.
+        std::wstring SniffCommonType(const PathArena& paths, ULONGLONG deadline) {
+            constexpr size_t MAX_SNIFFED_FILES = 256;
+            constexpr ULONGLONG TIME_LIMIT_MS = 250;
+
+            const ULONGLONG now = ::GetTickCount64();
+            if (paths.empty() || paths.size() > MAX_SNIFFED_FILES || now >= deadline) {
+                return std::wstring();
+            }
+
+            // shared with the threads, so one that outlives the menu still has it
+            auto job = std::make_shared<Job>();
+            job->deadline = min_of(now + TIME_LIMIT_MS, deadline);
+            job->paths.reserve(paths.size());
+            for (size_t i = 0; i < paths.size(); i += 1) {
+                job->paths.emplace_back(paths[i]);
+            }
+            job->types.assign(paths.size(), -1);
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            JoinFinishedWorkers();
+            if (m_nRunning >= MAX_LATE_THREADS) {
+                return std::wstring();
+            }
+            job->nThreads = min_of(MAX_THREADS, paths.size());
+            for (size_t i = 0; i < job->nThreads; i += 1) {
+                m_nRunning += 1;
+                m_workers.emplace_back();
+                Worker& worker = m_workers.back();
+                worker.thread = std::thread(&TypeSniffer::Run, this, job, &worker);
+            }
+
+            if (!m_finished.wait_for(lock, std::chrono::milliseconds(job->deadline - now), [&job]() { return job->nFinishedThreads == job->nThreads; })) {
+                job->givenUp = true;
+                return std::wstring();
+            }
+            if (job->givenUp) {
+                return std::wstring();
+            }
+
+            const wchar_t* commonType = get_signature_table().GetCommonType(job->types.data(), job->types.size());
+            return commonType ? commonType : std::wstring();
+        }
+
+        // Returns false while some sniffer is still reading, so the DLL can't be unloaded yet.
+        bool TryShutdown() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_nRunning > 0) {
+                return false;
+            }
+            JoinFinishedWorkers();
+            return true;
+        }
+
+    private:
+        static constexpr size_t MAX_THREADS = 4;
+        // threads still stuck in reads of earlier selections
+        static constexpr size_t MAX_LATE_THREADS = 4 * MAX_THREADS;
+
+        struct Job {
+            ULONGLONG deadline = 0;
+            std::vector<std::wstring> paths;
+            std::vector<int> types;
+            std::atomic<size_t> nextFile{ 0 };
+            std::atomic<bool> givenUp{ false };
+            size_t nThreads = 0;
+            size_t nFinishedThreads = 0;
+        };
+
+        struct Worker {
+            std::thread thread;
+            bool isFinished = false;
+        };
+
+        TypeSniffer() = default;
+
+        void Run(std::shared_ptr<Job> job, Worker* worker) {
+            for (size_t i = job->nextFile++; i < job->paths.size() && !job->givenUp.load(std::memory_order_relaxed); i = job->nextFile++) {
+                if (::GetTickCount64() > job->deadline) {
+                    job->givenUp = true;
+                    break;
+                }
+                job->types[i] = sniff_file_type(job->paths[i].c_str());
+                if (job->types[i] < 0) {
+                    // this one is unknown, so there is no common type
+                    job->givenUp = true;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            job->nFinishedThreads += 1;
+            worker->isFinished = true;
+            m_nRunning -= 1;
+            m_finished.notify_all();
+        }
+
+        // called with the lock held
+        void JoinFinishedWorkers() {
+            for (auto worker = m_workers.begin(); worker != m_workers.end();) {
+                if (worker->isFinished) {
+                    worker->thread.join();
+                    worker = m_workers.erase(worker);
+                }
+                else {
+                    ++worker;
+                }
+            }
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_finished;
+        std::list<Worker> m_workers;
+        size_t m_nRunning = 0;
+    };
+
+    // per-handler behaviour, requested by tags at the end of handler's name, like "Packer {list}.lnk"
+    struct HandlerOptions {
+        // pass a path to a file listing selected items, instead of the items themselves
+        bool passListFile = false;
+        // launch the handler once for every selected item, with at most maxProcesses of them running at once
+        bool launchPerItem = false;
+        size_t maxProcesses = 0;
+    };
+
+    size_t get_default_max_processes() {
+        SYSTEM_INFO systemInfo = { 0 };
+        ::GetSystemInfo(&systemInfo);
+        return systemInfo.dwNumberOfProcessors > 0 ? systemInfo.dwNumberOfProcessors : 1;
+    }
+
+    // strips recognized tags off the display name
+    std::wstring parse_handler_options(std::wstring displayName, HandlerOptions& options) {
+        while (displayName.size() > 2 && displayName.back() == L'}') {
+            const auto tagStart = displayName.rfind(L" {");
+            if (tagStart == std::wstring::npos) {
+                break;
+            }
+
+            const auto tag = std::wstring_view(displayName).substr(tagStart + 2, displayName.size() - tagStart - 3);
+            if (tag == L"list") {
+                options.passListFile = true;
+            }
+            else if (tag == L"each") {
+                options.launchPerItem = true;
+                options.maxProcesses = get_default_max_processes();
+            }
+            else if (tag.substr(0, 5) == L"each " && tag.size() > 5) {
+                // {each N}, with N clamped to what WaitForMultipleObjects can wait on, however many digits it has
+                size_t maxProcesses = 0;
+                bool isNumber = true;
+                for (const wchar_t c : tag.substr(5)) {
+                    if (c < L'0' || c > L'9') {
+                        isNumber = false;
+                        break;
+                    }
+                    maxProcesses = min_of<size_t>(maxProcesses * 10 + (c - L'0'), MAXIMUM_WAIT_OBJECTS);
+                }
+                if (!isNumber) {
+                    break;
+                }
+                options.launchPerItem = true;
+                options.maxProcesses = maxProcesses > 0 ? maxProcesses : 1;
+            }
+            else {
+                break;
+            }
+            displayName.erase(tagStart);
+        }
+        return displayName;
+    }
+
+    size_t get_max_arguments_length(const std::wstring& fullPathToHandler, const shell_link::ShellLink* link) {
+        return command_line::get_max_arguments_length(fullPathToHandler, link);
+    }
+
+    void append_quoted_argument(std::wstring& arguments, std::wstring_view argument) {
+        command_line::append_quoted_argument(arguments, argument);
+    }
+
+    std::vector<std::wstring> build_argument_batches(const PathArena& paths, size_t maxLength) {
+        return command_line::build_argument_batches(paths, maxLength);
+    }
+
+    // GetTempFileName names list files "mowXXXX.tmp"
+    const wchar_t* LIST_FILE_PREFIX{ L"mow" };
+
+    // Writes selected items, one per line in UTF-8, into a new temporary file.
+    bool write_list_file(const PathArena& paths, std::wstring& listFilePath) {
+        wchar_t tempFolder[MAX_PATH + 1] = { 0 };
+        wchar_t tempFile[MAX_PATH + 1] = { 0 };
+        if (!::GetTempPathW(MAX_PATH + 1, tempFolder) || !::GetTempFileNameW(tempFolder, LIST_FILE_PREFIX, 0, tempFile)) {
+            return false;
+        }
+
+        const std::string contents = command_line::build_list_file(paths);
+
+        HANDLE file = ::CreateFileW(tempFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            ::DeleteFileW(tempFile);
+            return false;
+        }
+        DWORD nWritten = 0;
+        const bool written = ::WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &nWritten, NULL) && nWritten == contents.size();
+        ::CloseHandle(file);
+        if (!written) {
+            ::DeleteFileW(tempFile);
+            return false;
+        }
+
+        listFilePath = tempFile;
+        return true;
+    }
+
+    // List files are deleted once their handler exits. Those handed over to an already running process
+    // (no process handle to wait on) are left for a day, then whichever launch comes next deletes them.
+    void delete_stale_list_files() {
+        constexpr uint64_t MAX_AGE = 24ULL * 60 * 60 * 10000000;
+
+        wchar_t tempFolder[MAX_PATH + 1] = { 0 };
+        if (!::GetTempPathW(MAX_PATH + 1, tempFolder)) {
+            return;
+        }
+        const std::wstring folder(tempFolder);
+        WIN32_FIND_DATAW findData;
+        HANDLE searchHandle = ::FindFirstFileExW((folder + LIST_FILE_PREFIX + L"*.tmp").c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, 0);
+        if (INVALID_HANDLE_VALUE == searchHandle) {
+            return;
+        }
+
+        FILETIME now;
+        ::GetSystemTimeAsFileTime(&now);
+        do {
+            const uint64_t writeTime = to_u64(findData.ftLastWriteTime);
+            if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && writeTime < to_u64(now) && to_u64(now) - writeTime > MAX_AGE) {
+                ::DeleteFileW((folder + findData.cFileName).c_str());
+            }
+        } while (::FindNextFileW(searchHandle, &findData));
+        ::FindClose(searchHandle);
+    }
+
+    using launch_queue::LaunchRequest;
+
+    // Launches of one request, as launch_scheduler runs them
+    struct ShellSpawner {
+        using Process = HANDLE;
+
+        const LaunchRequest& request;
+
+        launch_scheduler::Spawned Spawn(const std::wstring& arguments, bool keepProcess, HANDLE& process) {
+            SHELLEXECUTEINFOW executeInfo = { 0 };
+            executeInfo.cbSize = sizeof(executeInfo);
+            executeInfo.fMask = SEE_MASK_NOASYNC | (keepProcess ? SEE_MASK_NOCLOSEPROCESS : 0);
+            executeInfo.lpVerb = request.verb.c_str();
+            executeInfo.lpFile = request.file.c_str();
+            executeInfo.lpParameters = arguments.empty() ? nullptr : arguments.c_str();
+            executeInfo.nShow = SW_SHOW;
+            if (!::ShellExecuteExW(&executeInfo)) {
+                // user already saw what went wrong, and cancelling UAC prompt isn't an error
+                ::OutputDebugStringA("My Open With Extension: failed to launch handler");
+                return ::GetLastError() == ERROR_CANCELLED ? launch_scheduler::Spawned::Cancelled : launch_scheduler::Spawned::Failed;
+            }
+            if (keepProcess && !executeInfo.hProcess) {
+                // there is no process handle when the launch was handed over to an already running process
+                return launch_scheduler::Spawned::HandedOver;
+            }
+            process = executeInfo.hProcess;
+            return launch_scheduler::Spawned::Started;
+        }
+
+        static size_t WaitForAny(const std::vector<HANDLE>& processes) {
+            const DWORD result = ::WaitForMultipleObjects(static_cast<DWORD>(processes.size()), processes.data(), FALSE, INFINITE);
+            return (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + processes.size()) ? result - WAIT_OBJECT_0 : 0;
+        }
+
+        static void Close(HANDLE process) {
+            ::CloseHandle(process);
+        }
+    };
+
+    // What the launch queue does with a request on Windows
+    struct ShellLauncher {
+        // the shell launches some handlers through COM
+        struct ThreadScope {
+            const bool comInitialized = SUCCEEDED(::CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
+
+            ~ThreadScope() {
+                if (comInitialized) {
+                    ::CoUninitialize();
+                }
+            }
+        };
+
+        void Launch(const LaunchRequest& request) {
+            const bool haveListFile = !request.listFilePath.empty();
+            if (haveListFile) {
+                delete_stale_list_files();
+            }
+
+            // never wait on more processes than WaitForMultipleObjects can handle
+            const size_t maxProcesses = min_of<size_t>(request.maxProcesses, MAXIMUM_WAIT_OBJECTS);
+            ShellSpawner spawner{ request };
+            const bool isAllDone = launch_scheduler::run_launches(request.commandLines, maxProcesses, haveListFile, spawner);
+
+            // the list is done with once every process that could read it is gone
+            if (haveListFile && isAllDone) {
+                ::DeleteFileW(request.listFilePath.c_str());
+            }
+        }
+    };
+
+    /*
+    Launches handlers on a worker thread, so a slow target doesn't freeze Explorer window that asked for it.
+    A request with a cap on running processes, or with a list file to delete, has to wait for its processes
+    to exit, so it gets a thread of its own and the queue behind it keeps moving.
+    Failures are reported by the shell itself, as ShellExecute always did.
+    */
+    class Launcher final {
+    public:
+        static Launcher& Instance() {
+            static Launcher launcher;
+            return launcher;
+        }
+
+        Launcher(const Launcher&) = delete;
+        Launcher& operator=(const Launcher&) = delete;
+
+        // returns false if the queue is full
+        bool Enqueue(LaunchRequest&& request) {
+            return m_queue.Enqueue(std::move(request));
+        }
+
+        // Stops the worker if there is nothing left to launch, so the DLL can be unloaded.
+        // Returns false while there is some work left.
+        bool TryShutdown() {
+            return m_queue.TryShutdown();
+        }
+
+    private:
+        Launcher() = default;
+
+        launch_queue::LaunchQueue<ShellLauncher> m_queue;
+    };
+
+    // 32 bit top-down pixels of a bitmap, as GetDIBits converts them
+    bool read_bitmap_pixels(HBITMAP bitmap, uint32_t width, uint32_t height, std::vector<uint8_t>& pixels) {
+        BITMAPINFO info = { 0 };
+        info.bmiHeader.biSize = sizeof(info.bmiHeader);
+        info.bmiHeader.biWidth = static_cast<LONG>(width);
+        info.bmiHeader.biHeight = -static_cast<LONG>(height);
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        pixels.resize(size_t(width) * height * 4);
+        HDC screen = ::GetDC(NULL);
+        const int nRows = ::GetDIBits(screen, bitmap, 0, height, pixels.data(), &info, DIB_RGB_COLORS);
+        ::ReleaseDC(NULL, screen);
+        return nRows == static_cast<int>(height);
+    }
+
+    // small icons are as big as the system says for its DPI, the atlas doesn't take anything bigger than icons get
+    uint32_t get_small_icon_side() {
+        const int side = ::GetSystemMetrics(SM_CXSMICON);
+        return side > 0 && static_cast<uint32_t>(side) <= icon_decode::MAX_SIDE ? static_cast<uint32_t>(side) : 16;
+    }
+
+    // Premultiplied pixels of the icon, its mask applied if it has no alpha of its own. Destroys the icon.
+    bool convert_icon(HICON icon, icon_decode::Image& image) {
+        ICONINFO iconInfo = { 0 };
+        const bool haveInfo = ::GetIconInfo(icon, &iconInfo);
+        ::DestroyIcon(icon);
+        if (!haveInfo) {
+            return false;
+        }
+
+        BITMAP bitmapInfo = { 0 };
+        std::vector<uint8_t> mask;
+        bool isConverted = iconInfo.hbmColor
+            && ::GetObjectW(iconInfo.hbmColor, sizeof(bitmapInfo), &bitmapInfo)
+            && bitmapInfo.bmWidth > 0 && static_cast<uint32_t>(bitmapInfo.bmWidth) <= icon_decode::MAX_SIDE
+            && bitmapInfo.bmHeight > 0 && static_cast<uint32_t>(bitmapInfo.bmHeight) <= icon_decode::MAX_SIDE;
+        if (isConverted) {
+            image.width = static_cast<uint32_t>(bitmapInfo.bmWidth);
+            image.height = static_cast<uint32_t>(bitmapInfo.bmHeight);
+            isConverted = read_bitmap_pixels(iconInfo.hbmColor, image.width, image.height, image.pixels);
+        }
+        if (isConverted && iconInfo.hbmMask && read_bitmap_pixels(iconInfo.hbmMask, image.width, image.height, mask)) {
+            const size_t nPixels = size_t(image.width) * image.height;
+            bool haveAlpha = false;
+            for (size_t i = 0; i < nPixels && !haveAlpha; i += 1) {
+                haveAlpha = image.pixels[4 * i + 3] != 0;
+            }
+            // white in the mask is transparent
+            for (size_t i = 0; i < nPixels && !haveAlpha; i += 1) {
+                image.pixels[4 * i + 3] = mask[4 * i] ? 0 : 255;
+            }
+        }
+        if (isConverted) {
+            icon_decode::premultiply(image.pixels.data(), size_t(image.width) * image.height);
+        }
+
+        if (iconInfo.hbmColor) {
+            ::DeleteObject(iconInfo.hbmColor);
+        }
+        if (iconInfo.hbmMask) {
+            ::DeleteObject(iconInfo.hbmMask);
+        }
+        return isConverted;
+    }
+
+    bool load_link_file_icon(const std::wstring& path, icon_decode::Image& icon) {
+        SHFILEINFOW fileInfo = { 0 };
+        if (::SHGetFileInfoW(
+            path.c_str(),
+            0,
+            &fileInfo, sizeof(fileInfo),
+            SHGFI_ICON | SHGFI_SMALLICON /* | SHGFI_DISPLAYNAME | SHGFI_ADDOVERLAYS */))
+        {
+            return convert_icon(fileInfo.hIcon, icon);
+        }
+        return false;
+    }
+
+    void debug_print(const char* what) {
+#ifdef _DEBUG
+        ::OutputDebugStringA(what);
+#endif
+    }
+
+    void debug_print(const wchar_t* what) {
+#ifdef _DEBUG
+        ::OutputDebugStringW(what);
+#endif
+    }
+
+    struct HandlerFile {
+        std::wstring fullPath;
+        FILETIME lastWriteTime;
+    };
+
+    // Volume and file index: the same folder reached through a junction or a symbolic link has the same identity
+    struct FolderIdentity {
+        DWORD volume = 0;
+        DWORD indexHigh = 0;
+        DWORD indexLow = 0;
+    };
+
+    bool operator == (const FolderIdentity& a, const FolderIdentity& b) {
+        return a.volume == b.volume && a.indexHigh == b.indexHigh && a.indexLow == b.indexLow;
+    }
+
+    bool get_folder_identity(const std::wstring& folder, FolderIdentity& identity) {
+        HANDLE handle = ::CreateFileW(folder.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        BY_HANDLE_FILE_INFORMATION information;
+        const bool haveInformation = ::GetFileInformationByHandle(handle, &information);
+        ::CloseHandle(handle);
+        if (haveInformation) {
+            identity.volume = information.dwVolumeSerialNumber;
+            identity.indexHigh = information.nFileIndexHigh;
+            identity.indexLow = information.nFileIndexLow;
+        }
+        return haveInformation;
+    }
+
+    // What a handlers folder contained last time we looked into it.
+    struct FolderSnapshot {
+        bool exists = false;
+        std::vector<HandlerFile> files;
+        // names of (not hidden) subfolders
+        std::vector<std::wstring> subfolders;
+        // for telling loops when subfolders are walked
+        bool haveIdentity = false;
+        FolderIdentity identity;
+    };
+
+    std::shared_ptr<const FolderSnapshot> scan_handlers_folder(const std::wstring& folder) {
+        auto snapshot = std::make_shared<FolderSnapshot>();
+
+        std::wstring searchFolder = folder;
+        searchFolder.append(L"\\*");
+
+        WIN32_FIND_DATAW findData;
+        HANDLE searchHandle = FindFirstFileExW(searchFolder.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (INVALID_HANDLE_VALUE == searchHandle) {
+            const DWORD lastError = GetLastError();
+            switch (lastError) {
+            case ERROR_ACCESS_DENIED: {
+                //it's ok
+                snapshot->exists = true;
+                return snapshot;
+            } break;
+            case ERROR_FILE_NOT_FOUND: {
+                // create it back
+                CreateDirectoryW(folder.c_str(), NULL);
+                return snapshot;
+            } break;
+            default: {
+                OutputDebugStringW(L"FindFirstFileW just failed");
+                return snapshot;
+            }
+            }
+        }
+
+        snapshot->exists = true;
+        snapshot->haveIdentity = get_folder_identity(folder, snapshot->identity);
+
+        bool keepSearching = true;
+        while (keepSearching) {
+            if (FindNextFileW(searchHandle, &findData)) {
+                // junctions are listed like any other folder, whoever walks subfolders checks identities for loops
+                const DWORD attributes = findData.dwFileAttributes;
+                const bool isDirectory = ((attributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY);
+                const bool isHidden = ((attributes & FILE_ATTRIBUTE_HIDDEN) == FILE_ATTRIBUTE_HIDDEN);
+
+                if (isHidden || is_two_dots(findData.cFileName)) {
+                    continue;
+                }
+
+                if (isDirectory) {
+                    snapshot->subfolders.push_back(findData.cFileName);
+                    continue;
+                }
+
+                snapshot->files.push_back({ folder + L"\\" + findData.cFileName, findData.ftLastWriteTime });
+            }
+            else {
+                //what went wrong?
+                if (ERROR_NO_MORE_FILES != GetLastError()) {
+                    OutputDebugStringW(L"FindNextFileW failed");
+                }
+                keepSearching = false;
+            }
+        }
+
+        FindClose(searchHandle);
+        return snapshot;
+    }
+
+    bool get_last_write_time(const std::wstring& path, FILETIME& lastWriteTime) {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+            return false;
+        }
+        lastWriteTime = data.ftLastWriteTime;
+        return true;
+    }
+
+    // pixels are 32 bit BGRA, top-down rows; without them the bitmap is left blank
+    HBITMAP create_menu_bitmap(const uint8_t* pixels, uint32_t width, uint32_t height) {
+        BITMAPINFO info = { 0 };
+        info.bmiHeader.biSize = sizeof(info.bmiHeader);
+        info.bmiHeader.biWidth = static_cast<LONG>(width);
+        info.bmiHeader.biHeight = -static_cast<LONG>(height);
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        void* bits = nullptr;
+        HBITMAP bitmap = ::CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+        if (bitmap && pixels) {
+            memcpy(bits, pixels, size_t(width) * height * 4);
+        }
+        return bitmap;
+    }
+
+    /*
+    Handlers catalog compiled by the installer (see catalog_format.h), read into memory and the file closed again:
+    a mapped view would keep the installer from replacing or deleting it for as long as Explorer runs.
+    The file is looked at again every few seconds and read anew when the installer has compiled another one.
+    A folder listing or an icon is taken from it only while its last write time is what the installer saw,
+    anything added or changed since is looked up live, so a stale catalog costs speed, not correctness.
+    */
+    class CompiledCatalog final {
+    public:
+        static CompiledCatalog& Instance() {
+            static CompiledCatalog catalog;
+            return catalog;
+        }
+
+        CompiledCatalog(const CompiledCatalog&) = delete;
+        CompiledCatalog& operator=(const CompiledCatalog&) = delete;
+
+        // nullptr if the folder isn't in the catalog or it or any handler in it was changed since it was compiled.
+        // A link edited in place doesn't touch its folder's time, so every handler is checked on its own.
+        std::shared_ptr<const FolderSnapshot> FindFolder(const std::wstring& folder, const FILETIME& lastWriteTime) {
+            const auto loaded = GetLoaded();
+            const catalog_format::CatalogReader& reader = loaded->reader;
+            std::wstring_view relativePath;
+            catalog_format::FolderRecord record;
+            if (!GetRelativePath(*loaded, folder, relativePath)
+                || !reader.FindFolder(relativePath.data(), relativePath.size(), record)
+                || record.lastWriteTime != to_u64(lastWriteTime)) {
+                return nullptr;
+            }
+
+            auto snapshot = std::make_shared<FolderSnapshot>();
+            snapshot->exists = true;
+            snapshot->haveIdentity = get_folder_identity(folder, snapshot->identity);
+            snapshot->files.reserve(record.nHandlers);
+            for (size_t i = 0; i < record.nHandlers; i += 1) {
+                catalog_format::HandlerRecord handler;
+                if (!reader.GetHandler(record, i, handler)) {
+                    return nullptr;
+                }
+                snapshot->files.push_back({ folder + L"\\", FILETIME() });
+                HandlerFile& file = snapshot->files.back();
+                reader.AppendString(handler.name, file.fullPath);
+
+                WIN32_FILE_ATTRIBUTE_DATA attributes;
+                if (!::GetFileAttributesExW(file.fullPath.c_str(), GetFileExInfoStandard, &attributes)
+                    || to_u64(attributes.ftLastWriteTime) != handler.lastWriteTime) {
+                    return nullptr;
+                }
+                file.lastWriteTime = attributes.ftLastWriteTime;
+            }
+            for (size_t i = 0; i < record.nSubfolders; i += 1) {
+                catalog_format::StringRef name;
+                if (!reader.GetSubfolder(record, i, name)) {
+                    return nullptr;
+                }
+                snapshot->subfolders.emplace_back();
+                reader.AppendString(name, snapshot->subfolders.back());
+            }
+            return snapshot;
+        }
+
+        // false if the catalog has no icon for this version of the handler
+        bool LoadHandlerIcon(const HandlerFile& handler, icon_decode::Image& icon) {
+            const auto loaded = GetLoaded();
+            const catalog_format::CatalogReader& reader = loaded->reader;
+            const size_t nameStart = find_filename_start(handler.fullPath);
+            std::wstring_view relativePath;
+            catalog_format::FolderRecord record;
+            if (nameStart == 0
+                || !GetRelativePath(*loaded, std::wstring_view(handler.fullPath).substr(0, nameStart - 1), relativePath)
+                || !reader.FindFolder(relativePath.data(), relativePath.size(), record)) {
+                return false;
+            }
+
+            const wchar_t* name = handler.fullPath.c_str() + nameStart;
+            const size_t nameLength = handler.fullPath.size() - nameStart;
+            for (size_t i = 0; i < record.nHandlers; i += 1) {
+                catalog_format::HandlerRecord found;
+                if (reader.GetHandler(record, i, found) && reader.IsEqual(found.name, name, nameLength)) {
+                    // Icons were rendered at the DPI the installer ran with. Scaled down they still look right,
+                    // scaled up they'd be blurred: the shell does better with those.
+                    const uint32_t side = get_small_icon_side();
+                    const bool isUsable = found.lastWriteTime == to_u64(handler.lastWriteTime)
+                        && found.iconWidth >= side && found.iconWidth <= MAX_ICON_SIDE
+                        && found.iconHeight >= side && found.iconHeight <= MAX_ICON_SIDE;
+                    if (!isUsable) {
+                        return false;
+                    }
+                    // the installer keeps them as GDI gives them, straight alpha
+                    const uint8_t* pixels = reader.GetIconPixels(found);
+                    icon.width = found.iconWidth;
+                    icon.height = found.iconHeight;
+                    icon.pixels.assign(pixels, pixels + size_t(found.iconWidth) * found.iconHeight * 4);
+                    icon_decode::premultiply(icon.pixels.data(), size_t(found.iconWidth) * found.iconHeight);
+                    if (icon.width != side || icon.height != side) {
+                        icon_decode::Image rendered = std::move(icon);
+                        icon_decode::resample(rendered, side, side, icon);
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        // nobody compiles that many handlers, a bigger file is something else
+        static constexpr LONGLONG MAX_CATALOG_SIZE = 64 * 1024 * 1024;
+        static constexpr uint32_t MAX_ICON_SIDE = 256;
+        // how often the file is looked at for a newer catalog
+        static constexpr ULONGLONG CHECK_INTERVAL_MS = 3000;
+
+        // one catalog as read; the reader points into data, so it is never copied or moved once opened
+        struct Loaded {
+            std::vector<uint8_t> data;
+            catalog_format::CatalogReader reader;
+            std::wstring root;
+            FILETIME lastWriteTime = { 0 };
+            bool exists = false;
+        };
+
+        CompiledCatalog()
+            : m_loaded(std::make_shared<Loaded>())
+        {}
+
+        static std::wstring GetCatalogPath() {
+            auto localAppData = GetUserLocalAppDataFolderPath();
+            if (!localAppData) {
+                return std::wstring();
+            }
+            std::wstring path(localAppData.get());
+            path.append(catalog_format::CATALOG_FOLDER_NAME);
+            path.append(catalog_format::CATALOG_FILE_NAME);
+            return path;
+        }
+
+        // the catalog in use, read again if the installer has put another one in place since it was last looked at
+        std::shared_ptr<const Loaded> GetLoaded() {
+            std::lock_guard<std::mutex> guard(m_lock);
+            const ULONGLONG now = ::GetTickCount64();
+            if (m_nextCheckTime != 0 && now < m_nextCheckTime) {
+                return m_loaded;
+            }
+            m_nextCheckTime = now + CHECK_INTERVAL_MS;
+
+            if (m_path.empty()) {
+                m_path = GetCatalogPath();
+            }
+            FILETIME lastWriteTime = { 0 };
+            const bool exists = !m_path.empty() && get_last_write_time(m_path, lastWriteTime);
+            if (exists == m_loaded->exists && (!exists || to_u64(lastWriteTime) == to_u64(m_loaded->lastWriteTime))) {
+                return m_loaded;
+            }
+
+            // readers still holding the old one keep it alive until they are done
+            auto loaded = std::make_shared<Loaded>();
+            // not read, being replaced just now maybe: tried again at the next check
+            loaded->exists = exists && Read(*loaded);
+            loaded->lastWriteTime = lastWriteTime;
+            m_loaded = loaded;
+            return m_loaded;
+        }
+
+        // false if the file couldn't be read; a damaged one is read, just not used
+        bool Read(Loaded& loaded) const {
+            // shared for reading and deleting, so the installer isn't kept from replacing it even while it's read
+            HANDLE file = ::CreateFileW(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER size = { 0 };
+            bool isRead = false;
+            if (::GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= MAX_CATALOG_SIZE) {
+                loaded.data.resize(static_cast<size_t>(size.QuadPart));
+                DWORD nRead = 0;
+                isRead = ::ReadFile(file, loaded.data.data(), static_cast<DWORD>(loaded.data.size()), &nRead, NULL) && nRead == loaded.data.size();
+            }
+            ::CloseHandle(file);
+
+            if (!isRead || !loaded.reader.Open(loaded.data.data(), loaded.data.size())) {
+                if (isRead) {
+                    ::OutputDebugStringA("My Open With Extension: handlers catalog is damaged or of another version, ignoring it");
+                }
+                loaded.data.clear();
+                loaded.data.shrink_to_fit();
+                return isRead;
+            }
+            loaded.reader.AppendString(loaded.reader.GetRoot(), loaded.root);
+            return true;
+        }
+
+        static bool GetRelativePath(const Loaded& loaded, std::wstring_view folder, std::wstring_view& relativePath) {
+            const std::wstring& root = loaded.root;
+            if (!loaded.reader.IsOpen() || folder.substr(0, root.size()) != root) {
+                return false;
+            }
+            if (folder.size() == root.size()) {
+                relativePath = std::wstring_view();
+                return true;
+            }
+            if (folder[root.size()] != L'\\') {
+                return false;
+            }
+            relativePath = folder.substr(root.size() + 1);
+            return true;
+        }
+
+        std::mutex m_lock;
+        std::wstring m_path;
+        ULONGLONG m_nextCheckTime = 0;
+        std::shared_ptr<const Loaded> m_loaded;
+    };
+
+    bool has_extension(std::wstring_view path, const wchar_t* extension) {
+        std::wstring_view found;
+        return GetFileExtension(path, found)
+            && ::CompareStringOrdinal(found.data(), static_cast<int>(found.size()), extension, -1, TRUE) == CSTR_EQUAL;
+    }
+
+    // drive or UNC, the only kind of path that means the same thing whatever the current directory is
+    bool is_absolute_path(const std::wstring& path) {
+        return (path.size() > 2 && path[1] == L':' && path[2] == L'\\') || (path.size() > 1 && path[0] == L'\\' && path[1] == L'\\');
+    }
+
+    std::wstring expand_environment_strings(const std::u16string& text) {
+        const std::wstring unexpanded(text.begin(), text.end());
+        const DWORD nChars = ::ExpandEnvironmentStringsW(unexpanded.c_str(), NULL, 0);
+        if (nChars == 0) {
+            return unexpanded;
+        }
+        std::wstring expanded(nChars, L'\0');
+        if (::ExpandEnvironmentStringsW(unexpanded.c_str(), &expanded[0], nChars) != nChars) {
+            return unexpanded;
+        }
+        expanded.resize(nChars - 1);
+        return expanded;
+    }
+
+    void append_ansi(const char* text, size_t length, std::u16string& to) {
+        const int nChars = length ? ::MultiByteToWideChar(CP_ACP, 0, text, static_cast<int>(length), NULL, 0) : 0;
+        if (nChars <= 0) {
+            return;
+        }
+        std::wstring wide(nChars, L'\0');
+        ::MultiByteToWideChar(CP_ACP, 0, text, static_cast<int>(length), &wide[0], nChars);
+        to.append(wide.begin(), wide.end());
+    }
+
+    constexpr uint64_t FINGERPRINT_SEED = 14695981039346656037ULL;
+
+    // FNV-1a of the case folded text, folded as it goes so nothing is allocated
+    uint64_t hash_folded(uint64_t hash, std::wstring_view text) {
+        for (const wchar_t c : text) {
+            hash = (hash ^ static_cast<uint16_t>(fold_char(c))) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // what starting a program comes down to: the program and its arguments; never 0
+    uint64_t get_launch_fingerprint(std::wstring_view program, std::wstring_view arguments) {
+        // '|' can't be in a path, so a program can't run into its arguments
+        const uint64_t fingerprint = hash_folded(hash_folded(hash_folded(FINGERPRINT_SEED, program), L"|"), arguments);
+        return fingerprint ? fingerprint : 1;
+    }
+
+    // a link is started as its target with its arguments; 0 if it has no target path to go by
+    uint64_t get_link_fingerprint(const shell_link::ShellLink& link) {
+        if (link.targetPath.empty()) {
+            return 0;
+        }
+        const std::wstring target = link.targetHasVariables
+            ? expand_environment_strings(link.targetPath)
+            : std::wstring(link.targetPath.begin(), link.targetPath.end());
+        return get_launch_fingerprint(target, std::wstring(link.arguments.begin(), link.arguments.end()));
+    }
+
+    /*
+    Handlers that are shell links, parsed straight from the mapped file (see shell_link.h) rather than through
+    IShellLink, and kept by path and last write time like their icons are. Links that are gone or don't parse
+    are remembered as well, as nullptr, so a broken one isn't read again on every menu.
+    */
+    class LinkCache final {
+    public:
+        static LinkCache& Instance() {
+            static LinkCache cache;
+            return cache;
+        }
+
+        LinkCache(const LinkCache&) = delete;
+        LinkCache& operator=(const LinkCache&) = delete;
+
+        // nullptr if the handler isn't a link or it can't be read
+        std::shared_ptr<const shell_link::ShellLink> Get(const HandlerFile& handler) {
+            return Find(handler).link;
+        }
+
+        // see get_link_fingerprint, 0 if the handler isn't a link with a target path
+        uint64_t GetFingerprint(const HandlerFile& handler) {
+            return Find(handler).fingerprint;
+        }
+
+    private:
+        static constexpr size_t MAX_ENTRIES = 4096;
+        // links are a few KB, anything much bigger isn't one
+        static constexpr LONGLONG MAX_LINK_SIZE = 1024 * 1024;
+
+        struct Entry {
+            FILETIME lastWriteTime = { 0 };
+            std::shared_ptr<const shell_link::ShellLink> link;
+            uint64_t fingerprint = 0;
+        };
+
+        LinkCache() = default;
+
+        Entry Find(const HandlerFile& handler) {
+            if (!has_extension(handler.fullPath, L".lnk")) {
+                return Entry();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                auto found = m_entries.find(handler.fullPath);
+                if (found != m_entries.end() && found->second.lastWriteTime == handler.lastWriteTime) {
+                    return found->second;
+                }
+            }
+
+            Entry entry;
+            entry.lastWriteTime = handler.lastWriteTime;
+            entry.link = Read(handler.fullPath);
+            entry.fingerprint = entry.link ? get_link_fingerprint(*entry.link) : 0;
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_entries.size() >= MAX_ENTRIES) {
+                // nobody has that many handlers, somebody keeps renaming them; start over rather than keep track of age
+                m_entries.clear();
+            }
+            m_entries[handler.fullPath] = entry;
+            return entry;
+        }
+
+        static std::shared_ptr<const shell_link::ShellLink> Read(const std::wstring& path) {
+            HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                return nullptr;
+            }
+
+            LARGE_INTEGER size = { 0 };
+            HANDLE mapping = NULL;
+            if (::GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= MAX_LINK_SIZE) {
+                mapping = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            }
+            ::CloseHandle(file);
+            if (!mapping) {
+                return nullptr;
+            }
+
+            const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            ::CloseHandle(mapping);
+            if (!view) {
+                return nullptr;
+            }
+
+            auto link = std::make_shared<shell_link::ShellLink>();
+            const bool isParsed = shell_link::parse(static_cast<const uint8_t*>(view), static_cast<size_t>(size.QuadPart), *link, append_ansi);
+            ::UnmapViewOfFile(view);
+            if (!isParsed) {
+#ifdef _DEBUG
+                debug_print((L"My Open With Extension: not a valid shell link " + path).c_str());
+#endif
+                return nullptr;
+            }
+            return link;
+        }
+
+        std::mutex m_lock;
+        std::unordered_map<std::wstring, Entry> m_entries;
+    };
+
+    // Handlers with equal fingerprints do the same thing: a link is known by where it points to and with what arguments,
+    // anything else as a program started with none, so notepad.exe and a plain link to it are the same.
+    // Options in the name make a difference too.
+    uint64_t get_handler_fingerprint(const HandlerFile& handler) {
+        uint64_t fingerprint = LinkCache::Instance().GetFingerprint(handler);
+        if (fingerprint == 0) {
+            fingerprint = get_launch_fingerprint(handler.fullPath, std::wstring_view());
+        }
+        if (handler.fullPath.find(L" {") != std::wstring::npos) {
+            HandlerOptions options;
+            parse_handler_options(get_filename_without_extension(handler.fullPath), options);
+            const uint64_t launch = (options.passListFile ? 1 : 0) | (options.launchPerItem ? 2 : 0) | (uint64_t(options.maxProcesses) << 2);
+            fingerprint = (fingerprint ^ launch) * 1099511628211ULL;
+        }
+        return fingerprint;
+    }
+
+    // {CACAF262-9370-4615-A13B-9F5539DA4C0A}
+    constexpr GUID WIC_IMAGING_FACTORY_CLSID = { 0xcacaf262, 0x9370, 0x4615, {0xa1, 0x3b, 0x9f, 0x55, 0x39, 0xda, 0x4c, 0x0a} };
+    // GUID_WICPixelFormat32bppPBGRA
+    constexpr GUID WIC_PIXEL_FORMAT_PBGRA = { 0x6fddc324, 0x4e03, 0x4bfe, {0xb1, 0x85, 0x3d, 0x77, 0x76, 0x8d, 0xc9, 0x10} };
+
+    // PNG entries of .ico files: WIC decodes them straight into premultiplied BGRA. Needs COM on the calling thread.
+    bool decode_png(const uint8_t* data, size_t size, icon_decode::Image& image) {
+        IWICImagingFactory* factory = nullptr;
+        IWICStream* stream = nullptr;
+        IWICBitmapDecoder* decoder = nullptr;
+        IWICBitmapFrameDecode* frame = nullptr;
+        IWICFormatConverter* converter = nullptr;
+        UINT width = 0;
+        UINT height = 0;
+
+        bool isDecoded = size <= MAXDWORD
+            && SUCCEEDED(::CoCreateInstance(WIC_IMAGING_FACTORY_CLSID, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory)))
+            && SUCCEEDED(factory->CreateStream(&stream))
+            && SUCCEEDED(stream->InitializeFromMemory(const_cast<BYTE*>(data), static_cast<DWORD>(size)))
+            && SUCCEEDED(factory->CreateDecoderFromStream(stream, NULL, WICDecodeMetadataCacheOnDemand, &decoder))
+            && SUCCEEDED(decoder->GetFrame(0, &frame))
+            && SUCCEEDED(factory->CreateFormatConverter(&converter))
+            && SUCCEEDED(converter->Initialize(frame, WIC_PIXEL_FORMAT_PBGRA, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom))
+            && SUCCEEDED(converter->GetSize(&width, &height))
+            && width > 0 && width <= icon_decode::MAX_SIDE && height > 0 && height <= icon_decode::MAX_SIDE;
+        if (isDecoded) {
+            image.width = width;
+            image.height = height;
+            image.pixels.resize(size_t(width) * height * 4);
+            isDecoded = SUCCEEDED(converter->CopyPixels(NULL, width * 4, static_cast<UINT>(image.pixels.size()), image.pixels.data()));
+        }
+
+        for (IUnknown* object : std::initializer_list<IUnknown*>{ converter, frame, decoder, stream, factory }) {
+            if (object) {
+                object->Release();
+            }
+        }
+        return isDecoded;
+    }
+
+    // An .ico file decoded by us (see icon_decode.h), at the size asked for, without GDI round trips.
+    bool load_icon_file(const std::wstring& path, uint32_t side, icon_decode::Image& icon) {
+        // icons of 256 x 256 in every depth fit into this
+        constexpr LONGLONG MAX_ICON_FILE_SIZE = 4 * 1024 * 1024;
+
+        HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER size = { 0 };
+        HANDLE mapping = NULL;
+        if (::GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= MAX_ICON_FILE_SIZE) {
+            mapping = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        ::CloseHandle(file);
+        if (!mapping) {
+            return false;
+        }
+
+        const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        ::CloseHandle(mapping);
+        if (!view) {
+            return false;
+        }
+
+        const bool isDecoded = icon_decode::decode_icon(static_cast<const uint8_t*>(view), static_cast<size_t>(size.QuadPart), side, icon, decode_png);
+        ::UnmapViewOfFile(view);
+        return isDecoded;
+    }
+
+    // The icon a link names, or its target's own if that is a program: both can be had without asking the shell,
+    // .ico files are decoded by us. False for the rest, whose icons come from file associations.
+    bool load_shell_link_icon(const shell_link::ShellLink& link, icon_decode::Image& icon) {
+        std::wstring location;
+        int index = 0;
+        if (!link.iconLocation.empty()) {
+            location = expand_environment_strings(link.iconLocation);
+            index = link.iconIndex;
+        }
+        else if (has_extension(std::wstring(link.targetPath.begin(), link.targetPath.end()), L".exe")) {
+            location = expand_environment_strings(link.targetPath);
+        }
+        if (!is_absolute_path(location)) {
+            return false;
+        }
+
+        if (has_extension(location, L".ico") && load_icon_file(location, get_small_icon_side(), icon)) {
+            return true;
+        }
+
+        HICON extracted = NULL;
+        if (::ExtractIconExW(location.c_str(), index, NULL, &extracted, 1) == 0 || !extracted) {
+            return false;
+        }
+        return convert_icon(extracted, icon);
+    }
+
+    /*
+    Process-wide atlas of handler icons (see icon_atlas.h), plus one DIB section mirroring its pixels in a memory DC
+    that items of our menus are blended from: however many icons there are, that's one bitmap. An icon becomes
+    a bitmap of its own only for hosts that don't forward menu messages, whose menus have to draw it themselves.
+    */
+    class IconAtlas final {
+    public:
+        static IconAtlas& Instance() {
+            static IconAtlas atlas;
+            return atlas;
+        }
+
+        IconAtlas(const IconAtlas&) = delete;
+        IconAtlas& operator=(const IconAtlas&) = delete;
+
+        ~IconAtlas() {
+            if (m_dc) {
+                ::DeleteDC(m_dc);
+            }
+            if (m_mirror) {
+                ::DeleteObject(m_mirror);
+            }
+        }
+
+        // copies the icon in, NO_SLOT if it doesn't fit
+        icon_atlas::SlotId Add(const icon_decode::Image& icon) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_atlas.Add(icon.pixels.data(), icon.width, icon.height);
+        }
+
+        void Remove(icon_atlas::SlotId slot) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_atlas.Remove(slot);
+        }
+
+        bool GetSize(icon_atlas::SlotId slot, SIZE& size) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_atlas.IsUsed(slot)) {
+                return false;
+            }
+            size.cx = static_cast<LONG>(m_atlas.GetRect(slot).width);
+            size.cy = static_cast<LONG>(m_atlas.GetRect(slot).height);
+            return true;
+        }
+
+        // blends the icon into the middle of the rectangle
+        bool Draw(icon_atlas::SlotId slot, HDC dc, const RECT& into) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_atlas.IsUsed(slot) || !SyncMirror()) {
+                return false;
+            }
+
+            const icon_atlas::Rect& rect = m_atlas.GetRect(slot);
+            const int width = static_cast<int>(rect.width);
+            const int height = static_cast<int>(rect.height);
+            const int x = into.left + (into.right - into.left > width ? (into.right - into.left - width) / 2 : 0);
+            const int y = into.top + (into.bottom - into.top > height ? (into.bottom - into.top - height) / 2 : 0);
+            BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+            // AlphaBlend without linking to msimg32
+            return ::GdiAlphaBlend(dc, x, y, width, height, m_dc, static_cast<int>(rect.x), static_cast<int>(rect.y), width, height, blend);
+        }
+
+        // the icon as a bitmap of its own, premultiplied as menus want it
+        HBITMAP CreateBitmap(icon_atlas::SlotId slot) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_atlas.IsUsed(slot)) {
+                return NULL;
+            }
+
+            const icon_atlas::Rect& rect = m_atlas.GetRect(slot);
+            std::vector<uint8_t> pixels;
+            pixels.reserve(size_t(rect.width) * rect.height * 4);
+            for (uint32_t row = 0; row < rect.height; row += 1) {
+                const uint8_t* from = m_atlas.GetPixels() + (size_t(rect.y + row) * m_atlas.GetWidth() + rect.x) * 4;
+                pixels.insert(pixels.end(), from, from + size_t(rect.width) * 4);
+            }
+            return create_menu_bitmap(pixels.data(), rect.width, rect.height);
+        }
+
+    private:
+        IconAtlas() = default;
+
+        // Brings the mirror up to date with the atlas: only rows icons were added into since are copied.
+        // It's made taller than the atlas when it has to grow, so an atlas growing shelf by shelf isn't copied
+        // whole for every shelf.
+        bool SyncMirror() {
+            if (m_mirror && m_mirrorGeneration == m_atlas.GetGeneration()) {
+                return true;
+            }
+            if (!m_dc) {
+                m_dc = ::CreateCompatibleDC(NULL);
+                if (!m_dc) {
+                    return false;
+                }
+            }
+
+            if (!m_mirror || m_mirrorHeight < m_atlas.GetHeight()) {
+                const uint32_t grown = 2 * m_mirrorHeight > m_atlas.GetHeight() ? 2 * m_mirrorHeight : m_atlas.GetHeight();
+                const uint32_t height = min_of(grown, icon_atlas::Atlas::MAX_HEIGHT);
+                HBITMAP mirror = create_menu_bitmap(nullptr, m_atlas.GetWidth(), height);
+                if (!mirror) {
+                    return false;
+                }
+                // selecting the new one deselects the old one, which can go then
+                ::SelectObject(m_dc, mirror);
+                if (m_mirror) {
+                    ::DeleteObject(m_mirror);
+                }
+                m_mirror = mirror;
+                m_mirrorHeight = height;
+                m_isMirrorBlank = true;
+            }
+
+            DIBSECTION section = { 0 };
+            if (!::GetObjectW(m_mirror, sizeof(section), &section) || !section.dsBm.bmBits) {
+                return false;
+            }
+            // GDI may still be drawing from the bits
+            ::GdiFlush();
+            m_atlas.CopyChangedRows(static_cast<uint8_t*>(section.dsBm.bmBits), m_isMirrorBlank);
+            m_isMirrorBlank = false;
+            m_mirrorGeneration = m_atlas.GetGeneration();
+            return true;
+        }
+
+        std::mutex m_lock;
+        icon_atlas::Atlas m_atlas;
+        HDC m_dc = NULL;
+        HBITMAP m_mirror = NULL;
+        uint32_t m_mirrorHeight = 0;
+        // made anew and nothing copied into it yet: takes every row of the atlas
+        bool m_isMirrorBlank = false;
+        uint64_t m_mirrorGeneration = 0;
+    };
+
+    // A menu icon that can be shared between menus of different MyExtension instances, kept in the icon atlas.
+    class MenuIcon final {
+    public:
+        // an empty image is no icon
+        explicit MenuIcon(const icon_decode::Image& icon)
+            : m_slot(icon.pixels.empty() ? icon_atlas::NO_SLOT : IconAtlas::Instance().Add(icon))
+            , m_hBitmap(NULL)
+        {
+            if (m_slot == icon_atlas::NO_SLOT && !icon.pixels.empty()) {
+                // didn't fit into the atlas, it gets a bitmap of its own
+                m_hBitmap = create_menu_bitmap(icon.pixels.data(), icon.width, icon.height);
+            }
+        }
+
+        ~MenuIcon() {
+            if (m_slot != icon_atlas::NO_SLOT) {
+                IconAtlas::Instance().Remove(m_slot);
+            }
+            ::DeleteObject(m_hBitmap);
+        }
+
+        MenuIcon(const MenuIcon&) = delete;
+        MenuIcon& operator=(const MenuIcon&) = delete;
+
+        // the icon as a bitmap of its own, made when it's first asked for: only menus we don't draw need it
+        HBITMAP GetBitmap() const {
+            std::call_once(m_sliced, [this]() {
+                if (!m_hBitmap && m_slot != icon_atlas::NO_SLOT) {
+                    m_hBitmap = IconAtlas::Instance().CreateBitmap(m_slot);
+                }
+            });
+            return m_hBitmap;
+        }
+
+        // NO_SLOT if the icon isn't in the atlas
+        icon_atlas::SlotId GetSlot() const {
+            return m_slot;
+        }
+
+    private:
+        const icon_atlas::SlotId m_slot;
+        mutable HBITMAP m_hBitmap;
+        mutable std::once_flag m_sliced;
+    };
+
+    class IconProvider {
+    public:
+        virtual ~IconProvider() = default;
+
+        // false if there is no icon for the handler; pixels are premultiplied
+        virtual bool LoadHandlerIcon(const HandlerFile& handler, icon_decode::Image& icon) = 0;
+    };
+
+    class ShellIconProvider final : public IconProvider {
+    public:
+        virtual bool LoadHandlerIcon(const HandlerFile& handler, icon_decode::Image& icon) override {
+            auto link = LinkCache::Instance().Get(handler);
+            return (link && load_shell_link_icon(*link, icon)) || load_link_file_icon(handler.fullPath, icon);
+        }
+    };
+
+    // Icons pre-rendered into the compiled catalog, the shell extracts the rest
+    class CompiledIconProvider final : public IconProvider {
+    public:
+        explicit CompiledIconProvider(IconProvider& fallback)
+            : m_fallback(fallback)
+        {}
+
+        virtual bool LoadHandlerIcon(const HandlerFile& handler, icon_decode::Image& icon) override {
+            return CompiledCatalog::Instance().LoadHandlerIcon(handler, icon) || m_fallback.LoadHandlerIcon(handler, icon);
+        }
+
+    private:
+        IconProvider& m_fallback;
+    };
+
+    // Process-wide cache of handler icons, see icon_cache.h; icons are extracted by the provider
+    class IconCache final {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 256;
+
+        static IconCache& Instance() {
+            // cached icons are in the atlas, it has to outlive the cache
+            IconAtlas::Instance();
+            static ShellIconProvider shellIconProvider;
+            static CompiledIconProvider compiledIconProvider(shellIconProvider);
+            static IconCache cache(compiledIconProvider, DEFAULT_CAPACITY);
+            return cache;
+        }
+
+        IconCache(IconProvider& provider, size_t capacity)
+            : m_provider(provider)
+            , m_cache(capacity)
+        {}
+
+        IconCache(const IconCache&) = delete;
+        IconCache& operator=(const IconCache&) = delete;
+
+        std::shared_ptr<const MenuIcon> Get(const HandlerFile& handler) {
+            auto icon = Find(handler);
+            return icon ? icon : Load(handler);
+        }
+
+        // nullptr if there is no icon of this version of the handler in the cache
+        std::shared_ptr<const MenuIcon> Find(const HandlerFile& handler) {
+            return m_cache.Find(handler.fullPath, to_u64(handler.lastWriteTime));
+        }
+
+        // Like Find, but leaves hit counts and the order of entries alone: for looking again at what was missing.
+        std::shared_ptr<const MenuIcon> Peek(const HandlerFile& handler) {
+            return m_cache.Peek(handler.fullPath, to_u64(handler.lastWriteTime));
+        }
+
+        // extracts the icon and caches it, without looking whether it's there already
+        std::shared_ptr<const MenuIcon> Load(const HandlerFile& handler) {
+            return m_cache.Load(handler.fullPath, to_u64(handler.lastWriteTime), [this, &handler]() {
+                icon_decode::Image image;
+                if (!m_provider.LoadHandlerIcon(handler, image)) {
+                    image = icon_decode::Image();
+                }
+                return std::make_shared<const MenuIcon>(image);
+            });
+        }
+
+        unsigned long long GetHits() const {
+            return m_cache.GetHits();
+        }
+
+        unsigned long long GetMisses() const {
+            return m_cache.GetMisses();
+        }
+
+    private:
+        IconProvider& m_provider;
+        icon_cache::IconCache<MenuIcon> m_cache;
+    };
+
+    // what IconLoader extracts with: the shell, into the process-wide IconCache
+    struct ShellIconExtractor {
+        using Handler = HandlerFile;
+        using Icon = MenuIcon;
+
+        // the shell extracts icons of some handlers through COM
+        struct ThreadScope {
+            const bool comInitialized = SUCCEEDED(::CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
+
+            ~ThreadScope() {
+                if (comInitialized) {
+                    ::CoUninitialize();
+                }
+            }
+        };
+
+        const std::wstring& GetKey(const HandlerFile& handler) const {
+            return handler.fullPath;
+        }
+
+        std::shared_ptr<const MenuIcon> Find(const HandlerFile& handler) {
+            return IconCache::Instance().Find(handler);
+        }
+
+        std::shared_ptr<const MenuIcon> Extract(const HandlerFile& handler) {
+            return IconCache::Instance().Load(handler);
+        }
+    };
+
+    // Process-wide icon loader, see icon_loader.h
+    class IconLoader final {
+    public:
+        static constexpr size_t MAX_THREADS = 4;
+        // how long building a menu waits for the icons it doesn't have
+        static constexpr ULONGLONG MAX_MENU_WAIT_MS = 150;
+
+        static IconLoader& Instance() {
+            static IconLoader loader;
+            return loader;
+        }
+
+        IconLoader(const IconLoader&) = delete;
+        IconLoader& operator=(const IconLoader&) = delete;
+
+        // Icons of the handlers, in the same order: cached ones right away, others as they are extracted,
+        // nullptr for those not extracted by the deadline (a GetTickCount64 time).
+        std::vector<std::shared_ptr<const MenuIcon>> Load(const std::vector<HandlerFile>& handlers, ULONGLONG deadline) {
+            const ULONGLONG now = ::GetTickCount64();
+            const auto timeout = std::chrono::milliseconds(deadline > now ? deadline - now : 0);
+            auto icons = m_loader.Load(handlers, icon_loader::Clock::now() + timeout);
+#ifdef _DEBUG
+            const auto nMissed = std::count(icons.begin(), icons.end(), nullptr);
+            if (nMissed > 0) {
+                debug_print((L"My Open With Extension: " + std::to_wstring(nMissed) + L" icon(s) missed the menu").c_str());
+            }
+#endif
+            return icons;
+        }
+
+        // Stops the workers if there is nothing left to load, so the DLL can be unloaded.
+        // Returns false while there is some work left.
+        bool TryShutdown() {
+            return m_loader.TryShutdown();
+        }
+
+    private:
+        IconLoader() = default;
+
+        icon_loader::IconLoader<ShellIconExtractor> m_loader{ MAX_THREADS };
+    };
+
+    /*
+    Handler folders on Windows: a change notification per folder. When Windows refuses to give us one
+    (folder doesn't exist yet, network drive, etc.) we fall back to comparing folder's last write time.
+    */
+    class WindowsFolderBackend final {
+    public:
+        using Path = std::wstring;
+        using Snapshot = FolderSnapshot;
+
+        struct Watch {
+            HANDLE changeNotification = INVALID_HANDLE_VALUE;
+            FILETIME lastWriteTime = { 0 };
+        };
+
+        bool IsStale(const std::wstring& folder, const Watch& watch, const FolderSnapshot& snapshot) const {
+            bool isStale = false;
+            if (watch.changeNotification != INVALID_HANDLE_VALUE) {
+                isStale = WAIT_OBJECT_0 == ::WaitForSingleObject(watch.changeNotification, 0);
+            }
+            else {
+                FILETIME lastWriteTime = { 0 };
+                const bool exists = get_last_write_time(folder, lastWriteTime);
+                isStale = exists != snapshot.exists || !(lastWriteTime == watch.lastWriteTime);
+            }
+            if (isStale) {
+                debug_print(L"My Open With Extension: handlers folder changed, rescanning it");
+            }
+            return isStale;
+        }
+
+        void Rearm(const std::wstring& folder, Watch& watch) {
+            // (re)arm the notification before scanning, so changes made during the scan aren't lost
+            if (watch.changeNotification != INVALID_HANDLE_VALUE) {
+                if (!::FindNextChangeNotification(watch.changeNotification)) {
+                    ::FindCloseChangeNotification(watch.changeNotification);
+                    watch.changeNotification = INVALID_HANDLE_VALUE;
+                }
+            }
+            else {
+                watch.changeNotification = ::FindFirstChangeNotificationW(
+                    folder.c_str(),
+                    FALSE,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_LAST_WRITE);
+            }
+
+            if (watch.changeNotification == INVALID_HANDLE_VALUE) {
+                watch.lastWriteTime = { 0 };
+                get_last_write_time(folder, watch.lastWriteTime);
+            }
+        }
+
+        static std::shared_ptr<const FolderSnapshot> Scan(const std::wstring& folder, bool isFirstLook) {
+            // the first look at a folder may be served by the compiled catalog, rescans are always live
+            if (isFirstLook) {
+                FILETIME lastWriteTime = { 0 };
+                if (get_last_write_time(folder, lastWriteTime)) {
+                    if (auto snapshot = CompiledCatalog::Instance().FindFolder(folder, lastWriteTime)) {
+                        return snapshot;
+                    }
+                }
+            }
+            return scan_handlers_folder(folder);
+        }
+
+        void Close(Watch& watch) {
+            if (watch.changeNotification != INVALID_HANDLE_VALUE) {
+                ::FindCloseChangeNotification(watch.changeNotification);
+                watch.changeNotification = INVALID_HANDLE_VALUE;
+            }
+        }
+    };
+
+    // Process-wide cache of handler folders contents, see handler_catalog.h
+    class HandlerCatalog final {
+    public:
+        static HandlerCatalog& Instance() {
+            static HandlerCatalog catalog;
+            return catalog;
+        }
+
+        HandlerCatalog(const HandlerCatalog&) = delete;
+        HandlerCatalog& operator=(const HandlerCatalog&) = delete;
+
+        std::shared_ptr<const FolderSnapshot> GetFolder(const std::wstring& folder) {
+            return m_cache.GetFolder(folder);
+        }
+
+        // whether the folder was listed already, i.e. getting it is unlikely to touch the disk
+        bool IsListed(const std::wstring& folder) {
+            return m_cache.IsListed(folder);
+        }
+
+    private:
+        HandlerCatalog() = default;
+
+        handler_catalog::FolderCache<WindowsFolderBackend> m_cache;
+    };
+
+    /*
+    Which "(.extension)" folders exist in "Files by Extension", so extensions without handlers
+    (the vast majority of them) cost a hash lookup instead of trying to list a folder that isn't there.
+    Built from the catalog's listing of "Files by Extension" and rebuilt only when that listing changes,
+    i.e. when extension folders are added, removed or renamed.
+    */
+    class ExtensionIndex final {
+    public:
+        static ExtensionIndex& Instance() {
+            static ExtensionIndex index;
+            return index;
+        }
+
+        ExtensionIndex(const ExtensionIndex&) = delete;
+        ExtensionIndex& operator=(const ExtensionIndex&) = delete;
+
+        bool FindFolder(const std::wstring& filesByExtensionFolder, ExtensionAtom extension, std::wstring& extensionFolder) {
+            const auto lock = LockUpToDate(filesByExtensionFolder);
+
+            const std::wstring* folderName = m_extensionFolders.Find(extension);
+            if (!folderName) {
+                return false;
+            }
+            extensionFolder = m_folder + L"\\" + *folderName;
+            return true;
+        }
+
+        // extensions that have folders, for longest match of compound extensions
+        std::shared_ptr<const SuffixTrie> GetKnownExtensions(const std::wstring& filesByExtensionFolder) {
+            const auto lock = LockUpToDate(filesByExtensionFolder);
+            return m_knownExtensions;
+        }
+
+        /*
+        Handlers (by file name, case insensitive) that every one of the extensions has,
+        in the order of the first extension's folder. Every handler name gets a bit, every extension folder
+        a bitset of its handlers, so the intersection is a few ANDs per extension.
+        Extension folders are listed with the index unlocked: a folder that has to be listed anew (a change,
+        a network drive) mustn't hold up other threads classifying their selections.
+        */
+        FolderSnapshot GetCommonHandlers(const std::wstring& filesByExtensionFolder, const std::vector<ExtensionAtom>& extensions) {
+            FolderSnapshot common;
+            std::vector<std::wstring> folders;
+            {
+                const auto lock = LockUpToDate(filesByExtensionFolder);
+                for (const ExtensionAtom extension : extensions) {
+                    const std::wstring* folderName = m_extensionFolders.Find(extension);
+                    if (!folderName) {
+                        // this one has no handlers, so nothing is common
+                        return common;
+                    }
+                    folders.push_back(m_folder + L"\\" + *folderName);
+                }
+            }
+            if (folders.empty()) {
+                return common;
+            }
+
+            std::vector<std::shared_ptr<const FolderSnapshot>> snapshots;
+            for (const auto& folder : folders) {
+                snapshots.push_back(HandlerCatalog::Instance().GetFolder(folder));
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::vector<const extension_index::Bitset*> bitsets;
+            const ExtensionHandlers* first = nullptr;
+            for (size_t i = 0; i < folders.size(); i += 1) {
+                const ExtensionHandlers& handlers = GetExtensionHandlers(folders[i], snapshots[i]);
+                bitsets.push_back(&handlers.bits);
+                if (!first) {
+                    first = &handlers;
+                }
+            }
+
+            common.exists = true;
+            for (const size_t position : extension_index::find_common(first->ids, bitsets)) {
+                common.files.push_back(first->folder->files[position]);
+            }
+            return common;
+        }
+
+    private:
+        struct ExtensionHandlers {
+            std::shared_ptr<const FolderSnapshot> folder;
+            // handler id of every file of the folder
+            std::vector<size_t> ids;
+            extension_index::Bitset bits;
+        };
+
+        ExtensionIndex() = default;
+
+        // locks the index, rebuilding it first if "Files by Extension" has changed since
+        std::unique_lock<std::mutex> LockUpToDate(const std::wstring& filesByExtensionFolder) {
+            auto listing = HandlerCatalog::Instance().GetFolder(filesByExtensionFolder);
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            if (listing != m_listing || filesByExtensionFolder != m_folder) {
+                Rebuild(filesByExtensionFolder, std::move(listing));
+            }
+            return lock;
+        }
+
+        // the folder's handlers and their bits, worked out again if the folder was listed anew; called locked
+        const ExtensionHandlers& GetExtensionHandlers(const std::wstring& folder, const std::shared_ptr<const FolderSnapshot>& snapshot) {
+            ExtensionHandlers& handlers = m_extensionHandlers[folder];
+            if (handlers.folder != snapshot) {
+                handlers.folder = snapshot;
+                handlers.bits.clear();
+                std::vector<std::wstring> names;
+                names.reserve(snapshot->files.size());
+                for (const auto& file : snapshot->files) {
+                    names.push_back(fold_case(std::wstring_view(file.fullPath).substr(find_filename_start(file.fullPath))));
+                }
+                handlers.ids = m_handlerIds.Intern(names, handlers.bits);
+            }
+            return handlers;
+        }
+
+        void Rebuild(const std::wstring& filesByExtensionFolder, std::shared_ptr<const FolderSnapshot> listing) {
+            m_folder = filesByExtensionFolder;
+            m_listing = std::move(listing);
+            m_extensionHandlers.clear();
+            m_handlerIds.Clear();
+
+            auto knownExtensions = std::make_shared<SuffixTrie>(fold_char);
+            m_extensionFolders.Build(
+                m_listing->subfolders,
+                [](std::wstring_view extension, ExtensionAtom& atom) {
+                    return get_extension_atoms().Intern(extension, atom);
+                },
+                [&knownExtensions](std::wstring_view extension) {
+                    knownExtensions->Insert(extension);
+                });
+            m_knownExtensions = std::move(knownExtensions);
+        }
+
+    private:
+        std::mutex m_lock;
+        std::wstring m_folder;
+        std::shared_ptr<const FolderSnapshot> m_listing;
+        extension_index::ExtensionFolders m_extensionFolders;
+        std::shared_ptr<const SuffixTrie> m_knownExtensions = std::make_shared<SuffixTrie>(fold_char);
+        // extension folder -> its handlers
+        std::unordered_map<std::wstring, ExtensionHandlers> m_extensionHandlers;
+        extension_index::HandlerIds m_handlerIds;
+    };
+
+    using pattern_matcher::PatternMatcher;
+
+    /*
+    "[pattern]" folders of "Files by Pattern" and their compiled matcher,
+    rebuilt only when the catalog's listing of "Files by Pattern" changes.
+    */
+    class PatternIndex final {
+    public:
+        static PatternIndex& Instance() {
+            static PatternIndex index;
+            return index;
+        }
+
+        PatternIndex(const PatternIndex&) = delete;
+        PatternIndex& operator=(const PatternIndex&) = delete;
+
+        // Full paths of pattern folders, patterns of which every one of the paths matches
+        std::vector<std::wstring> FindCommonPatternFolders(const std::wstring& filesByPatternFolder, const PathArena& paths) {
+            auto listing = HandlerCatalog::Instance().GetFolder(filesByPatternFolder);
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (listing != m_listing || filesByPatternFolder != m_folder) {
+                Rebuild(filesByPatternFolder, std::move(listing));
+            }
+
+            std::vector<std::wstring> folders;
+            if (m_folderNames.empty()) {
+                return folders;
+            }
+
+            for (const size_t pattern : m_matcher->FindCommonMatches(paths)) {
+                folders.push_back(m_folder + L"\\" + m_folderNames[pattern]);
+            }
+            return folders;
+        }
+
+    private:
+        PatternIndex() = default;
+
+        void Rebuild(const std::wstring& filesByPatternFolder, std::shared_ptr<const FolderSnapshot> listing) {
+            m_folder = filesByPatternFolder;
+            m_listing = std::move(listing);
+            m_folderNames.clear();
+
+            std::vector<std::wstring> patterns;
+            for (const auto& name : m_listing->subfolders) {
+                if (name.size() > 2 && name.front() == L'[' && name.back() == L']') {
+                    m_folderNames.push_back(name);
+                    patterns.push_back(name.substr(1, name.size() - 2));
+                }
+            }
+            // folded as file names compare, beyond ASCII too
+            m_matcher = std::make_unique<PatternMatcher>(patterns, fold_char);
+        }
+
+    private:
+        std::mutex m_lock;
+        std::wstring m_folder;
+        std::shared_ptr<const FolderSnapshot> m_listing;
+        // "[pattern]" folder names, in the order of patterns in the matcher
+        std::vector<std::wstring> m_folderNames;
+        std::unique_ptr<PatternMatcher> m_matcher;
+    };
+
+    // the key handler's uses are recorded under: FNV-1a of its case folded path
+    uint64_t get_usage_key(const std::wstring& fullPathToHandler) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (const wchar_t c : fold_case(fullPathToHandler)) {
+            hash = (hash ^ static_cast<uint16_t>(c)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /*
+    How often and how recently handlers were launched, for ordering them within sections. Every launch is appended
+    to "%LOCALAPPDATA%\My Open With\usage.log" as a checksummed record of fixed size (see usage_log.h); every process
+    that loads us reads what others appended since it last looked. A torn record (a crash in the middle of a write)
+    fails its checksum and is skipped, and reading resumes at the next position a record checks out.
+    Uses decay with a half-life of HALF_LIFE_DAYS, and once the log grows past MAX_RECORDS it's compacted
+    to one record per handler: written aside, then moved in place of the log. Another process's compaction
+    is told by the file being another one, whatever its size.
+    */
+    class UsageLog final {
+    public:
+        // usage key -> score, relative to when the log was first read; only ordering of scores means anything
+        using Scores = usage_log::Scores;
+
+        static UsageLog& Instance() {
+            static UsageLog log;
+            return log;
+        }
+
+        UsageLog(const UsageLog&) = delete;
+        UsageLog& operator=(const UsageLog&) = delete;
+
+        std::shared_ptr<const Scores> GetScores() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            Refresh();
+            return m_scores;
+        }
+
+        void Record(const std::wstring& fullPathToHandler) {
+            usage_log::UsageRecord record;
+            record.key = get_usage_key(fullPathToHandler);
+            record.time = GetNow();
+            record.weight = usage_log::WEIGHT_ONE;
+            std::vector<uint8_t> bytes;
+            usage_log::encode_record(record, bytes);
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!Append(bytes)) {
+                ::OutputDebugStringA("My Open With Extension: failed to record handler use");
+                return;
+            }
+            // our record is read back with whatever others appended meanwhile
+            Refresh();
+            if (m_nRecords > MAX_RECORDS) {
+                Compact();
+            }
+        }
+
+    private:
+        static constexpr double HALF_LIFE_DAYS = 14;
+        static constexpr size_t MAX_RECORDS = 4096;
+        static constexpr uint64_t MAX_READ_SIZE = MAX_RECORDS * 4 * usage_log::RECORD_SIZE;
+        // compacted handlers used less than that are forgotten
+        static constexpr double MIN_SCORE = 1.0 / 64;
+
+        UsageLog()
+            : m_referenceTime(GetNow())
+            , m_scores(std::make_shared<Scores>())
+        {
+            auto localAppData = GetUserLocalAppDataFolderPath();
+            if (localAppData) {
+                m_folder = localAppData.get();
+                m_folder.append(catalog_format::CATALOG_FOLDER_NAME);
+                m_path = m_folder + L"\\usage.log";
+            }
+        }
+
+        static uint64_t GetNow() {
+            FILETIME now;
+            ::GetSystemTimeAsFileTime(&now);
+            return to_u64(now);
+        }
+
+        // reads what was appended since last time, or everything if the log was compacted meanwhile
+        void Refresh() {
+            HANDLE file = m_path.empty()
+                ? INVALID_HANDLE_VALUE
+                : ::CreateFileW(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            usage_log::FileIdentity identity;
+            uint64_t size = 0;
+            BY_HANDLE_FILE_INFORMATION information;
+            if (file != INVALID_HANDLE_VALUE && ::GetFileInformationByHandle(file, &information)) {
+                identity.volume = information.dwVolumeSerialNumber;
+                identity.index = (uint64_t(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+                size = (uint64_t(information.nFileSizeHigh) << 32) | information.nFileSizeLow;
+            }
+
+            const usage_log::ReadPlan plan = usage_log::plan_read(m_readFile, m_readSize, identity, size, MAX_READ_SIZE);
+            std::vector<uint8_t> bytes;
+            const bool haveRead = !usage_log::is_nothing_to_read(plan) && (plan.length == 0 || Read(file, plan.from, plan.length, bytes));
+            if (file != INVALID_HANDLE_VALUE) {
+                ::CloseHandle(file);
+            }
+            if (!haveRead) {
+                return;
+            }
+
+            // scores are shared with menus being built, so they are replaced, not changed
+            auto scores = plan.isWhole ? std::make_shared<Scores>() : std::make_shared<Scores>(*m_scores);
+            size_t nRecords = plan.isWhole ? 0 : m_nRecords;
+            const size_t nScanned = usage_log::scan_records(bytes.data(), bytes.size(), [this, &scores, &nRecords](const usage_log::UsageRecord& record) {
+                (*scores)[record.key] += usage_log::get_score(record, m_referenceTime, HALF_LIFE_DAYS);
+                nRecords += 1;
+            });
+
+            m_readFile = identity;
+            m_readSize = plan.from + nScanned;
+            m_nRecords = nRecords;
+            m_scores = std::move(scores);
+        }
+
+        static bool Read(HANDLE file, uint64_t from, uint64_t length, std::vector<uint8_t>& bytes) {
+            LARGE_INTEGER position;
+            position.QuadPart = static_cast<LONGLONG>(from);
+            bytes.resize(static_cast<size_t>(length));
+            DWORD nRead = 0;
+            const bool haveRead = ::SetFilePointerEx(file, position, NULL, FILE_BEGIN)
+                && ::ReadFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &nRead, NULL);
+            bytes.resize(nRead);
+            return haveRead;
+        }
+
+        bool Append(const std::vector<uint8_t>& bytes) const {
+            if (m_path.empty()) {
+                return false;
+            }
+            ::CreateDirectoryW(m_folder.c_str(), NULL);
+
+            // appends of other processes don't interleave with ours: every write goes to the end as a whole
+            HANDLE file = ::CreateFileW(m_path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            DWORD nWritten = 0;
+            const bool haveWritten = ::WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &nWritten, NULL) && nWritten == bytes.size();
+            ::CloseHandle(file);
+            return haveWritten;
+        }
+
+        // A use appended by another process between our last read and the move is lost, it's only a statistic.
+        void Compact() {
+            std::vector<uint8_t> bytes;
+            for (const auto& record : usage_log::compact_records(*m_scores, m_referenceTime, MAX_RECORDS / 2, MIN_SCORE)) {
+                usage_log::encode_record(record, bytes);
+            }
+
+            const std::wstring temporaryPath = m_path + L".new";
+            HANDLE file = ::CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                return;
+            }
+            DWORD nWritten = 0;
+            const bool haveWritten = ::WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &nWritten, NULL) && nWritten == bytes.size()
+                && ::FlushFileBuffers(file);
+            ::CloseHandle(file);
+
+            if (!haveWritten || !::MoveFileExW(temporaryPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+                ::DeleteFileW(temporaryPath.c_str());
+                return;
+            }
+            // the log is another file now, read as a whole
+            Refresh();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::wstring m_folder;
+        std::wstring m_path;
+        const uint64_t m_referenceTime;
+        usage_log::FileIdentity m_readFile;
+        uint64_t m_readSize = 0;
+        size_t m_nRecords = 0;
+        std::shared_ptr<const Scores> m_scores;
     };
 
-    Handlers operator | (Handlers a, Handlers b) {
-        return static_cast<Handlers>(static_cast<unsigned>(a) | static_cast<unsigned>(b));
-    }
+    using HandlerGroup = handler_groups::HandlerGroup<FolderSnapshot>;
 
-    Handlers operator & (Handlers a, Handlers b) {
-        return static_cast<Handlers>(static_cast<unsigned>(a) & static_cast<unsigned>(b));
+    // Subfolders of a handlers folder as nested groups, see handler_groups.h
+    std::vector<HandlerGroup> load_handler_groups(const std::wstring& folder, const FolderSnapshot& snapshot) {
+        return handler_groups::load_handler_groups(folder, snapshot, HandlerCatalog::Instance(), get_worker_pool());
     }
 
-    std::wstring get_filename_without_extension(const std::wstring& fullPath) {
-        for (auto current = fullPath.rbegin(), end = fullPath.rend(); current != end; ++current) {
-            if (*current == L'\\' || *current == L'/') {
-                // we reached path separator - there is no extension
-                return fullPath.substr(end - current);
-            }
-            else if (*current == L'.') {
-                auto endPos = end - current - 1; //no dots please
-                auto startPos = fullPath.rfind(L'\\');
-                if (startPos == std::wstring::npos) {
-                    startPos = 0;
+    // what Prewarmer warms up: the sections most menus show, on a low priority thread
+    struct CacheWarmUp {
+        struct ThreadScope {
+            // low CPU and I/O priority: Explorer is starting too, and it matters more
+            const BOOL isBackground = ::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+            const bool comInitialized = SUCCEEDED(::CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
+
+            ~ThreadScope() {
+                if (comInitialized) {
+                    ::CoUninitialize();
                 }
-                else {
-                    startPos += 1; // no \\ please
+            }
+        };
+
+        void WarmUp() {
+#ifdef _DEBUG
+            const ULONGLONG startTime = ::GetTickCount64();
+#endif
+            const std::wstring handlersRoot = get_handlers_root();
+            HandlerCatalog& catalog = HandlerCatalog::Instance();
+            IconCache& iconCache = IconCache::Instance();
+
+            // sections most of the menus show, icons and links included, leaving half of the icon cache to everything else
+            size_t nIcons = 0;
+            for (const Handlers section : { Handlers::Everything, Handlers::AllFiles, Handlers::Folders, Handlers::ExtensionlessFiles }) {
+                for (const auto& file : catalog.GetFolder(get_section_folder(handlersRoot, section))->files) {
+                    LinkCache::Instance().Get(file);
+                    if (nIcons < IconCache::DEFAULT_CAPACITY / 2) {
+                        iconCache.Get(file);
+                        nIcons += 1;
+                    }
                 }
-                return fullPath.substr(startPos, endPos - startPos);
             }
-        }
-        return fullPath;
-    }
 
-    HBITMAP load_link_file_icon(const std::wstring& path) {
-        HBITMAP menuImage = NULL;
+            // only listings of the specific ones: there are too many of their folders to watch them all
+            ExtensionIndex::Instance().GetKnownExtensions(get_section_folder(handlersRoot, Handlers::SpecificExtension));
+            catalog.GetFolder(get_section_folder(handlersRoot, Handlers::Patterns));
+            catalog.GetFolder(get_section_folder(handlersRoot, Handlers::SpecificType));
+#ifdef _DEBUG
+            debug_print((L"My Open With Extension: prewarm took " + std::to_wstring(::GetTickCount64() - startTime) + L"ms").c_str());
+#endif
+        }
+    };
 
-        SHFILEINFOW fileInfo = { 0 };
-        if (::SHGetFileInfoW(
-            path.c_str(),
-            0,
-            &fileInfo, sizeof(fileInfo),
-            SHGFI_ICON | SHGFI_SMALLICON /* | SHGFI_DISPLAYNAME | SHGFI_ADDOVERLAYS */))
-        {
-            ICONINFO iconInfo = { 0 };
-            if (::GetIconInfo(fileInfo.hIcon, &iconInfo)) {
-                ::DeleteObject(iconInfo.hbmMask);
-                menuImage = (HBITMAP)::CopyImage(iconInfo.hbmColor, IMAGE_BITMAP, 0, 0, LR_COPYDELETEORG | LR_CREATEDIBSECTION);
-            }
-            ::DestroyIcon(fileInfo.hIcon);
+    /*
+    Warms handler folders and icons up on a low priority thread as soon as Explorer asks for our class factory,
+    so the first right-click after Explorer starts finds them in memory instead of on disk. A menu waits for it
+    only a little: whatever isn't warm by then the menu loads itself, the caches don't mind both doing it at once.
+    */
+    class Prewarmer final {
+    public:
+        static constexpr DWORD MAX_MENU_WAIT_MS = 100;
+
+        static Prewarmer& Instance() {
+            static Prewarmer prewarmer;
+            return prewarmer;
         }
 
-        return menuImage;
-    }
+        Prewarmer(const Prewarmer&) = delete;
+        Prewarmer& operator=(const Prewarmer&) = delete;
 
-    void debug_print(const char* what) {
-#ifdef _DEBUG
-        ::OutputDebugStringA(what);
-#endif
-    }
+        // only the first call does anything
+        void Start() {
+            m_prewarmer.Start();
+        }
 
-    void debug_print(const wchar_t* what) {
+        // Waits at most timeoutMs for the warm-up to finish. Returns (and counts) whether the menu is built warm.
+        bool WaitUntilWarm(DWORD timeoutMs) {
+            const bool isWarm = m_prewarmer.WaitUntilWarm(std::chrono::milliseconds(timeoutMs));
 #ifdef _DEBUG
-        ::OutputDebugStringW(what);
+            debug_print((L"My Open With Extension: menu is built " + std::wstring(isWarm ? L"warm" : L"cold")
+                + L", warm menus: " + std::to_wstring(m_prewarmer.GetWarmMenus()) + L", cold menus: " + std::to_wstring(m_prewarmer.GetColdMenus())).c_str());
 #endif
-    }
+            return isWarm;
+        }
+
+        // Joins the finished warm-up thread, so the DLL can be unloaded. Returns false while it's still running.
+        bool TryShutdown() {
+            return m_prewarmer.TryShutdown();
+        }
+
+    private:
+        Prewarmer() = default;
+
+        prewarmer::Prewarmer<CacheWarmUp> m_prewarmer;
+    };
 }
 
 class HandlerMenuItem final {
 public:
-    explicit HandlerMenuItem(const std::wstring& fullPathToHandler)
-        : m_fullPathToHandler(fullPathToHandler)
-        , m_displayName(get_filename_without_extension(fullPathToHandler))
-        , m_hBitmap(load_link_file_icon(fullPathToHandler))
+    explicit HandlerMenuItem(const HandlerFile& handler)
+        : m_fullPathToHandler(handler.fullPath)
+        , m_lastWriteTime(handler.lastWriteTime)
+        , m_displayName(parse_handler_options(get_filename_without_extension(handler.fullPath), m_options))
     {}
 
-    ~HandlerMenuItem() {
-        ::DeleteObject(m_hBitmap);
-    }
-
     HandlerMenuItem(const HandlerMenuItem& src) = delete;
 
-    HandlerMenuItem(HandlerMenuItem&& src) noexcept
-        : m_fullPathToHandler(std::move(src.m_fullPathToHandler))
-        , m_displayName(std::move(src.m_displayName))
-        , m_hBitmap(src.m_hBitmap)
-    {
-        src.m_hBitmap = NULL;
-    }
+    HandlerMenuItem(HandlerMenuItem&& src) noexcept = default;
 
     HandlerMenuItem& operator=(const HandlerMenuItem& rhv) = delete;
 
@@ -127,25 +2416,234 @@ public:
         return m_fullPathToHandler.c_str();
     }
 
+    HandlerFile GetHandlerFile() const {
+        return { m_fullPathToHandler, m_lastWriteTime };
+    }
+
+    // nullptr unless the handler is a shell link
+    std::shared_ptr<const shell_link::ShellLink> GetLink() const {
+        return LinkCache::Instance().Get(GetHandlerFile());
+    }
+
+    // NULL until the icon is loaded, and for handlers without one
     const HBITMAP GetBitmap() const {
-        return m_hBitmap;
+        return m_icon ? m_icon->GetBitmap() : NULL;
+    }
+
+    // NO_SLOT until the icon is loaded, for handlers without one, and for icons that didn't fit into the atlas
+    icon_atlas::SlotId GetIconSlot() const {
+        return m_icon ? m_icon->GetSlot() : icon_atlas::NO_SLOT;
+    }
+
+    bool IsIconLoaded() const {
+        return m_icon != nullptr;
+    }
+
+    void SetIcon(std::shared_ptr<const MenuIcon> icon) {
+        m_icon = std::move(icon);
+    }
+
+    const HandlerOptions& GetOptions() const {
+        return m_options;
     }
 
 private:
+    HandlerOptions m_options;
     std::wstring m_displayName;
     std::wstring m_fullPathToHandler;
-    HBITMAP m_hBitmap;
+    FILETIME m_lastWriteTime;
+    std::shared_ptr<const MenuIcon> m_icon;
 
 };
 
-class MyExtension final : public IUnknown, IContextMenu, IShellExtInit {
+/*
+Contents of the "My Open with" popup: handler items laid out by menu_layout::MenuLayout, which decides
+the sections, groups, separators and command offsets; a command offset is an index of a handler here.
+*/
+class MenuModel final {
 public:
-    MyExtension() {
-        auto myDocuments = GetUserDocumentsFolderPath();
-        m_handlersRoot = myDocuments.get();
+    // scores, if any, order handlers of every folder, most used first
+    void Reset(UINT maxCommands, std::shared_ptr<const UsageLog::Scores> scores = nullptr) {
+        m_scores = std::move(scores);
+        m_handlers.clear();
+        m_layout.Reset(maxCommands);
+        m_drawIcons = false;
+    }
+
+    void AddSection(const FolderSnapshot& folder, const std::wstring& submenuTitle = std::wstring(), const std::vector<HandlerGroup>& groups = std::vector<HandlerGroup>()) {
+        Source source = { *this };
+        m_layout.AddSection(source, Folder{ &folder, &groups }, submenuTitle);
+        if (m_layout.IsTruncated()) {
+            debug_print(L"My Open With Extension: ran out of command ids, some handlers are not shown");
+        }
+    }
+
+    // command offsets the menu takes, "Open handlers folder" included
+    UINT GetUsedCommandsCount() const {
+        return static_cast<UINT>(m_layout.GetUsedCommandsCount());
+    }
+
+    // Icons of all the handlers at once, menus are materialized with whichever of them made it by the deadline.
+    void LoadIcons(ULONGLONG deadline) {
+        std::vector<HandlerFile> files;
+        files.reserve(m_handlers.size());
+        for (const auto& handler : m_handlers) {
+            files.push_back(handler.GetHandlerFile());
+        }
+
+        auto icons = IconLoader::Instance().Load(files, deadline);
+        for (size_t i = 0; i < m_handlers.size(); i += 1) {
+            m_handlers[i].SetIcon(std::move(icons[i]));
+        }
+    }
+
+    // Puts icons that were loaded since into items materialized without them.
+    void PatchIcons(HMENU menu, UINT idCmdFirst) {
+        for (size_t i = 0; i < m_handlers.size(); i += 1) {
+            HandlerMenuItem& handler = m_handlers[i];
+            if (handler.IsIconLoaded()) {
+                continue;
+            }
+            auto icon = IconCache::Instance().Peek(handler.GetHandlerFile());
+            if (!icon) {
+                continue;
+            }
+            handler.SetIcon(std::move(icon));
+
+            MENUITEMINFOW menuItemInfo = { 0 };
+            menuItemInfo.cbSize = sizeof(menuItemInfo);
+            menuItemInfo.fMask = MIIM_BITMAP;
+            menuItemInfo.hbmpItem = GetItemBitmap(handler);
+            // by command, so items of nested submenus are found too
+            SetMenuItemInfoW(menu, idCmdFirst + static_cast<UINT>(i), FALSE, &menuItemInfo);
+        }
+    }
+
+    const HandlerMenuItem* FindHandler(UINT commandOffset) const {
+        return commandOffset < m_handlers.size() ? &m_handlers[commandOffset] : nullptr;
+    }
+
+    // Icon size of the item with this command offset, false if it isn't an item we draw.
+    bool MeasureIcon(UINT commandOffset, SIZE& size) const {
+        const HandlerMenuItem* handler = FindHandler(commandOffset);
+        return m_drawIcons && handler && IconAtlas::Instance().GetSize(handler->GetIconSlot(), size);
+    }
+
+    bool DrawIcon(UINT commandOffset, HDC dc, const RECT& into) const {
+        const HandlerMenuItem* handler = FindHandler(commandOffset);
+        return m_drawIcons && handler && IconAtlas::Instance().Draw(handler->GetIconSlot(), dc, into);
+    }
+
+    // drawIcons is for hosts that forward WM_MEASUREITEM and WM_DRAWITEM, we draw icons from the atlas then
+    void Materialize(HMENU menu, UINT idCmdFirst, bool drawIcons) {
+        m_drawIcons = drawIcons;
+        Builder builder = { *this, idCmdFirst, { menu }, {} };
+        m_layout.Materialize(builder);
+    }
+
+private:
+    // a folder as the layout walks it: its handlers, and the groups of its subfolders
+    struct Folder {
+        const FolderSnapshot* snapshot;
+        const std::vector<HandlerGroup>* groups;
+    };
+
+    struct Source {
+        MenuModel& model;
+
+        std::vector<const HandlerFile*> Rank(const Folder& folder) const {
+            return model.RankHandlers(*folder.snapshot);
+        }
+
+        uint64_t GetFingerprint(const HandlerFile* file) const {
+            return get_handler_fingerprint(*file);
+        }
+
+        void Add(const HandlerFile* file) {
+            model.m_handlers.emplace_back(*file);
+        }
+
+        template <typename OnGroup>
+        void ForEachGroup(const Folder& folder, OnGroup onGroup) const {
+            for (const auto& group : *folder.groups) {
+                onGroup(group.title, Folder{ group.folder.get(), &group.groups });
+            }
+        }
+    };
+
+    // puts the layout into popups, a submenu is inserted into its parent once it's filled
+    struct Builder {
+        const MenuModel& model;
+        UINT idCmdFirst;
+        std::vector<HMENU> menus;
+        std::vector<std::wstring> titles;
+
+        void BeginSubmenu(const std::wstring& title) {
+            menus.push_back(CreatePopupMenu());
+            titles.push_back(title);
+        }
+
+        void EndSubmenu() {
+            HMENU submenu = menus.back();
+            menus.pop_back();
+            InsertMenuW(menus.back(), -1, MF_BYPOSITION | MF_STRING | MF_POPUP, (UINT_PTR)submenu, titles.back().c_str());
+            titles.pop_back();
+        }
+
+        void AddHandler(size_t offset) {
+            const HandlerMenuItem& handler = model.m_handlers[offset];
+
+            MENUITEMINFOW menuItemInfo = { 0 };
+            menuItemInfo.cbSize = sizeof(menuItemInfo);
+            menuItemInfo.fMask = MIIM_BITMAP | MIIM_STRING | MIIM_ID;
+            menuItemInfo.wID = idCmdFirst + static_cast<UINT>(offset);
+            menuItemInfo.hbmpItem = model.GetItemBitmap(handler);
+            menuItemInfo.dwTypeData = const_cast<wchar_t*>(handler.GetDisplayName());
+
+            InsertMenuItemW(menus.back(), -1, true, &menuItemInfo);
+        }
 
-        m_handlersRoot.append(L"\\Open With Handlers for");
+        void AddSeparator() {
+            InsertMenuW(menus.back(), -1, MF_BYPOSITION | MF_SEPARATOR, 0, NULL);
+        }
+
+        void AddOpenFolder(size_t offset) {
+            InsertMenuW(menus.back(), -1, MF_BYPOSITION | MF_STRING, idCmdFirst + static_cast<UINT>(offset), L"Open handlers folder");
+        }
+    };
+
+    // folder's handlers in the order they are shown: by score if there are scores, as listed otherwise
+    std::vector<const HandlerFile*> RankHandlers(const FolderSnapshot& folder) const {
+        std::vector<const HandlerFile*> files;
+        files.reserve(folder.files.size());
+        for (const auto& file : folder.files) {
+            files.push_back(&file);
+        }
+        if (!m_scores || m_scores->empty()) {
+            return files;
+        }
+        return menu_layout::rank_by_score(files, [this](const HandlerFile* file) {
+            const auto found = m_scores->find(get_usage_key(file->fullPath));
+            return found == m_scores->end() ? 0.0 : found->second;
+        });
+    }
 
+    // what an item shows for the icon: drawn by us from the atlas if we can, the icon's own bitmap otherwise
+    HBITMAP GetItemBitmap(const HandlerMenuItem& handler) const {
+        return m_drawIcons && handler.GetIconSlot() != icon_atlas::NO_SLOT ? HBMMENU_CALLBACK : handler.GetBitmap();
+    }
+
+    std::shared_ptr<const UsageLog::Scores> m_scores;
+    std::vector<HandlerMenuItem> m_handlers;
+    menu_layout::MenuLayout m_layout;
+    bool m_drawIcons = false;
+};
+
+class MyExtension final : public IUnknown, IContextMenu3, IShellExtInit {
+public:
+    MyExtension()
+        : m_handlersRoot(get_handlers_root())
+    {
         InterlockedIncrement(&m_nInstances);
     }
 
@@ -183,6 +2681,20 @@ public:
             return S_OK;
         }
 
+        if (IsEqualGUID(requestedIID, IID_IContextMenu2)) {
+            *ppv = static_cast<IContextMenu2*>(this);
+            m_hostWantsMenuMessages = true;
+            AddRef();
+            return S_OK;
+        }
+
+        if (IsEqualGUID(requestedIID, IID_IContextMenu3)) {
+            *ppv = static_cast<IContextMenu3*>(this);
+            m_hostWantsMenuMessages = true;
+            AddRef();
+            return S_OK;
+        }
+
         if (IsEqualGUID(requestedIID, IID_IShellExtInit)) {
             *ppv = static_cast<IShellExtInit*>(this);
             AddRef();
@@ -195,8 +2707,8 @@ public:
     virtual HRESULT STDMETHODCALLTYPE Initialize(LPCITEMIDLIST pIDFolder, IDataObject* pDataObj, HKEY hRegKey) override {
         UNREFERENCED_PARAMETER(hRegKey);
 
-        m_itemPaths.clear();
-        m_handlers.clear();
+        m_itemPaths.Reset();
+        m_menu.Reset(0);
 
         std::wstring buffer;
         buffer.resize(MAX_PATH);
@@ -204,30 +2716,42 @@ public:
             // we have context-menu request for a directory
 
             // have to do this way, because I have no idea how long the path is actually is.
-            m_itemPaths.push_back(buffer.c_str());
+            m_itemPaths.Append(buffer.c_str(), wcslen(buffer.c_str()));
         }
         else {
             // we (probably) have a request for an item.
             FORMATETC   fe = { CF_HDROP, NULL, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
             STGMEDIUM   medium;
             if (SUCCEEDED(pDataObj->GetData(&fe, &medium))) {
-                // Get the count of files dropped.
-                auto uCount = ::DragQueryFileW((HDROP)medium.hGlobal, (UINT)-1, NULL, 0);
-
-                for (UINT i = 0; i < uCount; i += 1) {
-                    std::wstring itemPath;
-                    itemPath.resize(MAX_WIDE_PATH_LENGTH);
-                    auto nCharsCopied = ::DragQueryFileW((HDROP)medium.hGlobal, i, &itemPath.front(), itemPath.size());
-                    if (nCharsCopied) {
-                        itemPath.resize(nCharsCopied);
-                        m_itemPaths.push_back(std::move(itemPath));
+                // paths are copied straight from the locked block into the arena, no DragQueryFileW round trips
+                const void* dropFiles = ::GlobalLock(medium.hGlobal);
+                if (dropFiles) {
+                    static_assert(sizeof(wchar_t) == sizeof(char16_t), "wide paths are copied as they are");
+                    const bool isWellFormed = drop_files::parse(dropFiles, ::GlobalSize(medium.hGlobal),
+                        [this](std::u16string_view path) {
+                            m_itemPaths.Append(reinterpret_cast<const wchar_t*>(path.data()), path.size());
+                        },
+                        [this](std::string_view path) {
+                            const int length = ::MultiByteToWideChar(CP_ACP, 0, path.data(), static_cast<int>(path.size()), NULL, 0);
+                            if (length > 0) {
+                                ::MultiByteToWideChar(CP_ACP, 0, path.data(), static_cast<int>(path.size()), m_itemPaths.Allocate(length), length);
+                            }
+                            else {
+                                ::OutputDebugStringA("My Open With Extension: Failed to get name of selected item");
+                            }
+                        });
+                    ::GlobalUnlock(medium.hGlobal);
+
+                    if (!isWellFormed) {
+                        ::OutputDebugStringA("My Open With Extension: malformed list of selected items");
                     }
-                    else {
-                        ::OutputDebugStringA("My Open With Extension: Failed to get name of selected item");
-                    }
-
                 }
 
+#ifdef _DEBUG
+                debug_print((L"My Open With Extension: selected items storage allocations: " + std::to_wstring(m_itemPaths.GetAllocationsCount())
+                    + L", peak bytes: " + std::to_wstring(m_itemPaths.GetPeakBytes())).c_str());
+#endif
+
                 ::ReleaseStgMedium(&medium);
             }
         }
@@ -245,72 +2769,89 @@ public:
 
         m_extendedMode = (CMF_EXTENDEDVERBS & uFlags) == CMF_EXTENDEDVERBS;
 
-        //OK let as see what handlers we are looking for, starting from most specific
-
-        std::wstring commonExtension;
-        Handlers handlers = DecideHandlers(commonExtension);
+        //in highly unlikely case where is no room left in the menu:
+        if (idCmdFirst >= idCmdLast) {
+            //we don't add any menu enries of ours
+            m_itemPaths.Reset();
+            m_menu.Reset(0);
+            return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 0);
+        }
 
-        HMENU handlersMenu = CreateMenu();
+        // Most of right-clicks never open our submenu, so don't look for handlers just yet:
+        // reserve command ids and add an empty popup, that will be filled on WM_INITMENUPOPUP.
+        m_idCmdFirst = idCmdFirst;
+        m_nReservedCommands = min_of(idCmdLast - idCmdFirst, MAX_RESERVED_COMMANDS);
+        m_menu.Reset(m_nReservedCommands);
+
+        m_handlersMenu = CreatePopupMenu();
+        m_handlersMenuFilled = false;
+        // placeholder, so the popup isn't empty until it's filled
+        InsertMenuW(m_handlersMenu, -1, MF_BYPOSITION | MF_STRING | MF_GRAYED, 0, L"...");
+
+        // Asking for IContextMenu3 doesn't make a host forward anything. Only once some host in this process was seen
+        // forwarding menu messages can the filling wait for WM_INITMENUPOPUP; until then the popup is filled right away.
+        if (!m_hostWantsMenuMessages || !m_menuMessagesForwarded) {
+            FillHandlersMenu(false);
+        }
 
-        UINT nextCmdId = idCmdFirst;
+        //insert our menu items: separator and the popup in that order.
+        InsertMenu(hmenu, -1, MF_BYPOSITION | MF_SEPARATOR, 0, NULL);
+        InsertMenu(hmenu, -1, MF_BYPOSITION | MF_STRING | MF_POPUP, (UINT_PTR)m_handlersMenu, L"My Open with");
 
-        // order is from top to bottom: most specialized -> least specialized, so
+        // Filled already, the menu takes only the ids it used and the rest is left to other extensions.
+        // Otherwise all of the reserved ones stay ours, whatever the popup turns out to need.
+        return MAKE_HRESULT(SEVERITY_SUCCESS, 0, m_handlersMenuFilled ? m_menu.GetUsedCommandsCount() : m_nReservedCommands);
+    }
 
-        // SpecializedExtenison
-        // <separator if not empty>
-        if (Handlers::SpecificExtension == (handlers & Handlers::SpecificExtension)) {
-            // You might wonder why enclose extension in parens.
-            // That's because you can't have folder named "." and Explorer forbids creating folders named like ".txt"
-            const std::wstring searchFolder = m_handlersRoot + L"\\Files by Extension\\(" + commonExtension + L")";
-            PopulateHandlers(searchFolder, handlersMenu, nextCmdId);
-        }
+    virtual HRESULT STDMETHODCALLTYPE HandleMenuMsg(UINT uMsg, WPARAM wParam, LPARAM lParam) override {
+        return HandleMenuMsg2(uMsg, wParam, lParam, nullptr);
+    }
 
-        // ExtensionlessFiles
-        // <separator if not empty>
-        if (Handlers::ExtensionlessFiles == (handlers & Handlers::ExtensionlessFiles)) {
-            const std::wstring searchFolder = m_handlersRoot + L"\\Extensionless Files";
-            PopulateHandlers(searchFolder, handlersMenu, nextCmdId);
+    virtual HRESULT STDMETHODCALLTYPE HandleMenuMsg2(UINT uMsg, WPARAM wParam, LPARAM lParam, LRESULT* plResult) override {
+        m_menuMessagesForwarded = true;
+        if (plResult) {
+            *plResult = 0;
         }
 
-
-        // AllFiles
-        // <separator if not empty>
-        if (Handlers::AllFiles == (handlers & Handlers::AllFiles)) {
-            const std::wstring searchFolder = m_handlersRoot + L"\\All files";
-            PopulateHandlers(searchFolder, handlersMenu, nextCmdId);
+        if (uMsg == WM_MEASUREITEM) {
+            auto measureItem = reinterpret_cast<MEASUREITEMSTRUCT*>(lParam);
+            SIZE size = { 0 };
+            if (measureItem && measureItem->CtlType == ODT_MENU && m_menu.MeasureIcon(measureItem->itemID - m_idCmdFirst, size)) {
+                measureItem->itemWidth = static_cast<UINT>(size.cx);
+                measureItem->itemHeight = static_cast<UINT>(size.cy);
+                if (plResult) {
+                    *plResult = TRUE;
+                }
+                return S_OK;
+            }
+            return S_FALSE;
         }
 
-        // Folders
-        // <separator if not empty>
-        if (Handlers::Folders == (handlers & Handlers::Folders)) {
-            const std::wstring searchFolder = m_handlersRoot + L"\\Folders";
-            PopulateHandlers(searchFolder, handlersMenu, nextCmdId);
+        if (uMsg == WM_DRAWITEM) {
+            auto drawItem = reinterpret_cast<DRAWITEMSTRUCT*>(lParam);
+            if (drawItem && drawItem->CtlType == ODT_MENU && m_menu.DrawIcon(drawItem->itemID - m_idCmdFirst, drawItem->hDC, drawItem->rcItem)) {
+                if (plResult) {
+                    *plResult = TRUE;
+                }
+                return S_OK;
+            }
+            return S_FALSE;
         }
 
-        // Everything
-        // <separator if not empty>
-        if (Handlers::Everything == (handlers & Handlers::Everything)) {
-            const std::wstring searchFolder = m_handlersRoot + L"\\Everything";
-            PopulateHandlers(searchFolder, handlersMenu, nextCmdId);
+        if (uMsg == WM_INITMENUPOPUP && m_handlersMenuFilled) {
+            // any of our popups about to be shown is a chance to put in icons that missed the deadline
+            m_menu.PatchIcons(m_handlersMenu, m_idCmdFirst);
         }
 
-        // "Open handlers folder"
-        InsertMenuW(handlersMenu, -1, MF_BYPOSITION | MF_STRING, nextCmdId++, L"Open handlers folder");
-
-        //in highly unlikely case where is no room left in the menu:
-        if (nextCmdId + 1 > idCmdLast) {
-            //we don't add any menu enries of ours
-            m_itemPaths.clear();
-            m_handlers.clear();
-            DestroyMenu(handlersMenu);
-            return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 0);
+        if (uMsg == WM_INITMENUPOPUP && (HMENU)wParam == m_handlersMenu) {
+            if (!m_handlersMenuFilled) {
+                // the host forwards menu messages, so we can draw icons ourselves
+                FillHandlersMenu(true);
+            }
+            return S_OK;
         }
 
-        //insert our menu items: separator, copy and move in that order.
-        InsertMenu(hmenu, -1, MF_BYPOSITION | MF_SEPARATOR, nextCmdId++, NULL);
-        InsertMenu(hmenu, -1, MF_BYPOSITION | MF_STRING | MF_POPUP, (UINT_PTR)handlersMenu, L"My Open with");
-
-        return MAKE_HRESULT(SEVERITY_SUCCESS, 0, nextCmdId - idCmdFirst);
+        return S_FALSE;
     }
 
     virtual HRESULT STDMETHODCALLTYPE GetCommandString(UINT_PTR idCmd, UINT uFlags, UINT* pwReserved, LPSTR pszName, UINT cchMax) override {
@@ -338,21 +2879,55 @@ public:
 
         const UINT itemIndex = (UINT)pVerb;
 
-        std::wstring allArguments;
-        for (const auto& item : m_itemPaths) {
-            allArguments.append(L" \""); //note space prefix
-            allArguments.append(item);
-            allArguments.append(L"\"");
-        }
+        if (const HandlerMenuItem* handler = m_menu.FindHandler(itemIndex)) {
+            std::vector<std::wstring> commandLines;
+            std::wstring listFilePath;
+            if (handler->GetOptions().passListFile) {
+                if (!write_list_file(m_itemPaths, listFilePath)) {
+                    ::OutputDebugStringA("My Open With Extension: failed to write list of selected items");
+                    return E_FAIL;
+                }
+                commandLines.emplace_back();
+                append_quoted_argument(commandLines.back(), listFilePath);
+            }
+            else if (handler->GetOptions().launchPerItem) {
+                // an item alone is always a batch of its own
+                commandLines = build_argument_batches(m_itemPaths, 0);
+            }
+            else {
+                // whole selection might not fit into one command line
+                commandLines = build_argument_batches(m_itemPaths, get_max_arguments_length(handler->GetFullPathToHandler(), handler->GetLink().get()));
+            }
 
-        if (itemIndex < m_handlers.size()) {
             const bool shiftIsDown = (1 << 15) & (::GetAsyncKeyState(VK_SHIFT));
             const wchar_t* verb = shiftIsDown ? L"runAs" : L"open";
-            ::ShellExecuteW(
-                nullptr, verb, m_handlers[itemIndex].GetFullPathToHandler(), allArguments.c_str(), nullptr, SW_SHOW);
+
+#ifdef _DEBUG
+            debug_print((L"My Open With Extension: launching handler " + std::to_wstring(commandLines.size()) + L" time(s)").c_str());
+#endif
+            LaunchRequest request = { verb, handler->GetFullPathToHandler(), std::move(commandLines) };
+            request.maxProcesses = handler->GetOptions().launchPerItem ? handler->GetOptions().maxProcesses : 0;
+            request.listFilePath = std::move(listFilePath);
+            if (m_rankByUsage) {
+                // appending to the log (and now and then compacting it) is left to the launcher's worker
+                request.onStarted = [fullPathToHandler = handler->GetFullPathToHandler()]() {
+                    UsageLog::Instance().Record(fullPathToHandler);
+                };
+            }
+            if (!Launcher::Instance().Enqueue(std::move(request))) {
+                ::OutputDebugStringA("My Open With Extension: too many handlers are being launched already");
+                if (!request.listFilePath.empty()) {
+                    // a refused request is left as it was
+                    ::DeleteFileW(request.listFilePath.c_str());
+                }
+                return E_FAIL;
+            }
         }
         else {
-            ::ShellExecuteW(nullptr, L"explore", m_handlersRoot.c_str(), nullptr, nullptr, SW_SHOW);
+            if (!Launcher::Instance().Enqueue({ L"explore", m_handlersRoot, { std::wstring() } })) {
+                ::OutputDebugStringA("My Open With Extension: too many handlers are being launched already");
+                return E_FAIL;
+            }
         }
 
         return S_OK;
@@ -363,47 +2938,16 @@ public:
 
 private:
 
-    Handlers DecideHandlers(std::wstring& commonExtensionIfAny) const {
-        bool haveExtensionlessFiles = false;
-        bool haveFilesWithExtension = false;
-        bool haveFolders = false;
-        bool haveFiles = false;
-        bool haveDifferentExtensions = false;
-        std::wstring commonExtension;
-        for (const auto& aPathToThing : m_itemPaths) {
-            bool isDirectory = FILE_ATTRIBUTE_DIRECTORY == (FILE_ATTRIBUTE_DIRECTORY & GetFileAttributesW(aPathToThing.c_str()));
-            if (isDirectory) {
-                haveFolders = true;
-            }
-            else {
-                haveFiles = true;
-
-                // ok what kind of file are you? do you have an extension?
-                std::wstring extension;
-                bool haveExtension = GetFileExtension(aPathToThing, extension);
-                if (haveExtension) {
-                    haveFilesWithExtension = true;
-
-                    if (commonExtension.empty()) {
-                        commonExtension = extension;
-                    }
-                    else {
-                        if (haveDifferentExtensions) {
-                            //no need to compare anything
-                            continue;
-                        }
-
-                        if (CSTR_EQUAL != ::CompareStringOrdinal(commonExtension.c_str(), commonExtension.length(), extension.c_str(), extension.length(), true)) {
-                            //so no, new extension is not the same we saw before
-                            haveDifferentExtensions = true;
-                        }
-                    }
-                }
-                else {
-                    haveExtensionlessFiles = true;
-                }
-            }
-        }
+    // extensionsIfAny receives extensions of the selected files, sorted by their case folded text
+    Handlers DecideHandlers(const Settings& settings, std::vector<ExtensionAtom>& extensionsIfAny) const {
+        const auto knownExtensions = ExtensionIndex::Instance().GetKnownExtensions(GetHandlersFolder(Handlers::SpecificExtension));
+        WindowsFileSystem fileSystem;
+        const SelectionKinds kinds = SelectionClassifier::Classify(m_itemPaths, *knownExtensions, get_extension_atoms(), fileSystem, get_worker_pool());
+        const bool haveExtensionlessFiles = kinds.haveExtensionlessFiles;
+        const bool haveFilesWithExtension = !kinds.extensions.empty() || kinds.haveTooManyExtensions || kinds.haveExtensionsWithoutFolder;
+        const bool haveFolders = kinds.haveFolders;
+        const bool haveFiles = kinds.haveFiles;
+        const bool haveDifferentExtensions = kinds.extensions.size() > 1 || kinds.haveTooManyExtensions;
 
         // decision time
 
@@ -418,7 +2962,7 @@ private:
         }
 
         if (haveFiles && (!haveFolders)) {
-            Handlers result = Handlers::Everything | Handlers::AllFiles;
+            Handlers result = Handlers::Everything | Handlers::AllFiles | Handlers::Patterns;
             //only files, eh? what kind?
             if (haveExtensionlessFiles && haveFilesWithExtension) {
                 // we can't specify handlers any further
@@ -426,18 +2970,27 @@ private:
             }
 
             if (haveExtensionlessFiles && (!haveFilesWithExtension)) {
-                return result | Handlers::ExtensionlessFiles;
+                result = result | Handlers::ExtensionlessFiles;
+                return settings.sniffContent ? result | Handlers::SpecificType : result;
             }
 
             if (haveFilesWithExtension && (!haveExtensionlessFiles)) {
                 // maybe they have common extension?
-                if (haveDifferentExtensions) {
+                if (haveDifferentExtensions && (settings.mixedExtensions == MixedExtensionsMode::Off || kinds.haveTooManyExtensions)) {
                     // some extensions are different - no special case for that
                     return result;
                 }
+                else if (kinds.haveExtensionsWithoutFolder) {
+                    // an extension without handlers has none in common with the others either
+                    return result;
+                }
                 else {
-                    // all files has same extension, hurray!
-                    commonExtensionIfAny = commonExtension;
+                    // all files has same extension, hurray! Or we were asked to look for what different extensions have in common.
+                    extensionsIfAny.assign(kinds.extensions.begin(), kinds.extensions.end());
+                    const ExtensionAtoms& atoms = get_extension_atoms();
+                    std::sort(extensionsIfAny.begin(), extensionsIfAny.end(), [&atoms](ExtensionAtom a, ExtensionAtom b) {
+                        return atoms.GetText(a) < atoms.GetText(b);
+                    });
                     return result | Handlers::SpecificExtension;
                 }
             }
@@ -457,116 +3010,135 @@ private:
         return Handlers::None;
     }
 
-    // Populates handlers from content in the folder. BAD NAME!
-    void EnumerateFolderFiles(const std::wstring& folder, std::vector<HandlerMenuItem>& files) const {
+    std::wstring GetHandlersFolder(Handlers section) const {
+        return get_section_folder(m_handlersRoot, section);
+    }
+
+    // a section of the folder's handlers, with its subfolders as nested submenus
+    void AddFolderSection(const std::wstring& folder, const std::wstring& submenuTitle = std::wstring()) {
+        const auto snapshot = HandlerCatalog::Instance().GetFolder(folder);
+        m_menu.AddSection(*snapshot, submenuTitle, load_handler_groups(folder, *snapshot));
+    }
 
-        std::wstring searchFolder = folder;
-        searchFolder.append(L"\\*");
+    void AddExtensionSections(const Settings& settings, const std::vector<ExtensionAtom>& extensions) {
+        ExtensionIndex& index = ExtensionIndex::Instance();
+        const std::wstring filesByExtension = GetHandlersFolder(Handlers::SpecificExtension);
 
-        WIN32_FIND_DATAW findData;
-        HANDLE searchHandle = FindFirstFileExW(searchFolder.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
-        if (INVALID_HANDLE_VALUE == searchHandle) {
-            const DWORD lastError = GetLastError();
-            switch (lastError) {
-            case ERROR_ACCESS_DENIED: {
-                //it's ok
-                return;
-            } break;
-            case ERROR_FILE_NOT_FOUND: {
-                // create it back
-                CreateDirectoryW(searchFolder.c_str(), NULL);
-                return;
-            } break;
-            default: {
-                OutputDebugStringW(L"FindFirstFileW just failed");
-                return;
-            }
+        if (extensions.size() == 1) {
+            std::wstring extensionFolder;
+            if (index.FindFolder(filesByExtension, extensions.front(), extensionFolder)) {
+                AddFolderSection(extensionFolder);
             }
+            return;
         }
 
-        bool keepSearching = true;
-        bool hasError = false;
-        while (keepSearching) {
-            if (FindNextFileW(searchHandle, &findData)) {
-                //ignore directory junctions for now: care required to handle those without "endless" recursion
-                const DWORD attributes = findData.dwFileAttributes;
-                const bool isDirectory = ((attributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY);
-                const bool isHidden = ((attributes & FILE_ATTRIBUTE_HIDDEN) == FILE_ATTRIBUTE_HIDDEN);
-
-                if (isDirectory || isHidden || is_two_dots(findData.cFileName)) {
-                    continue;
-                }
+        m_menu.AddSection(index.GetCommonHandlers(filesByExtension, extensions));
 
-                files.emplace_back(folder + L"\\" + findData.cFileName);
-            }
-            else {
-                //what went wrong?
-                if (ERROR_NO_MORE_FILES == GetLastError()) {
-                    //that's ok
-                    keepSearching = false;
-                }
-                else {
-                    OutputDebugStringW(L"FindNextFileW failed");
-                    hasError = true;
-                    keepSearching = false;
+        if (settings.mixedExtensions == MixedExtensionsMode::CommonAndGroupedHandlers) {
+            for (const ExtensionAtom extension : extensions) {
+                std::wstring extensionFolder;
+                if (index.FindFolder(filesByExtension, extension, extensionFolder)) {
+                    const auto title = extensionFolder.substr(find_filename_start(extensionFolder));
+                    AddFolderSection(extensionFolder, title);
                 }
             }
         }
-
-        FindClose(searchHandle);
     }
 
-    void PopulateHandlers(const std::wstring& handlersFolder, HMENU menu, UINT& nextCmdId) {
-        const auto oldSize = m_handlers.size();
+    void AddTypeSection(ULONGLONG deadline) {
+        // there are only extensionless files selected
+        const std::wstring type = TypeSniffer::Instance().SniffCommonType(m_itemPaths, deadline);
+        if (type.empty()) {
+            return;
+        }
+
+        // the same as for extensions: "(elf)"
+        const std::wstring folderName = L"(" + type + L")";
+        const std::wstring filesByType = GetHandlersFolder(Handlers::SpecificType);
+        for (const auto& name : HandlerCatalog::Instance().GetFolder(filesByType)->subfolders) {
+            if (CSTR_EQUAL == ::CompareStringOrdinal(name.c_str(), static_cast<int>(name.length()), folderName.c_str(), static_cast<int>(folderName.length()), true)) {
+                AddFolderSection(filesByType + L"\\" + name);
+                return;
+            }
+        }
+    }
 
-        EnumerateFolderFiles(handlersFolder, m_handlers);
+    void FillHandlersMenu(bool drawIcons) {
+        m_handlersMenuFilled = true;
+        const ULONGLONG deadline = ::GetTickCount64() + MAX_MENU_FILL_MS;
 
-        const bool insertSeparator = m_handlers.size() - oldSize;
-        if (insertSeparator) {
-            for (auto i = oldSize; i < m_handlers.size(); i += 1) {
-                const HandlerMenuItem& handler = m_handlers[i];
+        // the first menu after Explorer starts may catch the warm-up running
+        Prewarmer::Instance().WaitUntilWarm(Prewarmer::MAX_MENU_WAIT_MS);
 
-                MENUITEMINFOW menuItemInfo = { 0 };
-                menuItemInfo.cbSize = sizeof(menuItemInfo);
-                menuItemInfo.fMask = MIIM_BITMAP | MIIM_STRING | MIIM_ID;
-                menuItemInfo.wID = nextCmdId++;
-                menuItemInfo.hbmpItem = handler.GetBitmap();
-                menuItemInfo.dwTypeData = const_cast<wchar_t*>(handler.GetDisplayName());
+        const Settings settings = Settings::Load();
 
-                InsertMenuItemW(menu, -1, true, &menuItemInfo);
+        //OK let as see what handlers we are looking for, starting from most specific
+        std::vector<ExtensionAtom> extensions;
+        const Handlers handlers = DecideHandlers(settings, extensions);
+
+        // order is from top to bottom: most specialized -> least specialized
+        m_rankByUsage = settings.rankByUsage;
+        m_menu.Reset(m_nReservedCommands, m_rankByUsage ? UsageLog::Instance().GetScores() : nullptr);
+        for (const Handlers section : SECTIONS_ORDER) {
+            if (section != (handlers & section)) {
+                continue;
             }
-            InsertMenuW(menu, -1, MF_BYPOSITION | MF_SEPARATOR, 0, NULL);
-        }
-    }
 
-    bool GetFileExtension(const std::wstring& path, std::wstring& extension) const {
-        for (auto current = path.rbegin(), end = path.rend(); current != end; ++current) {
-            if (*current == L'\\' || *current == L'/') {
-                // we reached path separator - there is no extension
-                return false;
+            if (section == Handlers::SpecificExtension) {
+                AddExtensionSections(settings, extensions);
             }
-            else if (*current == L'.') {
-                auto pos = end - current - 1; //I want that dot too
-                extension = path.substr(pos);
-                return true;
+            else if (section == Handlers::SpecificType) {
+                AddTypeSection(deadline);
+            }
+            else if (section == Handlers::Patterns) {
+                // there are only files selected, so every item's name is checked
+                for (const auto& folder : PatternIndex::Instance().FindCommonPatternFolders(GetHandlersFolder(section), m_itemPaths)) {
+                    AddFolderSection(folder);
+                }
+            }
+            else {
+                AddFolderSection(GetHandlersFolder(section));
             }
         }
-        return false;
+
+        m_menu.LoadIcons(min_of(::GetTickCount64() + IconLoader::MAX_MENU_WAIT_MS, deadline));
+
+        while (::GetMenuItemCount(m_handlersMenu) > 0) {
+            ::DeleteMenu(m_handlersMenu, 0, MF_BYPOSITION);
+        }
+        m_menu.Materialize(m_handlersMenu, m_idCmdFirst, drawIcons);
+
+#ifdef _DEBUG
+        const auto& iconCache = IconCache::Instance();
+        debug_print((L"My Open With Extension: icon cache hits: " + std::to_wstring(iconCache.GetHits())
+            + L", misses: " + std::to_wstring(iconCache.GetMisses())).c_str());
+#endif
     }
 
 private:
     long m_nRefs = 1;
 
-    std::vector<std::wstring> m_itemPaths;
+    PathArena m_itemPaths;
 
     std::wstring m_handlersRoot;
 
-    std::vector<HandlerMenuItem> m_handlers;
+    MenuModel m_menu;
+
+    HMENU m_handlersMenu = NULL;
+    bool m_handlersMenuFilled = false;
+    UINT m_idCmdFirst = 0;
+    UINT m_nReservedCommands = 0;
 
+    // the host asked for IContextMenu2 or IContextMenu3
+    bool m_hostWantsMenuMessages = false;
+    // some host in this process has forwarded a menu message to us
+    static std::atomic<bool> m_menuMessagesForwarded;
     bool m_extendedMode = false;
+    bool m_rankByUsage = false;
 };
 
 long MyExtension::m_nInstances = 0;
+std::atomic<bool> MyExtension::m_menuMessagesForwarded{ false };
 
 class MyClassFactory final: public IClassFactory {
 public:
@@ -619,6 +3191,8 @@ public:
             || IsEqualGUID(pRequestedIID, IID_IShellExtInit)
             ) {
 
+            Prewarmer::Instance().Start();
+
             MyExtension* pExt = new MyExtension();
             return pExt->QueryInterface(pRequestedIID, ppvObject);
         }
@@ -668,6 +3242,9 @@ HRESULT __stdcall DllGetClassObject(REFCLSID pCLSID, REFIID pIID, void** ppv) {
         return CLASS_E_CLASSNOTAVAILABLE;
     }
 
+    // the first menu is coming, get ready for it
+    Prewarmer::Instance().Start();
+
     //alright, return our implementation of IClassFactory
     *ppv = new MyClassFactory;
     return S_OK;
@@ -676,7 +3253,12 @@ HRESULT __stdcall DllGetClassObject(REFCLSID pCLSID, REFIID pIID, void** ppv) {
 HRESULT __stdcall DllCanUnloadNow() {
     if (   MyClassFactory::m_nLocks == 0
         && MyClassFactory::m_nInstances == 0
-        && MyExtension::m_nInstances == 0)
+        && MyExtension::m_nInstances == 0
+        && Launcher::Instance().TryShutdown()
+        && Prewarmer::Instance().TryShutdown()
+        && IconLoader::Instance().TryShutdown()
+        && TypeSniffer::Instance().TryShutdown()
+        && get_worker_pool().TryShutdown())
     {
         return S_OK;
     }
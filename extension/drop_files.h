@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+CF_HDROP's DROPFILES block, walked in place: a header followed by a list of 0-terminated paths, ended by an empty one.
+Paths are either UTF-16 or ANSI, as the header says.
+
+Plain C++ with no Windows types in it, like catalog_format.h, so the header is read by its layout:
+
+    DROPFILES   offset of the paths, drop point (two 4 byte coordinates), non-client flag, wide flag; 20 bytes
+    paths       0-terminated, UTF-16 or ANSI, then an empty one
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace drop_files {
+
+    constexpr size_t HEADER_SIZE = 20;
+
+    inline uint32_t get_u32(const uint8_t* at) {
+        return uint32_t(at[0]) | (uint32_t(at[1]) << 8) | (uint32_t(at[2]) << 16) | (uint32_t(at[3]) << 24);
+    }
+
+    /*
+    Views passed to the callbacks point into the block, so they are valid only while the block is locked.
+    Returns false if the block is malformed or truncated, paths before the damaged one are still reported.
+    */
+    template <typename OnWidePath, typename OnAnsiPath>
+    bool parse(const void* block, size_t blockSize, OnWidePath onWidePath, OnAnsiPath onAnsiPath) {
+        if (block == nullptr || blockSize < HEADER_SIZE) {
+            return false;
+        }
+
+        const uint8_t* const blockStart = static_cast<const uint8_t*>(block);
+        const uint32_t filesOffset = get_u32(blockStart);
+        const bool isWide = get_u32(blockStart + 16) != 0;
+        if (filesOffset < HEADER_SIZE || filesOffset >= blockSize) {
+            return false;
+        }
+
+        if (isWide) {
+            // UTF-16 at an odd offset can't be read in place; nobody puts it there
+            if (filesOffset % sizeof(char16_t) != 0) {
+                return false;
+            }
+            const char16_t* current = reinterpret_cast<const char16_t*>(blockStart + filesOffset);
+            const char16_t* const end = current + (blockSize - filesOffset) / sizeof(char16_t);
+            while (current < end) {
+                const char16_t* terminator = std::char_traits<char16_t>::find(current, end - current, u'\0');
+                if (terminator == nullptr) {
+                    return false;
+                }
+                if (terminator == current) {
+                    return true;
+                }
+                onWidePath(std::u16string_view(current, terminator - current));
+                current = terminator + 1;
+            }
+        }
+        else {
+            const char* current = reinterpret_cast<const char*>(blockStart + filesOffset);
+            const char* const end = reinterpret_cast<const char*>(blockStart + blockSize);
+            while (current < end) {
+                const char* terminator = static_cast<const char*>(memchr(current, 0, end - current));
+                if (terminator == nullptr) {
+                    return false;
+                }
+                if (terminator == current) {
+                    return true;
+                }
+                onAnsiPath(std::string_view(current, terminator - current));
+                current = terminator + 1;
+            }
+        }
+
+        // ran out of the block before the terminating empty path
+        return false;
+    }
+}
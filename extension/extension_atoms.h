@@ -0,0 +1,128 @@
+#pragma once
+
+/*
+Extensions interned as small numbers, so classifying a selection compares and hashes integers
+and per extension data can live in arrays indexed by atom.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Case folding is the caller's:
+the table is given the function it folds text with.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace extension_atoms {
+
+    using Atom = unsigned;
+
+    /*
+    Table of case folded extensions, each one interned once and known by its small number afterwards.
+    Lookups of extensions seen before (nearly all of them) take a shared lock and allocate nothing,
+    since Explorer may classify selections on several threads at once.
+    */
+    class ExtensionAtoms final {
+    public:
+        // folds the text in place
+        using FoldText = void (*)(wchar_t* text, size_t length);
+
+        // the table only grows, this keeps a process that has seen every odd extension from growing forever
+        static constexpr size_t MAX_ATOMS = 65536;
+
+        explicit ExtensionAtoms(FoldText foldText, size_t maxAtoms = MAX_ATOMS)
+            : m_foldText(foldText)
+            , m_maxAtoms(maxAtoms)
+        {}
+
+        ExtensionAtoms(const ExtensionAtoms&) = delete;
+        ExtensionAtoms& operator=(const ExtensionAtoms&) = delete;
+
+        // returns false once the table is full and the extension isn't there
+        bool Intern(std::wstring_view extension, Atom& atom) {
+            wchar_t buffer[MAX_FOLDED_ON_STACK];
+            std::wstring longFolded;
+            const std::wstring_view folded = Fold(extension, buffer, longFolded);
+
+            {
+                std::shared_lock<std::shared_mutex> lock(m_lock);
+                if (FindFolded(folded, atom)) {
+                    return true;
+                }
+            }
+
+            std::unique_lock<std::shared_mutex> lock(m_lock);
+            if (FindFolded(folded, atom)) {
+                return true;
+            }
+            if (m_texts.size() >= m_maxAtoms) {
+                return false;
+            }
+            // deque never moves its elements, so the key can point into them
+            m_texts.emplace_back(folded);
+            atom = static_cast<Atom>(m_texts.size() - 1);
+            m_atoms.emplace(m_texts.back(), atom);
+            return true;
+        }
+
+        // Like Intern, but an extension seen for the first time is left out of the table. Selected files' extensions
+        // are only looked up this way: only extension folders are interned, an extension they don't know has no handlers.
+        bool Find(std::wstring_view extension, Atom& atom) const {
+            wchar_t buffer[MAX_FOLDED_ON_STACK];
+            std::wstring longFolded;
+            const std::wstring_view folded = Fold(extension, buffer, longFolded);
+
+            std::shared_lock<std::shared_mutex> lock(m_lock);
+            return FindFolded(folded, atom);
+        }
+
+        // case folded extension, the reference stays valid for the lifetime of the table
+        const std::wstring& GetText(Atom atom) const {
+            std::shared_lock<std::shared_mutex> lock(m_lock);
+            return m_texts[atom];
+        }
+
+        size_t size() const {
+            std::shared_lock<std::shared_mutex> lock(m_lock);
+            return m_texts.size();
+        }
+
+    private:
+        static constexpr size_t MAX_FOLDED_ON_STACK = 64;
+
+        // extensions are short, they are folded on the stack
+        std::wstring_view Fold(std::wstring_view extension, wchar_t (&buffer)[MAX_FOLDED_ON_STACK], std::wstring& longFolded) const {
+            wchar_t* folded = buffer;
+            if (extension.size() > MAX_FOLDED_ON_STACK) {
+                longFolded.assign(extension);
+                folded = &longFolded.front();
+            }
+            else {
+                std::copy(extension.begin(), extension.end(), buffer);
+            }
+            if (!extension.empty()) {
+                m_foldText(folded, extension.size());
+            }
+            return std::wstring_view(folded, extension.size());
+        }
+
+        bool FindFolded(std::wstring_view folded, Atom& atom) const {
+            const auto found = m_atoms.find(folded);
+            if (found == m_atoms.end()) {
+                return false;
+            }
+            atom = found->second;
+            return true;
+        }
+
+        FoldText m_foldText;
+        size_t m_maxAtoms;
+        mutable std::shared_mutex m_lock;
+        std::deque<std::wstring> m_texts;
+        std::unordered_map<std::wstring_view, Atom> m_atoms;
+    };
+}
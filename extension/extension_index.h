@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+Index of "Files by Extension": which "(.extension)" folder every extension has, and the handlers common
+to several extensions. Every handler name gets a bit, every extension folder a bitset of its handlers,
+so the handlers all of the folders have are a few ANDs per folder.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Listing folders and case folding names is
+left to the caller.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace extension_index {
+
+    // extension's number, as given out by the caller's interning
+    using Atom = unsigned;
+
+    /*
+    Extension of an extension folder, "(.txt)" -> ".txt", false for folders not named after an extension.
+    You might wonder why enclose extension in parens.
+    That's because you can't have folder named "." and Explorer forbids creating folders named like ".txt"
+    */
+    inline bool parse_extension_folder(std::wstring_view name, std::wstring_view& extension) {
+        if (name.size() > 3 && name.front() == L'(' && name[1] == L'.' && name.back() == L')') {
+            extension = name.substr(1, name.size() - 2);
+            return true;
+        }
+        return false;
+    }
+
+    // Extension folder ("(.Ext)") of every extension atom that has one
+    class ExtensionFolders final {
+    public:
+        /*
+        Built from the names of the subfolders of "Files by Extension". intern(extension, atom) gives
+        the extension its atom (case insensitive, so ".txt" and ".TXT" get the same one), false if it can't;
+        onExtension(extension) is called for every extension that got its folder.
+        */
+        template <typename Names, typename Intern, typename OnExtension>
+        void Build(const Names& subfolders, Intern intern, OnExtension onExtension) {
+            m_folderNames.clear();
+            m_nFolders = 0;
+            for (const auto& name : subfolders) {
+                std::wstring_view extension;
+                Atom atom;
+                if (!parse_extension_folder(name, extension) || !intern(extension, atom)) {
+                    continue;
+                }
+                if (m_folderNames.size() <= atom) {
+                    m_folderNames.resize(atom + 1);
+                }
+                // of "(.txt)" and "(.TXT)" the first one listed wins, as it did before
+                if (m_folderNames[atom].empty()) {
+                    m_folderNames[atom] = name;
+                    m_nFolders += 1;
+                }
+                onExtension(extension);
+            }
+        }
+
+        // nullptr if the extension has no folder
+        const std::wstring* Find(Atom atom) const {
+            if (atom >= m_folderNames.size() || m_folderNames[atom].empty()) {
+                return nullptr;
+            }
+            return &m_folderNames[atom];
+        }
+
+        size_t size() const {
+            return m_nFolders;
+        }
+
+    private:
+        // atom -> "(.Ext)", empty for extensions without folder
+        std::vector<std::wstring> m_folderNames;
+        size_t m_nFolders = 0;
+    };
+
+    // bit per handler id
+    using Bitset = std::vector<unsigned long long>;
+
+    inline void set_bit(Bitset& bits, size_t id) {
+        if (bits.size() <= id / 64) {
+            bits.resize(id / 64 + 1);
+        }
+        bits[id / 64] |= 1ULL << (id % 64);
+    }
+
+    inline bool has_bit(const Bitset& bits, size_t id) {
+        return id / 64 < bits.size() && (bits[id / 64] & (1ULL << (id % 64)));
+    }
+
+    // leaves in common only the bits that are in both
+    inline void intersect_bits(Bitset& common, const Bitset& bits) {
+        common.resize(std::min(common.size(), bits.size()));
+        for (size_t i = 0; i < common.size(); i += 1) {
+            common[i] &= bits[i];
+        }
+    }
+
+    // Handler names, case folded by the caller, each one given a bit the first time it's seen
+    class HandlerIds final {
+    public:
+        // ids of the names, in their order, with their bits set in bits
+        std::vector<size_t> Intern(const std::vector<std::wstring>& names, Bitset& bits) {
+            std::vector<size_t> ids;
+            ids.reserve(names.size());
+            for (const auto& name : names) {
+                const size_t id = m_ids.emplace(name, m_ids.size()).first->second;
+                ids.push_back(id);
+                set_bit(bits, id);
+            }
+            return ids;
+        }
+
+        size_t size() const {
+            return m_ids.size();
+        }
+
+        void Clear() {
+            m_ids.clear();
+        }
+
+    private:
+        std::unordered_map<std::wstring, size_t> m_ids;
+    };
+
+    /*
+    Positions in firstIds (the ids of the first folder's handlers) of the handlers every one of the bitsets has,
+    in the first folder's order. The first folder's own bitset is one of them; no bitsets, nothing is common.
+    */
+    inline std::vector<size_t> find_common(const std::vector<size_t>& firstIds, const std::vector<const Bitset*>& bitsets) {
+        std::vector<size_t> common;
+        if (bitsets.empty()) {
+            return common;
+        }
+
+        Bitset commonBits = *bitsets.front();
+        for (size_t i = 1; i < bitsets.size(); i += 1) {
+            intersect_bits(commonBits, *bitsets[i]);
+        }
+        for (size_t position = 0; position < firstIds.size(); position += 1) {
+            if (has_bit(commonBits, firstIds[position])) {
+                common.push_back(position);
+            }
+        }
+        return common;
+    }
+}
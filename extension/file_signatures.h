@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+File types told by their first bytes, for the "Files by Type" section: a file without an extension is sniffed
+and its type looked up as a "(type)" folder.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Reading the bytes is left to the caller.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cwchar>
+#include <vector>
+
+namespace file_signatures {
+
+    struct FileSignature {
+        const wchar_t* type;
+        size_t offset;
+        const char* magic;
+        size_t length;
+    };
+
+    // "Files by Type\(type)" folders are named after these types
+    inline constexpr FileSignature FILE_SIGNATURES[] = {
+        { L"elf", 0, "\x7F" "ELF", 4 },
+        { L"pe", 0, "MZ", 2 },
+        { L"pdf", 0, "%PDF-", 5 },
+        { L"zip", 0, "PK\x03\x04", 4 },
+        { L"zip", 0, "PK\x05\x06", 4 },
+        { L"png", 0, "\x89PNG\r\n\x1A\n", 8 },
+        { L"jpeg", 0, "\xFF\xD8\xFF", 3 },
+        { L"gif", 0, "GIF8", 4 },
+        { L"gzip", 0, "\x1F\x8B", 2 },
+        { L"bzip2", 0, "BZh", 3 },
+        { L"xz", 0, "\xFD" "7zXZ\x00", 6 },
+        { L"7z", 0, "7z\xBC\xAF\x27\x1C", 6 },
+        { L"rar", 0, "Rar!\x1A\x07", 6 },
+        { L"sqlite", 0, "SQLite format 3\x00", 16 },
+        { L"script", 0, "#!", 2 },
+        { L"tar", 257, "ustar", 5 },
+    };
+
+    // nothing in the table looks further than that
+    constexpr size_t SNIFFED_BYTES = 512;
+
+    /*
+    Tells file type by its first bytes. Signatures are bucketed by their first byte, so every file
+    is checked only against signatures that can possibly match, in one pass over the table.
+    */
+    class SignatureTable final {
+    public:
+        SignatureTable()
+            : SignatureTable(FILE_SIGNATURES, sizeof(FILE_SIGNATURES) / sizeof(FILE_SIGNATURES[0]))
+        {}
+
+        SignatureTable(const FileSignature* signatures, size_t nSignatures)
+            : m_signatures(signatures)
+            , m_nSignatures(nSignatures)
+        {
+            for (size_t i = 0; i < nSignatures; i += 1) {
+                const auto& signature = signatures[i];
+                m_buckets[static_cast<unsigned char>(signature.magic[0])].push_back(i);
+                bool isKnownOffset = false;
+                for (const size_t offset : m_offsets) {
+                    isKnownOffset = isKnownOffset || offset == signature.offset;
+                }
+                if (!isKnownOffset) {
+                    m_offsets.push_back(signature.offset);
+                }
+            }
+        }
+
+        // returns index of the longest matching signature, -1 if none matches
+        int Match(const unsigned char* data, size_t size) const {
+            int best = -1;
+            size_t bestLength = 0;
+            for (const size_t offset : m_offsets) {
+                if (offset >= size) {
+                    continue;
+                }
+                for (const size_t i : m_buckets[data[offset]]) {
+                    const auto& signature = m_signatures[i];
+                    if (signature.offset == offset
+                        && signature.length > bestLength
+                        && offset + signature.length <= size
+                        && 0 == memcmp(data + offset, signature.magic, signature.length)) {
+                        best = static_cast<int>(i);
+                        bestLength = signature.length;
+                    }
+                }
+            }
+            return best;
+        }
+
+        const FileSignature& operator[](size_t i) const {
+            return m_signatures[i];
+        }
+
+        size_t size() const {
+            return m_nSignatures;
+        }
+
+        // The type all of the files are of, nullptr if some are of another one or unknown (-1).
+        // Signatures of the same type (two kinds of zip) count as the same.
+        const wchar_t* GetCommonType(const int* types, size_t nTypes) const {
+            if (nTypes == 0 || types[0] < 0) {
+                return nullptr;
+            }
+            const wchar_t* commonType = m_signatures[types[0]].type;
+            for (size_t i = 1; i < nTypes; i += 1) {
+                if (types[i] < 0 || 0 != wcscmp(m_signatures[types[i]].type, commonType)) {
+                    return nullptr;
+                }
+            }
+            return commonType;
+        }
+
+    private:
+        const FileSignature* m_signatures;
+        size_t m_nSignatures;
+        std::vector<size_t> m_buckets[256];
+        // offsets signatures are at, each one once
+        std::vector<size_t> m_offsets;
+    };
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+Fingerprints of the handlers a menu already has, so the same tool reached from several folders is shown once.
+Open addressing in a table sized for the most handlers a menu can take: it is allocated on the first use
+and only cleared afterwards, so a menu build doesn't allocate for it.
+
+Plain C++ with no Windows types in it, like catalog_format.h.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+namespace fingerprint_set {
+
+    class FingerprintSet final {
+    public:
+        void Clear(size_t maxSize) {
+            m_capacity = 16;
+            while (m_capacity < maxSize * 2) {
+                m_capacity *= 2;
+            }
+            if (m_slots.size() == m_capacity) {
+                std::fill(m_slots.begin(), m_slots.end(), 0);
+            }
+            else {
+                m_slots.clear();
+            }
+        }
+
+        // false if the fingerprint is there already; the set has to have room, as Clear promised
+        bool Insert(uint64_t fingerprint) {
+            if (m_slots.size() != m_capacity) {
+                m_slots.assign(m_capacity, 0);
+            }
+            // 0 marks empty slots
+            fingerprint = fingerprint ? fingerprint : 1;
+            const size_t mask = m_capacity - 1;
+            for (size_t i = static_cast<size_t>(fingerprint) & mask; ; i = (i + 1) & mask) {
+                if (m_slots[i] == fingerprint) {
+                    return false;
+                }
+                if (m_slots[i] == 0) {
+                    m_slots[i] = fingerprint;
+                    return true;
+                }
+            }
+        }
+
+        // slots in the table, twice the size Clear was given at least
+        size_t GetCapacity() const {
+            return m_capacity;
+        }
+
+    private:
+        size_t m_capacity = 16;
+        std::vector<uint64_t> m_slots;
+    };
+}
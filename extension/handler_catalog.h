@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+Cache of handler folders contents, so right-clicks are served from memory. Handler folders change rarely,
+so every folder is listed once and listed again only when its backend tells it changed.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Watching and listing folders is the backend's:
+change notifications on Windows, inotify on Linux, anything a test makes up. A backend has:
+
+    Path                                how folders are named
+    Snapshot                            what a folder contained when it was listed
+    Watch                               what the backend keeps per folder to tell it changed
+    IsStale(folder, watch, snapshot)    whether the folder changed since it was last armed
+    Rearm(folder, watch)                watches the folder anew, called right before it's listed
+    Scan(folder, isFirstLook)           lists the folder, as std::shared_ptr<const Snapshot>
+    Close(watch)                        the folder is no longer watched
+*/
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace handler_catalog {
+
+    // How well the cache does: every lookup not needing a scan is a hit
+    struct CacheStats {
+        size_t nLookups = 0;
+        size_t nScans = 0;
+
+        size_t GetHits() const {
+            return nLookups - nScans;
+        }
+    };
+
+    /*
+    Folders are listed outside of the lock, so different folders can be listed on different threads at once.
+    A folder is armed before it's listed, so a change made while it's being listed isn't lost: it makes
+    the next lookup list the folder again.
+    */
+    template <typename Backend>
+    class FolderCache final {
+    public:
+        using Path = typename Backend::Path;
+        using Snapshot = typename Backend::Snapshot;
+
+        FolderCache() = default;
+
+        FolderCache(const FolderCache&) = delete;
+        FolderCache& operator=(const FolderCache&) = delete;
+
+        ~FolderCache() {
+            for (auto& entry : m_folders) {
+                m_backend.Close(entry.second.watch);
+            }
+        }
+
+        std::shared_ptr<const Snapshot> GetFolder(const Path& folder) {
+            unsigned long long generation = 0;
+            bool isFirstLook = false;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stats.nLookups += 1;
+                FolderEntry& entry = m_folders[folder];
+                if (entry.snapshot && !m_backend.IsStale(folder, entry.watch, *entry.snapshot)) {
+                    return entry.snapshot;
+                }
+                entry.generation += 1;
+                m_backend.Rearm(folder, entry.watch);
+                generation = entry.generation;
+                isFirstLook = !entry.snapshot;
+                m_stats.nScans += 1;
+            }
+
+            // listing is the slow part, so it's done unlocked: other folders can be listed meanwhile
+            std::shared_ptr<const Snapshot> snapshot = m_backend.Scan(folder, isFirstLook);
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            FolderEntry& entry = m_folders[folder];
+            // a scan that started after a later change knows better
+            if (entry.generation == generation || !entry.snapshot) {
+                entry.snapshot = snapshot;
+            }
+            return snapshot;
+        }
+
+        // whether the folder was listed already, i.e. getting it is unlikely to touch the disk
+        bool IsListed(const Path& folder) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            const auto found = m_folders.find(folder);
+            return found != m_folders.end() && found->second.snapshot;
+        }
+
+        CacheStats GetStats() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_stats;
+        }
+
+        // the backend is called with the cache locked, so whatever is set up on it should be before the first lookup
+        Backend& GetBackend() {
+            return m_backend;
+        }
+
+    private:
+        struct FolderEntry {
+            typename Backend::Watch watch;
+            std::shared_ptr<const Snapshot> snapshot;
+            // counts rescans, so an older one finishing late doesn't overwrite a newer one
+            unsigned long long generation = 0;
+        };
+
+        std::mutex m_lock;
+        Backend m_backend;
+        std::unordered_map<Path, FolderEntry> m_folders;
+        CacheStats m_stats;
+    };
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+Subfolders of a handlers folder, walked into the tree of nested submenus they are shown as.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Folders are listed by the catalog
+(HandlerCatalog on Windows, a FolderCache of any backend elsewhere), on the threads of a runner
+(worker_pool::WorkerPool). A catalog has:
+
+    GetFolder(path)     the folder's snapshot, as std::shared_ptr<const Snapshot>
+    IsListed(path)      whether getting it is unlikely to touch the disk
+
+and a snapshot has files and subfolders (names of them), and haveIdentity and identity to tell loops by.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace handler_groups {
+
+    constexpr size_t MAX_DEPTH = 4;
+    constexpr size_t MAX_THREADS = 4;
+
+    // A handlers subfolder, shown as a nested submenu named after it
+    template <typename Snapshot>
+    struct HandlerGroup {
+        std::wstring title;
+        std::shared_ptr<const Snapshot> folder;
+        std::vector<HandlerGroup> groups;
+    };
+
+    // drops loops, unreadable folders and groups without a single handler in them
+    template <typename Snapshot>
+    void prune_handler_groups(std::vector<HandlerGroup<Snapshot>>& groups) {
+        for (auto& group : groups) {
+            prune_handler_groups(group.groups);
+        }
+        groups.erase(std::remove_if(groups.begin(), groups.end(), [](const HandlerGroup<Snapshot>& group) {
+            return !group.folder || (group.folder->files.empty() && group.groups.empty());
+        }), groups.end());
+    }
+
+    /*
+    A tree of groups at most MAX_DEPTH deep. Walked level by level, each level listed on a few threads
+    of the runner at once, so a wide tree costs about as much as its deepest branch. Every level is run
+    on the same runner: its threads are kept from one level to the next, and from one menu to the next.
+    A folder that is its own ancestor (a junction or a symbolic link pointing up the tree) is left out.
+    */
+    template <typename Snapshot, typename Catalog, typename Runner>
+    std::vector<HandlerGroup<Snapshot>> load_handler_groups(const std::wstring& folder, const Snapshot& snapshot, Catalog& catalog, Runner& runner) {
+        using Identity = decltype(snapshot.identity);
+
+        struct Pending {
+            HandlerGroup<Snapshot>* group;
+            std::wstring path;
+            std::vector<Identity> ancestors;
+        };
+
+        std::vector<HandlerGroup<Snapshot>> groups(snapshot.subfolders.size());
+        if (groups.empty()) {
+            return groups;
+        }
+
+        std::vector<Identity> rootAncestors;
+        if (snapshot.haveIdentity) {
+            rootAncestors.push_back(snapshot.identity);
+        }
+        std::vector<Pending> level;
+        for (size_t i = 0; i < groups.size(); i += 1) {
+            groups[i].title = snapshot.subfolders[i];
+            level.push_back({ &groups[i], folder + L"\\" + snapshot.subfolders[i], rootAncestors });
+        }
+
+        for (size_t depth = 1; !level.empty(); depth += 1) {
+            // no point in waking threads up for folders that are in memory already
+            const bool haveUnlisted = std::any_of(level.begin(), level.end(), [&catalog](const Pending& pending) {
+                return !catalog.IsListed(pending.path);
+            });
+            runner.Run(level.size(), haveUnlisted ? MAX_THREADS : 1, [&level, &catalog](size_t i) {
+                level[i].group->folder = catalog.GetFolder(level[i].path);
+            });
+
+            std::vector<Pending> nextLevel;
+            for (auto& pending : level) {
+                HandlerGroup<Snapshot>& group = *pending.group;
+                if (group.folder->haveIdentity) {
+                    if (std::find(pending.ancestors.begin(), pending.ancestors.end(), group.folder->identity) != pending.ancestors.end()) {
+                        group.folder = nullptr;
+                        continue;
+                    }
+                    pending.ancestors.push_back(group.folder->identity);
+                }
+
+                if (depth >= MAX_DEPTH || group.folder->subfolders.empty()) {
+                    continue;
+                }
+                // sized once and for all: the next level points into it
+                group.groups.resize(group.folder->subfolders.size());
+                for (size_t i = 0; i < group.groups.size(); i += 1) {
+                    group.groups[i].title = group.folder->subfolders[i];
+                    nextLevel.push_back({ &group.groups[i], pending.path + L"\\" + group.folder->subfolders[i], pending.ancestors });
+                }
+            }
+            level = std::move(nextLevel);
+        }
+
+        prune_handler_groups(groups);
+        return groups;
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+/*
+Icon atlas: handler icons packed into one premultiplied 32 bit BGRA pixel buffer, each in a rectangle of its own,
+so a process with hundreds of handler icons keeps one buffer (and, on Windows, one bitmap) instead of one per icon.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Icons of a menu are nearly always the same size,
+so packing is by shelves: rows as high as the icons in them, filled left to right, with new rows added at the bottom.
+A removed icon's rectangle is taken by the next icon of the same size; the buffer never shrinks.
+Rows pixels were copied into are remembered, so a copy of the buffer (a DIB section on Windows) is brought
+up to date by copying those rows alone.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace icon_atlas {
+
+    using SlotId = uint32_t;
+    constexpr SlotId NO_SLOT = ~SlotId(0);
+
+    struct Rect {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    class Atlas {
+    public:
+        static constexpr uint32_t DEFAULT_WIDTH = 256;
+        // 256 x 4096 is a thousand 32 pixel icons, 4 MB; past that icons are left out of the atlas
+        static constexpr uint32_t MAX_HEIGHT = 4096;
+
+        explicit Atlas(uint32_t width = DEFAULT_WIDTH)
+            : m_width(width)
+        {}
+
+        // Copies premultiplied pixels (width * height, top-down rows) into the atlas.
+        // NO_SLOT if the icon is empty, wider than the atlas or there is no room left.
+        SlotId Add(const uint8_t* pixels, uint32_t width, uint32_t height) {
+            if (width == 0 || height == 0 || width > m_width || height > MAX_HEIGHT) {
+                return NO_SLOT;
+            }
+
+            SlotId id = TakeFreeSlot(width, height);
+            if (id == NO_SLOT) {
+                Rect rect;
+                if (!Pack(width, height, rect)) {
+                    return NO_SLOT;
+                }
+                id = static_cast<SlotId>(m_slots.size());
+                m_slots.push_back({ rect, true });
+            }
+
+            const Rect& rect = m_slots[id].rect;
+            for (uint32_t row = 0; row < height; row += 1) {
+                memcpy(&m_pixels[(size_t(rect.y + row) * m_width + rect.x) * 4], pixels + size_t(row) * width * 4, size_t(width) * 4);
+            }
+            m_nUsedSlots += 1;
+            m_generation += 1;
+            MarkChanged(rect.y, rect.y + height);
+            return id;
+        }
+
+        void Remove(SlotId id) {
+            if (id < m_slots.size() && m_slots[id].isUsed) {
+                m_slots[id].isUsed = false;
+                m_nUsedSlots -= 1;
+            }
+        }
+
+        // the slot has to be one Add returned and not removed since
+        const Rect& GetRect(SlotId id) const {
+            return m_slots[id].rect;
+        }
+
+        bool IsUsed(SlotId id) const {
+            return id < m_slots.size() && m_slots[id].isUsed;
+        }
+
+        // GetWidth() * GetHeight() pixels, top-down rows
+        const uint8_t* GetPixels() const {
+            return m_pixels.data();
+        }
+
+        uint32_t GetWidth() const {
+            return m_width;
+        }
+
+        uint32_t GetHeight() const {
+            return m_height;
+        }
+
+        // changes whenever pixels do, so a copy of them can tell it's stale
+        uint64_t GetGeneration() const {
+            return m_generation;
+        }
+
+        // Copies the rows changed since the last call (all of them with allRows) into a copy of the pixels:
+        // as wide as the atlas and at least as tall. Returns how many bytes it copied.
+        size_t CopyChangedRows(uint8_t* to, bool allRows = false) {
+            if (allRows) {
+                m_changedRows.assign(1, { 0, m_height });
+            }
+            std::sort(m_changedRows.begin(), m_changedRows.end());
+
+            const size_t rowBytes = size_t(m_width) * 4;
+            size_t nCopied = 0;
+            for (size_t i = 0; i < m_changedRows.size(); ) {
+                // overlapping and adjacent ones are copied as one
+                const uint32_t top = m_changedRows[i].first;
+                uint32_t bottom = m_changedRows[i].second;
+                for (i += 1; i < m_changedRows.size() && m_changedRows[i].first <= bottom; i += 1) {
+                    bottom = m_changedRows[i].second > bottom ? m_changedRows[i].second : bottom;
+                }
+                const size_t nBytes = (bottom - top) * rowBytes;
+                if (nBytes > 0) {
+                    memcpy(to + top * rowBytes, m_pixels.data() + top * rowBytes, nBytes);
+                }
+                nCopied += nBytes;
+            }
+            m_changedRows.clear();
+            return nCopied;
+        }
+
+        // what a bitmap per icon would have cost: one object for every icon held
+        size_t GetUsedSlots() const {
+            return m_nUsedSlots;
+        }
+
+        size_t GetPixelBytes() const {
+            return m_pixels.size();
+        }
+
+        size_t GetUsedPixelBytes() const {
+            size_t nBytes = 0;
+            for (const auto& slot : m_slots) {
+                nBytes += slot.isUsed ? size_t(slot.rect.width) * slot.rect.height * 4 : 0;
+            }
+            return nBytes;
+        }
+
+    private:
+        struct Slot {
+            Rect rect;
+            bool isUsed;
+        };
+
+        struct Shelf {
+            uint32_t y;
+            uint32_t height;
+            uint32_t nextX;
+        };
+
+        SlotId TakeFreeSlot(uint32_t width, uint32_t height) {
+            for (SlotId id = 0; id < m_slots.size(); id += 1) {
+                Slot& slot = m_slots[id];
+                if (!slot.isUsed && slot.rect.width == width && slot.rect.height == height) {
+                    slot.isUsed = true;
+                    return id;
+                }
+            }
+            return NO_SLOT;
+        }
+
+        // icons of a shelf share its rows, those are remembered once
+        void MarkChanged(uint32_t top, uint32_t bottom) {
+            for (const auto& rows : m_changedRows) {
+                if (rows.first <= top && bottom <= rows.second) {
+                    return;
+                }
+            }
+            m_changedRows.emplace_back(top, bottom);
+        }
+
+        bool Pack(uint32_t width, uint32_t height, Rect& rect) {
+            for (auto& shelf : m_shelves) {
+                if (shelf.height == height && m_width - shelf.nextX >= width) {
+                    rect = { shelf.nextX, shelf.y, width, height };
+                    shelf.nextX += width;
+                    return true;
+                }
+            }
+
+            if (MAX_HEIGHT - m_height < height) {
+                return false;
+            }
+            m_shelves.push_back({ m_height, height, width });
+            rect = { 0, m_height, width, height };
+            m_height += height;
+            m_pixels.resize(size_t(m_width) * m_height * 4);
+            return true;
+        }
+
+        const uint32_t m_width;
+        uint32_t m_height = 0;
+        std::vector<uint8_t> m_pixels;
+        std::vector<Shelf> m_shelves;
+        std::vector<Slot> m_slots;
+        size_t m_nUsedSlots = 0;
+        uint64_t m_generation = 0;
+        // [top, bottom) rows changed since the last CopyChangedRows
+        std::vector<std::pair<uint32_t, uint32_t>> m_changedRows;
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+LRU cache of handler icons, keyed by handler's path and its version (last write time),
+so the same icons aren't extracted and converted on every menu build.
+
+Plain C++ with no Windows types in it, like catalog_format.h. What an icon is and how it's extracted is
+the caller's: the cache is given a function making one when it's missing.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace icon_cache {
+
+    /*
+    Icons are refcounted: an evicted icon stays alive while some menu still uses it.
+    Icons are made outside of the lock, so a slow extraction doesn't hold up menus served from the cache.
+    */
+    template <typename Icon>
+    class IconCache final {
+    public:
+        explicit IconCache(size_t capacity)
+            : m_capacity(capacity)
+        {}
+
+        IconCache(const IconCache&) = delete;
+        IconCache& operator=(const IconCache&) = delete;
+
+        // nullptr if there is no icon of this version of the handler in the cache
+        std::shared_ptr<const Icon> Find(const std::wstring& path, uint64_t version) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto found = m_index.find(path);
+            if (found != m_index.end()) {
+                if (found->second->version == version) {
+                    m_nHits += 1;
+                    m_entries.splice(m_entries.begin(), m_entries, found->second);
+                    return found->second->icon;
+                }
+                // handler was changed since, its icon might be different now
+                m_entries.erase(found->second);
+                m_index.erase(found);
+            }
+            m_nMisses += 1;
+            return nullptr;
+        }
+
+        // Like Find, but leaves hit counts and the order of entries alone: for looking again at what was missing.
+        std::shared_ptr<const Icon> Peek(const std::wstring& path, uint64_t version) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto found = m_index.find(path);
+            if (found == m_index.end() || found->second->version != version) {
+                return nullptr;
+            }
+            return found->second->icon;
+        }
+
+        // Makes the icon (makeIcon() returns std::shared_ptr<const Icon>) and caches it, without looking whether
+        // it's there already. An icon of another version of the handler is replaced, one of the same is kept.
+        template <typename MakeIcon>
+        std::shared_ptr<const Icon> Load(const std::wstring& path, uint64_t version, MakeIcon makeIcon) {
+            // icon extraction is slow, don't block other threads while we are at it
+            std::shared_ptr<const Icon> icon = makeIcon();
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto found = m_index.find(path);
+            if (found != m_index.end() && found->second->version != version) {
+                m_entries.erase(found->second);
+                m_index.erase(found);
+                found = m_index.end();
+            }
+            if (found == m_index.end()) {
+                m_entries.push_front({ path, version, icon });
+                m_index.emplace(path, m_entries.begin());
+
+                while (m_entries.size() > m_capacity) {
+                    m_index.erase(m_entries.back().path);
+                    m_entries.pop_back();
+                }
+            }
+            return icon;
+        }
+
+        // counted under the lock, but read without it: a statistic needs no more than that
+        unsigned long long GetHits() const {
+            return m_nHits.load(std::memory_order_relaxed);
+        }
+
+        unsigned long long GetMisses() const {
+            return m_nMisses.load(std::memory_order_relaxed);
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_entries.size();
+        }
+
+    private:
+        struct Entry {
+            std::wstring path;
+            uint64_t version;
+            std::shared_ptr<const Icon> icon;
+        };
+
+        const size_t m_capacity;
+
+        std::mutex m_lock;
+        std::list<Entry> m_entries; // most recently used first
+        std::unordered_map<std::wstring, typename std::list<Entry>::iterator> m_index;
+
+        std::atomic<unsigned long long> m_nHits{ 0 };
+        std::atomic<unsigned long long> m_nMisses{ 0 };
+    };
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+/*
+Icon files (.ico) decoded into pixels menus can use as they are: 32 bit BGRA, premultiplied, top-down rows,
+of the size asked for. The entry closest to that size is picked from the file and scaled if it isn't exact.
+
+Plain C++ with no Windows types in it, like catalog_format.h. BMP entries (1, 4, 8, 24 and 32 bits per pixel,
+with their AND masks) are decoded here; PNG entries are handed to a decoder the caller passes in, as there is
+no inflate here to decode them with. Every size and offset in the file is checked before it is followed.
+
+    ICONDIR         reserved 0, type 1, entry count
+    ICONDIRENTRY    width, height (0 is 256), colors, reserved, planes, bits per pixel, size and offset of the image
+    images          BITMAPINFOHEADER, palette, XOR rows and AND mask rows, both bottom-up; or a whole PNG file
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// premultiplying works on 4 pixels at a time where SSE2 is there, one by one elsewhere (ARM64)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ICON_DECODE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace icon_decode {
+
+    // nothing bigger can be in an .ico directory
+    constexpr uint32_t MAX_SIDE = 256;
+
+    struct Image {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels; // width * height * 4 bytes, premultiplied BGRA, top-down rows
+    };
+
+    struct IconEntry {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bitCount = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        bool isPng = false;
+    };
+
+    inline uint16_t get_u16(const uint8_t* at) {
+        return static_cast<uint16_t>(at[0] | (at[1] << 8));
+    }
+
+    inline uint32_t get_u32(const uint8_t* at) {
+        return uint32_t(at[0]) | (uint32_t(at[1]) << 8) | (uint32_t(at[2]) << 16) | (uint32_t(at[3]) << 24);
+    }
+
+    // x * alpha / 255, rounded; exact for all 8 bit x and alpha
+    inline uint8_t multiply_alpha(unsigned x, unsigned alpha) {
+        const unsigned product = x * alpha + 128;
+        return static_cast<uint8_t>((product + (product >> 8)) >> 8);
+    }
+
+    // Premultiplies straight alpha BGRA pixels in place. Pixels with no alpha at all (old style icons, whose
+    // transparency is in a mask) are taken as opaque.
+    inline void premultiply(uint8_t* pixels, size_t nPixels) {
+        size_t i = 0;
+        bool haveAlpha = false;
+#ifdef ICON_DECODE_SSE2
+        const __m128i alphaBytes = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 4 <= nPixels && !haveAlpha; i += 4) {
+            const __m128i quad = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 4 * i));
+            haveAlpha = 0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(quad, alphaBytes), zero));
+        }
+#endif
+        for (; i < nPixels && !haveAlpha; i += 1) {
+            haveAlpha = pixels[4 * i + 3] != 0;
+        }
+
+        if (!haveAlpha) {
+            for (i = 0; i < nPixels; i += 1) {
+                pixels[4 * i + 3] = 255;
+            }
+            return;
+        }
+
+        i = 0;
+#ifdef ICON_DECODE_SSE2
+        // alpha is multiplied by 255 in its own lane, which leaves it as it is
+        const __m128i alphaLane = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        const __m128i colorLanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        const __m128i half = _mm_set1_epi16(128);
+        auto multiply = [&](__m128i twoPixels) {
+            const __m128i alphas = _mm_shufflehi_epi16(_mm_shufflelo_epi16(twoPixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            const __m128i factors = _mm_or_si128(_mm_and_si128(alphas, colorLanes), alphaLane);
+            const __m128i products = _mm_add_epi16(_mm_mullo_epi16(twoPixels, factors), half);
+            return _mm_srli_epi16(_mm_add_epi16(products, _mm_srli_epi16(products, 8)), 8);
+        };
+        for (; i + 4 <= nPixels; i += 4) {
+            __m128i* at = reinterpret_cast<__m128i*>(pixels + 4 * i);
+            const __m128i quad = _mm_loadu_si128(at);
+            const __m128i low = multiply(_mm_unpacklo_epi8(quad, zero));
+            const __m128i high = multiply(_mm_unpackhi_epi8(quad, zero));
+            _mm_storeu_si128(at, _mm_packus_epi16(low, high));
+        }
+#endif
+        for (; i < nPixels; i += 1) {
+            uint8_t* pixel = pixels + 4 * i;
+            for (int channel = 0; channel < 3; channel += 1) {
+                pixel[channel] = multiply_alpha(pixel[channel], pixel[3]);
+            }
+        }
+    }
+
+    // false if it isn't an icon file or its directory points outside of it
+    inline bool read_icon_directory(const uint8_t* data, size_t size, std::vector<IconEntry>& entries) {
+        constexpr size_t DIRECTORY_SIZE = 6;
+        constexpr size_t ENTRY_SIZE = 16;
+        if (size < DIRECTORY_SIZE || get_u16(data) != 0 || get_u16(data + 2) != 1) {
+            return false;
+        }
+        const size_t nEntries = get_u16(data + 4);
+        if (nEntries == 0 || (size - DIRECTORY_SIZE) / ENTRY_SIZE < nEntries) {
+            return false;
+        }
+
+        static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+        entries.clear();
+        for (size_t i = 0; i < nEntries; i += 1) {
+            const uint8_t* at = data + DIRECTORY_SIZE + i * ENTRY_SIZE;
+            IconEntry entry;
+            entry.width = at[0] ? at[0] : 256;
+            entry.height = at[1] ? at[1] : 256;
+            entry.bitCount = get_u16(at + 6);
+            entry.size = get_u32(at + 8);
+            entry.offset = get_u32(at + 12);
+            if (entry.offset > size || entry.size > size - entry.offset) {
+                continue;
+            }
+            entry.isPng = entry.size >= sizeof(PNG_SIGNATURE) && 0 == memcmp(data + entry.offset, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+            // PNG entries often don't bother saying
+            if (entry.bitCount == 0) {
+                entry.bitCount = 32;
+            }
+            entries.push_back(entry);
+        }
+        return !entries.empty();
+    }
+
+    // Entries best first for a side x side image: the smallest of those at least that big, so scaling only
+    // ever shrinks, then the rest from the biggest down; of the same size, the one with more colors.
+    inline void order_entries(std::vector<IconEntry>& entries, uint32_t side) {
+        std::stable_sort(entries.begin(), entries.end(), [side](const IconEntry& a, const IconEntry& b) {
+            const uint32_t aSide = std::max(a.width, a.height);
+            const uint32_t bSide = std::max(b.width, b.height);
+            const bool aIsBigEnough = aSide >= side;
+            const bool bIsBigEnough = bSide >= side;
+            if (aIsBigEnough != bIsBigEnough) {
+                return aIsBigEnough;
+            }
+            if (aSide != bSide) {
+                return aIsBigEnough ? aSide < bSide : aSide > bSide;
+            }
+            return a.bitCount > b.bitCount;
+        });
+    }
+
+    // BMP entry: BITMAPINFOHEADER with the height of XOR and AND rows together, palette, XOR rows, AND rows
+    inline bool decode_dib(const uint8_t* data, size_t size, Image& image) {
+        constexpr size_t INFO_HEADER_SIZE = 40;
+        constexpr uint32_t BI_RGB = 0;
+        constexpr uint32_t BI_BITFIELDS = 3;
+        if (size < INFO_HEADER_SIZE) {
+            return false;
+        }
+        const uint32_t headerSize = get_u32(data);
+        const int32_t width = static_cast<int32_t>(get_u32(data + 4));
+        const int32_t doubleHeight = static_cast<int32_t>(get_u32(data + 8));
+        const uint32_t bitCount = get_u16(data + 14);
+        const uint32_t compression = get_u32(data + 16);
+        const uint32_t nColorsUsed = get_u32(data + 32);
+        if (headerSize < INFO_HEADER_SIZE || headerSize > size
+            || width <= 0 || uint32_t(width) > MAX_SIDE || doubleHeight <= 0 || uint32_t(doubleHeight) / 2 > MAX_SIDE || doubleHeight < 2) {
+            return false;
+        }
+        const bool isPaletted = bitCount == 1 || bitCount == 4 || bitCount == 8;
+        if (!(isPaletted || bitCount == 24 || bitCount == 32)
+            || !(compression == BI_RGB || (compression == BI_BITFIELDS && bitCount == 32))) {
+            return false;
+        }
+
+        const uint32_t w = static_cast<uint32_t>(width);
+        const uint32_t h = static_cast<uint32_t>(doubleHeight) / 2;
+        size_t offset = headerSize;
+        if (compression == BI_BITFIELDS && headerSize == INFO_HEADER_SIZE) {
+            // channel masks follow the header, icons only ever have the usual ones
+            offset += 12;
+        }
+
+        const uint8_t* palette = data + offset;
+        size_t nColors = 0;
+        if (isPaletted) {
+            nColors = nColorsUsed ? nColorsUsed : (size_t(1) << bitCount);
+            if (nColors > 256 || (size - std::min(offset, size)) / 4 < nColors) {
+                return false;
+            }
+            offset += nColors * 4;
+        }
+
+        const size_t xorStride = (size_t(w) * bitCount + 31) / 32 * 4;
+        const size_t andStride = (size_t(w) + 31) / 32 * 4;
+        if (offset > size || (size - offset) / xorStride < h) {
+            return false;
+        }
+        const uint8_t* xorRows = data + offset;
+        offset += xorStride * h;
+        // some 32 bit icons leave the mask out, their alpha says it all
+        const uint8_t* andRows = (size - offset) / andStride >= h ? data + offset : nullptr;
+
+        image.width = w;
+        image.height = h;
+        image.pixels.assign(size_t(w) * h * 4, 0);
+        bool haveAlpha = false;
+        for (uint32_t y = 0; y < h; y += 1) {
+            // rows are bottom-up
+            const uint8_t* row = xorRows + (h - 1 - y) * xorStride;
+            uint8_t* to = image.pixels.data() + size_t(y) * w * 4;
+            for (uint32_t x = 0; x < w; x += 1) {
+                uint8_t* pixel = to + size_t(x) * 4;
+                if (bitCount == 32) {
+                    memcpy(pixel, row + size_t(x) * 4, 4);
+                    haveAlpha = haveAlpha || pixel[3] != 0;
+                    continue;
+                }
+                if (bitCount == 24) {
+                    memcpy(pixel, row + size_t(x) * 3, 3);
+                }
+                else {
+                    const size_t bit = size_t(x) * bitCount;
+                    const unsigned index = (row[bit / 8] >> (8 - bitCount - bit % 8)) & ((1u << bitCount) - 1);
+                    if (index >= nColors) {
+                        return false;
+                    }
+                    memcpy(pixel, palette + size_t(index) * 4, 3);
+                }
+                pixel[3] = 255;
+            }
+        }
+
+        // the mask makes transparent whatever the alpha channel doesn't
+        if (andRows && !haveAlpha) {
+            for (uint32_t y = 0; y < h; y += 1) {
+                const uint8_t* row = andRows + (h - 1 - y) * andStride;
+                uint8_t* to = image.pixels.data() + size_t(y) * w * 4;
+                for (uint32_t x = 0; x < w; x += 1) {
+                    to[size_t(x) * 4 + 3] = (row[x / 8] >> (7 - x % 8)) & 1 ? 0 : 255;
+                }
+            }
+        }
+
+        premultiply(image.pixels.data(), size_t(w) * h);
+        return true;
+    }
+
+    // Scales premultiplied pixels by area: every pixel is the average of what it covers of the source,
+    // which for enlarging comes down to the nearest pixel with the edges blended.
+    inline void resample(const Image& from, uint32_t width, uint32_t height, Image& to) {
+        to.width = width;
+        to.height = height;
+        to.pixels.assign(size_t(width) * height * 4, 0);
+        const double scaleX = double(from.width) / width;
+        const double scaleY = double(from.height) / height;
+
+        for (uint32_t y = 0; y < height; y += 1) {
+            const double top = y * scaleY;
+            const double bottom = std::min(top + scaleY, double(from.height));
+            for (uint32_t x = 0; x < width; x += 1) {
+                const double left = x * scaleX;
+                const double right = std::min(left + scaleX, double(from.width));
+                double sums[4] = { 0, 0, 0, 0 };
+                double area = 0;
+                for (uint32_t sy = static_cast<uint32_t>(top); sy < bottom; sy += 1) {
+                    const double coverY = std::min(bottom, sy + 1.0) - std::max(top, double(sy));
+                    for (uint32_t sx = static_cast<uint32_t>(left); sx < right; sx += 1) {
+                        const double cover = coverY * (std::min(right, sx + 1.0) - std::max(left, double(sx)));
+                        const uint8_t* pixel = from.pixels.data() + (size_t(sy) * from.width + sx) * 4;
+                        for (int channel = 0; channel < 4; channel += 1) {
+                            sums[channel] += pixel[channel] * cover;
+                        }
+                        area += cover;
+                    }
+                }
+                uint8_t* pixel = to.pixels.data() + (size_t(y) * width + x) * 4;
+                for (int channel = 0; channel < 4 && area > 0; channel += 1) {
+                    pixel[channel] = static_cast<uint8_t>(std::min(255.0, sums[channel] / area + 0.5));
+                }
+            }
+        }
+    }
+
+    // decodePng(const uint8_t* data, size_t size, Image& image) decodes a PNG entry into premultiplied pixels,
+    // or returns false; an entry that can't be decoded gives way to the next best one.
+    template <typename DecodePng>
+    bool decode_icon(const uint8_t* data, size_t size, uint32_t side, Image& image, DecodePng decodePng) {
+        std::vector<IconEntry> entries;
+        if (side == 0 || side > MAX_SIDE || !read_icon_directory(data, size, entries)) {
+            return false;
+        }
+        order_entries(entries, side);
+
+        for (const auto& entry : entries) {
+            Image decoded;
+            const bool isDecoded = entry.isPng
+                ? decodePng(data + entry.offset, size_t(entry.size), decoded)
+                : decode_dib(data + entry.offset, size_t(entry.size), decoded);
+            if (!isDecoded || decoded.width == 0 || decoded.width > MAX_SIDE || decoded.height == 0 || decoded.height > MAX_SIDE
+                || decoded.pixels.size() != size_t(decoded.width) * decoded.height * 4) {
+                continue;
+            }
+            if (decoded.width == side && decoded.height == side) {
+                image = std::move(decoded);
+            }
+            else {
+                resample(decoded, side, side, image);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    inline bool decode_icon(const uint8_t* data, size_t size, uint32_t side, Image& image) {
+        return decode_icon(data, size, side, image, [](const uint8_t*, size_t, Image&) { return false; });
+    }
+}
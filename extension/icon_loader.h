@@ -0,0 +1,193 @@
+#pragma once
+
+/*
+A few threads extracting handler icons into the cache, so a cold menu waits for its icons all at once rather than
+one after another, and for no longer than a deadline: icons that aren't there by then are left out of the menu
+and go on loading, to be put in when a popup of the menu is shown again, or by the next menu.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Extracting and caching icons is the backend's:
+IconProvider and IconCache on Windows, anything a test makes up. A backend has:
+
+    Handler             what an icon is extracted from
+    Icon                what the menu shows
+    ThreadScope         made at the start of a worker thread, gone at its end (COM on Windows)
+    GetKey(handler)     what tells handlers apart, as std::wstring
+    Find(handler)       its icon from the cache, as std::shared_ptr<const Icon>, nullptr if it isn't there
+    Extract(handler)    extracts its icon and caches it, on a worker thread
+*/
+
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace icon_loader {
+
+    using Clock = std::chrono::steady_clock;
+
+    /*
+    Workers are started as handlers are queued, up to maxThreads, and kept until TryShutdown.
+    They take handlers off one queue shared by every menu: a menu's icons go to whichever worker is free.
+    A handler is extracted once however many menus ask for it meanwhile: later ones wait for the same extraction.
+    */
+    template <typename Backend>
+    class IconLoader final {
+    public:
+        using Handler = typename Backend::Handler;
+        using Icon = typename Backend::Icon;
+
+        explicit IconLoader(size_t maxThreads)
+            : m_maxThreads(maxThreads)
+        {}
+
+        IconLoader(const IconLoader&) = delete;
+        IconLoader& operator=(const IconLoader&) = delete;
+
+        ~IconLoader() {
+            // same as the launcher's: on process exit the workers are already killed
+            for (auto& worker : m_workers) {
+                if (worker.joinable()) {
+                    worker.detach();
+                }
+            }
+        }
+
+        // Icons of the handlers, in the same order: cached ones right away, others as they are extracted,
+        // nullptr for those not extracted by the deadline.
+        std::vector<std::shared_ptr<const Icon>> Load(const std::vector<Handler>& handlers, Clock::time_point deadline) {
+            auto batch = std::make_shared<Batch>();
+            batch->icons.resize(handlers.size());
+
+            std::vector<size_t> missing;
+            for (size_t i = 0; i < handlers.size(); i += 1) {
+                batch->icons[i] = m_backend.Find(handlers[i]);
+                if (!batch->icons[i]) {
+                    missing.push_back(i);
+                }
+            }
+            if (missing.empty()) {
+                return std::move(batch->icons);
+            }
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            for (const size_t i : missing) {
+                auto& waiters = m_inFlight[m_backend.GetKey(handlers[i])];
+                if (waiters.empty()) {
+                    m_queue.push_back(handlers[i]);
+                }
+                waiters.push_back({ batch, i });
+            }
+            batch->nPending = missing.size();
+            const size_t nWanted = m_nBusy + m_queue.size();
+            while (m_workers.size() < m_maxThreads && m_workers.size() < nWanted) {
+                m_workers.emplace_back(&IconLoader::Run, this);
+                m_nStarted += 1;
+            }
+            m_wakeUp.notify_all();
+
+            batch->loaded.wait_until(lock, deadline, [&batch]() { return batch->nPending == 0; });
+            // workers still at it write into the batch under the lock, so this is a copy
+            return batch->icons;
+        }
+
+        // Stops the workers if there is nothing left to load, so the DLL can be unloaded.
+        // Returns false while there is some work left.
+        bool TryShutdown() {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_nBusy > 0 || !m_queue.empty()) {
+                    return false;
+                }
+                if (m_workers.empty()) {
+                    return true;
+                }
+                m_stopping = true;
+                m_wakeUp.notify_all();
+            }
+
+            // nobody starts workers while stopping, so the list can be gone through unlocked
+            for (auto& worker : m_workers) {
+                worker.join();
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_workers.clear();
+            m_stopping = false;
+            return true;
+        }
+
+        // workers ever started: stays put once the loader is warm
+        size_t GetStartedCount() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_nStarted;
+        }
+
+        Backend& GetBackend() {
+            return m_backend;
+        }
+
+    private:
+        // icons of one menu; shared with the workers, so an abandoned one lives until its icons are loaded
+        struct Batch {
+            std::vector<std::shared_ptr<const Icon>> icons;
+            size_t nPending = 0;
+            std::condition_variable loaded;
+        };
+
+        // an icon of a batch waiting for an extraction
+        struct Waiter {
+            std::shared_ptr<Batch> batch;
+            size_t index;
+        };
+
+        void Run() {
+            typename Backend::ThreadScope scope;
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (true) {
+                m_wakeUp.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) {
+                    break;
+                }
+
+                Handler handler = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_nBusy += 1;
+                lock.unlock();
+
+                auto icon = m_backend.Extract(handler);
+
+                lock.lock();
+                m_nBusy -= 1;
+                const auto waiters = m_inFlight.find(m_backend.GetKey(handler));
+                for (const Waiter& waiter : waiters->second) {
+                    waiter.batch->icons[waiter.index] = icon;
+                    waiter.batch->nPending -= 1;
+                    if (waiter.batch->nPending == 0) {
+                        waiter.batch->loaded.notify_all();
+                    }
+                }
+                m_inFlight.erase(waiters);
+            }
+        }
+
+        const size_t m_maxThreads;
+        Backend m_backend;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        std::deque<Handler> m_queue;
+        // handlers queued or being extracted -> icons waiting for them
+        std::unordered_map<std::wstring, std::vector<Waiter>> m_inFlight;
+        size_t m_nBusy = 0;
+        size_t m_nStarted = 0;
+        bool m_stopping = false;
+        std::vector<std::thread> m_workers;
+    };
+}
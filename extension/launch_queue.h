@@ -0,0 +1,201 @@
+#pragma once
+
+/*
+Queue of handler launches, so InvokeCommand returns right away and Explorer window that asked for a launch
+isn't frozen by a slow target (network share, UAC prompt, cold disk).
+
+Plain C++ with no Windows types in it, like catalog_format.h. Launching is the backend's: ShellExecuteEx
+on Windows, anything a test makes up. A backend has:
+
+    ThreadScope         made at the start of every thread that launches, gone at its end (COM on Windows)
+    Launch(request)     launches the request and, if it has to, waits for its processes;
+                        called from several threads at once
+*/
+
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace launch_queue {
+
+    struct LaunchRequest {
+        std::wstring verb;
+        std::wstring file;
+        // the file is launched once per command line
+        std::vector<std::wstring> commandLines;
+        // how many of those launches may run at once, 0 means no limit
+        size_t maxProcesses = 0;
+        // list file written for the launch, deleted once the handler exits
+        std::wstring listFilePath;
+        // run by the worker as it takes the request up, for bookkeeping that has no business on the UI thread
+        std::function<void()> onStarted;
+
+        // a request waiting for its processes to exit gets a thread of its own, so the queue behind it keeps moving
+        bool MustWait() const {
+            return !listFilePath.empty() || (maxProcesses > 0 && commandLines.size() > maxProcesses);
+        }
+    };
+
+    /*
+    Requests are launched in order by one worker, up to MAX_QUEUED_REQUESTS of them waiting.
+    The worker is started by the first request and stopped by TryShutdown once there is nothing left,
+    a request coming while it's being stopped starts it anew.
+    */
+    template <typename Backend>
+    class LaunchQueue final {
+    public:
+        static constexpr size_t MAX_QUEUED_REQUESTS = 64;
+
+        LaunchQueue() = default;
+
+        LaunchQueue(const LaunchQueue&) = delete;
+        LaunchQueue& operator=(const LaunchQueue&) = delete;
+
+        ~LaunchQueue() {
+            // Can only get here on process exit with the workers still around, they're already killed by then:
+            // joining them would never return.
+            if (m_worker.joinable()) {
+                m_worker.detach();
+            }
+            for (auto& job : m_jobs) {
+                job.thread.detach();
+            }
+        }
+
+        // returns false if the queue is full
+        bool Enqueue(LaunchRequest&& request) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_queue.size() >= MAX_QUEUED_REQUESTS) {
+                return false;
+            }
+
+            m_queue.push_back(std::move(request));
+            // while the worker is being stopped it's TryShutdown that starts the next one
+            if (!m_worker.joinable() && !m_stopping) {
+                m_worker = std::thread(&LaunchQueue::Run, this);
+            }
+            m_wakeUp.notify_one();
+            return true;
+        }
+
+        // Stops the worker if there is nothing left to launch, so the DLL can be unloaded.
+        // Returns false while there is some work left.
+        bool TryShutdown() {
+            std::thread worker;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_stopping || m_busy || !m_queue.empty() || m_nRunningJobs > 0) {
+                    return false;
+                }
+                JoinFinishedJobs();
+                if (!m_worker.joinable()) {
+                    return true;
+                }
+                m_stopping = true;
+                m_wakeUp.notify_one();
+                worker = std::move(m_worker);
+            }
+
+            worker.join();
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = false;
+            // came while the worker was on its way out
+            if (!m_queue.empty()) {
+                m_worker = std::thread(&LaunchQueue::Run, this);
+                return false;
+            }
+            return true;
+        }
+
+        // the backend launches from several threads, whatever is set up on it should be before the first request
+        Backend& GetBackend() {
+            return m_backend;
+        }
+
+    private:
+        struct Job {
+            std::thread thread;
+            bool isFinished = false;
+        };
+
+        void Run() {
+            typename Backend::ThreadScope scope;
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (true) {
+                m_wakeUp.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) {
+                    break;
+                }
+
+                LaunchRequest request = std::move(m_queue.front());
+                m_queue.pop_front();
+                if (request.onStarted) {
+                    m_busy = true;
+                    lock.unlock();
+                    request.onStarted();
+                    lock.lock();
+                    m_busy = false;
+                }
+                if (request.MustWait()) {
+                    JoinFinishedJobs();
+                    m_nRunningJobs += 1;
+                    m_jobs.emplace_back();
+                    Job& job = m_jobs.back();
+                    job.thread = std::thread(&LaunchQueue::RunJob, this, std::move(request), &job);
+                    continue;
+                }
+                m_busy = true;
+                lock.unlock();
+
+                m_backend.Launch(request);
+
+                lock.lock();
+                m_busy = false;
+            }
+        }
+
+        void RunJob(LaunchRequest request, Job* job) {
+            {
+                typename Backend::ThreadScope scope;
+                m_backend.Launch(request);
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            job->isFinished = true;
+            m_nRunningJobs -= 1;
+        }
+
+        // forgets threads of jobs that are done; called with the lock held
+        void JoinFinishedJobs() {
+            for (auto job = m_jobs.begin(); job != m_jobs.end();) {
+                if (job->isFinished) {
+                    job->thread.join();
+                    job = m_jobs.erase(job);
+                }
+                else {
+                    ++job;
+                }
+            }
+        }
+
+        Backend m_backend;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        std::deque<LaunchRequest> m_queue;
+        bool m_busy = false;
+        bool m_stopping = false;
+        std::thread m_worker;
+        // per-item launches waiting for their processes, each on a thread of its own
+        std::list<Job> m_jobs;
+        size_t m_nRunningJobs = 0;
+    };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+Launching a handler once per selected item, at most so many processes at once: 5,000 selected files
+are converted N at a time, rather than all at once or one after another.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Starting and waiting for processes is
+the spawner's: ShellExecuteEx and WaitForMultipleObjects on Windows, posix_spawn and waitpid on Linux.
+A spawner has:
+
+    Process                                 what a running process is known by
+    Spawn(arguments, keepProcess, process)  starts one, setting process if keepProcess, returns Spawned
+    WaitForAny(processes)                   waits for one of them to exit, returns its index
+    Close(process)                          the process is no longer waited for
+*/
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace launch_scheduler {
+
+    enum class Spawned {
+        Started,
+        // handed over to an already running process, there is nothing to wait for
+        HandedOver,
+        Failed,
+        // the user said no (cancelled UAC prompt), launches after it are not even tried
+        Cancelled
+    };
+
+    // waits for any of the processes to exit and forgets it
+    template <typename Spawner>
+    void forget_exited(std::vector<typename Spawner::Process>& running, Spawner& spawner) {
+        const size_t index = spawner.WaitForAny(running);
+        spawner.Close(running[index]);
+        running.erase(running.begin() + index);
+    }
+
+    /*
+    Spawns the process once per command line, never more than maxProcesses of them running at once
+    (0 means no limit), and with waitForAll waits for every one of them to exit.
+    Returns false if some launch was handed over, so waiting for all of them didn't mean they are done.
+    */
+    template <typename Spawner>
+    bool run_launches(const std::vector<std::wstring>& commandLines, size_t maxProcesses, bool waitForAll, Spawner& spawner) {
+        const bool keepProcesses = maxProcesses > 0 || waitForAll;
+        std::vector<typename Spawner::Process> running;
+        bool isHandedOver = false;
+
+        for (const auto& arguments : commandLines) {
+            if (maxProcesses > 0 && running.size() >= maxProcesses) {
+                forget_exited(running, spawner);
+            }
+
+            typename Spawner::Process process{};
+            const Spawned spawned = spawner.Spawn(arguments, keepProcesses, process);
+            if (spawned == Spawned::Cancelled) {
+                break;
+            }
+            if (spawned == Spawned::Started && keepProcesses) {
+                running.push_back(process);
+            }
+            isHandedOver = isHandedOver || spawned == Spawned::HandedOver;
+        }
+
+        if (waitForAll) {
+            while (!running.empty()) {
+                forget_exited(running, spawner);
+            }
+        }
+        for (const auto& process : running) {
+            spawner.Close(process);
+        }
+        return !isHandedOver;
+    }
+}
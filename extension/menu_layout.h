@@ -0,0 +1,197 @@
+#pragma once
+
+/*
+Layout of the "My Open with" popup: which handlers it shows, in which sections and groups, under which command
+offsets, and where separators and submenus go. The menu itself (items, icons, HMENUs) is left to the caller.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Handlers and folders are the caller's own types:
+the walk asks a source for them (see AddSection), the menu is given to a builder (see Materialize).
+*/
+
+#include "fingerprint_set.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace menu_layout {
+
+    // Items in the order they are shown: by score, highest first, if there are any; items scored the same
+    // (never used ones, for a start) stay in the order they were given.
+    template <typename Item, typename GetScore>
+    std::vector<Item> rank_by_score(const std::vector<Item>& items, GetScore getScore) {
+        std::vector<std::pair<double, Item>> ranked;
+        ranked.reserve(items.size());
+        for (const auto& item : items) {
+            ranked.emplace_back(getScore(item), item);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+
+        std::vector<Item> sorted;
+        sorted.reserve(ranked.size());
+        for (const auto& item : ranked) {
+            sorted.push_back(item.second);
+        }
+        return sorted;
+    }
+
+    /*
+    Sections of handlers, from the most specific to the least specific one, each followed by a separator,
+    and "Open handlers folder" at the very bottom. A section can be shown as a submenu, consecutive submenus
+    aren't separated. Subfolders of a section's folder are nested submenus of that section, shown ahead of
+    the folder's own handlers, the way Explorer lists folders before files.
+    Command offsets are given to handlers in the order they are added: a folder's handlers, then its groups',
+    so an offset is an index of a handler, and the first offset past the handlers belongs to "Open handlers folder".
+    */
+    class MenuLayout final {
+    public:
+        void Reset(size_t maxCommands) {
+            m_maxCommands = maxCommands;
+            m_nHandlers = 0;
+            m_isTruncated = false;
+            m_sections.clear();
+            m_shown.Clear(maxCommands);
+        }
+
+        /*
+        Adds a section of the folder's handlers and its groups. Handlers that don't fit into the command offsets
+        are dropped, so are ones doing the same as a handler added before: sections come from the most specific,
+        so the most specific one of duplicates stays. The source has:
+
+            Rank(folder)                handlers of the folder, in the order they are shown
+            GetFingerprint(handler)     handlers with equal fingerprints do the same thing
+            Add(handler)                the handler is in, under the next command offset
+            ForEachGroup(folder, f)     calls f(title, subfolder) for every subfolder shown as a group
+        */
+        template <typename Source, typename Folder>
+        void AddSection(Source& source, const Folder& folder, const std::wstring& submenuTitle = std::wstring()) {
+            Section section;
+            section.submenuTitle = submenuTitle;
+            AddHandlers(source, folder, section.content);
+            if (!section.content.IsEmpty()) {
+                m_sections.push_back(std::move(section));
+            }
+        }
+
+        /*
+        Gives the menu to the builder, top to bottom:
+
+            BeginSubmenu(title)     items up to the matching EndSubmenu go into a submenu
+            EndSubmenu()
+            AddHandler(offset)      the handler added under this command offset
+            AddSeparator()
+            AddOpenFolder(offset)   "Open handlers folder", always the last one
+        */
+        template <typename Builder>
+        void Materialize(Builder& builder) const {
+            for (size_t sectionIndex = 0; sectionIndex < m_sections.size(); sectionIndex += 1) {
+                const Section& section = m_sections[sectionIndex];
+                const bool isSubmenu = !section.submenuTitle.empty();
+                if (isSubmenu) {
+                    builder.BeginSubmenu(section.submenuTitle);
+                }
+                MaterializeGroup(builder, section.content);
+                if (isSubmenu) {
+                    builder.EndSubmenu();
+                }
+
+                const bool nextIsSubmenu = sectionIndex + 1 < m_sections.size() && !m_sections[sectionIndex + 1].submenuTitle.empty();
+                if (!(isSubmenu && nextIsSubmenu)) {
+                    builder.AddSeparator();
+                }
+            }
+            builder.AddOpenFolder(m_nHandlers);
+        }
+
+        size_t GetHandlersCount() const {
+            return m_nHandlers;
+        }
+
+        // command offsets the menu takes: its handlers and "Open handlers folder"
+        size_t GetUsedCommandsCount() const {
+            return m_nHandlers + 1;
+        }
+
+        size_t GetSectionsCount() const {
+            return m_sections.size();
+        }
+
+        // some handlers were left out for want of command offsets
+        bool IsTruncated() const {
+            return m_isTruncated;
+        }
+
+    private:
+        // handlers of one folder, [handlersBegin, handlersEnd) of the offsets, and its subfolders
+        struct Group {
+            std::wstring title;
+            size_t handlersBegin = 0;
+            size_t handlersEnd = 0;
+            std::vector<Group> groups;
+
+            bool IsEmpty() const {
+                return handlersBegin == handlersEnd && groups.empty();
+            }
+        };
+
+        struct Section {
+            Group content;
+            std::wstring submenuTitle;
+        };
+
+        bool IsFull() const {
+            // one offset is always kept for "Open handlers folder"
+            const size_t maxHandlers = m_maxCommands > 0 ? m_maxCommands - 1 : 0;
+            return m_nHandlers >= maxHandlers;
+        }
+
+        template <typename Source, typename Folder>
+        void AddHandlers(Source& source, const Folder& folder, Group& to) {
+            to.handlersBegin = m_nHandlers;
+            for (const auto& handler : source.Rank(folder)) {
+                if (IsFull()) {
+                    m_isTruncated = true;
+                    break;
+                }
+                if (!m_shown.Insert(source.GetFingerprint(handler))) {
+                    continue;
+                }
+                source.Add(handler);
+                m_nHandlers += 1;
+            }
+            to.handlersEnd = m_nHandlers;
+
+            source.ForEachGroup(folder, [this, &source, &to](const std::wstring& title, const auto& subfolder) {
+                Group group;
+                group.title = title;
+                AddHandlers(source, subfolder, group);
+                if (!group.IsEmpty()) {
+                    to.groups.push_back(std::move(group));
+                }
+            });
+        }
+
+        template <typename Builder>
+        void MaterializeGroup(Builder& builder, const Group& content) const {
+            for (const auto& group : content.groups) {
+                builder.BeginSubmenu(group.title);
+                MaterializeGroup(builder, group);
+                builder.EndSubmenu();
+            }
+            for (size_t offset = content.handlersBegin; offset < content.handlersEnd; offset += 1) {
+                builder.AddHandler(offset);
+            }
+        }
+
+        size_t m_maxCommands = 0;
+        size_t m_nHandlers = 0;
+        bool m_isTruncated = false;
+        std::vector<Section> m_sections;
+        fingerprint_set::FingerprintSet m_shown;
+    };
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+Storage for the paths of the selected items, which every menu build goes through several times:
+classifying them, matching patterns, sniffing types, and launching handlers with them.
+
+Plain C++ with no Windows types in it, like catalog_format.h.
+*/
+
+#include <cstddef>
+#include <cwchar>
+#include <string_view>
+#include <vector>
+
+namespace path_arena {
+
+    /*
+    Selected items paths, stored back to back in one buffer (each one followed by 0),
+    so a selection of thousands items costs a few allocations instead of one per item,
+    and none at all once the buffer has grown to the size selections usually are.
+    */
+    class PathArena final {
+    public:
+        static constexpr size_t INITIAL_CAPACITY = 4096;
+
+        // keeps the memory for the next selection
+        void Reset() {
+            m_chars.clear();
+            m_paths.clear();
+            m_nAllocations = 0;
+            m_peakBytes = m_chars.capacity() * sizeof(wchar_t) + m_paths.capacity() * sizeof(Span);
+        }
+
+        // returns space for `length` characters (0 terminator is added by the arena),
+        // valid until the next Allocate or Reset
+        wchar_t* Allocate(size_t length) {
+            const size_t needed = m_chars.size() + length + 1;
+            if (needed > m_chars.capacity()) {
+                m_chars.reserve(needed > 2 * m_chars.capacity() ? needed + INITIAL_CAPACITY : 2 * m_chars.capacity());
+                m_nAllocations += 1;
+            }
+            if (m_paths.size() == m_paths.capacity()) {
+                m_nAllocations += 1;
+            }
+
+            const size_t offset = m_chars.size();
+            m_chars.resize(needed, 0);
+            m_paths.push_back({ offset, length });
+
+            const size_t bytes = m_chars.capacity() * sizeof(wchar_t) + m_paths.capacity() * sizeof(Span);
+            m_peakBytes = bytes > m_peakBytes ? bytes : m_peakBytes;
+
+            return m_chars.data() + offset;
+        }
+
+        void Append(const wchar_t* path, size_t length) {
+            wmemcpy(Allocate(length), path, length);
+        }
+
+        size_t size() const {
+            return m_paths.size();
+        }
+
+        bool empty() const {
+            return m_paths.empty();
+        }
+
+        std::wstring_view operator[](size_t i) const {
+            return std::wstring_view(m_chars.data() + m_paths[i].offset, m_paths[i].length);
+        }
+
+        const wchar_t* CStr(size_t i) const {
+            return m_chars.data() + m_paths[i].offset;
+        }
+
+        size_t GetAllocationsCount() const {
+            return m_nAllocations;
+        }
+
+        size_t GetPeakBytes() const {
+            return m_peakBytes;
+        }
+
+    private:
+        struct Span {
+            size_t offset;
+            size_t length;
+        };
+
+        std::vector<wchar_t> m_chars;
+        std::vector<Span> m_paths;
+
+        size_t m_nAllocations = 0;
+        size_t m_peakBytes = 0;
+    };
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+The two loops every menu build runs over every selected path: finding where the file name and its extension start,
+and upper-casing extensions and names before they are looked up.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Both work on any character type; for 16 bit ones
+(wchar_t on Windows, char16_t anywhere) they take 8 characters at a time where SSE2 is there.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+// 8 UTF-16 code units at a time where SSE2 is there, one by one elsewhere (ARM64)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PATH_KERNELS_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace path_kernels {
+
+    // Positions of the last path separator and of the last dot after it, npos if there is none
+    struct PathMarks {
+        size_t lastSeparator = std::string_view::npos;
+        size_t lastDot = std::string_view::npos;
+    };
+
+#ifdef PATH_KERNELS_SSE2
+    // index of the highest set bit, mask must not be 0
+    inline unsigned highest_bit(unsigned mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, mask);
+        return index;
+#else
+        return 31 - __builtin_clz(mask);
+#endif
+    }
+#endif
+
+    template <typename Char>
+    PathMarks find_path_marks(std::basic_string_view<Char> path) {
+        PathMarks marks;
+        size_t end = path.size();
+#ifdef PATH_KERNELS_SSE2
+        if constexpr (sizeof(Char) == 2) {
+            const __m128i backslashes = _mm_set1_epi16('\\');
+            const __m128i slashes = _mm_set1_epi16('/');
+            const __m128i dots = _mm_set1_epi16('.');
+            for (; end >= 8; end -= 8) {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(path.data() + end - 8));
+                // two mask bits per character
+                const unsigned separatorBits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(chars, backslashes), _mm_cmpeq_epi16(chars, slashes)));
+                unsigned dotBits = _mm_movemask_epi8(_mm_cmpeq_epi16(chars, dots));
+                if (separatorBits != 0) {
+                    const unsigned separatorBit = highest_bit(separatorBits);
+                    marks.lastSeparator = end - 8 + separatorBit / 2;
+                    // dots before the separator belong to folder names
+                    dotBits &= ~((2u << separatorBit) - 1);
+                }
+                if (marks.lastDot == std::string_view::npos && dotBits != 0) {
+                    marks.lastDot = end - 8 + highest_bit(dotBits) / 2;
+                }
+                if (marks.lastSeparator != std::string_view::npos) {
+                    return marks;
+                }
+            }
+        }
+#endif
+        while (end > 0) {
+            end -= 1;
+            if (path[end] == Char('\\') || path[end] == Char('/')) {
+                marks.lastSeparator = end;
+                break;
+            }
+            else if (path[end] == Char('.') && marks.lastDot == std::string_view::npos) {
+                marks.lastDot = end;
+            }
+        }
+        return marks;
+    }
+
+    // Where the file name starts: right after the last path separator, 0 if there is none
+    template <typename Char>
+    size_t find_filename_start(std::basic_string_view<Char> path) {
+        const size_t separator = find_path_marks(path).lastSeparator;
+        return separator == std::string_view::npos ? 0 : separator + 1;
+    }
+
+    // Upper-cases ASCII letters in place. Returns false at the first non ASCII character,
+    // leaving what's folded so far folded.
+    template <typename Char>
+    bool fold_ascii(Char* text, size_t length) {
+        size_t i = 0;
+#ifdef PATH_KERNELS_SSE2
+        if constexpr (sizeof(Char) == 2) {
+            const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const __m128i beforeA = _mm_set1_epi16('a' - 1);
+            const __m128i afterZ = _mm_set1_epi16('z' + 1);
+            const __m128i caseBit = _mm_set1_epi16('a' - 'A');
+            const __m128i zero = _mm_setzero_si128();
+            for (; i + 8 <= length; i += 8) {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+                if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, nonAscii), zero))) {
+                    return false;
+                }
+                // all of them are below 0x80 now, so signed comparisons are fine
+                const __m128i lower = _mm_and_si128(_mm_cmpgt_epi16(chars, beforeA), _mm_cmplt_epi16(chars, afterZ));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(text + i), _mm_sub_epi16(chars, _mm_and_si128(lower, caseBit)));
+            }
+        }
+#endif
+        for (; i < length; i += 1) {
+            if (static_cast<uint32_t>(text[i]) >= 0x80) {
+                return false;
+            }
+            if (text[i] >= Char('a') && text[i] <= Char('z')) {
+                text[i] -= Char('a' - 'A');
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+All file name patterns of "Files by Pattern" compiled into one automaton, so a file name is matched
+against any number of patterns in a single pass over its characters.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Case folding beyond ASCII is the caller's:
+the matcher is given the function it folds characters with.
+*/
+
+#include "path_kernels.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pattern_matcher {
+
+    // upper-cases ASCII, leaves the rest as it is
+    inline wchar_t fold_ascii_char(wchar_t c) {
+        return (c >= L'a' && c <= L'z') ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+    }
+
+    /*
+    Patterns are globs: "%" (or "*") matches any run of characters, "?" any single character, the rest
+    matches itself, case insensitive. As Windows doesn't allow "*" and "?" in file names, folders use "%".
+    A pattern has to match the whole file name, not a part of it, and the folders the file is in don't count.
+    The DFA is built lazily, state by state, as names need them: subset construction ahead of time
+    can blow up with many "%" patterns. Not thread safe.
+    */
+    class PatternMatcher final {
+    public:
+        using FoldChar = wchar_t (*)(wchar_t);
+
+        // beyond that many DFA states the cache is dropped and built anew
+        static constexpr size_t MAX_CACHED_STATES = 16384;
+
+        explicit PatternMatcher(const std::vector<std::wstring>& patterns, FoldChar foldChar = fold_ascii_char)
+            : m_foldChar(foldChar)
+        {
+            // characters patterns mention get classes of their own, the rest share class 0
+            std::unordered_map<wchar_t, unsigned short> classes;
+            for (const auto& pattern : patterns) {
+                for (const wchar_t c : pattern) {
+                    if (!IsWildcard(c)) {
+                        classes.emplace(m_foldChar(c), static_cast<unsigned short>(classes.size() + 1));
+                    }
+                }
+            }
+            m_classes = std::move(classes);
+            m_nClasses = m_classes.size() + 1;
+
+            for (const auto& pattern : patterns) {
+                std::vector<Token> tokens;
+                for (const wchar_t c : pattern) {
+                    if (c == L'%' || c == L'*') {
+                        if (tokens.empty() || tokens.back().kind != Token::AnyRun) {
+                            tokens.push_back({ Token::AnyRun, 0 });
+                        }
+                    }
+                    else if (c == L'?') {
+                        tokens.push_back({ Token::AnyChar, 0 });
+                    }
+                    else {
+                        tokens.push_back({ Token::Literal, m_classes[m_foldChar(c)] });
+                    }
+                }
+                m_patterns.push_back(std::move(tokens));
+            }
+
+            Reset();
+        }
+
+        size_t GetPatternsCount() const {
+            return m_patterns.size();
+        }
+
+        // DFA states built so far
+        size_t GetStatesCount() const {
+            return m_states.size();
+        }
+
+        // Indexes of patterns that every one of the names matches; paths are any container of wide strings
+        template <typename Paths>
+        std::vector<size_t> FindCommonMatches(const Paths& paths) {
+            if (m_states.size() > MAX_CACHED_STATES) {
+                Reset();
+            }
+
+            std::vector<unsigned long long> common((m_patterns.size() + 63) / 64, ~0ULL);
+            for (size_t i = 0; i < paths.size(); i += 1) {
+                const std::wstring_view path = paths[i];
+                const size_t separator = path_kernels::find_path_marks(path).lastSeparator;
+                const auto& matches = m_states[Run(path.substr(separator == std::wstring_view::npos ? 0 : separator + 1))].matches;
+
+                bool anyLeft = false;
+                for (size_t word = 0; word < common.size(); word += 1) {
+                    common[word] &= matches[word];
+                    anyLeft |= common[word] != 0;
+                }
+                if (!anyLeft) {
+                    return {};
+                }
+            }
+
+            std::vector<size_t> result;
+            for (size_t pattern = 0; pattern < m_patterns.size(); pattern += 1) {
+                if (common[pattern / 64] & (1ULL << (pattern % 64))) {
+                    result.push_back(pattern);
+                }
+            }
+            return result;
+        }
+
+    private:
+        struct Token {
+            enum Kind { Literal, AnyChar, AnyRun } kind;
+            unsigned short charClass;
+        };
+
+        // NFA state is a position in a pattern: (pattern index << 32) | token index
+        using Position = unsigned long long;
+
+        struct DfaState {
+            std::vector<Position> positions;
+            // next state per character class, -1 until needed
+            std::vector<int> next;
+            // bit per pattern that is fully matched in this state
+            std::vector<unsigned long long> matches;
+        };
+
+        static bool IsWildcard(wchar_t c) {
+            return c == L'%' || c == L'*' || c == L'?';
+        }
+
+        void Reset() {
+            m_states.clear();
+            m_stateIds.clear();
+
+            std::vector<Position> start;
+            for (size_t pattern = 0; pattern < m_patterns.size(); pattern += 1) {
+                start.push_back(static_cast<Position>(pattern) << 32);
+            }
+            AddState(std::move(start));
+        }
+
+        // returns the state after the whole name
+        int Run(std::wstring_view name) {
+            int state = 0;
+            for (const wchar_t c : name) {
+                if (m_states[state].positions.empty()) {
+                    // nothing can match anymore
+                    break;
+                }
+                state = Step(state, ClassOf(c));
+            }
+            return state;
+        }
+
+        unsigned short ClassOf(wchar_t c) const {
+            const auto found = m_classes.find(m_foldChar(c));
+            return found == m_classes.end() ? 0 : found->second;
+        }
+
+        int Step(int state, unsigned short charClass) {
+            const int cached = m_states[state].next[charClass];
+            if (cached >= 0) {
+                return cached;
+            }
+
+            std::vector<Position> next;
+            for (const Position position : m_states[state].positions) {
+                const auto& tokens = m_patterns[position >> 32];
+                const size_t tokenIndex = position & 0xFFFFFFFF;
+                if (tokenIndex == tokens.size()) {
+                    continue;
+                }
+
+                const Token& token = tokens[tokenIndex];
+                if (token.kind == Token::AnyRun) {
+                    next.push_back(position);
+                }
+                else if (token.kind == Token::AnyChar || token.charClass == charClass) {
+                    next.push_back(position + 1);
+                }
+            }
+
+            const int nextState = AddState(std::move(next));
+            m_states[state].next[charClass] = nextState;
+            return nextState;
+        }
+
+        int AddState(std::vector<Position> positions) {
+            // "%" can match nothing, so a position before it is also a position after it
+            for (size_t i = 0; i < positions.size(); i += 1) {
+                const auto& tokens = m_patterns[positions[i] >> 32];
+                const size_t tokenIndex = positions[i] & 0xFFFFFFFF;
+                if (tokenIndex < tokens.size() && tokens[tokenIndex].kind == Token::AnyRun) {
+                    positions.push_back(positions[i] + 1);
+                }
+            }
+            std::sort(positions.begin(), positions.end());
+            positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+            const auto found = m_stateIds.find(positions);
+            if (found != m_stateIds.end()) {
+                return found->second;
+            }
+
+            DfaState state;
+            state.next.assign(m_nClasses, -1);
+            state.matches.assign((m_patterns.size() + 63) / 64, 0);
+            for (const Position position : positions) {
+                const size_t pattern = position >> 32;
+                if ((position & 0xFFFFFFFF) == m_patterns[pattern].size()) {
+                    state.matches[pattern / 64] |= 1ULL << (pattern % 64);
+                }
+            }
+            state.positions = positions;
+
+            const int id = static_cast<int>(m_states.size());
+            m_states.push_back(std::move(state));
+            m_stateIds.emplace(std::move(positions), id);
+            return id;
+        }
+
+    private:
+        FoldChar m_foldChar;
+        std::unordered_map<wchar_t, unsigned short> m_classes;
+        size_t m_nClasses = 1;
+        std::vector<std::vector<Token>> m_patterns;
+
+        std::vector<DfaState> m_states;
+        std::map<std::vector<Position>, int> m_stateIds;
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+Warm-up of the caches in the background, started as soon as the DLL is loaded: by the time the first menu
+is built handler folders are listed and their icons extracted, so even the first right-click is served
+from memory.
+
+Plain C++ with no Windows types in it, like catalog_format.h. What is warmed up is the backend's.
+A backend has:
+
+    ThreadScope     made at the start of the warm-up thread, gone at its end (priority and COM on Windows)
+    WarmUp()        fills the caches menus are built from
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace prewarmer {
+
+    /*
+    A menu built while the warm-up is running waits for it a little: whatever the warm-up has put
+    into the caches by the time it's done, the menu finds there. A menu that can't wait any longer
+    is built cold, filling the caches itself.
+    */
+    template <typename Backend>
+    class Prewarmer final {
+    public:
+        Prewarmer() = default;
+
+        Prewarmer(const Prewarmer&) = delete;
+        Prewarmer& operator=(const Prewarmer&) = delete;
+
+        ~Prewarmer() {
+            // same as the launcher's: on process exit the thread is already gone
+            if (m_worker.joinable()) {
+                m_worker.detach();
+            }
+        }
+
+        // only the first call does anything
+        void Start() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_state != State::NotStarted) {
+                return;
+            }
+            m_state = State::Running;
+            m_worker = std::thread(&Prewarmer::Run, this);
+        }
+
+        // Waits at most timeout for the warm-up to finish. Returns (and counts) whether the menu is built warm.
+        bool WaitUntilWarm(std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_warmedUp.wait_for(lock, timeout, [this]() { return m_state != State::Running; });
+            const bool isWarm = m_state == State::Done;
+            if (isWarm) {
+                m_nWarmMenus += 1;
+            }
+            else {
+                m_nColdMenus += 1;
+            }
+            return isWarm;
+        }
+
+        // Joins the finished warm-up thread, so the DLL can be unloaded. Returns false while it's still running.
+        bool TryShutdown() {
+            std::thread worker;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_state == State::Running) {
+                    return false;
+                }
+                worker = std::move(m_worker);
+            }
+            if (worker.joinable()) {
+                worker.join();
+            }
+            return true;
+        }
+
+        unsigned long long GetWarmMenus() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_nWarmMenus;
+        }
+
+        unsigned long long GetColdMenus() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_nColdMenus;
+        }
+
+        // the warm-up runs on its own thread, whatever is set up on the backend should be before Start
+        Backend& GetBackend() {
+            return m_backend;
+        }
+
+    private:
+        enum class State {
+            NotStarted,
+            Running,
+            Done
+        };
+
+        void Run() {
+            {
+                typename Backend::ThreadScope scope;
+                m_backend.WarmUp();
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_state = State::Done;
+            m_warmedUp.notify_all();
+        }
+
+        Backend m_backend;
+
+        std::mutex m_lock;
+        std::condition_variable m_warmedUp;
+        State m_state = State::NotStarted;
+        unsigned long long m_nWarmMenus = 0;
+        unsigned long long m_nColdMenus = 0;
+        std::thread m_worker;
+    };
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+/*
+What kinds of things are selected: files, folders, which extensions. Every menu build starts with it,
+and with thousands of items selected it's the slow part, so it stops as soon as the answer can't change,
+lists folders instead of looking items up one by one, and splits the work between a few threads.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Looking at the disk is the file system's:
+file attributes on Windows, anything a test makes up. A file system has:
+
+    IsDirectory(path)                       whether the item is a folder, path is 0 terminated
+    ListSiblings(folder, maxEntries)        std::unique_ptr<Listing> of the folder (ending with a separator),
+                                            listing up to maxEntries entries of it
+    Listing::IsDirectory(name, isDirectory) false if the name wasn't listed, called from several threads
+*/
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "extension_atoms.h"
+#include "path_arena.h"
+#include "path_kernels.h"
+#include "suffix_trie.h"
+
+namespace selection_classifier {
+
+    using extension_atoms::Atom;
+    using extension_atoms::ExtensionAtoms;
+    using path_arena::PathArena;
+    using suffix_trie::SuffixTrie;
+
+    // beyond that many different extensions a selection is treated as having no particular extension
+    constexpr size_t MAX_DISTINCT_EXTENSIONS = 1024;
+
+    // What kinds of things are selected
+    struct SelectionKinds {
+        bool haveExtensionlessFiles = false;
+        bool haveFolders = false;
+        bool haveFiles = false;
+        bool haveTooManyExtensions = false;
+        // some files have an extension no folder is named after, so it has no handlers
+        bool haveExtensionsWithoutFolder = false;
+        // distinct extensions of selected files
+        std::unordered_set<Atom> extensions;
+
+        // once there are both files and folders nothing else matters: only Everything is eligible
+        bool IsDecided() const {
+            return haveFiles && haveFolders;
+        }
+
+        void AddFolder() {
+            haveFolders = true;
+        }
+
+        // knownExtensions are those that have handlers, compound ones (".tar.gz") included
+        void AddFile(std::wstring_view path, const SuffixTrie& knownExtensions, const ExtensionAtoms& atoms) {
+            haveFiles = true;
+
+            // ok what kind of file are you? do you have an extension?
+            std::wstring_view extension;
+            if (const size_t knownLength = knownExtensions.FindLongestSuffix(path)) {
+                extension = path.substr(path.size() - knownLength);
+            }
+            else {
+                const size_t dot = path_kernels::find_path_marks(path).lastDot;
+                if (dot == std::wstring_view::npos) {
+                    haveExtensionlessFiles = true;
+                    return;
+                }
+                extension = path.substr(dot);
+            }
+
+            Atom atom;
+            if (atoms.Find(extension, atom)) {
+                AddExtension(atom);
+            }
+            else {
+                haveExtensionsWithoutFolder = true;
+            }
+        }
+
+        void Merge(const SelectionKinds& other) {
+            haveExtensionlessFiles |= other.haveExtensionlessFiles;
+            haveFolders |= other.haveFolders;
+            haveFiles |= other.haveFiles;
+            haveTooManyExtensions |= other.haveTooManyExtensions;
+            haveExtensionsWithoutFolder |= other.haveExtensionsWithoutFolder;
+            for (const Atom extension : other.extensions) {
+                AddExtension(extension);
+            }
+        }
+
+    private:
+        void AddExtension(Atom extension) {
+            if (extensions.size() < MAX_DISTINCT_EXTENSIONS) {
+                extensions.insert(extension);
+            }
+            else if (extensions.find(extension) == extensions.end()) {
+                haveTooManyExtensions = true;
+            }
+        }
+    };
+
+    /*
+    Lists parent folder once for large runs of siblings instead of asking attributes of every one of them.
+    The first SIBLINGS_LISTING_THRESHOLD items of a run are always looked up one by one, the listing only
+    starts if they haven't decided the answer. Chunks of the selection are classified by the runner
+    (a worker_pool::WorkerPool, or anything with the same Run).
+    */
+    class SelectionClassifier final {
+    public:
+        static constexpr size_t SIBLINGS_LISTING_THRESHOLD = 64;
+        // the listing stops at that many entries for every item of the run
+        static constexpr size_t LISTED_ENTRIES_PER_ITEM = 16;
+        static constexpr size_t CHUNK_SIZE = 1024;
+        static constexpr size_t MAX_THREADS = 4;
+
+        template <typename FileSystem, typename Runner>
+        static SelectionKinds Classify(const PathArena& paths, const SuffixTrie& knownExtensions, const ExtensionAtoms& atoms,
+            FileSystem& fileSystem, Runner& runner)
+        {
+            using Listing = typename decltype(fileSystem.ListSiblings(std::wstring(), 0))::element_type;
+
+            struct Chunk {
+                size_t first;
+                size_t last;
+                // first item of the run of siblings the chunk is part of
+                size_t runStart;
+                Listing* listing;
+            };
+
+            // split selection into runs of siblings, and runs into chunks
+            std::vector<Chunk> chunks;
+            std::vector<std::unique_ptr<Listing>> listings;
+            for (size_t runStart = 0; runStart < paths.size();) {
+                const auto parentLength = path_kernels::find_filename_start(paths[runStart]);
+                auto runEnd = runStart + 1;
+                while (runEnd < paths.size()
+                    && path_kernels::find_filename_start(paths[runEnd]) == parentLength
+                    && paths[runEnd].substr(0, parentLength) == paths[runStart].substr(0, parentLength)) {
+                    runEnd += 1;
+                }
+
+                Listing* listing = nullptr;
+                if (runEnd - runStart > SIBLINGS_LISTING_THRESHOLD && parentLength > 0) {
+                    const size_t maxEntries = (runEnd - runStart) * LISTED_ENTRIES_PER_ITEM;
+                    listings.push_back(fileSystem.ListSiblings(std::wstring(paths[runStart].substr(0, parentLength)), maxEntries));
+                    listing = listings.back().get();
+                }
+
+                for (auto chunkStart = runStart; chunkStart < runEnd; chunkStart += CHUNK_SIZE) {
+                    chunks.push_back({ chunkStart, chunkStart + CHUNK_SIZE < runEnd ? chunkStart + CHUNK_SIZE : runEnd, runStart, listing });
+                }
+                runStart = runEnd;
+            }
+
+            std::atomic<bool> decided{ false };
+            std::vector<SelectionKinds> results(chunks.size());
+            auto classifyChunk = [&](size_t chunkIndex) {
+                const Chunk& chunk = chunks[chunkIndex];
+                SelectionKinds& kinds = results[chunkIndex];
+                for (auto i = chunk.first; i < chunk.last && !decided.load(std::memory_order_relaxed); i += 1) {
+                    const std::wstring_view path = paths[i];
+
+                    bool isDirectory = false;
+                    const bool isListed = chunk.listing
+                        && i - chunk.runStart >= SIBLINGS_LISTING_THRESHOLD
+                        && chunk.listing->IsDirectory(path.substr(path_kernels::find_filename_start(path)), isDirectory);
+                    if (!isListed) {
+                        isDirectory = fileSystem.IsDirectory(paths.CStr(i));
+                    }
+
+                    if (isDirectory) {
+                        kinds.AddFolder();
+                    }
+                    else {
+                        kinds.AddFile(path, knownExtensions, atoms);
+                    }
+
+                    if (kinds.IsDecided()) {
+                        decided = true;
+                    }
+                }
+            };
+
+            // a few hundred of attribute lookups aren't worth waking threads for
+            const size_t maxThreads = paths.size() > CHUNK_SIZE ? MAX_THREADS : 1;
+
+            runner.Run(chunks.size(), maxThreads, classifyChunk);
+
+            SelectionKinds result;
+            for (const auto& kinds : results) {
+                result.Merge(kinds);
+            }
+            return result;
+        }
+    };
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+/*
+Shell Link (.lnk) files as described in [MS-SHLLINK]: just enough of the format to tell where a handler points to,
+with what arguments and which icon, without creating an IShellLink and loading the file through COM for every handler.
+
+Plain C++ with no Windows types in it, like catalog_format.h. The file is read in place, every size and offset found
+in it is checked against the end of the data before it is followed, and a malformed link is rejected as a whole
+rather than half parsed:
+
+    header          0x4C bytes, flags tell which of the rest is there
+    id list         skipped, we don't resolve shell namespace items
+    link info       local base path or network share, plus the common path suffix
+    string data     name, relative path, working directory, arguments, icon location
+    extra data      blocks up to a terminal one; only the environment variable blocks are of interest
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace shell_link {
+
+    constexpr uint32_t HEADER_SIZE = 0x4C;
+    // {00021401-0000-0000-C000-000000000046} as stored
+    constexpr uint8_t LINK_CLSID[16] = { 0x01, 0x14, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+
+    // LinkFlags
+    constexpr uint32_t HAS_LINK_TARGET_ID_LIST = 0x1;
+    constexpr uint32_t HAS_LINK_INFO = 0x2;
+    constexpr uint32_t HAS_NAME = 0x4;
+    constexpr uint32_t HAS_RELATIVE_PATH = 0x8;
+    constexpr uint32_t HAS_WORKING_DIR = 0x10;
+    constexpr uint32_t HAS_ARGUMENTS = 0x20;
+    constexpr uint32_t HAS_ICON_LOCATION = 0x40;
+    constexpr uint32_t IS_UNICODE = 0x80;
+    constexpr uint32_t FORCE_NO_LINK_INFO = 0x100;
+    constexpr uint32_t HAS_EXP_STRING = 0x200;
+
+    // LinkInfoFlags
+    constexpr uint32_t VOLUME_ID_AND_LOCAL_BASE_PATH = 0x1;
+    constexpr uint32_t COMMON_NETWORK_RELATIVE_LINK_AND_PATH_SUFFIX = 0x2;
+
+    // ExtraData blocks with a target or an icon path that may have %VARIABLES% in it
+    constexpr uint32_t ENVIRONMENT_VARIABLE_DATA_BLOCK = 0xA0000001;
+    constexpr uint32_t ICON_ENVIRONMENT_DATA_BLOCK = 0xA0000007;
+    constexpr uint32_t ENVIRONMENT_BLOCK_SIZE = 0x314;
+    constexpr uint32_t ENVIRONMENT_ANSI_CHARS = 260;
+
+    struct ShellLink {
+        uint32_t flags = 0;
+        uint32_t fileAttributes = 0;    // of the target, when the link was made
+        int32_t iconIndex = 0;          // negative is a resource id
+        uint32_t showCommand = 0;
+        std::u16string targetPath;      // empty if the target is a shell namespace item only
+        bool targetHasVariables = false;
+        std::u16string name;
+        std::u16string relativePath;
+        std::u16string workingDirectory;
+        std::u16string arguments;
+        std::u16string iconLocation;
+        bool iconHasVariables = false;
+    };
+
+    // Stand-in for the ANSI code page where there is none: good for ASCII, which is what nearly every link has
+    // next to its Unicode strings anyway.
+    inline void append_latin1(const char* text, size_t length, std::u16string& to) {
+        for (size_t i = 0; i < length; i += 1) {
+            to.push_back(static_cast<char16_t>(static_cast<unsigned char>(text[i])));
+        }
+    }
+
+    namespace detail {
+
+        inline uint16_t get_u16(const uint8_t* at) {
+            return static_cast<uint16_t>(at[0] | (at[1] << 8));
+        }
+
+        inline uint32_t get_u32(const uint8_t* at) {
+            return uint32_t(at[0]) | (uint32_t(at[1]) << 8) | (uint32_t(at[2]) << 16) | (uint32_t(at[3]) << 24);
+        }
+
+        // [begin, end) of the data the parser is allowed to look at
+        struct Span {
+            const uint8_t* data;
+            size_t size;
+
+            bool Has(size_t offset, size_t length) const {
+                return offset <= size && length <= size - offset;
+            }
+        };
+
+        // length in bytes of a NUL terminated ANSI string at offset, false if it isn't terminated inside the span
+        inline bool find_ansi_string(const Span& span, size_t offset, size_t& length) {
+            for (size_t i = offset; i < span.size; i += 1) {
+                if (span.data[i] == 0) {
+                    length = i - offset;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // length in code units of a NUL terminated UTF-16 string at offset
+        inline bool find_unicode_string(const Span& span, size_t offset, size_t& length) {
+            for (size_t i = offset; span.Has(i, 2); i += 2) {
+                if (get_u16(span.data + i) == 0) {
+                    length = (i - offset) / 2;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline void append_unicode(const uint8_t* at, size_t length, std::u16string& to) {
+            for (size_t i = 0; i < length; i += 1) {
+                to.push_back(static_cast<char16_t>(get_u16(at + 2 * i)));
+            }
+        }
+
+        template <typename DecodeAnsi>
+        bool append_ansi_string(const Span& span, size_t offset, std::u16string& to, DecodeAnsi& decodeAnsi) {
+            size_t length = 0;
+            if (!span.Has(offset, 0) || !find_ansi_string(span, offset, length)) {
+                return false;
+            }
+            decodeAnsi(reinterpret_cast<const char*>(span.data + offset), length, to);
+            return true;
+        }
+
+        inline bool append_unicode_string(const Span& span, size_t offset, std::u16string& to) {
+            size_t length = 0;
+            if (!span.Has(offset, 0) || !find_unicode_string(span, offset, length)) {
+                return false;
+            }
+            append_unicode(span.data + offset, length, to);
+            return true;
+        }
+
+        // LinkInfo: the target as a local path, or as a share name, followed by the common path suffix
+        template <typename DecodeAnsi>
+        bool parse_link_info(const Span& info, std::u16string& targetPath, DecodeAnsi& decodeAnsi) {
+            constexpr size_t MIN_HEADER_SIZE = 0x1C;
+            constexpr size_t UNICODE_HEADER_SIZE = 0x24;
+            if (!info.Has(0, MIN_HEADER_SIZE)) {
+                return false;
+            }
+            const uint32_t headerSize = get_u32(info.data + 4);
+            const uint32_t linkInfoFlags = get_u32(info.data + 8);
+            const uint32_t localBasePathOffset = get_u32(info.data + 16);
+            const uint32_t networkLinkOffset = get_u32(info.data + 20);
+            const uint32_t suffixOffset = get_u32(info.data + 24);
+            if (headerSize < MIN_HEADER_SIZE || !info.Has(0, headerSize)) {
+                return false;
+            }
+            const bool haveUnicode = headerSize >= UNICODE_HEADER_SIZE;
+            const uint32_t localBasePathOffsetUnicode = haveUnicode ? get_u32(info.data + 28) : 0;
+            const uint32_t suffixOffsetUnicode = haveUnicode ? get_u32(info.data + 32) : 0;
+
+            std::u16string path;
+            if (linkInfoFlags & VOLUME_ID_AND_LOCAL_BASE_PATH) {
+                const bool isParsed = localBasePathOffsetUnicode
+                    ? append_unicode_string(info, localBasePathOffsetUnicode, path)
+                    : append_ansi_string(info, localBasePathOffset, path, decodeAnsi);
+                if (!isParsed) {
+                    return false;
+                }
+            }
+            else if (linkInfoFlags & COMMON_NETWORK_RELATIVE_LINK_AND_PATH_SUFFIX) {
+                constexpr size_t MIN_NETWORK_LINK_SIZE = 0x14;
+                if (!info.Has(networkLinkOffset, MIN_NETWORK_LINK_SIZE)) {
+                    return false;
+                }
+                const uint8_t* networkLink = info.data + networkLinkOffset;
+                const uint32_t networkLinkSize = get_u32(networkLink);
+                const uint32_t netNameOffset = get_u32(networkLink + 8);
+                if (networkLinkSize < MIN_NETWORK_LINK_SIZE || !info.Has(networkLinkOffset, networkLinkSize)) {
+                    return false;
+                }
+                const Span network = { networkLink, networkLinkSize };
+                // offsets of the Unicode names are there only if the ANSI name doesn't start right after the fixed part
+                const uint32_t netNameOffsetUnicode = netNameOffset > MIN_NETWORK_LINK_SIZE && network.Has(0, MIN_NETWORK_LINK_SIZE + 4)
+                    ? get_u32(networkLink + MIN_NETWORK_LINK_SIZE) : 0;
+                const bool isParsed = netNameOffsetUnicode
+                    ? append_unicode_string(network, netNameOffsetUnicode, path)
+                    : append_ansi_string(network, netNameOffset, path, decodeAnsi);
+                if (!isParsed) {
+                    return false;
+                }
+            }
+            else {
+                // the target is known by its id list only
+                return true;
+            }
+
+            std::u16string suffix;
+            const bool isParsed = suffixOffsetUnicode
+                ? append_unicode_string(info, suffixOffsetUnicode, suffix)
+                : append_ansi_string(info, suffixOffset, suffix, decodeAnsi);
+            if (!isParsed) {
+                return false;
+            }
+            if (!suffix.empty() && !path.empty() && path.back() != u'\\') {
+                path.push_back(u'\\');
+            }
+            targetPath = path + suffix;
+            return true;
+        }
+
+        // the Unicode half of an environment block wins, the ANSI one is there for old readers
+        template <typename DecodeAnsi>
+        bool parse_environment_block(const uint8_t* block, std::u16string& path, DecodeAnsi& decodeAnsi) {
+            const Span ansi = { block + 8, ENVIRONMENT_ANSI_CHARS };
+            const Span unicode = { block + 8 + ENVIRONMENT_ANSI_CHARS, ENVIRONMENT_ANSI_CHARS * 2 };
+            std::u16string found;
+            if (append_unicode_string(unicode, 0, found) && !found.empty()) {
+                path = std::move(found);
+                return true;
+            }
+            found.clear();
+            if (append_ansi_string(ansi, 0, found, decodeAnsi) && !found.empty()) {
+                path = std::move(found);
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // decodeAnsi(const char* text, size_t length, std::u16string& to) appends text in the ANSI code page of the system
+    // the link was made on; it's used for links without Unicode strings.
+    template <typename DecodeAnsi>
+    bool parse(const uint8_t* data, size_t size, ShellLink& link, DecodeAnsi decodeAnsi) {
+        using namespace detail;
+
+        const Span file = { data, size };
+        if (!file.Has(0, HEADER_SIZE) || get_u32(data) != HEADER_SIZE) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(LINK_CLSID); i += 1) {
+            if (data[4 + i] != LINK_CLSID[i]) {
+                return false;
+            }
+        }
+
+        ShellLink parsed;
+        parsed.flags = get_u32(data + 20);
+        parsed.fileAttributes = get_u32(data + 24);
+        parsed.iconIndex = static_cast<int32_t>(get_u32(data + 56));
+        parsed.showCommand = get_u32(data + 60);
+        size_t offset = HEADER_SIZE;
+
+        if (parsed.flags & HAS_LINK_TARGET_ID_LIST) {
+            if (!file.Has(offset, 2)) {
+                return false;
+            }
+            const size_t idListSize = get_u16(data + offset);
+            offset += 2;
+            if (!file.Has(offset, idListSize)) {
+                return false;
+            }
+            offset += idListSize;
+        }
+
+        if (parsed.flags & HAS_LINK_INFO) {
+            if (!file.Has(offset, 4)) {
+                return false;
+            }
+            const size_t linkInfoSize = get_u32(data + offset);
+            if (!file.Has(offset, linkInfoSize)) {
+                return false;
+            }
+            if (!(parsed.flags & FORCE_NO_LINK_INFO) && !parse_link_info(Span{ data + offset, linkInfoSize }, parsed.targetPath, decodeAnsi)) {
+                return false;
+            }
+            offset += linkInfoSize;
+        }
+
+        // string data comes in this order, each one only if its flag is set
+        const std::pair<uint32_t, std::u16string*> strings[] = {
+            { HAS_NAME, &parsed.name },
+            { HAS_RELATIVE_PATH, &parsed.relativePath },
+            { HAS_WORKING_DIR, &parsed.workingDirectory },
+            { HAS_ARGUMENTS, &parsed.arguments },
+            { HAS_ICON_LOCATION, &parsed.iconLocation }
+        };
+        const bool isUnicode = (parsed.flags & IS_UNICODE) != 0;
+        for (const auto& string : strings) {
+            if (!(parsed.flags & string.first)) {
+                continue;
+            }
+            if (!file.Has(offset, 2)) {
+                return false;
+            }
+            const size_t nChars = get_u16(data + offset);
+            const size_t nBytes = isUnicode ? nChars * 2 : nChars;
+            offset += 2;
+            if (!file.Has(offset, nBytes)) {
+                return false;
+            }
+            if (isUnicode) {
+                append_unicode(data + offset, nChars, *string.second);
+            }
+            else {
+                decodeAnsi(reinterpret_cast<const char*>(data + offset), nChars, *string.second);
+            }
+            offset += nBytes;
+        }
+
+        // extra data ends with a terminal block smaller than 4 bytes, some writers leave it out altogether
+        while (file.Has(offset, 4)) {
+            const size_t blockSize = get_u32(data + offset);
+            if (blockSize < 4) {
+                break;
+            }
+            if (blockSize < 8 || !file.Has(offset, blockSize)) {
+                return false;
+            }
+            const uint32_t signature = get_u32(data + offset + 4);
+            if (signature == ENVIRONMENT_VARIABLE_DATA_BLOCK || signature == ICON_ENVIRONMENT_DATA_BLOCK) {
+                if (blockSize != ENVIRONMENT_BLOCK_SIZE) {
+                    return false;
+                }
+                if (signature == ENVIRONMENT_VARIABLE_DATA_BLOCK && (parsed.flags & HAS_EXP_STRING)) {
+                    // the unexpanded target is what the shell goes by, the one in link info was right on the machine the link was made on
+                    parsed.targetHasVariables = parse_environment_block(data + offset, parsed.targetPath, decodeAnsi);
+                }
+                else if (signature == ICON_ENVIRONMENT_DATA_BLOCK) {
+                    parsed.iconHasVariables = parse_environment_block(data + offset, parsed.iconLocation, decodeAnsi);
+                }
+            }
+            offset += blockSize;
+        }
+
+        link = std::move(parsed);
+        return true;
+    }
+
+    inline bool parse(const uint8_t* data, size_t size, ShellLink& link) {
+        return parse(data, size, link, append_latin1);
+    }
+}
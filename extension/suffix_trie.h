@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+Known extensions, compound ones (".tar.gz") included, for telling which one a file name ends with.
+
+Plain C++ with no Windows types in it, like catalog_format.h. Case folding beyond ASCII is the caller's:
+the trie is given the function it folds characters with.
+*/
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace suffix_trie {
+
+    // upper-cases ASCII, leaves the rest as it is
+    inline wchar_t fold_ascii_char(wchar_t c) {
+        return (c >= L'a' && c <= L'z') ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+    }
+
+    /*
+    Trie of known extensions (".txt", ".tar.gz"), case folded and stored back to front,
+    so the longest one a file name ends with is found walking the name backwards once:
+    the cost depends on the extension's length, not on how many extensions there are.
+    Extensions start with a dot and so does a match: ".gz" is not found in "foo.tgz", nor ".ts" in "foo.bats".
+    */
+    class SuffixTrie final {
+    public:
+        using FoldChar = wchar_t (*)(wchar_t);
+
+        explicit SuffixTrie(FoldChar foldChar = fold_ascii_char)
+            : m_foldChar(foldChar)
+            , m_nodes(1)
+        {}
+
+        void Insert(std::wstring_view suffix) {
+            size_t node = 0;
+            for (auto current = suffix.rbegin(); current != suffix.rend(); ++current) {
+                const wchar_t c = m_foldChar(*current);
+                size_t child = FindChild(node, c);
+                if (child == 0) {
+                    child = m_nodes.size();
+                    m_nodes[node].children.push_back({ c, child });
+                    m_nodes.emplace_back();
+                }
+                node = child;
+            }
+            m_nodes[node].isSuffix = true;
+        }
+
+        // returns length of the longest known suffix of the name, 0 if there is none
+        size_t FindLongestSuffix(std::wstring_view name) const {
+            size_t longest = 0;
+            size_t node = 0;
+            size_t length = 0;
+            for (auto current = name.rbegin(); current != name.rend(); ++current) {
+                node = FindChild(node, m_foldChar(*current));
+                if (node == 0) {
+                    break;
+                }
+                length += 1;
+                if (m_nodes[node].isSuffix && *current == L'.') {
+                    longest = length;
+                }
+            }
+            return longest;
+        }
+
+        size_t GetNodesCount() const {
+            return m_nodes.size();
+        }
+
+    private:
+        struct Node {
+            std::vector<std::pair<wchar_t, size_t>> children;
+            bool isSuffix = false;
+        };
+
+        // returns 0 (which is root, so can't be anybody's child) if there is no such child
+        size_t FindChild(size_t node, wchar_t c) const {
+            for (const auto& child : m_nodes[node].children) {
+                if (child.first == c) {
+                    return child.second;
+                }
+            }
+            return 0;
+        }
+
+        FoldChar m_foldChar;
+        std::vector<Node> m_nodes;
+    };
+}
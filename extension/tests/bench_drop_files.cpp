@@ -0,0 +1,138 @@
+#include "drop_files.h"
+#include "path_arena.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using path_arena::PathArena;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // a wide DROPFILES block as the shell builds it for a selection of nItems files
+    std::vector<uint8_t> make_block(size_t nItems) {
+        std::vector<uint8_t> block(drop_files::HEADER_SIZE, 0);
+        block[0] = static_cast<uint8_t>(drop_files::HEADER_SIZE);
+        block[16] = 1;
+        for (size_t i = 0; i < nItems; i += 1) {
+            const std::string path = "C:\\Users\\someone\\Pictures\\trip " + std::to_string(i / 400) + "\\IMG_" + std::to_string(i) + ".jpg";
+            for (const char c : path) {
+                block.push_back(static_cast<uint8_t>(c));
+                block.push_back(0);
+            }
+            block.push_back(0);
+            block.push_back(0);
+        }
+        block.push_back(0);
+        block.push_back(0);
+        return block;
+    }
+
+    // wide paths are copied as they are on Windows, wchar_t is wider than char16_t elsewhere
+    void append(PathArena& paths, std::u16string_view path) {
+        wchar_t* out = paths.Allocate(path.size());
+        for (const char16_t c : path) {
+            *out++ = static_cast<wchar_t>(c);
+        }
+    }
+
+    /*
+    What DragQueryFileW does: walks the block from the start to the index-th path, copies at most
+    size - 1 characters of it and returns how many it copied, or its length without a buffer;
+    the index 0xFFFFFFFF counts the paths.
+    */
+    unsigned drag_query_file(const std::vector<uint8_t>& block, unsigned index, wchar_t* buffer, unsigned size) {
+        unsigned current = 0;
+        unsigned result = 0;
+        bool isFound = false;
+        drop_files::parse(block.data(), block.size(),
+            [&](std::u16string_view path) {
+                if (isFound) {
+                    return;
+                }
+                if (current == index) {
+                    isFound = true;
+                    if (buffer == nullptr) {
+                        result = static_cast<unsigned>(path.size());
+                        return;
+                    }
+                    const size_t length = path.size() < size - 1 ? path.size() : size - 1;
+                    for (size_t i = 0; i < length; i += 1) {
+                        buffer[i] = static_cast<wchar_t>(path[i]);
+                    }
+                    buffer[length] = L'\0';
+                    result = static_cast<unsigned>(length);
+                }
+                current += 1;
+            },
+            [](std::string_view) {});
+        return index == 0xFFFFFFFF ? current : result;
+    }
+
+    // what Initialize did before: the count, then the length and a copy of every path, each a walk of its own
+    void read_copy_per_item(const std::vector<uint8_t>& block, PathArena& paths) {
+        const unsigned nItems = drag_query_file(block, 0xFFFFFFFF, nullptr, 0);
+        for (unsigned i = 0; i < nItems; i += 1) {
+            const unsigned length = drag_query_file(block, i, nullptr, 0);
+            drag_query_file(block, i, paths.Allocate(length), length + 1);
+        }
+    }
+
+    void read_in_place(const std::vector<uint8_t>& block, PathArena& paths) {
+        drop_files::parse(block.data(), block.size(),
+            [&paths](std::u16string_view path) { append(paths, path); },
+            [](std::string_view) {});
+    }
+}
+
+// Selected items read out of CF_HDROP's block into the path arena: items per second walking the block once,
+// in place, against asking DragQueryFileW for the count and then for every item's length and copy
+int main() {
+    bool isConsistent = true;
+
+    std::printf("%8s %16s %16s\n", "items", "copy per item/s", "in place/s");
+    for (const size_t nItems : { 10, 100, 1000, 5000 }) {
+        const auto block = make_block(nItems);
+
+        PathArena copied;
+        const double copiedRate = measure([&]() {
+            copied.Reset();
+            read_copy_per_item(block, copied);
+        }) * nItems;
+
+        PathArena inPlace;
+        const double inPlaceRate = measure([&]() {
+            inPlace.Reset();
+            read_in_place(block, inPlace);
+        }) * nItems;
+
+        isConsistent = isConsistent && copied.size() == nItems && inPlace.size() == nItems;
+        for (size_t i = 0; isConsistent && i < nItems; i += 1) {
+            isConsistent = copied[i] == inPlace[i];
+        }
+        std::printf("%8zu %16.0f %16.0f\n", nItems, copiedRate, inPlaceRate);
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "the two ways read different paths\n");
+        return 1;
+    }
+    return 0;
+}
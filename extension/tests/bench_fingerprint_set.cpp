@@ -0,0 +1,94 @@
+#include "fingerprint_set.h"
+#include "menu_fixtures.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+using fingerprint_set::FingerprintSet;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // fingerprints in the order MenuLayout walks the sections: a folder's handlers, then its groups'
+    void collect(const fixtures::Folder& folder, std::vector<uint64_t>& fingerprints) {
+        for (const auto& handler : folder.handlers) {
+            fingerprints.push_back(handler.fingerprint);
+        }
+        for (const auto& group : folder.groups) {
+            collect(group.second, fingerprints);
+        }
+    }
+}
+
+// Deduplicating the handlers of a menu, many of them the same tools under other names: menus per second
+// with the FingerprintSet a MenuLayout keeps from one menu to the next, against a std::unordered_set
+// kept and cleared the same way, and one made anew for every menu
+int main() {
+    bool isConsistent = true;
+
+    std::printf("%9s %9s %18s %18s %18s\n", "handlers", "shown", "FingerprintSet", "unordered_set kept", "unordered_set new");
+    for (const size_t nHandlers : { 30, 300, 3000, 30000 }) {
+        std::mt19937 random(7);
+        std::vector<uint64_t> fingerprints;
+        for (const auto& section : fixtures::make_sections(random, nHandlers, nHandlers / 3 + 1)) {
+            collect(section, fingerprints);
+        }
+
+        FingerprintSet set;
+        size_t nShown = 0;
+        const double setRate = measure([&]() {
+            set.Clear(fingerprints.size());
+            nShown = 0;
+            for (const uint64_t fingerprint : fingerprints) {
+                nShown += set.Insert(fingerprint) ? 1 : 0;
+            }
+        });
+
+        std::unordered_set<uint64_t> kept;
+        size_t nKeptShown = 0;
+        const double keptRate = measure([&]() {
+            kept.clear();
+            kept.reserve(fingerprints.size());
+            nKeptShown = 0;
+            for (const uint64_t fingerprint : fingerprints) {
+                nKeptShown += kept.insert(fingerprint).second ? 1 : 0;
+            }
+        });
+
+        size_t nNewShown = 0;
+        const double newRate = measure([&]() {
+            std::unordered_set<uint64_t> made;
+            nNewShown = 0;
+            for (const uint64_t fingerprint : fingerprints) {
+                nNewShown += made.insert(fingerprint).second ? 1 : 0;
+            }
+        });
+
+        isConsistent = isConsistent && nShown == nKeptShown && nShown == nNewShown;
+        std::printf("%9zu %9zu %13.0f/s %13.0f/s %13.0f/s\n", fingerprints.size(), nShown, setRate, keptRate, newRate);
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "the sets disagree on which handlers are duplicates\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "handler_catalog.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include "inotify_backend.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    struct TempFolder {
+        std::string path;
+
+        TempFolder() {
+            char pattern[] = "/tmp/handler_catalog_XXXXXX";
+            path = ::mkdtemp(pattern);
+        }
+
+        ~TempFolder() {
+            std::system(("rm -rf '" + path + "'").c_str());
+        }
+    };
+}
+
+// A right-click looks into a few handler folders: listing them every time against the catalog,
+// and the catalog's hit rate when handlers are added now and then
+int main() {
+    const size_t N_FOLDERS = 5;
+    const size_t N_HANDLERS = 200;
+    TempFolder root;
+    std::vector<std::string> folders;
+    for (size_t folder = 0; folder < N_FOLDERS; folder += 1) {
+        folders.push_back(root.path + "/folder" + std::to_string(folder));
+        ::mkdir(folders.back().c_str(), 0700);
+        for (size_t handler = 0; handler < N_HANDLERS; handler += 1) {
+            std::ofstream(folders.back() + "/handler" + std::to_string(handler) + ".desktop") << "x";
+        }
+    }
+
+    bool isConsistent = true;
+    size_t nListed = 0;
+    const double scanRate = measure([&]() {
+        for (const auto& folder : folders) {
+            nListed += inotify_backend::scan_folder(folder)->files.size();
+        }
+    });
+
+    inotify_backend::FolderCache cache;
+    const double cachedRate = measure([&]() {
+        for (const auto& folder : folders) {
+            nListed += cache.GetFolder(folder)->files.size();
+        }
+    });
+    auto stats = cache.GetStats();
+    isConsistent = isConsistent && stats.nScans == N_FOLDERS;
+    std::printf("menu of %zu folders, %zu handlers each: listed every time %8.0f menus/s, from the catalog %10.0f menus/s\n",
+        N_FOLDERS, N_HANDLERS, scanRate, cachedRate);
+
+    // a handler added every 100 menus: only its folder is listed again, and the menu right after sees it
+    const size_t N_MENUS = 20000;
+    const auto before = cache.GetStats();
+    size_t nAdded = 0;
+    const auto start = Clock::now();
+    for (size_t menu = 0; menu < N_MENUS; menu += 1) {
+        size_t changed = N_FOLDERS;
+        if (menu % 100 == 0) {
+            changed = (menu / 100) % N_FOLDERS;
+            std::ofstream(folders[changed] + "/added" + std::to_string(nAdded) + ".desktop") << "x";
+            nAdded += 1;
+        }
+        for (size_t folder = 0; folder < N_FOLDERS; folder += 1) {
+            const auto snapshot = cache.GetFolder(folders[folder]);
+            if (folder == changed) {
+                isConsistent = isConsistent && snapshot->files.size() == N_HANDLERS + (nAdded + N_FOLDERS - 1 - changed) / N_FOLDERS;
+            }
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats = cache.GetStats();
+    const size_t nLookups = stats.nLookups - before.nLookups;
+    const size_t nScans = stats.nScans - before.nScans;
+    isConsistent = isConsistent && nScans == nAdded;
+    std::printf("%zu menus, a handler added every 100: %zu of %zu lookups listed a folder, hit rate %.2f%%, %.0f menus/s\n",
+        N_MENUS, nScans, nLookups, 100.0 * (nLookups - nScans) / nLookups, N_MENUS / seconds);
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "the catalog listed a folder it didn't have to, or missed a change\n");
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int main() {
+    std::puts("the handler catalog benchmark needs inotify, skipped");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include "handler_groups.h"
+#include "worker_pool.h"
+#include "fake_handler_tree.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using fake_handler_tree::FakeCatalog;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // runs every task on the calling thread
+    struct Inline {
+        size_t nStarted = 0;
+
+        template <typename Task>
+        void Run(size_t nTasks, size_t, Task task) {
+            for (size_t i = 0; i < nTasks; i += 1) {
+                task(i);
+            }
+        }
+    };
+
+    // what the walk did before it shared the pool: threads started and joined on every level
+    struct ThreadPerLevel {
+        size_t nStarted = 0;
+
+        template <typename Task>
+        void Run(size_t nTasks, size_t maxThreads, Task task) {
+            std::atomic<size_t> nextTask{ 0 };
+            auto worker = [&]() {
+                for (size_t i = nextTask++; i < nTasks; i = nextTask++) {
+                    task(i);
+                }
+            };
+
+            std::vector<std::thread> helpers;
+            for (size_t i = 1, nThreads = maxThreads < nTasks ? maxThreads : nTasks; i < nThreads; i += 1) {
+                helpers.emplace_back(worker);
+                nStarted += 1;
+            }
+            worker();
+            for (auto& helper : helpers) {
+                helper.join();
+            }
+        }
+    };
+
+    struct KeptPool {
+        worker_pool::WorkerPool pool{ handler_groups::MAX_THREADS - 1 };
+        size_t nStarted = 0;
+
+        template <typename Task>
+        void Run(size_t nTasks, size_t maxThreads, Task task) {
+            pool.Run(nTasks, maxThreads, task);
+            nStarted = pool.GetStartedCount();
+        }
+    };
+
+    size_t count_groups(const std::vector<handler_groups::HandlerGroup<fake_handler_tree::FakeSnapshot>>& groups) {
+        size_t nGroups = groups.size();
+        for (const auto& group : groups) {
+            nGroups += count_groups(group.groups);
+        }
+        return nGroups;
+    }
+}
+
+// A section with nested groups, 6 of them with 4 in each, 3 in each of those and 2 deepest down (246 folders):
+// walks per second on the calling thread alone, on threads started per level, and on the kept pool,
+// with every folder listed already (the usual right-click) and with every folder taking 50 us to list
+int main() {
+    const size_t N_GROUPS = 6 + 6 * 4 + 6 * 4 * 3 + 6 * 4 * 3 * 2;
+    bool isConsistent = true;
+
+    FakeCatalog catalog;
+    catalog.AddTree(L"root", { 6, 4, 3, 2 }, 3);
+    const auto& root = catalog.GetRoot(L"root");
+
+    auto run = [&](const char* what, auto& runner, bool isListed) {
+        catalog.listingTime = std::chrono::microseconds(isListed ? 0 : 50);
+        catalog.Forget();
+        size_t nWalks = 0;
+        const double rate = measure([&]() {
+            if (!isListed) {
+                catalog.Forget();
+            }
+            isConsistent = count_groups(handler_groups::load_handler_groups(L"root", root, catalog, runner)) == N_GROUPS && isConsistent;
+            nWalks += 1;
+        });
+        std::printf("  %-26s %9.0f walks/s, %6.2f threads started per walk\n", what, rate, double(runner.nStarted) / nWalks);
+    };
+
+    for (const bool isListed : { true, false }) {
+        std::printf("%zu groups, %s:\n", N_GROUPS, isListed ? "listed already" : "listed anew, 50 us per folder");
+        Inline calling;
+        run("calling thread only", calling, isListed);
+        ThreadPerLevel perLevel;
+        run("threads started per level", perLevel, isListed);
+        KeptPool pool;
+        run("kept pool", pool, isListed);
+        isConsistent = isConsistent && pool.nStarted <= handler_groups::MAX_THREADS - 1;
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "a walk missed groups, or the pool started more threads than it keeps\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "icon_atlas.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <vector>
+
+using icon_atlas::Atlas;
+using icon_atlas::SlotId;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // an atlas holding nIcons icons of the sizes menus use
+    void fill(Atlas& atlas, std::mt19937& random, size_t nIcons, std::vector<SlotId>& held) {
+        const uint32_t sides[] = { 16, 20, 24, 32 };
+        std::vector<uint8_t> pixels(32 * 32 * 4);
+        for (auto& byte : pixels) {
+            byte = static_cast<uint8_t>(random());
+        }
+        while (held.size() < nIcons) {
+            const uint32_t side = sides[held.size() % std::size(sides)];
+            const SlotId id = atlas.Add(pixels.data(), side, side);
+            if (id == icon_atlas::NO_SLOT) {
+                break;
+            }
+            held.push_back(id);
+        }
+    }
+}
+
+// Icons coming into an atlas already holding many of them, the mirror (the DIB section menus are drawn from)
+// brought up to date before every draw, as WM_DRAWITEM does after an icon is put in: syncs per second and
+// bytes per sync, copying the whole atlas whenever it changed against copying the rows that did
+int main() {
+    bool isConsistent = true;
+
+    std::printf("%7s %10s %22s %22s\n", "icons", "atlas KB", "whole atlas", "changed rows");
+    for (const size_t nIcons : { 24, 200, 1000 }) {
+        std::mt19937 random(3);
+        Atlas atlas;
+        std::vector<SlotId> held;
+        fill(atlas, random, nIcons, held);
+        const size_t pixelBytes = atlas.GetPixelBytes();
+        std::vector<uint8_t> wholeMirror(pixelBytes);
+        std::vector<uint8_t> rowsMirror(pixelBytes);
+        atlas.CopyChangedRows(rowsMirror.data(), true);
+
+        // an icon replaced by another one of its size: its rectangle is reused, the atlas doesn't grow
+        std::vector<uint8_t> icon(32 * 32 * 4);
+        auto replace = [&]() {
+            const size_t k = random() % held.size();
+            const icon_atlas::Rect rect = atlas.GetRect(held[k]);
+            icon[0] = static_cast<uint8_t>(random());
+            atlas.Remove(held[k]);
+            held[k] = atlas.Add(icon.data(), rect.width, rect.height);
+        };
+
+        size_t nWholeSyncs = 0;
+        const double wholeRate = measure([&]() {
+            replace();
+            memcpy(wholeMirror.data(), atlas.GetPixels(), atlas.GetPixelBytes());
+            nWholeSyncs += 1;
+        });
+        atlas.CopyChangedRows(rowsMirror.data(), true);
+
+        size_t nRowsSyncs = 0;
+        size_t nRowsBytes = 0;
+        const double rowsRate = measure([&]() {
+            replace();
+            nRowsBytes += atlas.CopyChangedRows(rowsMirror.data());
+            nRowsSyncs += 1;
+        });
+
+        isConsistent = isConsistent
+            && atlas.GetPixelBytes() == pixelBytes
+            && memcmp(rowsMirror.data(), atlas.GetPixels(), pixelBytes) == 0;
+        std::printf("%7zu %10zu %10.0f/s %7zu KB %10.0f/s %7.1f KB\n", held.size(), pixelBytes / 1024,
+            wholeRate, pixelBytes / 1024, rowsRate, double(nRowsBytes) / nRowsSyncs / 1024);
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "the mirror synced by rows differs from the atlas\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "icon_loader.h"
+#include "fake_icon_extractor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using fake_icon_extractor::Extractions;
+using fake_icon_extractor::FakeExtractor;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // what a menu did before the loader: every icon it doesn't have extracted on its own thread, one after another
+    std::vector<std::shared_ptr<const fake_icon_extractor::FakeIcon>> load_one_by_one(FakeExtractor& extractor, const std::vector<std::wstring>& paths) {
+        std::vector<std::shared_ptr<const fake_icon_extractor::FakeIcon>> icons;
+        for (const auto& path : paths) {
+            auto icon = extractor.Find(path);
+            icons.push_back(icon ? icon : extractor.Extract(path));
+        }
+        return icons;
+    }
+
+    bool is_complete(const std::vector<std::shared_ptr<const fake_icon_extractor::FakeIcon>>& icons, size_t nHandlers) {
+        size_t nIcons = 0;
+        for (const auto& icon : icons) {
+            nIcons += icon ? 1 : 0;
+        }
+        return icons.size() == nHandlers && nIcons == nHandlers;
+    }
+}
+
+// Cold menus of 24 handlers whose icons take the shell 500 us each to extract (all of them missing, as after
+// Explorer restarts): menus per second with icons extracted on the menu's thread one by one, and by the loader's
+// pool of 1 to 8 workers. Then 4 such menus built at once: each on its own against the pool they share,
+// which extracts an icon once for all of them.
+int main() {
+    const size_t N_HANDLERS = 24;
+    const size_t N_MENUS = 4;
+    const auto EXTRACTION_TIME = std::chrono::microseconds(500);
+    bool isConsistent = true;
+
+    std::vector<std::wstring> paths;
+    for (size_t i = 0; i < N_HANDLERS; i += 1) {
+        paths.push_back(L"C:\\handlers\\Everything\\handler " + std::to_wstring(i) + L".lnk");
+    }
+
+    std::printf("%zu handlers, 500 us per icon:\n", N_HANDLERS);
+    {
+        Extractions extractions;
+        extractions.extractionTime = EXTRACTION_TIME;
+        FakeExtractor extractor;
+        extractor.extractions = &extractions;
+        size_t nMenus = 0;
+        const double rate = measure([&]() {
+            extractor.Forget();
+            isConsistent = is_complete(load_one_by_one(extractor, paths), N_HANDLERS) && isConsistent;
+            nMenus += 1;
+        });
+        isConsistent = isConsistent && extractions.nExtracted == nMenus * N_HANDLERS;
+        std::printf("  one by one:          %7.0f menus/s\n", rate);
+    }
+    for (const size_t nThreads : { 1, 2, 4, 8 }) {
+        Extractions extractions;
+        extractions.extractionTime = EXTRACTION_TIME;
+        icon_loader::IconLoader<FakeExtractor> loader(nThreads);
+        loader.GetBackend().extractions = &extractions;
+        size_t nMenus = 0;
+        const double rate = measure([&]() {
+            loader.GetBackend().Forget();
+            isConsistent = is_complete(loader.Load(paths, Clock::now() + std::chrono::seconds(5)), N_HANDLERS) && isConsistent;
+            nMenus += 1;
+        });
+        isConsistent = isConsistent && extractions.nExtracted == nMenus * N_HANDLERS && loader.GetStartedCount() <= nThreads;
+        std::printf("  pool of %zu worker(s): %7.0f menus/s, %zu worker(s) started\n", nThreads, rate, loader.GetStartedCount());
+        while (!loader.TryShutdown()) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::printf("%zu menus at once, same handlers:\n", N_MENUS);
+    {
+        Extractions extractions;
+        extractions.extractionTime = EXTRACTION_TIME;
+        FakeExtractor extractor;
+        extractor.extractions = &extractions;
+        size_t nRounds = 0;
+        const double rate = measure([&]() {
+            extractor.Forget();
+            std::vector<std::thread> menus;
+            for (size_t i = 0; i < N_MENUS; i += 1) {
+                menus.emplace_back([&]() {
+                    load_one_by_one(extractor, paths);
+                });
+            }
+            for (auto& menu : menus) {
+                menu.join();
+            }
+            nRounds += 1;
+        }) * N_MENUS;
+        std::printf("  one by one:          %7.0f menus/s, %5.1f extractions per menu\n", rate, double(extractions.nExtracted) / (nRounds * N_MENUS));
+    }
+    {
+        Extractions extractions;
+        extractions.extractionTime = EXTRACTION_TIME;
+        icon_loader::IconLoader<FakeExtractor> loader(4);
+        loader.GetBackend().extractions = &extractions;
+        size_t nRounds = 0;
+        std::atomic<bool> isComplete{ true };
+        const double rate = measure([&]() {
+            loader.GetBackend().Forget();
+            std::vector<std::thread> menus;
+            for (size_t i = 0; i < N_MENUS; i += 1) {
+                menus.emplace_back([&]() {
+                    if (!is_complete(loader.Load(paths, Clock::now() + std::chrono::seconds(5)), N_HANDLERS)) {
+                        isComplete = false;
+                    }
+                });
+            }
+            for (auto& menu : menus) {
+                menu.join();
+            }
+            nRounds += 1;
+        }) * N_MENUS;
+        // menus that come in after an icon is extracted find it cached: never more than once per menu
+        isConsistent = isConsistent && isComplete && extractions.nExtracted <= nRounds * N_MENUS * N_HANDLERS;
+        std::printf("  pool of 4 workers:   %7.0f menus/s, %5.1f extractions per menu\n", rate, double(extractions.nExtracted) / (nRounds * N_MENUS));
+        while (!loader.TryShutdown()) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "a menu missed icons, an icon was extracted more often than asked for, or the pool started too many workers\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "launch_scheduler.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include "posix_spawner.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+}
+
+// A handler launched once per selected item, waited for until every item is done:
+// items per second as the cap on processes running at once goes up, for a handler that takes its time
+// (sleeps 10 ms, as a converter waiting on the disk would) and for one that exits right away
+int main() {
+    const size_t N_ITEMS = 64;
+    bool isConsistent = true;
+
+    struct Handler {
+        const char* program;
+        const wchar_t* arguments;
+        const char* what;
+    };
+    const Handler handlers[] = {
+        { "/bin/sleep", L"0.01", "10 ms per item" },
+        { "/bin/true", L"", "exits at once" },
+    };
+    for (const auto& handler : handlers) {
+        const std::vector<std::wstring> commandLines(N_ITEMS, handler.arguments);
+        std::printf("%zu items, %s:\n", N_ITEMS, handler.what);
+        for (const size_t maxProcesses : { 1, 2, 4, 8, 16, 0 }) {
+            posix_spawner::PosixSpawner spawner(handler.program);
+            size_t nRuns = 0;
+            const double rate = measure([&]() {
+                isConsistent = launch_scheduler::run_launches(commandLines, maxProcesses, true, spawner) && isConsistent;
+                nRuns += 1;
+            }) * N_ITEMS;
+            isConsistent = isConsistent
+                && spawner.GetSpawnedCount() == nRuns * N_ITEMS
+                && spawner.GetRunningCount() == 0
+                && (maxProcesses == 0 || spawner.GetMaxRunning() <= maxProcesses);
+
+            if (maxProcesses > 0) {
+                std::printf("  at most %2zu at once: %8.0f items/s, %zu running at most\n", maxProcesses, rate, spawner.GetMaxRunning());
+            }
+            else {
+                std::printf("  no limit:           %8.0f items/s, %zu running at most\n", rate, spawner.GetMaxRunning());
+            }
+        }
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "an item wasn't launched or waited for, or more processes ran at once than allowed\n");
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int main() {
+    std::puts("the launch scheduler benchmark needs posix_spawn, skipped");
+    return 0;
+}
+
+#endif
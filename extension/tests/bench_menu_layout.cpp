@@ -0,0 +1,88 @@
+#include "menu_fixtures.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace fixtures;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() in batches for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            for (int i = 0; i < 100; i += 1) {
+                run();
+            }
+            nRuns += 100;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // counts what the menu would get, as cheap as a builder can be
+    struct CountingBuilder {
+        size_t nItems = 0;
+        size_t nSubmenus = 0;
+        size_t depth = 0;
+
+        void BeginSubmenu(const std::wstring&) {
+            nSubmenus += 1;
+            depth += 1;
+        }
+
+        void EndSubmenu() {
+            depth -= 1;
+        }
+
+        void AddHandler(size_t) {
+            nItems += 1;
+        }
+
+        void AddSeparator() {
+            nItems += 1;
+        }
+
+        void AddOpenFolder(size_t) {
+            nItems += 1;
+        }
+    };
+}
+
+// Latency of laying a menu out, from the walk over its folders (ranking, dedupe, command offsets) to the last item
+// handed to the builder: the part of a right-click that isn't I/O, icons or the HMENUs themselves
+int main() {
+    std::mt19937 random(20);
+    bool isConsistent = true;
+
+    for (const size_t nHandlers : { 20, 200, 1000 }) {
+        const auto sections = make_sections(random, nHandlers, nHandlers / 3 + 1);
+        std::unordered_map<std::wstring, double> scores;
+        for (size_t i = 0; i < nHandlers; i += 7) {
+            scores[L"handler" + std::to_wstring(i)] = static_cast<double>(random() % 100);
+        }
+
+        menu_layout::MenuLayout layout;
+        Source source;
+        source.scores = &scores;
+        size_t nShown = 0;
+        const double rate = measure([&]() {
+            layout.Reset(1024);
+            source.added.clear();
+            for (size_t i = 0; i < sections.size(); i += 1) {
+                layout.AddSection(source, sections[i], i % 3 == 0 ? L"section" : L"");
+            }
+            CountingBuilder builder;
+            layout.Materialize(builder);
+            isConsistent = isConsistent && builder.depth == 0 && source.added.size() == layout.GetHandlersCount();
+            nShown = layout.GetHandlersCount();
+        });
+        std::printf("%zu handlers (%zu shown after dedupe) in %zu sections: %.2f us per menu\n", nHandlers, nShown, sections.size(), 1e6 / rate);
+    }
+    return isConsistent ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include "path_arena.h"
+#include "path_kernels.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// every allocation of the process is counted, so the benchmark can tell what a selection costs in them
+namespace {
+    std::atomic<size_t> g_nAllocations{ 0 };
+}
+
+void* operator new(size_t size) {
+    g_nAllocations += 1;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // paths as Explorer hands them over: one folder, names of all lengths, most of them with an extension
+    std::vector<std::wstring> make_selection(std::mt19937& random, size_t nPaths) {
+        const wchar_t* extensions[] = { L".txt", L".jpg", L".tar.gz", L".cpp", L"", L".docx" };
+        std::vector<std::wstring> paths;
+        for (size_t i = 0; i < nPaths; i += 1) {
+            std::wstring path = L"C:\\Users\\someone\\Documents\\Projects\\photos 2024\\";
+            const size_t nameLength = 4 + random() % 40;
+            for (size_t j = 0; j < nameLength; j += 1) {
+                path.push_back(static_cast<wchar_t>(L'a' + random() % 26));
+            }
+            path += extensions[random() % 6];
+            paths.push_back(std::move(path));
+        }
+        return paths;
+    }
+
+    // what classifying does with every path: find its name and extension
+    template <typename Paths>
+    size_t read_all(const Paths& paths) {
+        size_t nWithExtension = 0;
+        for (size_t i = 0; i < paths.size(); i += 1) {
+            nWithExtension += path_kernels::find_path_marks(std::wstring_view(paths[i])).lastDot != std::wstring_view::npos ? 1 : 0;
+        }
+        return nWithExtension;
+    }
+}
+
+// Storing a selection and reading it once, selection after selection, as the menu does on every right-click:
+// the arena against a string per path
+int main() {
+    std::mt19937 random(5);
+    bool isConsistent = true;
+
+    for (const size_t nPaths : { 1000, 10000, 100000 }) {
+        const auto selection = make_selection(random, nPaths);
+        const size_t nWithExtension = read_all(selection);
+
+        path_arena::PathArena arena;
+        size_t nRead = 0;
+        const auto storeInArena = [&]() {
+            arena.Reset();
+            for (const auto& path : selection) {
+                arena.Append(path.data(), path.size());
+            }
+            nRead = read_all(arena);
+        };
+
+        std::vector<std::wstring> strings;
+        const auto storeAsStrings = [&]() {
+            strings.clear();
+            for (const auto& path : selection) {
+                strings.emplace_back(path.data(), path.size());
+            }
+            nRead = read_all(strings);
+        };
+
+        // the first selection grows the buffers, the ones after it reuse them
+        storeInArena();
+        size_t nAllocations = g_nAllocations;
+        storeInArena();
+        const size_t arenaAllocations = g_nAllocations - nAllocations;
+        isConsistent = isConsistent && arenaAllocations == 0 && arena.GetAllocationsCount() == 0 && nRead == nWithExtension;
+        for (size_t i = 0; i < selection.size(); i += 1) {
+            isConsistent = isConsistent && arena[i] == selection[i] && arena.CStr(i)[selection[i].size()] == 0;
+        }
+        const double arenaRate = measure(storeInArena) * nPaths;
+        isConsistent = isConsistent && nRead == nWithExtension;
+
+        storeAsStrings();
+        nAllocations = g_nAllocations;
+        storeAsStrings();
+        const size_t stringAllocations = g_nAllocations - nAllocations;
+        const double stringRate = measure(storeAsStrings) * nPaths;
+        isConsistent = isConsistent && nRead == nWithExtension;
+
+        std::printf("%6zu paths: arena %6.1f M paths/s, %zu allocations; string per path %6.1f M paths/s, %zu allocations; peak arena %zu KB\n",
+            nPaths, arenaRate / 1e6, arenaAllocations, stringRate / 1e6, stringAllocations, arena.GetPeakBytes() / 1024);
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "the arena doesn't hold what was stored in it, or allocates once grown\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "pattern_matcher.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using pattern_matcher::PatternMatcher;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() in batches for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            for (int i = 0; i < 100; i += 1) {
+                run();
+            }
+            nRuns += 100;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    bool naive_match(std::wstring_view pattern, std::wstring_view name) {
+        if (pattern.empty()) {
+            return name.empty();
+        }
+        const wchar_t p = pattern.front();
+        if (p == L'%' || p == L'*') {
+            for (size_t skip = 0; skip <= name.size(); skip += 1) {
+                if (naive_match(pattern.substr(1), name.substr(skip))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (name.empty()) {
+            return false;
+        }
+        if (p != L'?' && pattern_matcher::fold_ascii_char(p) != pattern_matcher::fold_ascii_char(name.front())) {
+            return false;
+        }
+        return naive_match(pattern.substr(1), name.substr(1));
+    }
+
+    // every pattern against every name, as a loop over the folders would
+    std::vector<size_t> naive_common_matches(const std::vector<std::wstring>& patterns, const std::vector<std::wstring>& paths) {
+        std::vector<size_t> result;
+        for (size_t i = 0; i < patterns.size(); i += 1) {
+            bool all = true;
+            for (size_t j = 0; j < paths.size() && all; j += 1) {
+                const size_t separator = paths[j].find_last_of(L'\\');
+                all = naive_match(patterns[i], std::wstring_view(paths[j]).substr(separator + 1));
+            }
+            if (all) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+}
+
+// Selections matched per second against a "Files by Pattern" folder of many patterns: the lazy DFA against
+// matching every pattern on its own
+int main() {
+    std::mt19937 random(18);
+    const wchar_t* words[] = { L"report", L"invoice", L"backup", L"notes", L"IMG_", L"test", L"draft", L"final", L"log", L"data" };
+    const wchar_t* extensions[] = { L".txt", L".csv", L".log", L".jpg", L".docx", L".tar.gz", L".md", L".json" };
+
+    bool isSame = true;
+    for (const size_t nPatterns : { 10, 50, 200 }) {
+        std::vector<std::wstring> patterns;
+        for (size_t i = 0; i < nPatterns; i += 1) {
+            std::wstring pattern;
+            switch (i % 4) {
+            case 0: pattern = std::wstring(words[random() % 10]) + L"%" + extensions[random() % 8]; break;
+            case 1: pattern = L"%" + std::wstring(words[random() % 10]) + L"%"; break;
+            case 2: pattern = std::wstring(words[random() % 10]) + L"-????" + extensions[random() % 8]; break;
+            default: pattern = L"%" + std::wstring(extensions[random() % 8]); break;
+            }
+            patterns.push_back(pattern);
+        }
+
+        // selections of a few files of the kind people keep together
+        std::vector<std::vector<std::wstring>> selections(64);
+        for (auto& selection : selections) {
+            const std::wstring word = words[random() % 10];
+            const std::wstring extension = extensions[random() % 8];
+            for (size_t i = 0, n = 1 + random() % 8; i < n; i += 1) {
+                selection.push_back(L"C:\\Users\\someone\\Documents\\" + word + L"-" + std::to_wstring(1000 + random() % 9000) + extension);
+            }
+        }
+
+        PatternMatcher matcher(patterns);
+        for (const auto& selection : selections) {
+            isSame = matcher.FindCommonMatches(selection) == naive_common_matches(patterns, selection) && isSame;
+        }
+
+        size_t next = 0;
+        size_t checksum = 0;
+        const double dfa = measure([&]() {
+            checksum += matcher.FindCommonMatches(selections[next++ % selections.size()]).size();
+        });
+        const double naive = measure([&]() {
+            checksum += naive_common_matches(patterns, selections[next++ % selections.size()]).size();
+        });
+        std::printf("%zu patterns: DFA %.0f selections/s (%zu states), naive %.0f selections/s (checksum %zu)\n",
+            nPatterns, dfa, matcher.GetStatesCount(), naive, checksum);
+    }
+    return isSame ? 0 : 1;
+}
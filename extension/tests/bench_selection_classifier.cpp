@@ -0,0 +1,154 @@
+#include "selection_classifier.h"
+#include "worker_pool.h"
+#include "fake_file_system.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace selection_classifier;
+using fake_file_system::FakeFileSystem;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // calls run() for half a second at least, returns calls per second
+    template <typename Run>
+    double measure(Run run) {
+        const auto start = Clock::now();
+        size_t nRuns = 0;
+        double seconds = 0;
+        do {
+            run();
+            nRuns += 1;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        return nRuns / seconds;
+    }
+
+    // runs every task on the calling thread
+    struct Inline {
+        template <typename Task>
+        void Run(size_t nTasks, size_t, Task task) {
+            for (size_t i = 0; i < nTasks; i += 1) {
+                task(i);
+            }
+        }
+    };
+
+    // what run_in_parallel did before the pool: threads started and joined on every call
+    struct ThreadPerCall {
+        size_t nStarted = 0;
+
+        template <typename Task>
+        void Run(size_t nTasks, size_t maxThreads, Task task) {
+            std::atomic<size_t> nextTask{ 0 };
+            auto worker = [&]() {
+                for (size_t i = nextTask++; i < nTasks; i = nextTask++) {
+                    task(i);
+                }
+            };
+
+            std::vector<std::thread> helpers;
+            for (size_t i = 1, nThreads = maxThreads < nTasks ? maxThreads : nTasks; i < nThreads; i += 1) {
+                helpers.emplace_back(worker);
+                nStarted += 1;
+            }
+            worker();
+            for (auto& helper : helpers) {
+                helper.join();
+            }
+        }
+    };
+
+    // a selection as Explorer hands it over: runs of siblings in a few folders, files of a few dozen extensions
+    void make_selection(std::mt19937& random, size_t nItems, FakeFileSystem& fileSystem, PathArena& paths) {
+        const size_t N_EXTENSIONS = 40;
+        for (size_t folder = 0; paths.size() < nItems; folder += 1) {
+            const std::wstring path = L"C:\\Users\\someone\\Pictures\\trip " + std::to_wstring(folder) + L"\\";
+            const size_t nSiblings = 1 + random() % 400;
+            for (size_t i = 0; i < nSiblings && paths.size() < nItems; i += 1) {
+                const std::wstring name = L"IMG_" + std::to_wstring(i) + L".e" + std::to_wstring(random() % N_EXTENSIONS);
+                fileSystem.Add(path, name, false);
+                const std::wstring item = path + name;
+                paths.Append(item.data(), item.size());
+            }
+        }
+    }
+
+    bool same_kinds(const SelectionKinds& a, const SelectionKinds& b) {
+        return a.haveExtensionlessFiles == b.haveExtensionlessFiles
+            && a.haveFolders == b.haveFolders
+            && a.haveFiles == b.haveFiles
+            && a.haveTooManyExtensions == b.haveTooManyExtensions
+            && a.haveExtensionsWithoutFolder == b.haveExtensionsWithoutFolder
+            && a.extensions == b.extensions;
+    }
+}
+
+// Classifying a selection of files only (nothing decides it early, every item is looked at),
+// with the file system in memory so what is measured is the classifier and its threads:
+// on one thread, on threads started for every right-click, and on the pool the extension keeps
+int main() {
+    std::mt19937 random(4);
+    ExtensionAtoms atoms(fake_file_system::fold_ascii_text);
+    SuffixTrie knownExtensions;
+    for (int i = 0; i < 30; i += 1) {
+        const std::wstring extension = L".e" + std::to_wstring(i);
+        Atom atom;
+        atoms.Intern(extension, atom);
+        knownExtensions.Insert(extension);
+    }
+
+    bool isConsistent = true;
+    worker_pool::WorkerPool pool(SelectionClassifier::MAX_THREADS - 1);
+    for (const size_t nItems : { 1000, 10000, 100000 }) {
+        FakeFileSystem fileSystem;
+        PathArena paths;
+        make_selection(random, nItems, fileSystem, paths);
+
+        Inline inlineRunner;
+        const auto expected = SelectionClassifier::Classify(paths, knownExtensions, atoms, fileSystem, inlineRunner);
+        isConsistent = isConsistent && expected.haveExtensionsWithoutFolder && expected.extensions.size() == 30;
+
+        SelectionKinds kinds;
+        const double inlineRate = measure([&]() {
+            kinds = SelectionClassifier::Classify(paths, knownExtensions, atoms, fileSystem, inlineRunner);
+        }) * nItems;
+        isConsistent = isConsistent && same_kinds(kinds, expected);
+
+        ThreadPerCall threadPerCall;
+        size_t nClicks = 0;
+        const double threadsRate = measure([&]() {
+            kinds = SelectionClassifier::Classify(paths, knownExtensions, atoms, fileSystem, threadPerCall);
+            nClicks += 1;
+        }) * nItems;
+        isConsistent = isConsistent && same_kinds(kinds, expected);
+        const double threadsPerClick = static_cast<double>(threadPerCall.nStarted) / nClicks;
+
+        // warm: whatever the pool needs is started by the first right-click
+        SelectionClassifier::Classify(paths, knownExtensions, atoms, fileSystem, pool);
+        const size_t nStarted = pool.GetStartedCount();
+        nClicks = 0;
+        const double poolRate = measure([&]() {
+            kinds = SelectionClassifier::Classify(paths, knownExtensions, atoms, fileSystem, pool);
+            nClicks += 1;
+        }) * nItems;
+        isConsistent = isConsistent && same_kinds(kinds, expected) && pool.GetStartedCount() == nStarted;
+        const double poolThreadsPerClick = static_cast<double>(pool.GetStartedCount() - nStarted) / nClicks;
+
+        std::printf("%6zu items: one thread %6.1f M items/s; threads per call %6.1f M items/s, %.1f started per click; pool %6.1f M items/s, %.1f started per click\n",
+            nItems, inlineRate / 1e6, threadsRate / 1e6, threadsPerClick, poolRate / 1e6, poolThreadsPerClick);
+    }
+
+    if (!isConsistent) {
+        std::fprintf(stderr, "classified differently on threads, or the pool started threads once warm\n");
+        return 1;
+    }
+    return 0;
+}
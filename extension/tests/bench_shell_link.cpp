@@ -0,0 +1,50 @@
+#include "shell_link_fixtures.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace fixtures;
+
+// Links parsed per second over a mix of the fixtures, what a menu with many handlers pays for reading them
+int main() {
+    std::vector<std::vector<uint8_t>> links;
+    links.push_back(build(spec_example()).bytes);
+    links.push_back(build(handler_example()).bytes);
+    Link ansi = handler_example();
+    ansi.flags &= ~shell_link::IS_UNICODE;
+    links.push_back(build(ansi).bytes);
+    Link network = spec_example();
+    network.linkInfo = network_link_info("\\\\server\\share", "tools\\app.exe");
+    links.push_back(build(network).bytes);
+
+    size_t nBytes = 0;
+    for (const auto& link : links) {
+        nBytes += link.size();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    size_t nParsed = 0;
+    size_t nFailed = 0;
+    size_t checksum = 0;
+    double seconds = 0;
+    do {
+        for (int round = 0; round < 1000; round += 1) {
+            for (const auto& bytes : links) {
+                shell_link::ShellLink link;
+                if (shell_link::parse(bytes.data(), bytes.size(), link)) {
+                    checksum += link.targetPath.size();
+                }
+                else {
+                    nFailed += 1;
+                }
+            }
+        }
+        nParsed += 1000 * links.size();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < 0.5);
+
+    std::printf("shell_link::parse: %.0f links/s, %.1f MB/s (%zu links, %zu bytes each on average, checksum %zu)\n",
+        nParsed / seconds, nParsed * (double(nBytes) / links.size()) / seconds / 1e6, nParsed, nBytes / links.size(), checksum);
+    return nFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+Just enough of a test harness for the portable headers: CHECK reports a failed condition and carries on,
+so one run shows every failure; main returns check::report().
+*/
+
+#include <cstdio>
+
+namespace check {
+
+    inline int& failures() {
+        static int nFailures = 0;
+        return nFailures;
+    }
+
+    inline bool expect(bool condition, const char* text, const char* file, int line) {
+        if (!condition) {
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, text);
+            failures() += 1;
+        }
+        return condition;
+    }
+
+    inline int report() {
+        if (failures() != 0) {
+            std::fprintf(stderr, "%d check(s) failed\n", failures());
+            return 1;
+        }
+        std::puts("all checks passed");
+        return 0;
+    }
+}
+
+#define CHECK(condition) check::expect(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+selection_classifier.h's file system in memory, counting how it's asked: item by item,
+as GetFileAttributes does on Windows, or folder by folder, as FindFirstFile does.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fake_file_system {
+
+    // what ExtensionAtoms and SuffixTrie fold with in tests: ASCII only
+    inline void fold_ascii_text(wchar_t* text, size_t length) {
+        for (size_t i = 0; i < length; i += 1) {
+            if (text[i] >= L'a' && text[i] <= L'z') {
+                text[i] = static_cast<wchar_t>(text[i] - (L'a' - L'A'));
+            }
+        }
+    }
+
+    class FakeFileSystem {
+    public:
+        // a folder's entries up to maxEntries, as SiblingsListing lists them
+        class Listing {
+        public:
+            // entries outlive the listing
+            Listing(const std::vector<std::pair<std::wstring, bool>>& entries, size_t maxEntries) {
+                for (size_t i = 0; i < entries.size() && i < maxEntries; i += 1) {
+                    m_isDirectory.emplace(entries[i].first, entries[i].second);
+                }
+            }
+
+            bool IsDirectory(std::wstring_view name, bool& isDirectory) const {
+                const auto found = m_isDirectory.find(name);
+                if (found == m_isDirectory.end()) {
+                    return false;
+                }
+                isDirectory = found->second;
+                return true;
+            }
+
+        private:
+            std::unordered_map<std::wstring_view, bool> m_isDirectory;
+        };
+
+        // folder ends with a separator
+        void Add(const std::wstring& folder, const std::wstring& name, bool isDirectory) {
+            m_entries[folder].push_back({ name, isDirectory });
+            if (isDirectory) {
+                m_directories.insert(folder + name);
+            }
+        }
+
+        bool IsDirectory(const wchar_t* path) {
+            nLookups += 1;
+            return m_directories.count(path) != 0;
+        }
+
+        std::unique_ptr<Listing> ListSiblings(std::wstring folder, size_t maxEntries) {
+            nListings += 1;
+            static const std::vector<std::pair<std::wstring, bool>> none;
+            const auto found = m_entries.find(folder);
+            return std::make_unique<Listing>(found == m_entries.end() ? none : found->second, maxEntries);
+        }
+
+        std::atomic<size_t> nLookups{ 0 };
+        std::atomic<size_t> nListings{ 0 };
+
+    private:
+        std::unordered_map<std::wstring, std::vector<std::pair<std::wstring, bool>>> m_entries;
+        std::unordered_set<std::wstring> m_directories;
+    };
+}
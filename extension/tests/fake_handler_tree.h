@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+handler_groups.h's catalog in memory: a tree of handler folders, listed once each, as HandlerCatalog
+lists them, and taking listingTime to list as the disk would. Counts its listings.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fake_handler_tree {
+
+    struct FakeSnapshot {
+        std::vector<std::wstring> files;
+        std::vector<std::wstring> subfolders;
+        bool haveIdentity = false;
+        int identity = 0;
+    };
+
+    class FakeCatalog {
+    public:
+        std::chrono::microseconds listingTime{ 0 };
+
+        // a folder of nFiles handlers, its identity a number of its own unless given one
+        void Add(const std::wstring& path, size_t nFiles, int identity = 0) {
+            auto& snapshot = m_folders[path];
+            snapshot = std::make_shared<FakeSnapshot>();
+            snapshot->haveIdentity = true;
+            snapshot->identity = identity != 0 ? identity : static_cast<int>(m_folders.size());
+            for (size_t i = 0; i < nFiles; i += 1) {
+                snapshot->files.push_back(path + L"\\handler " + std::to_wstring(i) + L".lnk");
+            }
+            const size_t separator = path.rfind(L'\\');
+            if (separator != std::wstring::npos) {
+                const auto parent = m_folders.find(path.substr(0, separator));
+                if (parent != m_folders.end()) {
+                    parent->second->subfolders.push_back(path.substr(separator + 1));
+                }
+            }
+        }
+
+        // levels[0] subfolders under root, levels[1] under each of them and so on, nFiles handlers in each
+        void AddTree(const std::wstring& root, const std::vector<size_t>& levels, size_t nFiles) {
+            if (m_folders.count(root) == 0) {
+                Add(root, 0);
+            }
+            if (levels.empty()) {
+                return;
+            }
+            const std::vector<size_t> deeper(levels.begin() + 1, levels.end());
+            for (size_t i = 0; i < levels[0]; i += 1) {
+                const std::wstring path = root + L"\\group " + std::to_wstring(i);
+                Add(path, nFiles);
+                AddTree(path, deeper, nFiles);
+            }
+        }
+
+        std::shared_ptr<const FakeSnapshot> GetFolder(const std::wstring& path) {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                const auto listed = m_listed.find(path);
+                if (listed != m_listed.end()) {
+                    return listed->second;
+                }
+            }
+
+            if (listingTime.count() > 0) {
+                std::this_thread::sleep_for(listingTime);
+            }
+            nListings += 1;
+            const auto found = m_folders.find(path);
+            // a folder that is gone lists as empty
+            auto snapshot = found != m_folders.end() ? found->second : std::make_shared<FakeSnapshot>();
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_listed.emplace(path, snapshot);
+            return snapshot;
+        }
+
+        bool IsListed(const std::wstring& path) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_listed.count(path) != 0;
+        }
+
+        // as after Explorer restarts: nothing is in memory
+        void Forget() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_listed.clear();
+        }
+
+        const FakeSnapshot& GetRoot(const std::wstring& root) {
+            return *m_folders.at(root);
+        }
+
+        std::atomic<size_t> nListings{ 0 };
+
+    private:
+        // made up before anything is listed, only read after
+        std::unordered_map<std::wstring, std::shared_ptr<FakeSnapshot>> m_folders;
+
+        std::mutex m_lock;
+        std::unordered_map<std::wstring, std::shared_ptr<const FakeSnapshot>> m_listed;
+    };
+}
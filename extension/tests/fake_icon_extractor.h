@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+icon_loader.h's backend in memory: handlers are paths, an icon is extracted in extractionTime
+(as the shell takes its time to) and only while the extractor isn't held. Counts its extractions.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace fake_icon_extractor {
+
+    struct FakeIcon {
+        std::wstring path;
+    };
+
+    // worker threads the extractors were used on, started and not ended yet
+    inline std::atomic<int> g_nLiveScopes{ 0 };
+
+    // extractors are made by their loaders: what they have in common with the test is here
+    struct Extractions {
+        std::chrono::microseconds extractionTime{ 0 };
+        std::atomic<size_t> nExtracted{ 0 };
+
+        // while held, extractions wait
+        void Hold() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isHeld = true;
+        }
+
+        void Release() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isHeld = false;
+            m_released.notify_all();
+        }
+
+        void WaitUntilReleased() {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_released.wait(lock, [this]() { return !m_isHeld; });
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_released;
+        bool m_isHeld = false;
+    };
+
+    class FakeExtractor {
+    public:
+        using Handler = std::wstring;
+        using Icon = FakeIcon;
+
+        struct ThreadScope {
+            ThreadScope() {
+                g_nLiveScopes += 1;
+            }
+
+            ~ThreadScope() {
+                g_nLiveScopes -= 1;
+            }
+        };
+
+        // set before the first Load
+        Extractions* extractions = nullptr;
+
+        const std::wstring& GetKey(const std::wstring& handler) const {
+            return handler;
+        }
+
+        std::shared_ptr<const FakeIcon> Find(const std::wstring& handler) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            const auto found = m_cache.find(handler);
+            return found != m_cache.end() ? found->second : nullptr;
+        }
+
+        std::shared_ptr<const FakeIcon> Extract(const std::wstring& handler) {
+            extractions->WaitUntilReleased();
+            if (extractions->extractionTime.count() > 0) {
+                std::this_thread::sleep_for(extractions->extractionTime);
+            }
+            extractions->nExtracted += 1;
+            auto icon = std::make_shared<const FakeIcon>(FakeIcon{ handler });
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_cache[handler] = icon;
+            return icon;
+        }
+
+        // as after Explorer restarts: no icon is in memory
+        void Forget() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_cache.clear();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::unordered_map<std::wstring, std::shared_ptr<const FakeIcon>> m_cache;
+    };
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+/*
+Icon files built byte by byte, for the icon_decode test and benchmark: BMP entries of any bit depth from pixels
+given top-down, the way they are meant to look, and .ico directories around them.
+*/
+
+#include "icon_decode.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace fixtures {
+
+    inline void put_u16(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    inline void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int i = 0; i < 4; i += 1) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    struct Dib {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bitCount = 32;
+        uint32_t compression = 0;           // BI_RGB; BI_BITFIELDS (3) adds the three masks after the header
+        std::vector<uint32_t> palette;      // 0x00RRGGBB, for 1, 4 and 8 bits per pixel
+        std::vector<uint32_t> pixels;       // top-down; palette indexes, or 0xAARRGGBB (alpha ignored below 32 bits)
+        std::vector<bool> transparent;      // top-down AND mask; left out of the entry if empty
+    };
+
+    // BITMAPINFOHEADER with the height of both XOR and AND rows, palette, XOR rows, AND rows; rows bottom-up
+    inline std::vector<uint8_t> build_dib(const Dib& dib) {
+        std::vector<uint8_t> out;
+        put_u32(out, 40);
+        put_u32(out, dib.width);
+        put_u32(out, dib.height * 2);
+        put_u16(out, 1);
+        put_u16(out, dib.bitCount);
+        put_u32(out, dib.compression);
+        put_u32(out, 0);
+        put_u32(out, 0);
+        put_u32(out, 0);
+        put_u32(out, static_cast<uint32_t>(dib.palette.size()));
+        put_u32(out, 0);
+        if (dib.compression == 3) {
+            put_u32(out, 0x00FF0000);
+            put_u32(out, 0x0000FF00);
+            put_u32(out, 0x000000FF);
+        }
+        for (const uint32_t color : dib.palette) {
+            put_u32(out, color & 0xFFFFFF);
+        }
+
+        const size_t xorStride = (size_t(dib.width) * dib.bitCount + 31) / 32 * 4;
+        for (uint32_t y = dib.height; y-- > 0;) {
+            std::vector<uint8_t> row(xorStride, 0);
+            for (uint32_t x = 0; x < dib.width; x += 1) {
+                const uint32_t value = dib.pixels[size_t(y) * dib.width + x];
+                if (dib.bitCount >= 24) {
+                    for (uint32_t byte = 0; byte < dib.bitCount / 8; byte += 1) {
+                        row[size_t(x) * dib.bitCount / 8 + byte] = static_cast<uint8_t>(value >> (8 * byte));
+                    }
+                }
+                else {
+                    const size_t bit = size_t(x) * dib.bitCount;
+                    row[bit / 8] |= static_cast<uint8_t>(value << (8 - dib.bitCount - bit % 8));
+                }
+            }
+            out.insert(out.end(), row.begin(), row.end());
+        }
+
+        if (!dib.transparent.empty()) {
+            const size_t andStride = (size_t(dib.width) + 31) / 32 * 4;
+            for (uint32_t y = dib.height; y-- > 0;) {
+                std::vector<uint8_t> row(andStride, 0);
+                for (uint32_t x = 0; x < dib.width; x += 1) {
+                    if (dib.transparent[size_t(y) * dib.width + x]) {
+                        row[x / 8] |= static_cast<uint8_t>(0x80 >> (x % 8));
+                    }
+                }
+                out.insert(out.end(), row.begin(), row.end());
+            }
+        }
+        return out;
+    }
+
+    struct Entry {
+        uint32_t width = 0;                 // as the directory says, 256 is written as 0
+        uint32_t height = 0;
+        uint32_t bitCount = 0;
+        std::vector<uint8_t> image;         // a BMP entry from build_dib, or PNG bytes
+    };
+
+    inline std::vector<uint8_t> build_icon(const std::vector<Entry>& entries) {
+        std::vector<uint8_t> out;
+        put_u16(out, 0);
+        put_u16(out, 1);
+        put_u16(out, static_cast<uint32_t>(entries.size()));
+        size_t offset = 6 + 16 * entries.size();
+        for (const auto& entry : entries) {
+            out.push_back(static_cast<uint8_t>(entry.width));
+            out.push_back(static_cast<uint8_t>(entry.height));
+            out.push_back(0);
+            out.push_back(0);
+            put_u16(out, 1);
+            put_u16(out, entry.bitCount);
+            put_u32(out, static_cast<uint32_t>(entry.image.size()));
+            put_u32(out, static_cast<uint32_t>(offset));
+            offset += entry.image.size();
+        }
+        for (const auto& entry : entries) {
+            out.insert(out.end(), entry.image.begin(), entry.image.end());
+        }
+        return out;
+    }
+
+    // a side x side 32 bit entry with alpha, pixels from the seed
+    inline Entry alpha_entry(uint32_t side, uint32_t seed) {
+        Dib dib;
+        dib.width = side;
+        dib.height = side;
+        for (uint32_t i = 0; i < side * side; i += 1) {
+            seed = seed * 1664525u + 1013904223u;
+            dib.pixels.push_back(seed);
+        }
+        dib.transparent.assign(size_t(side) * side, false);
+        return { side, side, 32, build_dib(dib) };
+    }
+
+    // a side x side 8 bit entry with a mask, the kind old icons have next to the 32 bit ones
+    inline Entry paletted_entry(uint32_t side, uint32_t seed) {
+        Dib dib;
+        dib.width = side;
+        dib.height = side;
+        dib.bitCount = 8;
+        for (uint32_t i = 0; i < 256; i += 1) {
+            dib.palette.push_back(i * 0x010101);
+        }
+        for (uint32_t i = 0; i < side * side; i += 1) {
+            seed = seed * 1664525u + 1013904223u;
+            dib.pixels.push_back(seed >> 24);
+            dib.transparent.push_back((seed & 0x100) != 0);
+        }
+        return { side, side, 8, build_dib(dib) };
+    }
+
+    // what a program's icon file usually has
+    inline std::vector<uint8_t> typical_icon() {
+        return build_icon({ alpha_entry(16, 1), alpha_entry(32, 2), alpha_entry(48, 3), paletted_entry(16, 4), paletted_entry(32, 5) });
+    }
+}
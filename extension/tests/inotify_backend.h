@@ -0,0 +1,167 @@
+#pragma once
+
+/*
+handler_catalog.h's backend on Linux: inotify where it can watch a folder, modification time where it can't
+(the folder doesn't exist yet), as the Windows one does with change notifications and last write time.
+*/
+
+#include "handler_catalog.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace inotify_backend {
+
+    // What a folder contained last time it was listed
+    struct FolderSnapshot {
+        bool exists = false;
+        std::vector<std::string> files;
+        std::vector<std::string> subfolders;
+    };
+
+    inline bool get_modification_time(const std::string& path, timespec& time) {
+        struct stat status;
+        if (0 != ::stat(path.c_str(), &status)) {
+            return false;
+        }
+        time = status.st_mtim;
+        return true;
+    }
+
+    inline std::shared_ptr<const FolderSnapshot> scan_folder(const std::string& folder) {
+        auto snapshot = std::make_shared<FolderSnapshot>();
+        DIR* directory = ::opendir(folder.c_str());
+        if (!directory) {
+            snapshot->exists = errno != ENOENT && errno != ENOTDIR;
+            return snapshot;
+        }
+        snapshot->exists = true;
+        while (const dirent* entry = ::readdir(directory)) {
+            const std::string name = entry->d_name;
+            if (name == "." || name == ".." || name.front() == '.') {
+                continue;
+            }
+            struct stat status;
+            if (0 != ::stat((folder + "/" + name).c_str(), &status)) {
+                continue;
+            }
+            (S_ISDIR(status.st_mode) ? snapshot->subfolders : snapshot->files).push_back(name);
+        }
+        ::closedir(directory);
+        return snapshot;
+    }
+
+    class InotifyFolderBackend final {
+    public:
+        using Path = std::string;
+        using Snapshot = FolderSnapshot;
+
+        struct Watch {
+            int descriptor = -1;
+            timespec modificationTime = { 0, 0 };
+        };
+
+        InotifyFolderBackend()
+            : m_inotify(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+        {}
+
+        InotifyFolderBackend(const InotifyFolderBackend&) = delete;
+        InotifyFolderBackend& operator=(const InotifyFolderBackend&) = delete;
+
+        ~InotifyFolderBackend() {
+            if (m_inotify >= 0) {
+                ::close(m_inotify);
+            }
+        }
+
+        bool IsStale(const std::string& folder, const Watch& watch, const FolderSnapshot& snapshot) {
+            if (watch.descriptor >= 0) {
+                Drain();
+                return m_changed.count(watch.descriptor) != 0;
+            }
+
+            timespec modificationTime = { 0, 0 };
+            const bool exists = get_modification_time(folder, modificationTime);
+            return exists != snapshot.exists
+                || modificationTime.tv_sec != watch.modificationTime.tv_sec
+                || modificationTime.tv_nsec != watch.modificationTime.tv_nsec;
+        }
+
+        void Rearm(const std::string& folder, Watch& watch) {
+            if (watch.descriptor >= 0) {
+                // events read after this are of changes made from now on
+                Drain();
+                if (m_changed.erase(watch.descriptor) != 0 && m_removed.erase(watch.descriptor) != 0) {
+                    // the folder itself is gone, its watch with it
+                    watch.descriptor = -1;
+                }
+            }
+            if (watch.descriptor < 0 && m_inotify >= 0) {
+                const int descriptor = ::inotify_add_watch(m_inotify, folder.c_str(),
+                    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+                // the same folder watched anew after it was removed gets a new descriptor, an old one may be reused
+                if (descriptor >= 0) {
+                    m_changed.erase(descriptor);
+                    m_removed.erase(descriptor);
+                }
+                watch.descriptor = descriptor;
+            }
+            if (watch.descriptor < 0) {
+                watch.modificationTime = { 0, 0 };
+                get_modification_time(folder, watch.modificationTime);
+            }
+        }
+
+        std::shared_ptr<const FolderSnapshot> Scan(const std::string& folder, bool) {
+            return scan_folder(folder);
+        }
+
+        void Close(Watch& watch) {
+            if (watch.descriptor >= 0) {
+                ::inotify_rm_watch(m_inotify, watch.descriptor);
+                watch.descriptor = -1;
+            }
+        }
+
+        // whether inotify is there at all; without it every folder is told by modification time
+        bool IsWatching() const {
+            return m_inotify >= 0;
+        }
+
+    private:
+        void Drain() {
+            alignas(inotify_event) char buffer[16 * 1024];
+            for (;;) {
+                const ssize_t nRead = ::read(m_inotify, buffer, sizeof(buffer));
+                if (nRead <= 0) {
+                    return;
+                }
+                for (ssize_t offset = 0; offset < nRead;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    m_changed.insert(event->wd);
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                        m_removed.insert(event->wd);
+                    }
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        int m_inotify;
+        // watches with events since they were last armed
+        std::unordered_set<int> m_changed;
+        // of them, watches of folders that are gone
+        std::unordered_set<int> m_removed;
+    };
+
+    using FolderCache = handler_catalog::FolderCache<InotifyFolderBackend>;
+}
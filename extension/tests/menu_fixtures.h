@@ -0,0 +1,123 @@
+#pragma once
+
+/*
+Handler folders made up in memory, and a menu drawn as text, for the menu_layout and fingerprint_set tests
+and benchmarks: what menu_layout::MenuLayout walks and builds without a single HMENU.
+*/
+
+#include "menu_layout.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fixtures {
+
+    // a handler as far as the layout goes: what it launches, and a name to tell which copy was kept
+    struct Handler {
+        std::wstring name;
+        uint64_t fingerprint = 0;
+    };
+
+    struct Folder {
+        std::vector<Handler> handlers;
+        std::vector<std::pair<std::wstring, Folder>> groups;
+    };
+
+    // handlers added to the menu, in the order of their command offsets
+    struct Source {
+        const std::unordered_map<std::wstring, double>* scores = nullptr;
+        std::vector<std::wstring> added;
+
+        std::vector<const Handler*> Rank(const Folder& folder) const {
+            std::vector<const Handler*> handlers;
+            for (const auto& handler : folder.handlers) {
+                handlers.push_back(&handler);
+            }
+            if (!scores) {
+                return handlers;
+            }
+            return menu_layout::rank_by_score(handlers, [this](const Handler* handler) {
+                const auto found = scores->find(handler->name);
+                return found == scores->end() ? 0.0 : found->second;
+            });
+        }
+
+        uint64_t GetFingerprint(const Handler* handler) const {
+            return handler->fingerprint;
+        }
+
+        void Add(const Handler* handler) {
+            added.push_back(handler->name);
+        }
+
+        template <typename OnGroup>
+        void ForEachGroup(const Folder& folder, OnGroup onGroup) const {
+            for (const auto& group : folder.groups) {
+                onGroup(group.first, group.second);
+            }
+        }
+    };
+
+    // the menu as lines: "[title" opens a submenu and "]" closes it, "name #offset", "---", "open #offset"
+    struct TextBuilder {
+        const std::vector<std::wstring>& added;
+        std::vector<std::wstring> lines;
+
+        void BeginSubmenu(const std::wstring& title) {
+            lines.push_back(L"[" + title);
+        }
+
+        void EndSubmenu() {
+            lines.push_back(L"]");
+        }
+
+        void AddHandler(size_t offset) {
+            lines.push_back(added[offset] + L" #" + std::to_wstring(offset));
+        }
+
+        void AddSeparator() {
+            lines.push_back(L"---");
+        }
+
+        void AddOpenFolder(size_t offset) {
+            lines.push_back(L"open #" + std::to_wstring(offset));
+        }
+    };
+
+    inline uint64_t fnv(const std::wstring& text) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (const wchar_t c : text) {
+            hash = (hash ^ static_cast<uint16_t>(c)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Sections of folders of handlers, many of them the same few tools under other names, as menus built
+    // from several sections (an extension's, all files', everything's) have them
+    inline std::vector<Folder> make_sections(std::mt19937& random, size_t nHandlers, size_t nTools) {
+        std::vector<Folder> sections;
+        size_t nMade = 0;
+        while (nMade < nHandlers) {
+            Folder section;
+            const size_t nGroups = 1 + random() % 4;
+            for (size_t g = 0; g <= nGroups && nMade < nHandlers; g += 1) {
+                Folder* folder = &section;
+                if (g > 0) {
+                    section.groups.emplace_back(L"group" + std::to_wstring(g), Folder());
+                    folder = &section.groups.back().second;
+                }
+                const size_t n = 1 + random() % 64;
+                for (size_t i = 0; i < n && nMade < nHandlers; i += 1) {
+                    const std::wstring tool = L"C:\\Tools\\tool" + std::to_wstring(random() % nTools) + L".exe|" + std::to_wstring(random() % 3);
+                    folder->handlers.push_back({ L"handler" + std::to_wstring(nMade), fnv(tool) });
+                    nMade += 1;
+                }
+            }
+            sections.push_back(std::move(section));
+        }
+        return sections;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+launch_scheduler.h's spawner on Linux: posix_spawn and waitpid, as the Windows one does with
+ShellExecuteEx and WaitForMultipleObjects. Every command line is split on spaces into arguments.
+*/
+
+#include "launch_scheduler.h"
+
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+extern char** environ;
+
+namespace posix_spawner {
+
+    class PosixSpawner {
+    public:
+        using Process = pid_t;
+
+        explicit PosixSpawner(std::string program)
+            : m_program(std::move(program))
+        {}
+
+        launch_scheduler::Spawned Spawn(const std::wstring& arguments, bool keepProcess, pid_t& process) {
+            // command lines of the tests are plain ASCII
+            std::vector<std::string> words(1, m_program);
+            std::string word;
+            for (const wchar_t c : arguments + L" ") {
+                if (c != L' ') {
+                    word.push_back(static_cast<char>(c));
+                }
+                else if (!word.empty()) {
+                    words.push_back(word);
+                    word.clear();
+                }
+            }
+            std::vector<char*> argv;
+            for (auto& argument : words) {
+                argv.push_back(&argument.front());
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid = 0;
+            if (::posix_spawn(&pid, m_program.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+                return launch_scheduler::Spawned::Failed;
+            }
+            m_nSpawned += 1;
+            m_nRunning += 1;
+            m_maxRunning = m_nRunning > m_maxRunning ? m_nRunning : m_maxRunning;
+            if (keepProcess) {
+                process = pid;
+            }
+            return launch_scheduler::Spawned::Started;
+        }
+
+        size_t WaitForAny(const std::vector<pid_t>& processes) {
+            while (true) {
+                const pid_t pid = ::waitpid(-1, nullptr, 0);
+                if (pid <= 0) {
+                    return 0;
+                }
+                m_nRunning -= 1;
+                for (size_t i = 0; i < processes.size(); i += 1) {
+                    if (processes[i] == pid) {
+                        return i;
+                    }
+                }
+                // one that wasn't kept to be waited for
+            }
+        }
+
+        void Close(pid_t) {}
+
+        // waits for the processes nobody waited for, so none is left a zombie
+        void ReapAll() {
+            while (::waitpid(-1, nullptr, 0) > 0) {
+                m_nRunning -= 1;
+            }
+        }
+
+        size_t GetSpawnedCount() const {
+            return m_nSpawned;
+        }
+
+        // most processes running at once, as far as the spawner knows: a process counts until it's reaped
+        size_t GetMaxRunning() const {
+            return m_maxRunning;
+        }
+
+        size_t GetRunningCount() const {
+            return m_nRunning;
+        }
+
+    private:
+        const std::string m_program;
+        size_t m_nSpawned = 0;
+        size_t m_nRunning = 0;
+        size_t m_maxRunning = 0;
+    };
+}
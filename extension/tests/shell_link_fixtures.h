@@ -0,0 +1,277 @@
+#pragma once
+
+/*
+.lnk files built byte by byte to the [MS-SHLLINK] layouts, for the shell_link test and benchmark.
+Offsets the format has in it are written as placeholders and patched once what they point to is there.
+*/
+
+#include "shell_link.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fixtures {
+
+    class Writer {
+    public:
+        size_t Size() const {
+            return m_bytes.size();
+        }
+
+        const std::vector<uint8_t>& Bytes() const {
+            return m_bytes;
+        }
+
+        void PutU16(uint32_t value) {
+            m_bytes.push_back(static_cast<uint8_t>(value));
+            m_bytes.push_back(static_cast<uint8_t>(value >> 8));
+        }
+
+        // returns where the value is, to patch it later
+        size_t PutU32(uint32_t value) {
+            const size_t at = m_bytes.size();
+            for (int i = 0; i < 4; i += 1) {
+                m_bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+            return at;
+        }
+
+        void PatchU32(size_t at, size_t value) {
+            for (int i = 0; i < 4; i += 1) {
+                m_bytes[at + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        void PutBytes(const std::vector<uint8_t>& bytes) {
+            m_bytes.insert(m_bytes.end(), bytes.begin(), bytes.end());
+        }
+
+        // NUL terminated
+        void PutAnsi(const std::string& text) {
+            m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+            m_bytes.push_back(0);
+        }
+
+        void PutUnicode(const std::u16string& text) {
+            for (const char16_t c : text) {
+                PutU16(c);
+            }
+            PutU16(0);
+        }
+
+    private:
+        std::vector<uint8_t> m_bytes;
+    };
+
+    // an id list with the My Computer root item only; the parser skips id lists, it only has to be well formed
+    inline std::vector<uint8_t> my_computer_id_list() {
+        Writer list;
+        list.PutU16(0x14);
+        list.PutBytes({ 0x1F, 0x50, 0xE0, 0x4F, 0xD0, 0x20, 0xEA, 0x3A, 0x69, 0x10, 0xA2, 0xD8, 0x08, 0x00, 0x2B, 0x30, 0x30, 0x9D });
+        list.PutU16(0);
+        return list.Bytes();
+    }
+
+    // LinkInfo of a file on a local volume; with a Unicode base path and suffix, the header is the longer one that has their offsets
+    inline std::vector<uint8_t> local_link_info(const std::string& basePath, const std::string& suffix,
+        const std::u16string* unicodeBasePath = nullptr, const std::u16string* unicodeSuffix = nullptr)
+    {
+        const bool haveUnicode = unicodeBasePath != nullptr;
+        Writer info;
+        const size_t sizeAt = info.PutU32(0);
+        info.PutU32(haveUnicode ? 0x24 : 0x1C);
+        info.PutU32(shell_link::VOLUME_ID_AND_LOCAL_BASE_PATH);
+        const size_t volumeIdAt = info.PutU32(0);
+        const size_t basePathAt = info.PutU32(0);
+        info.PutU32(0);
+        const size_t suffixAt = info.PutU32(0);
+        const size_t unicodeBasePathAt = haveUnicode ? info.PutU32(0) : 0;
+        const size_t unicodeSuffixAt = haveUnicode ? info.PutU32(0) : 0;
+
+        // VolumeID: a fixed disk with an empty label
+        info.PatchU32(volumeIdAt, info.Size());
+        info.PutU32(0x11);
+        info.PutU32(3);
+        info.PutU32(0x307A8A81);
+        info.PutU32(0x10);
+        info.PutAnsi("");
+
+        info.PatchU32(basePathAt, info.Size());
+        info.PutAnsi(basePath);
+        info.PatchU32(suffixAt, info.Size());
+        info.PutAnsi(suffix);
+        if (haveUnicode) {
+            info.PatchU32(unicodeBasePathAt, info.Size());
+            info.PutUnicode(*unicodeBasePath);
+            info.PatchU32(unicodeSuffixAt, info.Size());
+            info.PutUnicode(unicodeSuffix ? *unicodeSuffix : std::u16string());
+        }
+        info.PatchU32(sizeAt, info.Size());
+        return info.Bytes();
+    }
+
+    // LinkInfo of a file on a share; with a Unicode share name, CommonNetworkRelativeLink is the longer one
+    inline std::vector<uint8_t> network_link_info(const std::string& netName, const std::string& suffix,
+        const std::u16string* unicodeNetName = nullptr)
+    {
+        const bool haveUnicode = unicodeNetName != nullptr;
+        Writer info;
+        const size_t sizeAt = info.PutU32(0);
+        info.PutU32(0x1C);
+        info.PutU32(shell_link::COMMON_NETWORK_RELATIVE_LINK_AND_PATH_SUFFIX);
+        info.PutU32(0);
+        info.PutU32(0);
+        const size_t networkLinkAt = info.PutU32(0);
+        const size_t suffixAt = info.PutU32(0);
+
+        const size_t networkLink = info.Size();
+        info.PatchU32(networkLinkAt, networkLink);
+        const size_t networkLinkSizeAt = info.PutU32(0);
+        info.PutU32(0);
+        const size_t netNameAt = info.PutU32(0);
+        info.PutU32(0);
+        info.PutU32(0x00020000); // WNNC_NET_LANMAN
+        const size_t unicodeNetNameAt = haveUnicode ? info.PutU32(0) : 0;
+        if (haveUnicode) {
+            info.PutU32(0);
+        }
+        info.PatchU32(netNameAt, info.Size() - networkLink);
+        info.PutAnsi(netName);
+        if (haveUnicode) {
+            info.PatchU32(unicodeNetNameAt, info.Size() - networkLink);
+            info.PutUnicode(*unicodeNetName);
+        }
+        info.PatchU32(networkLinkSizeAt, info.Size() - networkLink);
+
+        info.PatchU32(suffixAt, info.Size());
+        info.PutAnsi(suffix);
+        info.PatchU32(sizeAt, info.Size());
+        return info.Bytes();
+    }
+
+    // EnvironmentVariableDataBlock or IconEnvironmentDataBlock: the same path in fixed size ANSI and Unicode fields
+    inline std::vector<uint8_t> environment_block(uint32_t signature, const std::string& ansi, const std::u16string& unicode) {
+        Writer block;
+        block.PutU32(shell_link::ENVIRONMENT_BLOCK_SIZE);
+        block.PutU32(signature);
+        std::vector<uint8_t> ansiField(shell_link::ENVIRONMENT_ANSI_CHARS, 0);
+        std::copy(ansi.begin(), ansi.end(), ansiField.begin());
+        block.PutBytes(ansiField);
+        for (uint32_t i = 0; i < shell_link::ENVIRONMENT_ANSI_CHARS; i += 1) {
+            block.PutU16(i < unicode.size() ? unicode[i] : 0);
+        }
+        return block.Bytes();
+    }
+
+    struct Link {
+        uint32_t flags = 0;
+        uint32_t fileAttributes = 0x20;
+        int32_t iconIndex = 0;
+        uint32_t showCommand = 1;
+        std::vector<uint8_t> idList;    // written if flags have HAS_LINK_TARGET_ID_LIST
+        std::vector<uint8_t> linkInfo;  // written if flags have HAS_LINK_INFO
+        std::u16string name;            // these are written if their flags are set, in UTF-16 or Latin-1 as IS_UNICODE says
+        std::u16string relativePath;
+        std::u16string workingDirectory;
+        std::u16string arguments;
+        std::u16string iconLocation;
+        std::vector<std::vector<uint8_t>> extraBlocks;
+        bool haveTerminalBlock = true;
+    };
+
+    struct Built {
+        std::vector<uint8_t> bytes;
+        size_t extraDataOffset = 0;
+    };
+
+    inline Built build(const Link& link) {
+        Writer file;
+        file.PutU32(shell_link::HEADER_SIZE);
+        file.PutBytes(std::vector<uint8_t>(std::begin(shell_link::LINK_CLSID), std::end(shell_link::LINK_CLSID)));
+        file.PutU32(link.flags);
+        file.PutU32(link.fileAttributes);
+        for (int i = 0; i < 3; i += 1) {
+            // creation, access and write times
+            file.PutU32(0xD2E4C3A0);
+            file.PutU32(0x01C8A3E6);
+        }
+        file.PutU32(0x1000);
+        file.PutU32(static_cast<uint32_t>(link.iconIndex));
+        file.PutU32(link.showCommand);
+        file.PutU16(0);
+        file.PutU16(0);
+        file.PutU32(0);
+        file.PutU32(0);
+
+        if (link.flags & shell_link::HAS_LINK_TARGET_ID_LIST) {
+            file.PutU16(static_cast<uint32_t>(link.idList.size()));
+            file.PutBytes(link.idList);
+        }
+        if (link.flags & shell_link::HAS_LINK_INFO) {
+            file.PutBytes(link.linkInfo);
+        }
+
+        const std::pair<uint32_t, const std::u16string*> strings[] = {
+            { shell_link::HAS_NAME, &link.name },
+            { shell_link::HAS_RELATIVE_PATH, &link.relativePath },
+            { shell_link::HAS_WORKING_DIR, &link.workingDirectory },
+            { shell_link::HAS_ARGUMENTS, &link.arguments },
+            { shell_link::HAS_ICON_LOCATION, &link.iconLocation }
+        };
+        for (const auto& string : strings) {
+            if (link.flags & string.first) {
+                file.PutU16(static_cast<uint32_t>(string.second->size()));
+                for (const char16_t c : *string.second) {
+                    if (link.flags & shell_link::IS_UNICODE) {
+                        file.PutU16(c);
+                    }
+                    else {
+                        file.PutBytes({ static_cast<uint8_t>(c) });
+                    }
+                }
+            }
+        }
+
+        Built built;
+        built.extraDataOffset = file.Size();
+        for (const auto& block : link.extraBlocks) {
+            file.PutBytes(block);
+        }
+        if (link.haveTerminalBlock) {
+            file.PutU32(0);
+        }
+        built.bytes = file.Bytes();
+        return built;
+    }
+
+    // The example in [MS-SHLLINK] section 3: a link to C:\test\a.txt
+    inline Link spec_example() {
+        Link link;
+        link.flags = shell_link::HAS_LINK_TARGET_ID_LIST | shell_link::HAS_LINK_INFO | shell_link::HAS_RELATIVE_PATH
+            | shell_link::HAS_WORKING_DIR | shell_link::IS_UNICODE | 0x80000; // EnableTargetMetadata
+        link.idList = my_computer_id_list();
+        link.linkInfo = local_link_info("C:\\test\\a.txt", "");
+        link.relativePath = u".\\a.txt";
+        link.workingDirectory = u"C:\\test";
+        return link;
+    }
+
+    // What a handler link usually is: a program with arguments, an icon and a %VARIABLE% target
+    inline Link handler_example() {
+        Link link;
+        link.flags = shell_link::HAS_LINK_TARGET_ID_LIST | shell_link::HAS_LINK_INFO | shell_link::HAS_WORKING_DIR
+            | shell_link::HAS_ARGUMENTS | shell_link::HAS_ICON_LOCATION | shell_link::IS_UNICODE | shell_link::HAS_EXP_STRING;
+        link.iconIndex = -3;
+        link.idList = my_computer_id_list();
+        link.linkInfo = local_link_info("C:\\Tools", "app.exe");
+        link.workingDirectory = u"C:\\Work";
+        link.arguments = u"--open \"%1\"";
+        link.iconLocation = u"C:\\Tools\\icons.dll";
+        link.extraBlocks.push_back(environment_block(shell_link::ENVIRONMENT_VARIABLE_DATA_BLOCK, "%TOOLS%\\app.exe", u"%TOOLS%\\app.exe"));
+        return link;
+    }
+}
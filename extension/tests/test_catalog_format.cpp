@@ -0,0 +1,240 @@
+#include "catalog_format.h"
+#include "check.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace catalog_format;
+
+namespace {
+
+    const std::u16string ROOT = u"C:\\Users\\me\\Documents\\Open With Handlers for";
+    const std::u16string TXT_FOLDER = u"Files by Extension\\(.txt)";
+
+    HandlerEntry make_handler(const std::u16string& name, uint64_t lastWriteTime, uint32_t side, uint8_t shade) {
+        HandlerEntry handler;
+        handler.name = name;
+        handler.lastWriteTime = lastWriteTime;
+        handler.iconWidth = side;
+        handler.iconHeight = side;
+        handler.iconPixels.assign(size_t(side) * side * 4, shade);
+        return handler;
+    }
+
+    std::vector<FolderEntry> make_folders() {
+        std::vector<FolderEntry> folders(4);
+        folders[0].path = TXT_FOLDER;
+        folders[0].lastWriteTime = 0x01D9'1234'5678'9ABCull;
+        folders[0].handlers.push_back(make_handler(u"Notepad.lnk", 7, 16, 0xAB));
+        folders[0].handlers.push_back(make_handler(u"\u00c9diteur.lnk", 8, 0, 0));
+        folders[1].path = u"";
+        folders[1].subfolders = { u"Everything", u"Files by Extension" };
+        folders[2].path = u"Everything";
+        folders[2].lastWriteTime = 1;
+        folders[2].handlers.push_back(make_handler(u"Total Commander.lnk", ~0ull, 32, 0x40));
+        folders[3].path = u"Files by Extension";
+        folders[3].subfolders = { u"(.txt)" };
+        return folders;
+    }
+
+    std::u16string read_string(const CatalogReader& reader, const StringRef& ref) {
+        std::u16string text;
+        reader.AppendString(ref, text);
+        return text;
+    }
+
+    // rewrites the checksum, so damage gets past it and to the reader's bounds checks
+    void reseal(std::vector<uint8_t>& bytes) {
+        const uint32_t sum = checksum(bytes.data() + HEADER_SIZE, bytes.size() - HEADER_SIZE);
+        for (int i = 0; i < 4; i += 1) {
+            bytes[12 + i] = static_cast<uint8_t>(sum >> (8 * i));
+        }
+    }
+
+    // reads all a menu would read from the folder; under a sanitizer, anything out of bounds shows up here
+    size_t walk_folder(const CatalogReader& reader, const std::u16string& path) {
+        size_t nRead = 0;
+        FolderRecord folder;
+        if (!reader.FindFolder(path.data(), path.size(), folder)) {
+            return nRead;
+        }
+        nRead += read_string(reader, folder.path).size();
+        for (size_t i = 0; i < folder.nHandlers && i < 64; i += 1) {
+            HandlerRecord handler;
+            if (reader.GetHandler(folder, i, handler)) {
+                nRead += read_string(reader, handler.name).size();
+                const uint8_t* pixels = reader.GetIconPixels(handler);
+                for (size_t byte = 0; byte < size_t(handler.iconWidth) * handler.iconHeight * 4; byte += 1) {
+                    nRead += pixels[byte];
+                }
+            }
+        }
+        for (size_t i = 0; i < folder.nSubfolders && i < 64; i += 1) {
+            StringRef name;
+            if (reader.GetSubfolder(folder, i, name)) {
+                nRead += read_string(reader, name).size();
+            }
+        }
+        return nRead;
+    }
+
+    void walk(const std::vector<uint8_t>& bytes) {
+        CatalogReader reader;
+        if (!reader.Open(bytes.data(), bytes.size())) {
+            return;
+        }
+        read_string(reader, reader.GetRoot());
+        for (const auto& path : { TXT_FOLDER, std::u16string(), std::u16string(u"Everything"), std::u16string(u"Files by Extension") }) {
+            walk_folder(reader, path);
+        }
+    }
+
+    void test_round_trip() {
+        const std::vector<uint8_t> bytes = write_catalog(ROOT, make_folders());
+        CatalogReader reader;
+        CHECK(!reader.IsOpen());
+        CHECK(reader.Open(bytes.data(), bytes.size()));
+        CHECK(reader.IsOpen());
+        CHECK(read_string(reader, reader.GetRoot()) == ROOT);
+
+        FolderRecord folder;
+        CHECK(reader.FindFolder(TXT_FOLDER.data(), TXT_FOLDER.size(), folder));
+        CHECK(read_string(reader, folder.path) == TXT_FOLDER);
+        CHECK(folder.lastWriteTime == 0x01D9'1234'5678'9ABCull);
+        CHECK(folder.nHandlers == 2);
+        CHECK(folder.nSubfolders == 0);
+
+        HandlerRecord handler;
+        CHECK(reader.GetHandler(folder, 0, handler));
+        CHECK(reader.IsEqual(handler.name, u"Notepad.lnk", 11));
+        CHECK(!reader.IsEqual(handler.name, u"Notepad.ln", 10));
+        CHECK(handler.lastWriteTime == 7);
+        CHECK(handler.iconWidth == 16 && handler.iconHeight == 16);
+        CHECK(reader.GetIconPixels(handler)[0] == 0xAB && reader.GetIconPixels(handler)[16 * 16 * 4 - 1] == 0xAB);
+        CHECK(reader.GetHandler(folder, 1, handler));
+        CHECK(read_string(reader, handler.name) == u"\u00c9diteur.lnk");
+        CHECK(handler.iconWidth == 0 && handler.iconHeight == 0);
+        CHECK(!reader.GetHandler(folder, 2, handler));
+
+        // any character type that holds UTF-16 code units finds the same folder
+        const std::wstring widePath(TXT_FOLDER.begin(), TXT_FOLDER.end());
+        FolderRecord sameFolder;
+        CHECK(reader.FindFolder(widePath.data(), widePath.size(), sameFolder));
+        CHECK(sameFolder.firstHandler == folder.firstHandler);
+
+        CHECK(reader.FindFolder(u"", 0, folder));
+        CHECK(folder.nHandlers == 0 && folder.nSubfolders == 2);
+        StringRef name;
+        CHECK(reader.GetSubfolder(folder, 0, name) && read_string(reader, name) == u"Everything");
+        CHECK(reader.GetSubfolder(folder, 1, name) && reader.IsEqual(name, u"Files by Extension", 18));
+        CHECK(!reader.GetSubfolder(folder, 2, name));
+
+        CHECK(reader.FindFolder(u"Everything", 10, folder));
+        CHECK(reader.GetHandler(folder, 0, handler) && handler.lastWriteTime == ~0ull);
+        CHECK(handler.iconWidth == 32 && reader.GetIconPixels(handler)[32 * 32 * 4 - 1] == 0x40);
+
+        CHECK(!reader.FindFolder(u"Nope", 4, folder));
+        CHECK(!reader.FindFolder(u"Everythin", 9, folder));
+        CHECK(!reader.FindFolder(u"Everything\\", 11, folder));
+        CHECK(!reader.FindFolder(u"files by extension", 18, folder));
+    }
+
+    void test_icon_size_mismatch() {
+        // pixels that don't match the size given are left out rather than read past
+        std::vector<FolderEntry> folders(1);
+        folders[0].handlers.push_back(make_handler(u"a.lnk", 0, 16, 1));
+        folders[0].handlers[0].iconPixels.resize(10);
+        const std::vector<uint8_t> bytes = write_catalog(ROOT, folders);
+        CatalogReader reader;
+        FolderRecord folder;
+        HandlerRecord handler;
+        CHECK(reader.Open(bytes.data(), bytes.size()));
+        CHECK(reader.FindFolder(u"", 0, folder) && reader.GetHandler(folder, 0, handler));
+        CHECK(handler.iconWidth == 0 && handler.iconHeight == 0);
+    }
+
+    void test_many_folders() {
+        // folders come in any order and are found by binary search
+        std::vector<FolderEntry> folders;
+        for (int i = 0; i < 3000; i += 1) {
+            FolderEntry folder;
+            folder.path = u"Files by Extension\\(." + std::u16string(1, char16_t(u'a' + i % 26)) + std::u16string(i / 26 + 1, u'x') + u")";
+            folder.lastWriteTime = i;
+            folder.handlers.push_back(make_handler(u"h.lnk", i, 0, 0));
+            folders.push_back(folder);
+        }
+        std::shuffle(folders.begin(), folders.end(), std::mt19937(1));
+        const std::vector<uint8_t> bytes = write_catalog(ROOT, folders);
+        CatalogReader reader;
+        CHECK(reader.Open(bytes.data(), bytes.size()));
+        for (const auto& entry : folders) {
+            FolderRecord folder;
+            HandlerRecord handler;
+            if (CHECK(reader.FindFolder(entry.path.data(), entry.path.size(), folder))) {
+                CHECK(folder.lastWriteTime == entry.lastWriteTime);
+                CHECK(reader.GetHandler(folder, 0, handler) && handler.lastWriteTime == entry.lastWriteTime);
+            }
+            const std::u16string missing = entry.path + u"!";
+            CHECK(!reader.FindFolder(missing.data(), missing.size(), folder));
+        }
+    }
+
+    void test_truncated() {
+        const std::vector<uint8_t> bytes = write_catalog(ROOT, make_folders());
+        for (size_t size = 0; size < bytes.size(); size += 1) {
+            const std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + size);
+            CatalogReader reader;
+            CHECK(!reader.Open(truncated.data(), truncated.size()));
+            FolderRecord folder;
+            CHECK(!reader.FindFolder(u"", 0, folder));
+        }
+        std::vector<uint8_t> longer = bytes;
+        longer.push_back(0);
+        CatalogReader reader;
+        CHECK(!reader.Open(longer.data(), longer.size()));
+    }
+
+    void test_corrupted() {
+        const std::vector<uint8_t> bytes = write_catalog(ROOT, make_folders());
+
+        // the checksum catches damage anywhere past the header, the header checks catch the rest of it
+        for (size_t i = 0; i < bytes.size(); i += 1) {
+            std::vector<uint8_t> damaged = bytes;
+            damaged[i] ^= 0x5A;
+            CatalogReader reader;
+            if (i < 16 || i >= HEADER_SIZE) {
+                CHECK(!reader.Open(damaged.data(), damaged.size()));
+            }
+            walk(damaged);
+        }
+
+        // damage the checksum doesn't catch still reads in bounds, whatever it reads
+        std::mt19937 random(2);
+        for (size_t i = 16; i < bytes.size(); i += 1) {
+            for (const uint8_t value : { uint8_t(0x00), uint8_t(0xFF), uint8_t(0x80), static_cast<uint8_t>(random()) }) {
+                std::vector<uint8_t> damaged = bytes;
+                damaged[i] = value;
+                reseal(damaged);
+                walk(damaged);
+            }
+        }
+        for (int round = 0; round < 20000; round += 1) {
+            std::vector<uint8_t> damaged = bytes;
+            for (int n = 0; n < 4; n += 1) {
+                damaged[16 + random() % (damaged.size() - 16)] = static_cast<uint8_t>(random());
+            }
+            reseal(damaged);
+            walk(damaged);
+        }
+    }
+}
+
+int main() {
+    test_round_trip();
+    test_icon_size_mismatch();
+    test_many_folders();
+    test_truncated();
+    test_corrupted();
+    return check::report();
+}
@@ -0,0 +1,207 @@
+#include "command_line.h"
+#include "check.h"
+
+#include <random>
+
+using namespace command_line;
+
+namespace {
+
+    // arguments as CommandLineToArgvW reads them back: 2n backslashes and a quote are n backslashes and a delimiter,
+    // 2n+1 are n and a literal quote, backslashes anywhere else are themselves
+    std::vector<std::wstring> split_arguments(const std::wstring& line) {
+        std::vector<std::wstring> arguments;
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && (line[i] == L' ' || line[i] == L'\t')) {
+                i += 1;
+            }
+            if (i == line.size()) {
+                break;
+            }
+            std::wstring argument;
+            bool isQuoted = false;
+            while (i < line.size() && (isQuoted || (line[i] != L' ' && line[i] != L'\t'))) {
+                size_t nBackslashes = 0;
+                while (i < line.size() && line[i] == L'\\') {
+                    nBackslashes += 1;
+                    i += 1;
+                }
+                if (i < line.size() && line[i] == L'"') {
+                    argument.append(nBackslashes / 2, L'\\');
+                    if (nBackslashes % 2 == 1) {
+                        argument.push_back(L'"');
+                    }
+                    else {
+                        isQuoted = !isQuoted;
+                    }
+                    i += 1;
+                }
+                else {
+                    argument.append(nBackslashes, L'\\');
+                    if (i < line.size() && (isQuoted || (line[i] != L' ' && line[i] != L'\t'))) {
+                        argument.push_back(line[i]);
+                        i += 1;
+                    }
+                }
+            }
+            arguments.push_back(std::move(argument));
+        }
+        return arguments;
+    }
+
+    std::vector<std::wstring> split_batches(const std::vector<std::wstring>& batches) {
+        std::vector<std::wstring> arguments;
+        for (const auto& batch : batches) {
+            for (auto& argument : split_arguments(batch)) {
+                arguments.push_back(std::move(argument));
+            }
+        }
+        return arguments;
+    }
+
+    shell_link::ShellLink make_link(const std::u16string& targetPath, const std::u16string& arguments) {
+        shell_link::ShellLink link;
+        link.targetPath = targetPath;
+        link.arguments = arguments;
+        return link;
+    }
+
+    void test_quoting() {
+        std::wstring line;
+        append_quoted_argument(line, L"C:\\");
+        CHECK(line == L" \"C:\\\\\"");
+        CHECK(line.size() == get_quoted_argument_length(L"C:\\"));
+        CHECK(split_arguments(line) == std::vector<std::wstring>{ L"C:\\" });
+
+        const std::vector<std::wstring> paths = {
+            L"C:\\", L"\\\\server\\share\\", L"C:\\folder with spaces\\\\\\", L"C:\\a\\b.txt", L"", L"\\", L"D:\\x\\y\\\\"
+        };
+        line.clear();
+        for (const auto& path : paths) {
+            const size_t before = line.size();
+            append_quoted_argument(line, path);
+            CHECK(line.size() - before == get_quoted_argument_length(path));
+        }
+        CHECK(split_arguments(line) == paths);
+    }
+
+    void test_batches() {
+        std::mt19937 random(11);
+        std::vector<std::wstring> paths;
+        for (int i = 0; i < 2000; i += 1) {
+            std::wstring path = L"C:\\folder " + std::to_wstring(random() % 1000) + L"\\file";
+            path.append(random() % 200, L'x');
+            path.append(random() % 3, L'\\');
+            paths.push_back(std::move(path));
+        }
+
+        for (const size_t maxLength : { size_t(100), size_t(1000), size_t(8000), MAX_COMMAND_LINE_LENGTH }) {
+            const auto batches = build_argument_batches(paths, maxLength);
+            CHECK(split_batches(batches) == paths);
+            for (size_t i = 0; i < batches.size(); i += 1) {
+                const size_t nArguments = split_arguments(batches[i]).size();
+                CHECK(nArguments > 0);
+                // over the budget only as an item alone
+                CHECK(batches[i].size() <= maxLength || nArguments == 1);
+                // as few as fit: the next one's first item would have fitted into this one otherwise
+                if (i + 1 < batches.size()) {
+                    CHECK(batches[i].size() + get_quoted_argument_length(split_arguments(batches[i + 1]).front()) > maxLength);
+                }
+            }
+        }
+    }
+
+    void test_path_longer_than_budget() {
+        const std::wstring longPath = L"C:\\" + std::wstring(500, L'l') + L"\\";
+        const std::vector<std::wstring> paths = { L"C:\\a", L"C:\\b", longPath, L"C:\\c", L"C:\\d" };
+        const auto batches = build_argument_batches(paths, 20);
+        CHECK(batches.size() == 3);
+        CHECK(split_arguments(batches[0]) == (std::vector<std::wstring>{ L"C:\\a", L"C:\\b" }));
+        CHECK(split_arguments(batches[1]) == std::vector<std::wstring>{ longPath });
+        CHECK(split_arguments(batches[2]) == (std::vector<std::wstring>{ L"C:\\c", L"C:\\d" }));
+
+        // alone, it's still launched
+        const auto alone = build_argument_batches(std::vector<std::wstring>{ longPath }, 20);
+        CHECK(alone.size() == 1 && split_arguments(alone[0]) == std::vector<std::wstring>{ longPath });
+    }
+
+    void test_each() {
+        // {each} asks for a budget of 0: every item is a launch of its own, in order
+        const std::vector<std::wstring> paths = { L"C:\\", L"C:\\a b", L"", L"D:\\x\\" };
+        const auto batches = build_argument_batches(paths, 0);
+        CHECK(batches.size() == paths.size());
+        for (size_t i = 0; i < paths.size(); i += 1) {
+            CHECK(split_arguments(batches[i]) == std::vector<std::wstring>{ paths[i] });
+        }
+
+        // nothing selected is one launch with no arguments
+        const auto none = build_argument_batches(std::vector<std::wstring>(), 0);
+        CHECK(none.size() == 1 && none[0].empty());
+    }
+
+    void test_budgets() {
+        const std::wstring exe = L"C:\\Tools\\tool.exe";
+        CHECK(get_max_arguments_length(exe, nullptr) == MAX_COMMAND_LINE_LENGTH - exe.size() - 3 - LINK_ARGUMENTS_RESERVE);
+
+        // cmd.exe takes 8191 characters, whatever the extension's case
+        for (const std::wstring batch : { L"C:\\Tools\\run.cmd", L"C:\\Tools\\run.BAT", L"C:\\Tools\\run.Cmd" }) {
+            const size_t budget = get_max_arguments_length(batch, nullptr);
+            CHECK(budget < MAX_BATCH_COMMAND_LINE_LENGTH);
+            CHECK(budget + batch.size() + 3 + BATCH_COMMAND_RESERVE == MAX_BATCH_COMMAND_LINE_LENGTH);
+        }
+        CHECK(!is_batch_file(std::wstring_view(L"C:\\Tools\\run.cmdx")));
+        CHECK(!is_batch_file(std::wstring_view(L"cmd")));
+        CHECK(is_batch_file(std::wstring_view(L".bat")));
+
+        // a link is its target with its own arguments ahead of ours
+        const auto toExe = make_link(u"C:\\Tools\\tool.exe", u"--flag");
+        CHECK(get_max_arguments_length(L"C:\\Handlers\\Tool.lnk", &toExe) == MAX_COMMAND_LINE_LENGTH - (17 + 3 + 6 + 1));
+        const auto toBatch = make_link(u"C:\\Tools\\run.bat", u"--flag");
+        CHECK(get_max_arguments_length(L"C:\\Handlers\\Run.lnk", &toBatch) == MAX_BATCH_COMMAND_LINE_LENGTH - BATCH_COMMAND_RESERVE - (16 + 3 + 6 + 1));
+        // the link's own name doesn't matter, its target does
+        const auto namedLikeBatch = make_link(u"C:\\Tools\\tool.exe", u"");
+        CHECK(get_max_arguments_length(L"C:\\Handlers\\Run.cmd.lnk", &namedLikeBatch) > MAX_BATCH_COMMAND_LINE_LENGTH);
+        auto withVariables = make_link(u"%TOOLS%\\run.cmd", u"");
+        withVariables.targetHasVariables = true;
+        CHECK(get_max_arguments_length(L"C:\\Handlers\\Run.lnk", &withVariables) == MAX_BATCH_COMMAND_LINE_LENGTH - BATCH_COMMAND_RESERVE - (MAX_PATH_LENGTH + 3 + 1));
+
+        // batches made for a batch file fit what cmd.exe takes
+        const std::wstring batch = L"C:\\Tools\\run.cmd";
+        const std::vector<std::wstring> paths(500, L"C:\\Users\\someone\\Documents\\some file.txt");
+        for (const auto& line : build_argument_batches(paths, get_max_arguments_length(batch, nullptr))) {
+            CHECK(BATCH_COMMAND_RESERVE + batch.size() + 3 + line.size() <= MAX_BATCH_COMMAND_LINE_LENGTH);
+        }
+
+        // nothing left when the handler's own part takes it all
+        const auto huge = make_link(u"C:\\Tools\\run.cmd", std::u16string(9000, u'a'));
+        CHECK(get_max_arguments_length(L"C:\\Handlers\\Run.lnk", &huge) == 0);
+    }
+
+    void test_list_file() {
+        const std::vector<std::wstring> paths = { L"C:\\a.txt", L"C:\\\u00E9t\u00E9", L"C:\\\u4E2D", L"" };
+        CHECK(build_list_file(paths) == "C:\\a.txt\r\nC:\\\xC3\xA9t\xC3\xA9\r\nC:\\\xE4\xB8\xAD\r\n\r\n");
+        CHECK(build_list_file(std::vector<std::wstring>()).empty());
+
+        // outside the BMP: a surrogate pair on Windows, one character elsewhere, the same 4 bytes either way
+        std::string utf8;
+        append_utf8(utf8, L"\U0001F600");
+        CHECK(utf8 == "\xF0\x9F\x98\x80");
+
+        // a lone surrogate, which file names can have, becomes U+FFFD
+        const wchar_t lone[] = { L'a', static_cast<wchar_t>(0xD800), L'b', static_cast<wchar_t>(0xDC00), 0 };
+        utf8.clear();
+        append_utf8(utf8, lone);
+        CHECK(utf8 == "a\xEF\xBF\xBD" "b\xEF\xBF\xBD");
+    }
+}
+
+int main() {
+    test_quoting();
+    test_batches();
+    test_path_longer_than_budget();
+    test_each();
+    test_budgets();
+    test_list_file();
+    return check::report();
+}
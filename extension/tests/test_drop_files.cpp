@@ -0,0 +1,168 @@
+#include "drop_files.h"
+#include "check.h"
+
+#include <vector>
+
+namespace {
+
+    void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int i = 0; i < 4; i += 1) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    std::vector<uint8_t> make_header(uint32_t filesOffset, bool isWide) {
+        std::vector<uint8_t> block;
+        put_u32(block, filesOffset);
+        put_u32(block, 10); // drop point
+        put_u32(block, 20);
+        put_u32(block, 0);  // non-client
+        put_u32(block, isWide ? 1 : 0);
+        return block;
+    }
+
+    // as the shell builds it: header, paths, an empty path
+    std::vector<uint8_t> make_wide_block(const std::vector<std::u16string>& paths) {
+        std::vector<uint8_t> block = make_header(drop_files::HEADER_SIZE, true);
+        for (const auto& path : paths) {
+            for (const char16_t c : path) {
+                block.push_back(static_cast<uint8_t>(c));
+                block.push_back(static_cast<uint8_t>(c >> 8));
+            }
+            block.push_back(0);
+            block.push_back(0);
+        }
+        block.push_back(0);
+        block.push_back(0);
+        return block;
+    }
+
+    std::vector<uint8_t> make_ansi_block(const std::vector<std::string>& paths) {
+        std::vector<uint8_t> block = make_header(drop_files::HEADER_SIZE, false);
+        for (const auto& path : paths) {
+            block.insert(block.end(), path.begin(), path.end());
+            block.push_back(0);
+        }
+        block.push_back(0);
+        return block;
+    }
+
+    struct Parsed {
+        bool isWellFormed = false;
+        std::vector<std::u16string> widePaths;
+        std::vector<std::string> ansiPaths;
+    };
+
+    Parsed parse(const std::vector<uint8_t>& block, size_t size) {
+        Parsed parsed;
+        parsed.isWellFormed = drop_files::parse(block.data(), size,
+            [&parsed](std::u16string_view path) { parsed.widePaths.emplace_back(path); },
+            [&parsed](std::string_view path) { parsed.ansiPaths.emplace_back(path); });
+        return parsed;
+    }
+
+    Parsed parse(const std::vector<uint8_t>& block) {
+        return parse(block, block.size());
+    }
+
+    void test_wide_paths() {
+        const std::vector<std::u16string> paths = { u"C:\\Users\\me\\a.txt", u"D:\\\u00e9t\u00e9\\b.tar.gz", u"\\\\server\\share\\c" };
+        const Parsed parsed = parse(make_wide_block(paths));
+        CHECK(parsed.isWellFormed);
+        CHECK(parsed.widePaths == paths);
+        CHECK(parsed.ansiPaths.empty());
+    }
+
+    void test_ansi_paths() {
+        const std::vector<std::string> paths = { "C:\\a.txt", "C:\\folder" };
+        const Parsed parsed = parse(make_ansi_block(paths));
+        CHECK(parsed.isWellFormed);
+        CHECK(parsed.ansiPaths == paths);
+        CHECK(parsed.widePaths.empty());
+    }
+
+    void test_empty_list() {
+        const Parsed parsed = parse(make_wide_block({}));
+        CHECK(parsed.isWellFormed);
+        CHECK(parsed.widePaths.empty());
+    }
+
+    void test_paths_after_a_gap() {
+        // pFiles may point past the header, whatever is between is not ours to read
+        std::vector<uint8_t> block = make_header(drop_files::HEADER_SIZE + 4, false);
+        put_u32(block, 0xFFFFFFFF);
+        for (const char c : std::string("C:\\x")) {
+            block.push_back(static_cast<uint8_t>(c));
+        }
+        block.push_back(0);
+        block.push_back(0);
+        const Parsed parsed = parse(block);
+        CHECK(parsed.isWellFormed);
+        CHECK(parsed.ansiPaths == std::vector<std::string>{ "C:\\x" });
+    }
+
+    void test_malformed_headers() {
+        CHECK(!drop_files::parse(nullptr, 100, [](std::u16string_view) {}, [](std::string_view) {}));
+
+        const std::vector<uint8_t> good = make_wide_block({ u"C:\\a" });
+        CHECK(!parse(good, drop_files::HEADER_SIZE - 1).isWellFormed);
+
+        std::vector<uint8_t> inHeader = good;
+        inHeader[0] = drop_files::HEADER_SIZE - 2;
+        CHECK(!parse(inHeader).isWellFormed);
+
+        std::vector<uint8_t> pastEnd = good;
+        pastEnd[0] = static_cast<uint8_t>(good.size());
+        CHECK(!parse(pastEnd).isWellFormed);
+
+        std::vector<uint8_t> farPastEnd = good;
+        farPastEnd[3] = 0x80;
+        CHECK(!parse(farPastEnd).isWellFormed);
+
+        std::vector<uint8_t> odd = make_header(drop_files::HEADER_SIZE + 1, true);
+        odd.insert(odd.end(), { 0, 'C', 0, 0, 0, 0, 0 });
+        CHECK(!parse(odd).isWellFormed);
+    }
+
+    void test_truncated_lists() {
+        // paths before the damage are reported, the list as a whole isn't well formed
+        const std::vector<std::u16string> paths = { u"C:\\first", u"C:\\second" };
+        const std::vector<uint8_t> block = make_wide_block(paths);
+
+        const Parsed withoutEnd = parse(block, block.size() - 2);
+        CHECK(!withoutEnd.isWellFormed);
+        CHECK(withoutEnd.widePaths == paths);
+
+        const Parsed inSecond = parse(block, block.size() - 6);
+        CHECK(!inSecond.isWellFormed);
+        CHECK(inSecond.widePaths == std::vector<std::u16string>{ paths[0] });
+
+        // an odd byte left at the end doesn't make half a character
+        std::vector<uint8_t> oddTail = block;
+        oddTail.resize(block.size() - 2);
+        oddTail.push_back(0);
+        CHECK(!parse(oddTail).isWellFormed);
+
+        const std::vector<uint8_t> ansi = make_ansi_block({ "C:\\first", "C:\\second" });
+        for (size_t size = 0; size < ansi.size(); size += 1) {
+            const Parsed parsed = parse(ansi, size);
+            CHECK(!parsed.isWellFormed);
+            CHECK(parsed.ansiPaths.size() <= 2);
+        }
+        for (size_t size = 0; size < block.size(); size += 1) {
+            const Parsed parsed = parse(block, size);
+            CHECK(!parsed.isWellFormed);
+            CHECK(parsed.widePaths.size() <= 2);
+        }
+    }
+}
+
+int main() {
+    test_wide_paths();
+    test_ansi_paths();
+    test_empty_list();
+    test_paths_after_a_gap();
+    test_malformed_headers();
+    test_truncated_lists();
+    return check::report();
+}
@@ -0,0 +1,167 @@
+#include "extension_atoms.h"
+#include "check.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace extension_atoms;
+
+// every allocation of the process is counted, so a test can tell a piece of code allocates nothing
+namespace {
+    std::atomic<size_t> g_nAllocations{ 0 };
+}
+
+void* operator new(size_t size) {
+    g_nAllocations += 1;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+    void fold_ascii_text(wchar_t* text, size_t length) {
+        for (size_t i = 0; i < length; i += 1) {
+            if (text[i] >= L'a' && text[i] <= L'z') {
+                text[i] = static_cast<wchar_t>(text[i] - (L'a' - L'A'));
+            }
+        }
+    }
+
+    void test_interning() {
+        ExtensionAtoms atoms(fold_ascii_text);
+        Atom txt;
+        Atom md;
+        Atom again;
+        CHECK(atoms.Intern(L".txt", txt) && txt == 0);
+        CHECK(atoms.Intern(L".md", md) && md == 1);
+        // case doesn't matter
+        CHECK(atoms.Intern(L".TXT", again) && again == txt);
+        CHECK(atoms.Intern(L".Txt", again) && again == txt);
+        CHECK(atoms.size() == 2);
+        CHECK(atoms.GetText(txt) == L".TXT");
+        CHECK(atoms.GetText(md) == L".MD");
+
+        // Find leaves what it doesn't know out of the table
+        CHECK(atoms.Find(L".tXt", again) && again == txt);
+        CHECK(!atoms.Find(L".doc", again));
+        CHECK(atoms.size() == 2);
+
+        // compound extensions are extensions like any other
+        Atom tarGz;
+        Atom gz;
+        CHECK(atoms.Intern(L".tar.gz", tarGz) && atoms.Intern(L".gz", gz) && tarGz != gz);
+
+        // longer than what is folded on the stack
+        const std::wstring longExtension = L"." + std::wstring(200, L'x');
+        const std::wstring longUpper = L"." + std::wstring(200, L'X');
+        Atom longAtom;
+        CHECK(atoms.Intern(longExtension, longAtom));
+        CHECK(atoms.Find(longUpper, again) && again == longAtom);
+        CHECK(atoms.GetText(longAtom) == longUpper);
+
+        // the empty extension is an extension too
+        Atom empty;
+        CHECK(atoms.Intern(L"", empty) && atoms.Find(L"", again) && again == empty);
+    }
+
+    void test_full_table() {
+        ExtensionAtoms atoms(fold_ascii_text, 3);
+        Atom atom;
+        CHECK(atoms.Intern(L".a", atom) && atoms.Intern(L".b", atom) && atoms.Intern(L".c", atom));
+        CHECK(!atoms.Intern(L".d", atom));
+        CHECK(atoms.size() == 3);
+        // what is there is still found
+        CHECK(atoms.Intern(L".B", atom) && atom == 1);
+        CHECK(atoms.Find(L".c", atom) && atom == 2);
+    }
+
+    void test_lookups_dont_allocate() {
+        ExtensionAtoms atoms(fold_ascii_text);
+        const wchar_t* extensions[] = { L".txt", L".md", L".tar.gz", L".jpeg", L".cpp", L".h" };
+        for (const wchar_t* extension : extensions) {
+            Atom atom;
+            atoms.Intern(extension, atom);
+        }
+
+        const wchar_t* lookups[] = { L".TXT", L".md", L".Tar.Gz", L".JPEG", L".doc", L".exe", L".h" };
+        const size_t nBefore = g_nAllocations;
+        size_t nFound = 0;
+        for (int round = 0; round < 10000; round += 1) {
+            for (const wchar_t* lookup : lookups) {
+                Atom atom;
+                nFound += atoms.Find(lookup, atom) ? 1 : 0;
+            }
+            // interning an extension that is there already is a lookup too
+            Atom atom;
+            nFound += atoms.Intern(L".CPP", atom) ? 1 : 0;
+        }
+        CHECK(g_nAllocations == nBefore);
+        CHECK(nFound == 10000 * 6);
+
+        // which the counting does see
+        Atom atom;
+        atoms.Intern(L".new", atom);
+        CHECK(g_nAllocations > nBefore);
+    }
+
+    void test_concurrent_interning() {
+        ExtensionAtoms atoms(fold_ascii_text);
+        const size_t N_THREADS = 8;
+        const size_t N_EXTENSIONS = 2000;
+        std::vector<std::vector<Atom>> seen(N_THREADS, std::vector<Atom>(N_EXTENSIONS));
+
+        std::vector<std::thread> threads;
+        for (size_t thread = 0; thread < N_THREADS; thread += 1) {
+            threads.emplace_back([&atoms, &seen, thread]() {
+                // every thread goes another way through the same extensions, half of them in upper case
+                for (size_t i = 0; i < N_EXTENSIONS; i += 1) {
+                    const size_t extension = (i * 7 + thread * 131) % N_EXTENSIONS;
+                    std::wstring text = L".ext" + std::to_wstring(extension);
+                    if (thread % 2) {
+                        fold_ascii_text(&text.front(), text.size());
+                    }
+                    atoms.Intern(text, seen[thread][extension]);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        // one atom per extension, the same one on every thread
+        CHECK(atoms.size() == N_EXTENSIONS);
+        std::vector<bool> isUsed(N_EXTENSIONS);
+        for (size_t extension = 0; extension < N_EXTENSIONS; extension += 1) {
+            const Atom atom = seen[0][extension];
+            for (size_t thread = 1; thread < N_THREADS; thread += 1) {
+                CHECK(seen[thread][extension] == atom);
+            }
+            CHECK(atom < N_EXTENSIONS && !isUsed[atom]);
+            if (atom < N_EXTENSIONS) {
+                isUsed[atom] = true;
+            }
+            CHECK(atoms.GetText(atom) == L".EXT" + std::to_wstring(extension));
+        }
+    }
+}
+
+int main() {
+    test_interning();
+    test_full_table();
+    test_lookups_dont_allocate();
+    test_concurrent_interning();
+    return check::report();
+}
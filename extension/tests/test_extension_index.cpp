@@ -0,0 +1,292 @@
+#include "extension_index.h"
+#include "suffix_trie.h"
+#include "check.h"
+
+#include <map>
+#include <random>
+#include <set>
+
+using namespace extension_index;
+
+namespace {
+
+    // ExtensionAtoms' part: case folded extensions get numbers in the order they are first seen
+    struct FakeAtoms {
+        std::map<std::wstring, Atom> atoms;
+        size_t maxAtoms = 1000;
+
+        static std::wstring Fold(std::wstring_view extension) {
+            std::wstring folded;
+            for (const wchar_t c : extension) {
+                folded.push_back(suffix_trie::fold_ascii_char(c));
+            }
+            return folded;
+        }
+
+        bool Intern(std::wstring_view extension, Atom& atom) {
+            const auto folded = Fold(extension);
+            const auto found = atoms.find(folded);
+            if (found != atoms.end()) {
+                atom = found->second;
+                return true;
+            }
+            if (atoms.size() >= maxAtoms) {
+                return false;
+            }
+            atom = static_cast<Atom>(atoms.size());
+            atoms.emplace(folded, atom);
+            return true;
+        }
+
+        bool Find(std::wstring_view extension, Atom& atom) const {
+            const auto found = atoms.find(Fold(extension));
+            if (found == atoms.end()) {
+                return false;
+            }
+            atom = found->second;
+            return true;
+        }
+    };
+
+    // ExtensionIndex::Rebuild's part
+    struct Index {
+        FakeAtoms atoms;
+        ExtensionFolders folders;
+        suffix_trie::SuffixTrie knownExtensions;
+        std::vector<std::wstring> extensions;
+
+        void Build(const std::vector<std::wstring>& subfolders) {
+            knownExtensions = suffix_trie::SuffixTrie();
+            extensions.clear();
+            folders.Build(
+                subfolders,
+                [this](std::wstring_view extension, Atom& atom) {
+                    return atoms.Intern(extension, atom);
+                },
+                [this](std::wstring_view extension) {
+                    knownExtensions.Insert(extension);
+                    extensions.emplace_back(extension);
+                });
+        }
+
+        // SelectionKinds::AddFile and ExtensionIndex::FindFolder's part: the folder of the file's extension
+        const std::wstring* FindFolder(std::wstring_view path) const {
+            const size_t length = knownExtensions.FindLongestSuffix(path);
+            Atom atom;
+            if (length == 0 || !atoms.Find(path.substr(path.size() - length), atom)) {
+                return nullptr;
+            }
+            return folders.Find(atom);
+        }
+    };
+
+    bool is_folder(const std::wstring* found, const wchar_t* folder) {
+        return found && *found == folder;
+    }
+
+    void test_parse_extension_folder() {
+        std::wstring_view extension;
+        CHECK(parse_extension_folder(L"(.txt)", extension) && extension == L".txt");
+        CHECK(parse_extension_folder(L"(.tar.gz)", extension) && extension == L".tar.gz");
+        CHECK(parse_extension_folder(L"(.a)", extension) && extension == L".a");
+        CHECK(!parse_extension_folder(L"(.)", extension));
+        CHECK(!parse_extension_folder(L"(txt)", extension));
+        CHECK(!parse_extension_folder(L".txt", extension));
+        CHECK(!parse_extension_folder(L"(.txt", extension));
+        CHECK(!parse_extension_folder(L"Editors", extension));
+        CHECK(!parse_extension_folder(L"", extension));
+    }
+
+    void test_build() {
+        Index index;
+        index.Build({ L"(.txt)", L"Editors", L"(.TXT)", L"(.tar.gz)", L"(.gz)", L"(.)", L"(md)", L"(.Md)" });
+
+        // folders that aren't of an extension are left out, ".txt" and ".TXT" are one extension
+        CHECK(index.folders.size() == 4);
+        CHECK(index.atoms.atoms.size() == 4);
+        Atom atom;
+        CHECK(index.atoms.Find(L".txt", atom) && is_folder(index.folders.Find(atom), L"(.txt)"));
+        CHECK(index.atoms.Find(L".tar.gz", atom) && is_folder(index.folders.Find(atom), L"(.tar.gz)"));
+        CHECK(index.atoms.Find(L".md", atom) && is_folder(index.folders.Find(atom), L"(.Md)"));
+        // every one of them is known to the trie, ".TXT" too (it makes no difference folded)
+        CHECK(index.extensions.size() == 5);
+
+        // an atom given out to something else, or never given out, has no folder
+        Atom other;
+        CHECK(index.atoms.Intern(L".doc", other));
+        CHECK(!index.folders.Find(other));
+        CHECK(!index.folders.Find(other + 100));
+
+        // the first one listed wins
+        Index reversed;
+        reversed.Build({ L"(.TXT)", L"(.txt)" });
+        CHECK(reversed.atoms.Find(L".txt", atom) && is_folder(reversed.folders.Find(atom), L"(.TXT)"));
+        CHECK(reversed.folders.size() == 1);
+
+        // rebuilt from another listing: folders gone are gone, atoms stay what they were
+        Atom txt;
+        CHECK(index.atoms.Find(L".txt", txt));
+        index.Build({ L"(.gz)", L"(.log)" });
+        CHECK(index.folders.size() == 2);
+        CHECK(!index.folders.Find(txt));
+        CHECK(index.atoms.Find(L".gz", atom) && is_folder(index.folders.Find(atom), L"(.gz)"));
+        CHECK(index.atoms.Find(L".txt", atom) && atom == txt);
+
+        // an extension the atoms have no room for has no folder, the rest still have theirs
+        Index full;
+        full.atoms.maxAtoms = 1;
+        full.Build({ L"(.txt)", L"(.md)" });
+        CHECK(full.folders.size() == 1);
+        CHECK(full.extensions.size() == 1);
+        CHECK(full.atoms.Find(L".txt", atom) && is_folder(full.folders.Find(atom), L"(.txt)"));
+        CHECK(!full.atoms.Find(L".md", atom));
+
+        Index empty;
+        empty.Build({});
+        CHECK(empty.folders.size() == 0 && !empty.folders.Find(0));
+    }
+
+    void test_lookup() {
+        Index index;
+        index.Build({ L"(.txt)", L"(.gz)", L"(.tar.gz)", L"(.ts)", L"Editors" });
+
+        CHECK(is_folder(index.FindFolder(L"C:\\Users\\me\\notes.txt"), L"(.txt)"));
+        CHECK(is_folder(index.FindFolder(L"C:\\Users\\me\\NOTES.TXT"), L"(.txt)"));
+        // compound extensions: the longest one that has a folder
+        CHECK(is_folder(index.FindFolder(L"C:\\Downloads\\archive.tar.gz"), L"(.tar.gz)"));
+        CHECK(is_folder(index.FindFolder(L"C:\\Downloads\\archive.gz"), L"(.gz)"));
+        CHECK(is_folder(index.FindFolder(L"C:\\Downloads\\archive.star.gz"), L"(.gz)"));
+        // no folder
+        CHECK(!index.FindFolder(L"C:\\Users\\me\\notes.doc"));
+        CHECK(!index.FindFolder(L"C:\\Users\\me\\script.bats"));
+        CHECK(!index.FindFolder(L"C:\\Users\\me\\Makefile"));
+        CHECK(!index.FindFolder(L"C:\\Users\\me\\Editors"));
+    }
+
+    void test_bits() {
+        Bitset bits;
+        CHECK(!has_bit(bits, 0) && !has_bit(bits, 1000));
+        set_bit(bits, 0);
+        set_bit(bits, 63);
+        set_bit(bits, 64);
+        set_bit(bits, 200);
+        CHECK(bits.size() == 4);
+        CHECK(has_bit(bits, 0) && has_bit(bits, 63) && has_bit(bits, 64) && has_bit(bits, 200));
+        CHECK(!has_bit(bits, 1) && !has_bit(bits, 65) && !has_bit(bits, 199) && !has_bit(bits, 256));
+
+        // a shorter bitset has none of the bits beyond its end
+        Bitset common = bits;
+        Bitset shorter;
+        set_bit(shorter, 63);
+        set_bit(shorter, 64);
+        intersect_bits(common, shorter);
+        CHECK(has_bit(common, 63) && has_bit(common, 64));
+        CHECK(!has_bit(common, 0) && !has_bit(common, 200));
+        CHECK(common.size() == 2);
+
+        intersect_bits(common, Bitset());
+        CHECK(common.empty());
+    }
+
+    void test_handler_ids() {
+        HandlerIds ids;
+        Bitset firstBits;
+        const auto first = ids.Intern({ L"NOTEPAD.LNK", L"CODE.LNK", L"VIM.LNK" }, firstBits);
+        CHECK(first.size() == 3 && first[0] == 0 && first[1] == 1 && first[2] == 2);
+        CHECK(ids.size() == 3);
+
+        // a name seen before keeps its id, one seen for the first time gets the next one
+        Bitset secondBits;
+        const auto second = ids.Intern({ L"VIM.LNK", L"EMACS.LNK", L"NOTEPAD.LNK" }, secondBits);
+        CHECK(second.size() == 3 && second[0] == 2 && second[1] == 3 && second[2] == 0);
+        CHECK(ids.size() == 4);
+        CHECK(has_bit(secondBits, 0) && !has_bit(secondBits, 1) && has_bit(secondBits, 2) && has_bit(secondBits, 3));
+
+        ids.Clear();
+        CHECK(ids.size() == 0);
+        Bitset bits;
+        CHECK(ids.Intern({ L"EMACS.LNK" }, bits)[0] == 0);
+    }
+
+    void test_common() {
+        HandlerIds ids;
+        Bitset txtBits;
+        Bitset mdBits;
+        Bitset logBits;
+        const auto txt = ids.Intern({ L"NOTEPAD.LNK", L"CODE.LNK", L"VIM.LNK", L"WORDPAD.LNK" }, txtBits);
+        ids.Intern({ L"VIM.LNK", L"TYPORA.LNK", L"NOTEPAD.LNK" }, mdBits);
+        ids.Intern({ L"NOTEPAD.LNK", L"VIM.LNK", L"CODE.LNK" }, logBits);
+
+        // in the first folder's order, whatever order the others have them in
+        auto common = find_common(txt, { &txtBits, &mdBits, &logBits });
+        CHECK(common.size() == 2 && common[0] == 0 && common[1] == 2);
+
+        common = find_common(txt, { &txtBits, &logBits });
+        CHECK(common.size() == 3 && common[0] == 0 && common[1] == 1 && common[2] == 2);
+
+        // a single extension has all of its handlers
+        CHECK(find_common(txt, { &txtBits }).size() == txt.size());
+
+        // an extension folder without handlers leaves nothing common
+        const Bitset empty;
+        CHECK(find_common(txt, { &txtBits, &empty }).empty());
+        CHECK(find_common(txt, {}).empty());
+    }
+
+    void test_common_against_sets() {
+        // many folders over many names: what the bits say is what sets of names say
+        std::mt19937 random(11);
+        for (int round = 0; round < 200; round += 1) {
+            const size_t nNames = 1 + random() % 300;
+            const size_t nFolders = 1 + random() % 6;
+
+            HandlerIds ids;
+            std::vector<std::vector<std::wstring>> folders(nFolders);
+            std::vector<Bitset> bitsets(nFolders);
+            std::vector<size_t> firstIds;
+            for (size_t folder = 0; folder < nFolders; folder += 1) {
+                for (size_t name = 0; name < nNames; name += 1) {
+                    // most handlers in most folders, so something is common
+                    if (random() % 8 != 0) {
+                        folders[folder].push_back(L"HANDLER" + std::to_wstring(name) + L".LNK");
+                    }
+                }
+                std::shuffle(folders[folder].begin(), folders[folder].end(), random);
+                const auto folderIds = ids.Intern(folders[folder], bitsets[folder]);
+                if (folder == 0) {
+                    firstIds = folderIds;
+                }
+            }
+
+            std::vector<const Bitset*> pointers;
+            for (const auto& bits : bitsets) {
+                pointers.push_back(&bits);
+            }
+            const auto common = find_common(firstIds, pointers);
+
+            std::vector<size_t> expected;
+            for (size_t position = 0; position < folders[0].size(); position += 1) {
+                bool everywhere = true;
+                for (size_t folder = 1; folder < nFolders; folder += 1) {
+                    const std::set<std::wstring> names(folders[folder].begin(), folders[folder].end());
+                    everywhere = everywhere && names.count(folders[0][position]) != 0;
+                }
+                if (everywhere) {
+                    expected.push_back(position);
+                }
+            }
+            CHECK(common == expected);
+        }
+    }
+}
+
+int main() {
+    test_parse_extension_folder();
+    test_build();
+    test_lookup();
+    test_bits();
+    test_handler_ids();
+    test_common();
+    test_common_against_sets();
+    return check::report();
+}
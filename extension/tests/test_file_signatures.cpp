@@ -0,0 +1,150 @@
+#include "file_signatures.h"
+#include "check.h"
+
+#include <random>
+#include <string>
+
+using namespace file_signatures;
+
+namespace {
+
+    // every signature of the table checked one by one, the longest match wins
+    int naive_match(const SignatureTable& table, const unsigned char* data, size_t size) {
+        int best = -1;
+        size_t bestLength = 0;
+        for (size_t i = 0; i < table.size(); i += 1) {
+            const auto& signature = table[i];
+            if (signature.offset + signature.length <= size
+                && signature.length > bestLength
+                && 0 == memcmp(data + signature.offset, signature.magic, signature.length)) {
+                best = static_cast<int>(i);
+                bestLength = signature.length;
+            }
+        }
+        return best;
+    }
+
+    std::vector<unsigned char> with_signature(const FileSignature& signature, size_t size, unsigned char filler) {
+        std::vector<unsigned char> data(size, filler);
+        memcpy(data.data() + signature.offset, signature.magic, signature.length);
+        return data;
+    }
+
+    void test_every_signature() {
+        const SignatureTable table;
+        CHECK(table.size() == sizeof(FILE_SIGNATURES) / sizeof(FILE_SIGNATURES[0]));
+        for (size_t i = 0; i < table.size(); i += 1) {
+            const auto& signature = table[i];
+            CHECK(signature.offset + signature.length <= SNIFFED_BYTES);
+
+            auto data = with_signature(signature, SNIFFED_BYTES, ' ');
+            CHECK(table.Match(data.data(), data.size()) == static_cast<int>(i));
+            // just long enough
+            CHECK(table.Match(data.data(), signature.offset + signature.length) == static_cast<int>(i));
+            // a byte short, as a file that small is
+            CHECK(table.Match(data.data(), signature.offset + signature.length - 1) == -1);
+            // the last byte of the magic wrong
+            data[signature.offset + signature.length - 1] ^= 0x40;
+            CHECK(table.Match(data.data(), data.size()) == -1);
+        }
+    }
+
+    void test_offsets() {
+        const SignatureTable table;
+        // tar's magic is at 257, files ending before it or right at it are told by their start alone
+        int tar = -1;
+        for (size_t i = 0; i < table.size(); i += 1) {
+            if (std::wstring(table[i].type) == L"tar") {
+                tar = static_cast<int>(i);
+            }
+        }
+        CHECK(tar >= 0);
+        const auto data = with_signature(table[tar], 300, 0);
+        CHECK(table.Match(data.data(), data.size()) == tar);
+        CHECK(table.Match(data.data(), 257) == -1);
+        CHECK(table.Match(data.data(), 258) == -1);
+        CHECK(table.Match(data.data(), 0) == -1);
+
+        // a file can have a magic at both offsets: an ELF that happens to have "ustar" at 257 is still a tar,
+        // the longer signature wins (5 bytes over 4)
+        auto both = data;
+        memcpy(both.data(), "\x7F" "ELF", 4);
+        CHECK(table.Match(both.data(), both.size()) == tar);
+    }
+
+    void test_longest_wins() {
+        // signatures of one bucket that start the same: the longer one wins wherever it is in the table
+        const FileSignature signatures[] = {
+            { L"short", 0, "AB", 2 },
+            { L"long", 0, "ABCD", 4 },
+            { L"other", 0, "AX", 2 },
+            { L"later", 4, "AB", 2 },
+            { L"laterlong", 4, "ABCDEF", 6 },
+        };
+        const SignatureTable table(signatures, 5);
+        const unsigned char abcd[] = "ABCD....";
+        CHECK(table.Match(abcd, 8) == 1);
+        CHECK(table.Match(abcd, 3) == 0);
+        const unsigned char ax[] = "AXCD";
+        CHECK(table.Match(ax, 4) == 2);
+        const unsigned char far[] = "ABC.ABCDEF";
+        CHECK(table.Match(far, 10) == 4);
+        CHECK(table.Match(far, 9) == 0);
+        const unsigned char nothing[] = "ZZZZZZZZZZ";
+        CHECK(table.Match(nothing, 10) == -1);
+    }
+
+    void test_against_naive() {
+        std::mt19937 random(14);
+        const SignatureTable table;
+        for (int round = 0; round < 20000; round += 1) {
+            std::vector<unsigned char> data(random() % (SNIFFED_BYTES + 1));
+            for (auto& byte : data) {
+                byte = static_cast<unsigned char>(random());
+            }
+            // most of them with some magic in them, maybe cut short
+            if (round % 4 != 0) {
+                const auto& signature = table[random() % table.size()];
+                if (signature.offset < data.size()) {
+                    memcpy(data.data() + signature.offset, signature.magic, std::min(signature.length, data.size() - signature.offset));
+                }
+            }
+            CHECK(table.Match(data.data(), data.size()) == naive_match(table, data.data(), data.size()));
+        }
+    }
+
+    void test_common_type() {
+        const SignatureTable table;
+        auto find = [&table](const wchar_t* type, const char* magic) {
+            for (size_t i = 0; i < table.size(); i += 1) {
+                if (std::wstring(table[i].type) == type && 0 == memcmp(table[i].magic, magic, table[i].length)) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        };
+        const int zip = find(L"zip", "PK\x03\x04");
+        const int emptyZip = find(L"zip", "PK\x05\x06");
+        const int pdf = find(L"pdf", "%PDF-");
+        CHECK(zip >= 0 && emptyZip >= 0 && zip != emptyZip && pdf >= 0);
+
+        const int zips[] = { zip, emptyZip, zip };
+        CHECK(table.GetCommonType(zips, 3) != nullptr && std::wstring(table.GetCommonType(zips, 3)) == L"zip");
+        const int mixed[] = { zip, pdf };
+        CHECK(table.GetCommonType(mixed, 2) == nullptr);
+        const int unknown[] = { pdf, -1 };
+        CHECK(table.GetCommonType(unknown, 2) == nullptr);
+        CHECK(table.GetCommonType(unknown, 1) != nullptr);
+        CHECK(table.GetCommonType(unknown + 1, 1) == nullptr);
+        CHECK(table.GetCommonType(zips, 0) == nullptr);
+    }
+}
+
+int main() {
+    test_every_signature();
+    test_offsets();
+    test_longest_wins();
+    test_against_naive();
+    test_common_type();
+    return check::report();
+}
@@ -0,0 +1,111 @@
+#include "fingerprint_set.h"
+#include "check.h"
+#include "menu_fixtures.h"
+
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using fingerprint_set::FingerprintSet;
+
+namespace {
+
+    // What the layout should show: the sections' handlers in the order it walks them, a folder's own then its
+    // groups', the first one of every fingerprint, up to maxHandlers of them. Told with a std::unordered_set.
+    void reference_handlers(const fixtures::Folder& folder, std::unordered_set<uint64_t>& shown, size_t maxHandlers, std::vector<std::wstring>& menu) {
+        for (const auto& handler : folder.handlers) {
+            if (menu.size() >= maxHandlers) {
+                break;
+            }
+            if (shown.insert(handler.fingerprint ? handler.fingerprint : 1).second) {
+                menu.push_back(handler.name);
+            }
+        }
+        for (const auto& group : folder.groups) {
+            reference_handlers(group.second, shown, maxHandlers, menu);
+        }
+    }
+
+    void test_menu_order() {
+        std::mt19937 random(4);
+        // one layout for menu after menu, of other sizes, as MenuModel keeps it: its set is cleared, not made anew
+        menu_layout::MenuLayout layout;
+        for (const size_t nHandlers : { 10, 5000, 200, 5000, 20000, 3, 8000 }) {
+            for (const size_t maxHandlers : { nHandlers, nHandlers / 2 + 1 }) {
+                const auto sections = fixtures::make_sections(random, nHandlers, nHandlers / 3 + 1);
+                // one offset more for "Open handlers folder"
+                layout.Reset(maxHandlers + 1);
+                fixtures::Source source;
+                for (const auto& section : sections) {
+                    layout.AddSection(source, section);
+                }
+
+                std::unordered_set<uint64_t> referenceShown;
+                std::vector<std::wstring> referenceItems;
+                for (const auto& section : sections) {
+                    reference_handlers(section, referenceShown, maxHandlers, referenceItems);
+                }
+                CHECK(source.added == referenceItems);
+                CHECK(layout.GetHandlersCount() == source.added.size() && source.added.size() <= maxHandlers);
+            }
+        }
+    }
+
+    void test_against_unordered_set() {
+        std::mt19937_64 random(5);
+        FingerprintSet set;
+        for (const size_t maxSize : { 1, 16, 1000, 4096, 50000 }) {
+            set.Clear(maxSize);
+            std::unordered_set<uint64_t> reference;
+            // values from a small range, so most of them come again
+            const uint64_t range = maxSize + maxSize / 2 + 1;
+            while (reference.size() < maxSize) {
+                const uint64_t value = random() % range;
+                CHECK(set.Insert(value) == reference.insert(value ? value : 1).second);
+            }
+            for (uint64_t value = 0; value < range; value += 1) {
+                CHECK(set.Insert(value) == (reference.count(value ? value : 1) == 0));
+                reference.insert(value ? value : 1);
+            }
+        }
+    }
+
+    void test_colliding_fingerprints() {
+        // same low bits, so every one of them starts probing at the same slot and wraps around the table
+        FingerprintSet set;
+        set.Clear(3000);
+        for (uint64_t i = 0; i < 3000; i += 1) {
+            CHECK(set.Insert((i << 40) | 0xFFFF));
+        }
+        for (uint64_t i = 0; i < 3000; i += 1) {
+            CHECK(!set.Insert((i << 40) | 0xFFFF));
+        }
+    }
+
+    void test_clear() {
+        FingerprintSet set;
+        CHECK(set.Insert(42));
+        CHECK(!set.Insert(42));
+        // 0 can't be told from an empty slot, it's taken for 1
+        CHECK(set.Insert(0));
+        CHECK(!set.Insert(1));
+
+        set.Clear(100);
+        CHECK(set.Insert(42));
+        set.Clear(100);
+        CHECK(set.Insert(42));
+        set.Clear(5);
+        CHECK(set.GetCapacity() == 16);
+        CHECK(set.Insert(42));
+        CHECK(set.Insert(1));
+    }
+}
+
+int main() {
+    test_menu_order();
+    test_against_unordered_set();
+    test_colliding_fingerprints();
+    test_clear();
+    return check::report();
+}
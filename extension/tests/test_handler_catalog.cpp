@@ -0,0 +1,347 @@
+#include "handler_catalog.h"
+#include "check.h"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include "inotify_backend.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#endif
+
+using handler_catalog::FolderCache;
+
+namespace {
+
+    // Folders that are only a version number, bumped by every change
+    struct FakeSnapshot {
+        bool exists = false;
+        unsigned version = 0;
+    };
+
+    class FakeBackend {
+    public:
+        using Path = std::string;
+        using Snapshot = FakeSnapshot;
+
+        struct Watch {
+            unsigned armedVersion = 0;
+        };
+
+        // folder -> its version, no entry if it doesn't exist
+        std::map<std::string, unsigned> folders;
+        std::vector<std::string> scanned;
+        size_t nFirstLooks = 0;
+        size_t* nClosed = nullptr;
+        // called in the middle of a scan, with the cache unlocked
+        std::function<void(const std::string&)> onScan;
+
+        bool IsStale(const std::string& folder, const Watch& watch, const FakeSnapshot&) const {
+            return GetVersion(folder) != watch.armedVersion;
+        }
+
+        void Rearm(const std::string& folder, Watch& watch) {
+            watch.armedVersion = GetVersion(folder);
+        }
+
+        std::shared_ptr<const FakeSnapshot> Scan(const std::string& folder, bool isFirstLook) {
+            auto snapshot = std::make_shared<FakeSnapshot>();
+            snapshot->exists = folders.count(folder) != 0;
+            snapshot->version = GetVersion(folder);
+            scanned.push_back(folder);
+            nFirstLooks += isFirstLook ? 1 : 0;
+            if (onScan) {
+                onScan(folder);
+            }
+            return snapshot;
+        }
+
+        void Close(Watch&) {
+            if (nClosed) {
+                *nClosed += 1;
+            }
+        }
+
+        unsigned GetVersion(const std::string& folder) const {
+            const auto found = folders.find(folder);
+            return found == folders.end() ? 0 : found->second;
+        }
+
+        void Change(const std::string& folder) {
+            folders[folder] += 1;
+        }
+    };
+
+    void test_hits() {
+        FolderCache<FakeBackend> cache;
+        cache.GetBackend().folders = { { "a", 1 }, { "b", 1 } };
+
+        CHECK(!cache.IsListed("a"));
+        const auto first = cache.GetFolder("a");
+        CHECK(first->exists && first->version == 1);
+        CHECK(cache.IsListed("a") && !cache.IsListed("b"));
+        for (int i = 0; i < 100; i += 1) {
+            CHECK(cache.GetFolder("a") == first);
+        }
+        CHECK(cache.GetBackend().scanned.size() == 1);
+        CHECK(cache.GetBackend().nFirstLooks == 1);
+        CHECK(cache.GetStats().nLookups == 101 && cache.GetStats().nScans == 1 && cache.GetStats().GetHits() == 100);
+
+        // a folder that doesn't exist is cached like any other
+        const auto missing = cache.GetFolder("missing");
+        CHECK(!missing->exists);
+        CHECK(cache.GetFolder("missing") == missing);
+        CHECK(cache.GetStats().nScans == 2);
+    }
+
+    void test_invalidation() {
+        FolderCache<FakeBackend> cache;
+        FakeBackend& backend = cache.GetBackend();
+        backend.folders = { { "a", 1 }, { "b", 1 }, { "c", 1 } };
+        const auto a = cache.GetFolder("a");
+        const auto b = cache.GetFolder("b");
+        const auto c = cache.GetFolder("c");
+
+        // only the folder that changed is listed again, and not as a first look
+        backend.Change("b");
+        CHECK(cache.GetFolder("a") == a);
+        const auto changed = cache.GetFolder("b");
+        CHECK(changed != b && changed->version == 2);
+        CHECK(cache.GetFolder("c") == c);
+        CHECK(backend.scanned.size() == 4 && backend.scanned.back() == "b");
+        CHECK(backend.nFirstLooks == 3);
+        CHECK(cache.GetFolder("b") == changed);
+
+        // created after it was found missing
+        CHECK(!cache.GetFolder("d")->exists);
+        backend.Change("d");
+        CHECK(cache.GetFolder("d")->exists);
+    }
+
+    void test_change_during_scan() {
+        // the folder is armed before it's listed: a change made while it's being listed makes the next lookup list it again
+        FolderCache<FakeBackend> cache;
+        FakeBackend& backend = cache.GetBackend();
+        backend.folders = { { "a", 1 } };
+        bool isChanging = true;
+        backend.onScan = [&backend, &isChanging](const std::string& folder) {
+            if (isChanging) {
+                isChanging = false;
+                backend.Change(folder);
+            }
+        };
+
+        CHECK(cache.GetFolder("a")->version == 1);
+        const auto rescanned = cache.GetFolder("a");
+        CHECK(rescanned->version == 2);
+        CHECK(cache.GetFolder("a") == rescanned);
+        CHECK(backend.scanned.size() == 2);
+    }
+
+    void test_late_scan_loses() {
+        // a scan that started before a change and finishes after the scan of the change doesn't replace it
+        FolderCache<FakeBackend> cache;
+        FakeBackend& backend = cache.GetBackend();
+        backend.folders = { { "a", 1 } };
+
+        std::mutex lock;
+        std::condition_variable wakeUp;
+        bool isFirstScanning = false;
+        bool isReleased = false;
+        backend.onScan = [&](const std::string&) {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!isFirstScanning) {
+                isFirstScanning = true;
+                wakeUp.notify_all();
+                wakeUp.wait(guard, [&]() { return isReleased; });
+            }
+        };
+
+        std::shared_ptr<const FakeSnapshot> late;
+        std::thread slow([&]() {
+            late = cache.GetFolder("a");
+        });
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeUp.wait(guard, [&]() { return isFirstScanning; });
+        }
+
+        // meanwhile: changed and listed again, on another thread
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            backend.Change("a");
+        }
+        const auto newer = cache.GetFolder("a");
+        CHECK(newer->version == 2);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            isReleased = true;
+        }
+        wakeUp.notify_all();
+        slow.join();
+
+        CHECK(late && late->version == 1);
+        CHECK(cache.GetFolder("a") == newer);
+    }
+
+    void test_hit_rate() {
+        // lookups over a few folders that change now and then: every lookup scans if and only if
+        // its folder is new or changed since it was last listed
+        std::mt19937 random(1);
+        FolderCache<FakeBackend> cache;
+        FakeBackend& backend = cache.GetBackend();
+        const size_t N_FOLDERS = 20;
+        std::vector<std::string> names;
+        for (size_t i = 0; i < N_FOLDERS; i += 1) {
+            names.push_back("folder" + std::to_string(i));
+            backend.folders[names.back()] = 1;
+        }
+
+        std::vector<bool> isListed(N_FOLDERS);
+        std::vector<bool> isChanged(N_FOLDERS);
+        size_t nExpectedScans = 0;
+        const size_t N_LOOKUPS = 20000;
+        for (size_t i = 0; i < N_LOOKUPS; i += 1) {
+            if (random() % 100 == 0) {
+                const size_t changed = random() % N_FOLDERS;
+                backend.Change(names[changed]);
+                isChanged[changed] = true;
+            }
+            const size_t folder = random() % N_FOLDERS;
+            if (!isListed[folder] || isChanged[folder]) {
+                nExpectedScans += 1;
+            }
+            isListed[folder] = true;
+            isChanged[folder] = false;
+            CHECK(cache.GetFolder(names[folder])->version == backend.GetVersion(names[folder]));
+        }
+
+        const auto stats = cache.GetStats();
+        CHECK(stats.nLookups == N_LOOKUPS);
+        CHECK(stats.nScans == nExpectedScans);
+        CHECK(stats.GetHits() > N_LOOKUPS * 95 / 100);
+    }
+
+    void test_close() {
+        size_t nClosed = 0;
+        {
+            FolderCache<FakeBackend> cache;
+            cache.GetBackend().nClosed = &nClosed;
+            cache.GetFolder("a");
+            cache.GetFolder("b");
+            cache.GetFolder("a");
+        }
+        CHECK(nClosed == 2);
+    }
+
+#ifdef __linux__
+    struct TempFolder {
+        std::string path;
+
+        TempFolder() {
+            char pattern[] = "/tmp/handler_catalog_XXXXXX";
+            path = ::mkdtemp(pattern);
+        }
+
+        ~TempFolder() {
+            std::system(("rm -rf '" + path + "'").c_str());
+        }
+    };
+
+    void touch(const std::string& path) {
+        std::ofstream(path) << "x";
+    }
+
+    bool has(const std::vector<std::string>& names, const std::string& name) {
+        for (const auto& present : names) {
+            if (present == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void test_inotify() {
+        TempFolder root;
+        const std::string editors = root.path + "/Editors";
+        const std::string viewers = root.path + "/Viewers";
+        ::mkdir(editors.c_str(), 0700);
+        ::mkdir(viewers.c_str(), 0700);
+        touch(editors + "/vim.desktop");
+        touch(viewers + "/feh.desktop");
+
+        inotify_backend::FolderCache cache;
+        CHECK(cache.GetBackend().IsWatching());
+
+        const auto listed = cache.GetFolder(editors);
+        CHECK(listed->exists && listed->files.size() == 1 && has(listed->files, "vim.desktop"));
+        const auto viewersListed = cache.GetFolder(viewers);
+        CHECK(cache.GetFolder(editors) == listed);
+        CHECK(cache.GetStats().nScans == 2);
+
+        // a new handler: listed again, the other folder isn't
+        touch(editors + "/code.desktop");
+        const auto added = cache.GetFolder(editors);
+        CHECK(added != listed && added->files.size() == 2 && has(added->files, "code.desktop"));
+        CHECK(cache.GetFolder(viewers) == viewersListed);
+        CHECK(cache.GetFolder(editors) == added);
+
+        // renamed, removed, a subfolder made
+        std::rename((editors + "/code.desktop").c_str(), (editors + "/codium.desktop").c_str());
+        const auto renamed = cache.GetFolder(editors);
+        CHECK(has(renamed->files, "codium.desktop") && !has(renamed->files, "code.desktop"));
+        std::remove((editors + "/vim.desktop").c_str());
+        CHECK(cache.GetFolder(editors)->files.size() == 1);
+        ::mkdir((editors + "/Terminal").c_str(), 0700);
+        const auto withSubfolder = cache.GetFolder(editors);
+        CHECK(withSubfolder->subfolders.size() == 1 && withSubfolder->subfolders[0] == "Terminal");
+        // a change inside the subfolder isn't a change of the folder
+        touch(editors + "/Terminal/kitty.desktop");
+        CHECK(cache.GetFolder(editors) == withSubfolder);
+
+        // a folder that isn't there yet is told by its modification time, then watched once it's there
+        const std::string later = root.path + "/Later";
+        CHECK(!cache.GetFolder(later)->exists);
+        CHECK(!cache.GetFolder(later)->exists);
+        ::mkdir(later.c_str(), 0700);
+        const auto created = cache.GetFolder(later);
+        CHECK(created->exists && created->files.empty());
+        touch(later + "/new.desktop");
+        CHECK(cache.GetFolder(later)->files.size() == 1);
+
+        // removed and made anew
+        std::system(("rm -rf '" + viewers + "'").c_str());
+        CHECK(!cache.GetFolder(viewers)->exists);
+        ::mkdir(viewers.c_str(), 0700);
+        touch(viewers + "/eog.desktop");
+        const auto remade = cache.GetFolder(viewers);
+        CHECK(remade->exists && remade->files.size() == 1 && has(remade->files, "eog.desktop"));
+        touch(viewers + "/gimp.desktop");
+        CHECK(cache.GetFolder(viewers)->files.size() == 2);
+
+        const auto stats = cache.GetStats();
+        CHECK(stats.nScans < stats.nLookups);
+    }
+#endif
+}
+
+int main() {
+    test_hits();
+    test_invalidation();
+    test_change_during_scan();
+    test_late_scan_loses();
+    test_hit_rate();
+    test_close();
+#ifdef __linux__
+    test_inotify();
+#endif
+    return check::report();
+}
@@ -0,0 +1,154 @@
+#include "handler_groups.h"
+#include "worker_pool.h"
+#include "check.h"
+#include "fake_handler_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using fake_handler_tree::FakeCatalog;
+using fake_handler_tree::FakeSnapshot;
+using HandlerGroup = handler_groups::HandlerGroup<FakeSnapshot>;
+
+namespace {
+
+    // the pool, remembering what it was asked to run
+    struct CountingRunner {
+        worker_pool::WorkerPool pool{ 3 };
+        size_t nRuns = 0;
+        size_t maxThreads = 0;
+
+        template <typename Task>
+        void Run(size_t nTasks, size_t maxThreadsWanted, Task task) {
+            nRuns += 1;
+            maxThreads = std::max(maxThreads, maxThreadsWanted);
+            pool.Run(nTasks, maxThreadsWanted, task);
+        }
+    };
+
+    size_t count_groups(const std::vector<HandlerGroup>& groups) {
+        size_t nGroups = groups.size();
+        for (const auto& group : groups) {
+            nGroups += count_groups(group.groups);
+        }
+        return nGroups;
+    }
+
+    size_t get_depth(const std::vector<HandlerGroup>& groups) {
+        size_t depth = 0;
+        for (const auto& group : groups) {
+            depth = std::max(depth, 1 + get_depth(group.groups));
+        }
+        return depth;
+    }
+
+    std::vector<HandlerGroup> load(FakeCatalog& catalog, CountingRunner& runner) {
+        return handler_groups::load_handler_groups(L"root", catalog.GetRoot(L"root"), catalog, runner);
+    }
+
+    void test_tree() {
+        FakeCatalog catalog;
+        catalog.AddTree(L"root", { 3, 2 }, 1);
+        CountingRunner runner;
+
+        const auto groups = load(catalog, runner);
+        CHECK(groups.size() == 3 && count_groups(groups) == 9);
+        CHECK(groups[1].title == L"group 1" && groups[1].groups[0].title == L"group 0");
+        CHECK(groups[2].groups[1].folder->files == std::vector<std::wstring>{ L"root\\group 2\\group 1\\handler 0.lnk" });
+        // a listing per folder, a run per level
+        CHECK(catalog.nListings == 9 && runner.nRuns == 2);
+        CHECK(runner.maxThreads == handler_groups::MAX_THREADS);
+    }
+
+    void test_depth_is_capped() {
+        FakeCatalog catalog;
+        catalog.AddTree(L"root", { 1, 1, 1, 1, 1, 1 }, 1);
+        CountingRunner runner;
+
+        const auto groups = load(catalog, runner);
+        CHECK(get_depth(groups) == handler_groups::MAX_DEPTH);
+        // nothing deeper is even listed
+        CHECK(catalog.nListings == handler_groups::MAX_DEPTH);
+    }
+
+    void test_pruned() {
+        FakeCatalog catalog;
+        catalog.Add(L"root", 0);
+        catalog.Add(L"root\\empty", 0);
+        catalog.Add(L"root\\empty\\emptier", 0);
+        catalog.Add(L"root\\deep", 0);
+        catalog.Add(L"root\\deep\\handlers", 2);
+        catalog.Add(L"root\\flat", 1);
+        CountingRunner runner;
+
+        const auto groups = load(catalog, runner);
+        // a group with nothing but empty groups in it goes, one with handlers deeper down stays
+        CHECK(groups.size() == 2 && groups[0].title == L"deep" && groups[1].title == L"flat");
+        CHECK(groups[0].groups.size() == 1 && groups[0].groups[0].folder->files.size() == 2);
+    }
+
+    void test_loops_are_left_out() {
+        FakeCatalog catalog;
+        catalog.Add(L"root", 0, 100);
+        catalog.Add(L"root\\a", 1, 200);
+        // junctions back to a and to the root
+        catalog.Add(L"root\\a\\back to a", 1, 200);
+        catalog.Add(L"root\\a\\back to root", 1, 100);
+        catalog.Add(L"root\\a\\real", 1, 300);
+        // the same folder twice, side by side, is no loop
+        catalog.Add(L"root\\b", 1, 400);
+        catalog.Add(L"root\\b\\again", 1, 300);
+        CountingRunner runner;
+
+        const auto groups = load(catalog, runner);
+        CHECK(groups.size() == 2 && groups[0].groups.size() == 1 && groups[0].groups[0].title == L"real");
+        CHECK(groups[1].groups.size() == 1 && groups[1].groups[0].title == L"again");
+    }
+
+    void test_one_pool_for_every_level_and_menu() {
+        FakeCatalog catalog;
+        catalog.AddTree(L"root", { 4, 3, 2, 2 }, 1);
+        CountingRunner runner;
+
+        for (size_t i = 0; i < 20; i += 1) {
+            catalog.Forget();
+            CHECK(count_groups(load(catalog, runner)) == 4 + 12 + 24 + 48);
+        }
+        // 4 levels of 20 walks, on helpers started once
+        CHECK(runner.nRuns == 80);
+        CHECK(runner.pool.GetStartedCount() <= 3);
+    }
+
+    void test_listed_levels_stay_on_the_calling_thread() {
+        FakeCatalog catalog;
+        catalog.AddTree(L"root", { 4, 3 }, 1);
+        CountingRunner warmUp;
+        load(catalog, warmUp);
+        const size_t nListings = catalog.nListings;
+
+        CountingRunner runner;
+        CHECK(count_groups(load(catalog, runner)) == 16);
+        CHECK(catalog.nListings == nListings);
+        CHECK(runner.maxThreads == 1 && runner.pool.GetStartedCount() == 0);
+    }
+
+    void test_no_subfolders() {
+        FakeCatalog catalog;
+        catalog.Add(L"root", 3);
+        CountingRunner runner;
+        CHECK(load(catalog, runner).empty() && runner.nRuns == 0);
+    }
+}
+
+int main() {
+    test_tree();
+    test_depth_is_capped();
+    test_pruned();
+    test_loops_are_left_out();
+    test_one_pool_for_every_level_and_menu();
+    test_listed_levels_stay_on_the_calling_thread();
+    test_no_subfolders();
+    return check::report();
+}
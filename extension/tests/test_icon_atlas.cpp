@@ -0,0 +1,270 @@
+#include "icon_atlas.h"
+#include "check.h"
+
+#include <cstdio>
+#include <iterator>
+#include <random>
+
+using namespace icon_atlas;
+
+namespace {
+
+    std::vector<uint8_t> make_icon(std::mt19937& random, uint32_t width, uint32_t height) {
+        std::vector<uint8_t> pixels(size_t(width) * height * 4);
+        for (auto& byte : pixels) {
+            byte = static_cast<uint8_t>(random());
+        }
+        return pixels;
+    }
+
+    bool holds(const Atlas& atlas, SlotId id, const std::vector<uint8_t>& pixels) {
+        const Rect& rect = atlas.GetRect(id);
+        if (rect.x + rect.width > atlas.GetWidth() || rect.y + rect.height > atlas.GetHeight()) {
+            return false;
+        }
+        for (uint32_t row = 0; row < rect.height; row += 1) {
+            const uint8_t* at = atlas.GetPixels() + (size_t(rect.y + row) * atlas.GetWidth() + rect.x) * 4;
+            if (memcmp(at, pixels.data() + size_t(row) * rect.width * 4, size_t(rect.width) * 4) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool overlap(const Rect& a, const Rect& b) {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    void test_empty() {
+        Atlas atlas;
+        CHECK(atlas.GetWidth() == Atlas::DEFAULT_WIDTH);
+        CHECK(atlas.GetHeight() == 0);
+        CHECK(atlas.GetUsedSlots() == 0);
+        CHECK(atlas.GetPixelBytes() == 0);
+        CHECK(atlas.GetUsedPixelBytes() == 0);
+        CHECK(!atlas.IsUsed(0));
+        CHECK(!atlas.IsUsed(NO_SLOT));
+        atlas.Remove(0);
+        atlas.Remove(NO_SLOT);
+        CHECK(atlas.GetUsedSlots() == 0);
+    }
+
+    void test_rejected() {
+        std::mt19937 random(6);
+        Atlas atlas(64);
+        const std::vector<uint8_t> pixels = make_icon(random, 65, 65);
+        CHECK(atlas.Add(pixels.data(), 0, 16) == NO_SLOT);
+        CHECK(atlas.Add(pixels.data(), 16, 0) == NO_SLOT);
+        CHECK(atlas.Add(pixels.data(), 65, 1) == NO_SLOT);
+        CHECK(atlas.Add(pixels.data(), 1, Atlas::MAX_HEIGHT + 1) == NO_SLOT);
+        CHECK(atlas.GetUsedSlots() == 0);
+        CHECK(atlas.GetGeneration() == 0);
+    }
+
+    void test_shelves() {
+        std::mt19937 random(7);
+        Atlas atlas;
+        const auto small = make_icon(random, 16, 16);
+        const auto large = make_icon(random, 32, 32);
+
+        // sixteen 16 pixel icons fill a row of a 256 pixel wide atlas, the seventeenth starts the next
+        std::vector<SlotId> ids;
+        for (int i = 0; i < 17; i += 1) {
+            ids.push_back(atlas.Add(small.data(), 16, 16));
+        }
+        CHECK(atlas.GetRect(ids[15]).x == 240 && atlas.GetRect(ids[15]).y == 0);
+        CHECK(atlas.GetRect(ids[16]).x == 0 && atlas.GetRect(ids[16]).y == 16);
+        CHECK(atlas.GetHeight() == 32);
+
+        // icons of another size get rows of their own
+        const SlotId largeId = atlas.Add(large.data(), 32, 32);
+        CHECK(atlas.GetRect(largeId).y == 32 && atlas.GetHeight() == 64);
+        const SlotId smallId = atlas.Add(small.data(), 16, 16);
+        CHECK(atlas.GetRect(smallId).y == 16 && atlas.GetRect(smallId).x == 16);
+
+        CHECK(atlas.GetUsedSlots() == 19);
+        CHECK(atlas.GetPixelBytes() == size_t(256) * 64 * 4);
+        CHECK(atlas.GetUsedPixelBytes() == size_t(18) * 16 * 16 * 4 + 32 * 32 * 4);
+        CHECK(holds(atlas, ids[0], small) && holds(atlas, largeId, large) && holds(atlas, smallId, small));
+    }
+
+    void test_slot_reuse() {
+        std::mt19937 random(8);
+        Atlas atlas;
+        const auto first = make_icon(random, 16, 16);
+        const auto second = make_icon(random, 16, 16);
+        const auto other = make_icon(random, 20, 20);
+
+        const SlotId a = atlas.Add(first.data(), 16, 16);
+        const SlotId b = atlas.Add(first.data(), 16, 16);
+        const uint64_t generation = atlas.GetGeneration();
+        atlas.Remove(a);
+        CHECK(!atlas.IsUsed(a) && atlas.IsUsed(b));
+        CHECK(atlas.GetUsedSlots() == 1);
+        CHECK(atlas.GetUsedPixelBytes() == 16 * 16 * 4);
+        // removing alone doesn't change any pixel
+        CHECK(atlas.GetGeneration() == generation);
+        atlas.Remove(a);
+        CHECK(atlas.GetUsedSlots() == 1);
+
+        // a different size doesn't take the free rectangle
+        const SlotId c = atlas.Add(other.data(), 20, 20);
+        CHECK(c != a);
+        // the same size does, and the buffer doesn't grow for it
+        const size_t nBytes = atlas.GetPixelBytes();
+        const SlotId d = atlas.Add(second.data(), 16, 16);
+        CHECK(d == a);
+        CHECK(atlas.GetPixelBytes() == nBytes);
+        CHECK(atlas.GetGeneration() > generation);
+        CHECK(holds(atlas, d, second) && holds(atlas, b, first) && holds(atlas, c, other));
+    }
+
+    void test_max_height() {
+        std::mt19937 random(9);
+        Atlas atlas(32);
+        const auto icon = make_icon(random, 32, 32);
+        const size_t nFit = Atlas::MAX_HEIGHT / 32;
+        std::vector<SlotId> ids;
+        for (size_t i = 0; i < nFit; i += 1) {
+            ids.push_back(atlas.Add(icon.data(), 32, 32));
+            CHECK(ids.back() != NO_SLOT);
+        }
+        CHECK(atlas.GetHeight() == Atlas::MAX_HEIGHT);
+        CHECK(atlas.Add(icon.data(), 32, 32) == NO_SLOT);
+        CHECK(atlas.Add(icon.data(), 1, 1) == NO_SLOT);
+        CHECK(atlas.GetUsedSlots() == nFit);
+
+        // full, but room is made by removing
+        atlas.Remove(ids[7]);
+        CHECK(atlas.Add(icon.data(), 32, 32) == ids[7]);
+        CHECK(atlas.GetPixelBytes() == size_t(32) * Atlas::MAX_HEIGHT * 4);
+    }
+
+    void test_random_churn() {
+        // a process's worth of handler icons coming and going, at the sizes menus use
+        std::mt19937 random(10);
+        const uint32_t sides[] = { 16, 20, 24, 32, 48 };
+        Atlas atlas;
+        std::vector<std::pair<SlotId, std::vector<uint8_t>>> held;
+        size_t nRejected = 0;
+        for (int round = 0; round < 6000; round += 1) {
+            if (!held.empty() && random() % 3 == 0) {
+                const size_t k = random() % held.size();
+                atlas.Remove(held[k].first);
+                held.erase(held.begin() + k);
+                continue;
+            }
+            const uint32_t side = sides[random() % std::size(sides)];
+            auto pixels = make_icon(random, side, side);
+            const uint64_t generation = atlas.GetGeneration();
+            const SlotId id = atlas.Add(pixels.data(), side, side);
+            if (id == NO_SLOT) {
+                nRejected += 1;
+                CHECK(atlas.GetGeneration() == generation);
+                continue;
+            }
+            CHECK(atlas.IsUsed(id));
+            CHECK(atlas.GetGeneration() > generation);
+            held.emplace_back(id, std::move(pixels));
+        }
+
+        size_t nUsedBytes = 0;
+        for (size_t i = 0; i < held.size(); i += 1) {
+            CHECK(holds(atlas, held[i].first, held[i].second));
+            nUsedBytes += held[i].second.size();
+            for (size_t j = i + 1; j < held.size(); j += 1) {
+                CHECK(!overlap(atlas.GetRect(held[i].first), atlas.GetRect(held[j].first)));
+            }
+        }
+        CHECK(atlas.GetUsedSlots() == held.size());
+        CHECK(atlas.GetUsedPixelBytes() == nUsedBytes);
+        CHECK(atlas.GetUsedPixelBytes() <= atlas.GetPixelBytes());
+        CHECK(atlas.GetPixelBytes() == size_t(atlas.GetWidth()) * atlas.GetHeight() * 4);
+        CHECK(atlas.GetHeight() <= Atlas::MAX_HEIGHT);
+        std::printf("%zu icons held in %zu of %zu bytes, %zu left out\n", held.size(), atlas.GetUsedPixelBytes(), atlas.GetPixelBytes(), nRejected);
+    }
+
+    void test_changed_rows() {
+        std::mt19937 random(11);
+        Atlas atlas(64);
+        const size_t rowBytes = 64 * 4;
+        std::vector<uint8_t> mirror(rowBytes * Atlas::MAX_HEIGHT, 0);
+
+        // nothing added, nothing to copy
+        CHECK(atlas.CopyChangedRows(mirror.data()) == 0);
+        // icons of one shelf share its rows: copied once
+        const auto first = make_icon(random, 16, 16);
+        const auto second = make_icon(random, 16, 16);
+        atlas.Add(first.data(), 16, 16);
+        atlas.Add(second.data(), 16, 16);
+        CHECK(atlas.CopyChangedRows(mirror.data()) == 16 * rowBytes);
+        CHECK(atlas.CopyChangedRows(mirror.data()) == 0);
+
+        // a shelf below: only its rows
+        const auto tall = make_icon(random, 24, 24);
+        const SlotId tallId = atlas.Add(tall.data(), 24, 24);
+        CHECK(atlas.GetRect(tallId).y == 16);
+        CHECK(atlas.CopyChangedRows(mirror.data()) == 24 * rowBytes);
+        // removing changes no pixels, the slot taken again does
+        atlas.Remove(tallId);
+        CHECK(atlas.CopyChangedRows(mirror.data()) == 0);
+        const auto wide = make_icon(random, 24, 16);
+        atlas.Add(wide.data(), 24, 16);
+        atlas.Add(tall.data(), 24, 24);
+        CHECK(atlas.CopyChangedRows(mirror.data()) == (16 + 24) * rowBytes);
+        CHECK(memcmp(mirror.data(), atlas.GetPixels(), atlas.GetPixelBytes()) == 0);
+
+        // a new mirror takes all of them
+        std::vector<uint8_t> fresh(mirror.size(), 0);
+        CHECK(atlas.CopyChangedRows(fresh.data(), true) == atlas.GetPixelBytes());
+        CHECK(memcmp(fresh.data(), atlas.GetPixels(), atlas.GetPixelBytes()) == 0);
+    }
+
+    void test_mirror_churn() {
+        // a mirror synced now and then, as IconAtlas does before drawing, stays the same as the atlas
+        std::mt19937 random(12);
+        const uint32_t sides[] = { 16, 20, 24, 32 };
+        Atlas atlas;
+        const size_t rowBytes = size_t(atlas.GetWidth()) * 4;
+        std::vector<uint8_t> mirror(rowBytes * Atlas::MAX_HEIGHT, 0);
+        std::vector<SlotId> held;
+        size_t nCopied = 0;
+        size_t nFullCopies = 0;
+        bool isSame = true;
+        for (int round = 0; round < 3000; round += 1) {
+            if (!held.empty() && random() % 3 == 0) {
+                const size_t k = random() % held.size();
+                atlas.Remove(held[k]);
+                held.erase(held.begin() + k);
+            }
+            else {
+                const uint32_t side = sides[random() % std::size(sides)];
+                const auto pixels = make_icon(random, side, side);
+                const SlotId id = atlas.Add(pixels.data(), side, side);
+                if (id != NO_SLOT) {
+                    held.push_back(id);
+                }
+            }
+            if (random() % 4 == 0) {
+                nCopied += atlas.CopyChangedRows(mirror.data());
+                nFullCopies += atlas.GetPixelBytes();
+                isSame = isSame && memcmp(mirror.data(), atlas.GetPixels(), atlas.GetPixelBytes()) == 0;
+            }
+        }
+        CHECK(isSame);
+        // a sync copies a shelf or two, not the whole atlas
+        CHECK(nCopied * 10 < nFullCopies);
+    }
+}
+
+int main() {
+    test_empty();
+    test_rejected();
+    test_shelves();
+    test_slot_reuse();
+    test_max_height();
+    test_random_churn();
+    test_changed_rows();
+    test_mirror_churn();
+    return check::report();
+}
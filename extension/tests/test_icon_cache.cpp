@@ -0,0 +1,210 @@
+#include "icon_cache.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <random>
+#include <thread>
+#include <vector>
+
+using icon_cache::IconCache;
+
+namespace {
+
+    std::atomic<int> g_nLiveIcons{ 0 };
+
+    // what the fake provider extracts: which handler, of which version
+    struct FakeIcon {
+        std::wstring path;
+        uint64_t version;
+
+        FakeIcon(std::wstring path, uint64_t version)
+            : path(std::move(path))
+            , version(version)
+        {
+            g_nLiveIcons += 1;
+        }
+
+        ~FakeIcon() {
+            g_nLiveIcons -= 1;
+        }
+    };
+
+    // IconProvider's part: counts extractions
+    struct FakeProvider {
+        std::atomic<size_t> nExtracted{ 0 };
+
+        std::shared_ptr<const FakeIcon> Extract(const std::wstring& path, uint64_t version) {
+            nExtracted += 1;
+            return std::make_shared<const FakeIcon>(path, version);
+        }
+    };
+
+    std::shared_ptr<const FakeIcon> get(IconCache<FakeIcon>& cache, FakeProvider& provider, const std::wstring& path, uint64_t version) {
+        auto icon = cache.Find(path, version);
+        return icon ? icon : cache.Load(path, version, [&]() { return provider.Extract(path, version); });
+    }
+
+    void test_hits() {
+        IconCache<FakeIcon> cache(8);
+        FakeProvider provider;
+        const auto first = get(cache, provider, L"a.lnk", 1);
+        CHECK(first && first->path == L"a.lnk" && first->version == 1);
+        CHECK(get(cache, provider, L"a.lnk", 1) == first);
+        CHECK(get(cache, provider, L"a.lnk", 1) == first);
+        CHECK(provider.nExtracted == 1);
+        CHECK(cache.GetHits() == 2 && cache.GetMisses() == 1);
+
+        // Peek counts nothing
+        CHECK(cache.Peek(L"a.lnk", 1) == first);
+        CHECK(!cache.Peek(L"b.lnk", 1));
+        CHECK(cache.GetHits() == 2 && cache.GetMisses() == 1);
+    }
+
+    void test_versions() {
+        IconCache<FakeIcon> cache(8);
+        FakeProvider provider;
+        const auto old = get(cache, provider, L"a.lnk", 1);
+
+        // the handler changed: its old icon is dropped and the new one extracted
+        CHECK(!cache.Peek(L"a.lnk", 2));
+        const auto changed = get(cache, provider, L"a.lnk", 2);
+        CHECK(changed != old && changed->version == 2);
+        CHECK(cache.size() == 1);
+        CHECK(!cache.Peek(L"a.lnk", 1));
+        CHECK(get(cache, provider, L"a.lnk", 2) == changed);
+
+        // loaded over an icon of another version, which was only peeked at: the new one replaces it
+        const auto newer = cache.Load(L"a.lnk", 3, [&]() { return provider.Extract(L"a.lnk", 3); });
+        CHECK(cache.Peek(L"a.lnk", 3) == newer);
+        CHECK(cache.size() == 1);
+
+        // loaded again at the same version: the cached one stays
+        cache.Load(L"a.lnk", 3, [&]() { return provider.Extract(L"a.lnk", 3); });
+        CHECK(cache.Peek(L"a.lnk", 3) == newer);
+    }
+
+    void test_eviction() {
+        IconCache<FakeIcon> cache(3);
+        FakeProvider provider;
+        get(cache, provider, L"a", 1);
+        get(cache, provider, L"b", 1);
+        get(cache, provider, L"c", 1);
+        // a is used again, so b is the least recently used one
+        get(cache, provider, L"a", 1);
+        get(cache, provider, L"d", 1);
+        CHECK(cache.size() == 3);
+        CHECK(cache.Peek(L"a", 1) && !cache.Peek(L"b", 1) && cache.Peek(L"c", 1) && cache.Peek(L"d", 1));
+
+        // peeking doesn't count as use: c goes next
+        cache.Peek(L"c", 1);
+        get(cache, provider, L"e", 1);
+        CHECK(!cache.Peek(L"c", 1) && cache.Peek(L"a", 1) && cache.Peek(L"d", 1) && cache.Peek(L"e", 1));
+        CHECK(provider.nExtracted == 5);
+
+        // an evicted icon lives on while a menu has it, and goes with the last one using it
+        const int nLive = g_nLiveIcons;
+        auto held = get(cache, provider, L"f", 1);
+        // f in, the least recently used one out
+        CHECK(g_nLiveIcons == nLive);
+        get(cache, provider, L"g", 1);
+        get(cache, provider, L"h", 1);
+        get(cache, provider, L"i", 1);
+        CHECK(!cache.Peek(L"f", 1));
+        CHECK(held->path == L"f");
+        const int nWithHeld = g_nLiveIcons;
+        held.reset();
+        CHECK(g_nLiveIcons == nWithHeld - 1);
+    }
+
+    void test_extraction_unlocked() {
+        // a handler slow to extract holds up nobody but who waits for it
+        IconCache<FakeIcon> cache(8);
+        FakeProvider provider;
+        get(cache, provider, L"cached", 1);
+
+        std::mutex lock;
+        std::condition_variable wakeUp;
+        bool isExtracting = false;
+        bool isReleased = false;
+        std::thread slow([&]() {
+            cache.Load(L"slow", 1, [&]() {
+                std::unique_lock<std::mutex> guard(lock);
+                isExtracting = true;
+                wakeUp.notify_all();
+                wakeUp.wait(guard, [&]() { return isReleased; });
+                return provider.Extract(L"slow", 1);
+            });
+        });
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeUp.wait(guard, [&]() { return isExtracting; });
+        }
+
+        CHECK(cache.Find(L"cached", 1));
+        CHECK(get(cache, provider, L"other", 1));
+        CHECK(!cache.Find(L"slow", 1));
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            isReleased = true;
+        }
+        wakeUp.notify_all();
+        slow.join();
+        CHECK(cache.Find(L"slow", 1));
+    }
+
+    void test_concurrent() {
+        const size_t CAPACITY = 64;
+        const size_t N_HANDLERS = 200;
+        const size_t N_THREADS = 8;
+        const size_t N_LOOKUPS = 20000;
+        IconCache<FakeIcon> cache(CAPACITY);
+        FakeProvider provider;
+        const int nLiveBefore = g_nLiveIcons;
+
+        std::atomic<size_t> nWrong{ 0 };
+        std::atomic<size_t> nOverCapacity{ 0 };
+        std::vector<std::thread> threads;
+        for (size_t thread = 0; thread < N_THREADS; thread += 1) {
+            threads.emplace_back([&, thread]() {
+                std::mt19937 random(static_cast<unsigned>(thread));
+                for (size_t i = 0; i < N_LOOKUPS; i += 1) {
+                    // a few handlers are used far more than the rest, and now and then one is changed
+                    const size_t handler = random() % 4 == 0 ? random() % N_HANDLERS : random() % 16;
+                    const uint64_t version = random() % 500 == 0 ? 2 : 1;
+                    const std::wstring path = L"handler" + std::to_wstring(handler) + L".lnk";
+                    const auto icon = get(cache, provider, path, version);
+                    if (!icon || icon->path != path || icon->version != version) {
+                        nWrong += 1;
+                    }
+                    if (cache.size() > CAPACITY) {
+                        nOverCapacity += 1;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        CHECK(nWrong == 0);
+        CHECK(nOverCapacity == 0);
+        CHECK(cache.GetHits() + cache.GetMisses() == N_THREADS * N_LOOKUPS);
+        // every miss is one extraction, and the often used handlers mostly hit
+        CHECK(provider.nExtracted == cache.GetMisses());
+        CHECK(cache.GetHits() > cache.GetMisses());
+        // nothing leaks: what is alive is what is cached
+        CHECK(static_cast<size_t>(g_nLiveIcons - nLiveBefore) == cache.size());
+    }
+}
+
+int main() {
+    test_hits();
+    test_versions();
+    test_eviction();
+    test_extraction_unlocked();
+    test_concurrent();
+    return check::report();
+}
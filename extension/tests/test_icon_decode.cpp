@@ -0,0 +1,326 @@
+#include "icon_fixtures.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace fixtures;
+using icon_decode::Image;
+
+namespace {
+
+    uint8_t reference_multiply(unsigned x, unsigned alpha) {
+        return static_cast<uint8_t>((x * alpha + 127) / 255);
+    }
+
+    // one pixel at a time, as premultiply is specified
+    void reference_premultiply(uint8_t* pixels, size_t nPixels) {
+        bool haveAlpha = false;
+        for (size_t i = 0; i < nPixels; i += 1) {
+            haveAlpha = haveAlpha || pixels[4 * i + 3] != 0;
+        }
+        for (size_t i = 0; i < nPixels; i += 1) {
+            uint8_t* pixel = pixels + 4 * i;
+            if (!haveAlpha) {
+                pixel[3] = 255;
+            }
+            for (int channel = 0; channel < 3; channel += 1) {
+                pixel[channel] = reference_multiply(pixel[channel], pixel[3]);
+            }
+        }
+    }
+
+    // what decoding the entry has to give: top-down premultiplied BGRA
+    std::vector<uint8_t> expected_pixels(const Dib& dib) {
+        std::vector<uint8_t> pixels;
+        bool haveAlpha = false;
+        for (size_t i = 0; i < dib.pixels.size(); i += 1) {
+            const uint32_t color = dib.bitCount >= 24 ? dib.pixels[i] : dib.palette[dib.pixels[i]];
+            const uint8_t alpha = dib.bitCount == 32 ? static_cast<uint8_t>(color >> 24) : 255;
+            haveAlpha = haveAlpha || (dib.bitCount == 32 && alpha != 0);
+            pixels.insert(pixels.end(), { static_cast<uint8_t>(color), static_cast<uint8_t>(color >> 8), static_cast<uint8_t>(color >> 16), alpha });
+        }
+        if (!haveAlpha && !dib.transparent.empty()) {
+            for (size_t i = 0; i < dib.transparent.size(); i += 1) {
+                pixels[4 * i + 3] = dib.transparent[i] ? 0 : 255;
+            }
+        }
+        reference_premultiply(pixels.data(), dib.pixels.size());
+        return pixels;
+    }
+
+    Dib random_dib(std::mt19937& random, uint32_t width, uint32_t height, uint32_t bitCount, bool haveMask) {
+        Dib dib;
+        dib.width = width;
+        dib.height = height;
+        dib.bitCount = bitCount;
+        if (bitCount <= 8) {
+            for (uint32_t i = 0; i < (1u << bitCount); i += 1) {
+                dib.palette.push_back(random() & 0xFFFFFF);
+            }
+        }
+        for (uint32_t i = 0; i < width * height; i += 1) {
+            const uint32_t value = static_cast<uint32_t>(random());
+            dib.pixels.push_back(bitCount <= 8 ? value % (1u << bitCount) : (bitCount == 24 ? value & 0xFFFFFF : value));
+            if (haveMask) {
+                dib.transparent.push_back(random() % 4 == 0);
+            }
+        }
+        return dib;
+    }
+
+    bool decode_dib(const std::vector<uint8_t>& bytes, Image& image) {
+        return icon_decode::decode_dib(bytes.data(), bytes.size(), image);
+    }
+
+    void check_dib(const Dib& dib) {
+        Image image;
+        if (CHECK(decode_dib(build_dib(dib), image))) {
+            CHECK(image.width == dib.width && image.height == dib.height);
+            CHECK(image.pixels == expected_pixels(dib));
+        }
+    }
+
+    void test_multiply_alpha() {
+        size_t nWrong = 0;
+        for (unsigned x = 0; x < 256; x += 1) {
+            for (unsigned alpha = 0; alpha < 256; alpha += 1) {
+                nWrong += icon_decode::multiply_alpha(x, alpha) != reference_multiply(x, alpha);
+            }
+        }
+        CHECK(nWrong == 0);
+    }
+
+    void test_premultiply() {
+        // lengths around the 4 pixel blocks, at every byte alignment, with alpha first found in the blocks or in the tail
+        std::mt19937 random(11);
+        for (size_t nPixels = 0; nPixels < 70; nPixels += 1) {
+            for (size_t misalignment = 0; misalignment < 4; misalignment += 1) {
+                for (const int alphaAt : { -1, 0, 1, 2, 3, 5, 64, 67 }) {
+                    std::vector<uint8_t> buffer(misalignment + nPixels * 4);
+                    uint8_t* pixels = buffer.data() + misalignment;
+                    for (size_t i = 0; i < nPixels * 4; i += 1) {
+                        pixels[i] = static_cast<uint8_t>(random());
+                    }
+                    for (size_t i = 0; i < nPixels; i += 1) {
+                        pixels[4 * i + 3] = (int(i) == alphaAt) ? static_cast<uint8_t>(1 + random() % 255) : (int(i) > alphaAt && alphaAt >= 0 ? pixels[4 * i + 3] : 0);
+                    }
+                    std::vector<uint8_t> expected(pixels, pixels + nPixels * 4);
+                    reference_premultiply(expected.data(), nPixels);
+                    icon_decode::premultiply(pixels, nPixels);
+                    CHECK(std::equal(expected.begin(), expected.end(), pixels));
+                }
+            }
+        }
+
+        // every color with every alpha, through the blocks
+        std::vector<uint8_t> all;
+        for (unsigned x = 0; x < 256; x += 1) {
+            for (unsigned alpha = 0; alpha < 256; alpha += 1) {
+                all.insert(all.end(), { uint8_t(x), uint8_t(255 - x), uint8_t(x ^ 0x5A), uint8_t(alpha) });
+            }
+        }
+        std::vector<uint8_t> expected = all;
+        reference_premultiply(expected.data(), expected.size() / 4);
+        icon_decode::premultiply(all.data(), all.size() / 4);
+        CHECK(all == expected);
+    }
+
+    void test_bit_depths() {
+        std::mt19937 random(12);
+        // widths that do and don't fill the 4 byte rows
+        for (const uint32_t width : { 1, 3, 8, 16, 20, 31, 32, 33, 48 }) {
+            for (const uint32_t bitCount : { 1, 4, 8, 24, 32 }) {
+                check_dib(random_dib(random, width, width % 7 + 1, bitCount, true));
+                check_dib(random_dib(random, width, width, bitCount, false));
+            }
+        }
+
+        // a 32 bit entry with no alpha at all goes by its mask
+        Dib noAlpha = random_dib(random, 16, 16, 32, true);
+        for (auto& pixel : noAlpha.pixels) {
+            pixel &= 0xFFFFFF;
+        }
+        check_dib(noAlpha);
+        noAlpha.transparent.clear();
+        check_dib(noAlpha);
+
+        Dib bitfields = random_dib(random, 16, 16, 32, true);
+        bitfields.compression = 3;
+        check_dib(bitfields);
+
+        // a known 1 bit image, to not only compare with a reference of the same making
+        Dib mono;
+        mono.width = 2;
+        mono.height = 2;
+        mono.bitCount = 1;
+        mono.palette = { 0x000000, 0x204080 };
+        mono.pixels = { 1, 0, 0, 1 };
+        mono.transparent = { false, false, true, false };
+        Image image;
+        CHECK(decode_dib(build_dib(mono), image));
+        CHECK(image.pixels == std::vector<uint8_t>({ 0x80, 0x40, 0x20, 255, 0, 0, 0, 255, 0, 0, 0, 0, 0x80, 0x40, 0x20, 255 }));
+    }
+
+    void test_malformed_dibs() {
+        std::mt19937 random(13);
+        Image image;
+        const Dib good = random_dib(random, 16, 16, 4, true);
+        const std::vector<uint8_t> bytes = build_dib(good);
+        CHECK(decode_dib(bytes, image));
+
+        // a palette shorter than the indexes need
+        Dib shortPalette = good;
+        shortPalette.palette.resize(3);
+        for (auto& index : shortPalette.pixels) {
+            index = 5;
+        }
+        CHECK(!decode_dib(build_dib(shortPalette), image));
+
+        std::vector<uint8_t> damaged = bytes;
+        damaged[14] = 16; // 16 bits per pixel
+        CHECK(!decode_dib(damaged, image));
+        damaged = bytes;
+        damaged[16] = 1; // RLE
+        CHECK(!decode_dib(damaged, image));
+        damaged = bytes;
+        damaged[7] = 0x80; // negative width
+        CHECK(!decode_dib(damaged, image));
+        damaged = bytes;
+        damaged[5] = 0x02; // wider than an icon can be
+        CHECK(!decode_dib(damaged, image));
+        damaged = bytes;
+        damaged[8] = 1; // less than one row
+        CHECK(!decode_dib(damaged, image));
+        damaged = bytes;
+        damaged[0] = 0xFF; // header bigger than the entry
+        CHECK(!decode_dib(damaged, image));
+
+        // the mask may be left out, the pixels may not
+        const size_t maskSize = 16 * 4;
+        for (size_t size = 0; size < bytes.size() - maskSize; size += 1) {
+            CHECK(!icon_decode::decode_dib(bytes.data(), size, image));
+        }
+        CHECK(icon_decode::decode_dib(bytes.data(), bytes.size() - maskSize, image));
+    }
+
+    void test_entry_choice() {
+        Image image;
+        const std::vector<uint8_t> icon = typical_icon();
+
+        // exact sizes are taken as they are, the 32 bit entry over the 8 bit one
+        CHECK(icon_decode::decode_icon(icon.data(), icon.size(), 16, image));
+        Image exact;
+        const Entry entry16 = alpha_entry(16, 1);
+        CHECK(decode_dib(entry16.image, exact));
+        CHECK(image.pixels == exact.pixels);
+
+        // in between sizes are shrunk from the next bigger one, bigger ones from the biggest
+        for (const uint32_t side : { 20u, 24u, 40u, 64u, 256u }) {
+            CHECK(icon_decode::decode_icon(icon.data(), icon.size(), side, image));
+            CHECK(image.width == side && image.height == side && image.pixels.size() == size_t(side) * side * 4);
+        }
+        CHECK(!icon_decode::decode_icon(icon.data(), icon.size(), 0, image));
+        CHECK(!icon_decode::decode_icon(icon.data(), icon.size(), 257, image));
+
+        std::vector<icon_decode::IconEntry> entries;
+        CHECK(icon_decode::read_icon_directory(icon.data(), icon.size(), entries));
+        icon_decode::order_entries(entries, 20);
+        CHECK(entries.size() == 5);
+        CHECK(entries[0].width == 32 && entries[0].bitCount == 32);
+        CHECK(entries[1].width == 32 && entries[1].bitCount == 8);
+        CHECK(entries[2].width == 48);
+        CHECK(entries[3].width == 16 && entries[3].bitCount == 32);
+        CHECK(entries[4].width == 16 && entries[4].bitCount == 8);
+
+        // PNG entries go to the decoder given; one that fails gives way to the next best entry
+        const std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A, 1, 2, 3 };
+        const std::vector<uint8_t> withPng = build_icon({ { 0, 0, 32, png }, alpha_entry(32, 2) });
+        size_t nPngs = 0;
+        auto decodePng = [&nPngs](const uint8_t* data, size_t size, Image& decoded) {
+            nPngs += 1;
+            decoded.width = 256;
+            decoded.height = 256;
+            decoded.pixels.assign(size_t(256) * 256 * 4, 0x7F);
+            return size == 11 && data[8] == 1;
+        };
+        CHECK(icon_decode::decode_icon(withPng.data(), withPng.size(), 48, image, decodePng));
+        CHECK(nPngs == 1 && image.pixels[0] == 0x7F);
+        CHECK(icon_decode::decode_icon(withPng.data(), withPng.size(), 48, image));
+        CHECK(image.width == 48 && image.pixels[0] != 0x7F);
+    }
+
+    void test_resample() {
+        Image from;
+        from.width = 4;
+        from.height = 4;
+        for (int i = 0; i < 16; i += 1) {
+            from.pixels.insert(from.pixels.end(), { 10, 20, 30, 40 });
+        }
+        Image to;
+        for (const uint32_t side : { 1u, 2u, 3u, 5u, 16u }) {
+            icon_decode::resample(from, side, side, to);
+            CHECK(to.width == side && to.height == side);
+            bool isUniform = true;
+            for (size_t i = 0; i < to.pixels.size(); i += 4) {
+                isUniform = isUniform && to.pixels[i] == 10 && to.pixels[i + 1] == 20 && to.pixels[i + 2] == 30 && to.pixels[i + 3] == 40;
+            }
+            CHECK(isUniform);
+        }
+
+        // halving averages each 2 x 2 block
+        for (int i = 0; i < 16; i += 1) {
+            from.pixels[4 * i] = static_cast<uint8_t>((i % 4) < 2 ? 0 : 200);
+        }
+        icon_decode::resample(from, 2, 2, to);
+        CHECK(to.pixels[0] == 0 && to.pixels[4] == 200 && to.pixels[8] == 0 && to.pixels[12] == 200);
+        icon_decode::resample(from, 1, 1, to);
+        CHECK(to.pixels[0] == 100);
+    }
+
+    void test_corrupted_icons() {
+        const std::vector<uint8_t> icon = typical_icon();
+        Image image;
+        for (size_t size = 0; size < icon.size(); size += 1) {
+            icon_decode::decode_icon(icon.data(), size, 20, image);
+        }
+        CHECK(!icon_decode::decode_icon(icon.data(), 6 + 16 * 5 - 1, 16, image));
+
+        std::vector<uint8_t> damaged = icon;
+        damaged[2] = 2; // a cursor
+        CHECK(!icon_decode::decode_icon(damaged.data(), damaged.size(), 16, image));
+        damaged = icon;
+        damaged[4] = 0;
+        CHECK(!icon_decode::decode_icon(damaged.data(), damaged.size(), 16, image));
+
+        // whatever is in the bytes, decoding stays inside them; run under a sanitizer to see it
+        std::mt19937 random(14);
+        for (size_t i = 0; i < 6 + 16 * 5 + 200; i += 1) {
+            for (const uint8_t value : { 0x00, 0x01, 0x20, 0x7F, 0x80, 0xFF }) {
+                damaged = icon;
+                damaged[i] = value;
+                if (icon_decode::decode_icon(damaged.data(), damaged.size(), 20, image)) {
+                    CHECK(image.width == 20 && image.pixels.size() == 20 * 20 * 4);
+                }
+            }
+        }
+        for (int round = 0; round < 3000; round += 1) {
+            damaged = icon;
+            for (int n = 0; n < 3; n += 1) {
+                damaged[random() % damaged.size()] = static_cast<uint8_t>(random());
+            }
+            icon_decode::decode_icon(damaged.data(), damaged.size(), 24, image);
+        }
+    }
+}
+
+int main() {
+    test_multiply_alpha();
+    test_premultiply();
+    test_bit_depths();
+    test_malformed_dibs();
+    test_entry_choice();
+    test_resample();
+    test_corrupted_icons();
+    return check::report();
+}
@@ -0,0 +1,166 @@
+#include "icon_loader.h"
+#include "check.h"
+#include "fake_icon_extractor.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using fake_icon_extractor::Extractions;
+using fake_icon_extractor::FakeExtractor;
+using fake_icon_extractor::g_nLiveScopes;
+using IconLoader = icon_loader::IconLoader<FakeExtractor>;
+
+namespace {
+
+    std::vector<std::wstring> handlers(const std::wstring& prefix, size_t nHandlers) {
+        std::vector<std::wstring> paths;
+        for (size_t i = 0; i < nHandlers; i += 1) {
+            paths.push_back(prefix + std::to_wstring(i) + L".lnk");
+        }
+        return paths;
+    }
+
+    icon_loader::Clock::time_point in(std::chrono::milliseconds timeout) {
+        return icon_loader::Clock::now() + timeout;
+    }
+
+    // what the DLL does before it's unloaded, for as long as it takes the workers to finish
+    void shut_down(IconLoader& loader) {
+        const auto deadline = in(5s);
+        while (!loader.TryShutdown() && icon_loader::Clock::now() < deadline) {
+            std::this_thread::sleep_for(1ms);
+        }
+        CHECK(loader.TryShutdown());
+    }
+
+    void test_loaded_in_order() {
+        Extractions extractions;
+        IconLoader loader(4);
+        loader.GetBackend().extractions = &extractions;
+
+        const auto paths = handlers(L"handler ", 10);
+        const auto icons = loader.Load(paths, in(5s));
+        CHECK(icons.size() == paths.size());
+        bool isInOrder = true;
+        for (size_t i = 0; i < icons.size(); i += 1) {
+            isInOrder = isInOrder && icons[i] && icons[i]->path == paths[i];
+        }
+        CHECK(isInOrder);
+        CHECK(extractions.nExtracted == 10);
+        CHECK(loader.GetStartedCount() <= 4);
+
+        // the next menu is served from the cache, no worker is asked
+        const size_t nStarted = loader.GetStartedCount();
+        CHECK(loader.Load(paths, in(0ms)) == icons);
+        CHECK(extractions.nExtracted == 10 && loader.GetStartedCount() == nStarted);
+        shut_down(loader);
+        CHECK(g_nLiveScopes == 0);
+    }
+
+    void test_no_more_workers_than_wanted() {
+        Extractions extractions;
+        IconLoader loader(8);
+        loader.GetBackend().extractions = &extractions;
+
+        // a single icon missing needs no more than a single worker
+        loader.Load(handlers(L"one ", 1), in(5s));
+        CHECK(loader.GetStartedCount() == 1);
+        // and no more than maxThreads of them however many are missing
+        loader.Load(handlers(L"many ", 100), in(5s));
+        CHECK(loader.GetStartedCount() <= 8);
+        // workers are kept from one menu to the next
+        const size_t nStarted = loader.GetStartedCount();
+        for (size_t menu = 0; menu < 20; menu += 1) {
+            loader.Load(handlers(L"menu " + std::to_wstring(menu) + L" ", 8), in(5s));
+        }
+        CHECK(loader.GetStartedCount() == nStarted);
+        shut_down(loader);
+    }
+
+    void test_deadline() {
+        Extractions extractions;
+        IconLoader loader(2);
+        loader.GetBackend().extractions = &extractions;
+        loader.Load({ L"cached.lnk" }, in(5s));
+
+        // the shell is stuck: the menu is built without the icons it doesn't have
+        extractions.Hold();
+        const auto start = icon_loader::Clock::now();
+        const auto icons = loader.Load({ L"cached.lnk", L"slow 1.lnk", L"slow 2.lnk", L"slow 3.lnk" }, in(20ms));
+        CHECK(icon_loader::Clock::now() - start < 5s);
+        CHECK(icons.size() == 4 && icons[0] && !icons[1] && !icons[2] && !icons[3]);
+        CHECK(!loader.TryShutdown());
+
+        // the abandoned menu's icons still make it to the cache, for the next menu
+        extractions.Release();
+        shut_down(loader);
+        CHECK(extractions.nExtracted == 4);
+        CHECK(loader.GetBackend().Find(L"slow 3.lnk") != nullptr);
+    }
+
+    void test_extracted_once_for_every_menu() {
+        const size_t N_MENUS = 6;
+        Extractions extractions;
+        IconLoader loader(4);
+        loader.GetBackend().extractions = &extractions;
+        const auto paths = handlers(L"shared ", 12);
+
+        // menus asking for the same icons at once wait for the same extractions
+        extractions.Hold();
+        std::atomic<size_t> nComplete{ 0 };
+        std::vector<std::thread> menus;
+        for (size_t i = 0; i < N_MENUS; i += 1) {
+            menus.emplace_back([&]() {
+                const auto icons = loader.Load(paths, in(5s));
+                size_t nIcons = 0;
+                for (const auto& icon : icons) {
+                    nIcons += icon ? 1 : 0;
+                }
+                if (nIcons == paths.size()) {
+                    nComplete += 1;
+                }
+            });
+        }
+        std::this_thread::sleep_for(20ms);
+        extractions.Release();
+        for (auto& menu : menus) {
+            menu.join();
+        }
+        // a menu that came in after the extractions were done found them cached, either way once per handler
+        CHECK(nComplete == N_MENUS);
+        CHECK(extractions.nExtracted == paths.size());
+        shut_down(loader);
+    }
+
+    void test_shutdown_and_restart() {
+        Extractions extractions;
+        IconLoader loader(3);
+        loader.GetBackend().extractions = &extractions;
+
+        // nothing started, nothing to stop
+        CHECK(loader.TryShutdown());
+        loader.Load(handlers(L"before ", 6), in(5s));
+        shut_down(loader);
+        CHECK(g_nLiveScopes == 0);
+
+        // workers start again for the next menu
+        const auto icons = loader.Load(handlers(L"after ", 6), in(5s));
+        CHECK(icons.size() == 6 && icons[5] && icons[5]->path == L"after 5.lnk");
+        CHECK(g_nLiveScopes > 0);
+        shut_down(loader);
+        CHECK(g_nLiveScopes == 0);
+    }
+}
+
+int main() {
+    test_loaded_in_order();
+    test_no_more_workers_than_wanted();
+    test_deadline();
+    test_extracted_once_for_every_menu();
+    test_shutdown_and_restart();
+    return check::report();
+}
@@ -0,0 +1,310 @@
+#include "launch_queue.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using launch_queue::LaunchQueue;
+using launch_queue::LaunchRequest;
+
+namespace {
+
+    // Holds launches back until released
+    class Latch {
+    public:
+        void Wait() {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_nWaiting += 1;
+            m_wakeUp.notify_all();
+            m_wakeUp.wait(lock, [this]() { return m_isOpen; });
+        }
+
+        // false if nobody came in time
+        bool WaitForWaiting(size_t nWaiting) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            return m_wakeUp.wait_for(lock, std::chrono::seconds(5), [&]() { return m_nWaiting >= nWaiting; });
+        }
+
+        void Open() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isOpen = true;
+            m_wakeUp.notify_all();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        size_t m_nWaiting = 0;
+        bool m_isOpen = false;
+    };
+
+    std::atomic<int> g_nScopes{ 0 };
+    // called as a launching thread ends, with the queue unlocked
+    std::function<void()> g_onScopeEnd;
+
+    // Launches nothing: remembers what it was asked to launch, taking its time over it
+    class FakeLauncher {
+    public:
+        struct ThreadScope {
+            ThreadScope() {
+                g_nScopes += 1;
+            }
+
+            ~ThreadScope() {
+                g_nScopes -= 1;
+                if (g_onScopeEnd) {
+                    g_onScopeEnd();
+                }
+            }
+        };
+
+        // a launch takes that long, or a random time up to it
+        std::chrono::microseconds latency{ 0 };
+        bool isLatencyRandom = false;
+        // launches of files starting with "blocked" wait for it
+        Latch* latch = nullptr;
+
+        void Launch(const LaunchRequest& request) {
+            const int nLaunching = ++m_nLaunching;
+            int maxLaunching = m_maxLaunching;
+            while (nLaunching > maxLaunching && !m_maxLaunching.compare_exchange_weak(maxLaunching, nLaunching)) {
+            }
+
+            if (latch && request.file.compare(0, 7, L"blocked") == 0) {
+                latch->Wait();
+            }
+            if (latency.count() > 0) {
+                thread_local std::mt19937 random(1);
+                std::this_thread::sleep_for(isLatencyRandom ? latency * static_cast<int>(random() % 100) / 100 : latency);
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_launched.push_back(request.file);
+            m_nLaunching -= 1;
+        }
+
+        std::vector<std::wstring> GetLaunched() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_launched;
+        }
+
+        int GetMaxLaunching() const {
+            return m_maxLaunching;
+        }
+
+    private:
+        std::mutex m_lock;
+        std::vector<std::wstring> m_launched;
+        std::atomic<int> m_nLaunching{ 0 };
+        std::atomic<int> m_maxLaunching{ 0 };
+    };
+
+    LaunchRequest make_request(const std::wstring& file, bool mustWait = false) {
+        LaunchRequest request;
+        request.verb = L"open";
+        request.file = file;
+        request.commandLines = { L"\"C:\\some file.txt\"" };
+        if (mustWait) {
+            request.commandLines.assign(3, L"item");
+            request.maxProcesses = 1;
+        }
+        return request;
+    }
+
+    // the DLL is unloaded only when this is true, so it has to become true once the work is done
+    bool shut_down(LaunchQueue<FakeLauncher>& queue) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!queue.TryShutdown()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    void test_order() {
+        LaunchQueue<FakeLauncher> queue;
+        CHECK(queue.TryShutdown());
+
+        std::vector<std::wstring> expected;
+        size_t nStarted = 0;
+        for (int i = 0; i < 50; i += 1) {
+            expected.push_back(L"handler" + std::to_wstring(i));
+            auto request = make_request(expected.back());
+            request.onStarted = [&nStarted]() { nStarted += 1; };
+            CHECK(queue.Enqueue(std::move(request)));
+        }
+        CHECK(shut_down(queue));
+        CHECK(queue.GetBackend().GetLaunched() == expected);
+        CHECK(nStarted == expected.size());
+        CHECK(queue.GetBackend().GetMaxLaunching() == 1);
+        CHECK(g_nScopes == 0);
+
+        // started again by the next request
+        CHECK(queue.Enqueue(make_request(L"again")));
+        CHECK(shut_down(queue));
+        CHECK(queue.GetBackend().GetLaunched().back() == L"again");
+    }
+
+    void test_returns_at_once() {
+        // a slow launch holds up nobody but the requests queued behind it
+        LaunchQueue<FakeLauncher> queue;
+        queue.GetBackend().latency = std::chrono::milliseconds(300);
+        const auto start = std::chrono::steady_clock::now();
+        CHECK(queue.Enqueue(make_request(L"slow")));
+        CHECK(queue.Enqueue(make_request(L"behind")));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+        CHECK(!queue.TryShutdown());
+        CHECK(shut_down(queue));
+        CHECK(queue.GetBackend().GetLaunched().size() == 2);
+    }
+
+    void test_bounded() {
+        LaunchQueue<FakeLauncher> queue;
+        Latch latch;
+        queue.GetBackend().latch = &latch;
+
+        // the worker takes the first one up and is stuck with it, the queue fills behind it
+        CHECK(queue.Enqueue(make_request(L"blocked")));
+        CHECK(latch.WaitForWaiting(1));
+        for (size_t i = 0; i < LaunchQueue<FakeLauncher>::MAX_QUEUED_REQUESTS; i += 1) {
+            CHECK(queue.Enqueue(make_request(L"queued" + std::to_wstring(i))));
+        }
+        CHECK(!queue.Enqueue(make_request(L"rejected")));
+        CHECK(!queue.TryShutdown());
+
+        latch.Open();
+        CHECK(shut_down(queue));
+        const auto launched = queue.GetBackend().GetLaunched();
+        CHECK(launched.size() == LaunchQueue<FakeLauncher>::MAX_QUEUED_REQUESTS + 1);
+        CHECK(launched.front() == L"blocked" && launched.back() != L"rejected");
+    }
+
+    void test_waiting_job() {
+        // a request waiting for its processes doesn't hold the queue up, but does hold the shutdown
+        LaunchQueue<FakeLauncher> queue;
+        Latch latch;
+        queue.GetBackend().latch = &latch;
+
+        CHECK(queue.Enqueue(make_request(L"blocked each", true)));
+        CHECK(latch.WaitForWaiting(1));
+        for (int i = 0; i < 10; i += 1) {
+            CHECK(queue.Enqueue(make_request(L"after" + std::to_wstring(i))));
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (queue.GetBackend().GetLaunched().size() < 10 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(queue.GetBackend().GetLaunched().size() == 10);
+        CHECK(!queue.TryShutdown());
+        CHECK(!queue.TryShutdown());
+
+        latch.Open();
+        CHECK(shut_down(queue));
+        CHECK(queue.GetBackend().GetLaunched().back() == L"blocked each");
+        CHECK(g_nScopes == 0);
+    }
+
+    void test_enqueued_while_stopping() {
+        // a request coming as the worker is on its way out is launched by a worker started anew
+        LaunchQueue<FakeLauncher> queue;
+        CHECK(queue.Enqueue(make_request(L"first")));
+        bool isEnqueued = false;
+        g_onScopeEnd = [&]() {
+            if (!isEnqueued) {
+                isEnqueued = queue.Enqueue(make_request(L"late"));
+            }
+        };
+        CHECK(shut_down(queue));
+        g_onScopeEnd = nullptr;
+
+        CHECK(isEnqueued);
+        CHECK(queue.GetBackend().GetLaunched() == std::vector<std::wstring>({ L"first", L"late" }));
+        CHECK(g_nScopes == 0);
+    }
+
+    void test_stress() {
+        // Explorer windows launching all at once, some of the requests waiting for their processes,
+        // while DllCanUnloadNow tries to shut the launcher down every now and then
+        const size_t N_PRODUCERS = 8;
+        const size_t N_REQUESTS = 400;
+        LaunchQueue<FakeLauncher> queue;
+        queue.GetBackend().latency = std::chrono::microseconds(200);
+        queue.GetBackend().isLatencyRandom = true;
+
+        std::atomic<size_t> nStarted{ 0 };
+        std::vector<std::vector<std::wstring>> accepted(N_PRODUCERS);
+        std::vector<size_t> nRejected(N_PRODUCERS);
+        std::atomic<bool> isDone{ false };
+        std::thread unloader([&]() {
+            while (!isDone) {
+                queue.TryShutdown();
+                std::this_thread::sleep_for(std::chrono::microseconds(300));
+            }
+        });
+
+        std::vector<std::thread> producers;
+        for (size_t producer = 0; producer < N_PRODUCERS; producer += 1) {
+            producers.emplace_back([&, producer]() {
+                std::mt19937 random(static_cast<unsigned>(producer));
+                for (size_t i = 0; i < N_REQUESTS; i += 1) {
+                    const std::wstring file = std::to_wstring(producer) + L":" + std::to_wstring(i);
+                    auto request = make_request(file, random() % 20 == 0);
+                    request.onStarted = [&nStarted]() { nStarted += 1; };
+                    if (queue.Enqueue(std::move(request))) {
+                        accepted[producer].push_back(file);
+                    }
+                    else {
+                        nRejected[producer] += 1;
+                    }
+                    // now a burst, now a pause long enough for the queue to run dry
+                    if (random() % 50 == 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    }
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        isDone = true;
+        unloader.join();
+        CHECK(shut_down(queue));
+
+        // every accepted request launched exactly once, nothing rejected launched
+        std::map<std::wstring, size_t> nLaunches;
+        for (const auto& file : queue.GetBackend().GetLaunched()) {
+            nLaunches[file] += 1;
+        }
+        size_t nAccepted = 0;
+        for (size_t producer = 0; producer < N_PRODUCERS; producer += 1) {
+            nAccepted += accepted[producer].size();
+            CHECK(accepted[producer].size() + nRejected[producer] == N_REQUESTS);
+            for (const auto& file : accepted[producer]) {
+                CHECK(nLaunches[file] == 1);
+            }
+        }
+        CHECK(nLaunches.size() == nAccepted);
+        CHECK(nStarted == nAccepted);
+        CHECK(g_nScopes == 0);
+    }
+}
+
+int main() {
+    test_order();
+    test_returns_at_once();
+    test_bounded();
+    test_waiting_job();
+    test_enqueued_while_stopping();
+    test_stress();
+    return check::report();
+}
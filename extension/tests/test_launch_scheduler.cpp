@@ -0,0 +1,149 @@
+#include "launch_scheduler.h"
+#include "check.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include "posix_spawner.h"
+#endif
+
+using launch_scheduler::Spawned;
+using launch_scheduler::run_launches;
+
+namespace {
+
+    // Processes that exit when waited for, oldest first. Command lines say how their launch goes.
+    class FakeSpawner {
+    public:
+        using Process = int;
+
+        std::vector<std::wstring> spawned;
+        std::vector<int> running;
+        size_t maxRunning = 0;
+        size_t nWaits = 0;
+        size_t nClosed = 0;
+        size_t nKept = 0;
+
+        Spawned Spawn(const std::wstring& arguments, bool keepProcess, int& process) {
+            spawned.push_back(arguments);
+            if (arguments == L"fail") {
+                return Spawned::Failed;
+            }
+            if (arguments == L"cancel") {
+                return Spawned::Cancelled;
+            }
+            if (arguments == L"handover") {
+                return Spawned::HandedOver;
+            }
+            const int id = static_cast<int>(spawned.size());
+            running.push_back(id);
+            maxRunning = std::max(maxRunning, running.size());
+            if (keepProcess) {
+                process = id;
+                nKept += 1;
+            }
+            return Spawned::Started;
+        }
+
+        size_t WaitForAny(const std::vector<int>& processes) {
+            nWaits += 1;
+            // the oldest one of them exits
+            const auto oldest = std::min_element(processes.begin(), processes.end());
+            running.erase(std::find(running.begin(), running.end(), *oldest));
+            return oldest - processes.begin();
+        }
+
+        void Close(int) {
+            nClosed += 1;
+        }
+    };
+
+    std::vector<std::wstring> items(size_t nItems) {
+        std::vector<std::wstring> commandLines;
+        for (size_t i = 0; i < nItems; i += 1) {
+            commandLines.push_back(L"item" + std::to_wstring(i));
+        }
+        return commandLines;
+    }
+
+    void test_capped() {
+        for (const size_t maxProcesses : { 1, 2, 3, 8, 100 }) {
+            FakeSpawner spawner;
+            const auto commandLines = items(20);
+            CHECK(run_launches(commandLines, maxProcesses, false, spawner));
+            CHECK(spawner.spawned == commandLines);
+            CHECK(spawner.maxRunning == std::min<size_t>(maxProcesses, 20));
+            // waited for as few as the cap needs
+            CHECK(spawner.nWaits == (maxProcesses < 20 ? 20 - maxProcesses : 0));
+            // every one of them is let go of, exited or left running
+            CHECK(spawner.nKept == 20 && spawner.nClosed == 20);
+        }
+    }
+
+    void test_unlimited() {
+        FakeSpawner spawner;
+        CHECK(run_launches(items(50), 0, false, spawner));
+        CHECK(spawner.spawned.size() == 50 && spawner.maxRunning == 50);
+        // nothing to wait for, nothing kept
+        CHECK(spawner.nWaits == 0 && spawner.nKept == 0 && spawner.nClosed == 0);
+    }
+
+    void test_wait_for_all() {
+        FakeSpawner spawner;
+        CHECK(run_launches(items(10), 3, true, spawner));
+        CHECK(spawner.running.empty());
+        CHECK(spawner.nWaits == 10 && spawner.nClosed == 10);
+
+        FakeSpawner unlimited;
+        CHECK(run_launches(items(10), 0, true, unlimited));
+        CHECK(unlimited.running.empty() && unlimited.maxRunning == 10);
+    }
+
+    void test_failures() {
+        // a failed launch doesn't take a slot and doesn't stop the others
+        FakeSpawner failing;
+        CHECK(run_launches({ L"a", L"fail", L"b", L"fail", L"c" }, 2, true, failing));
+        CHECK(failing.spawned.size() == 5 && failing.nWaits == 3);
+
+        // a cancelled one stops the rest, those running are still waited for
+        FakeSpawner cancelled;
+        CHECK(run_launches({ L"a", L"b", L"cancel", L"c" }, 0, true, cancelled));
+        CHECK(cancelled.spawned.size() == 3);
+        CHECK(cancelled.running.empty() && cancelled.nWaits == 2);
+
+        // a handed over one can't be waited for, so they aren't all done when it returns
+        FakeSpawner handedOver;
+        CHECK(!run_launches({ L"a", L"handover", L"b" }, 0, true, handedOver));
+        CHECK(handedOver.nWaits == 2);
+    }
+
+#ifdef __linux__
+    void test_posix_spawn() {
+        posix_spawner::PosixSpawner spawner("/bin/sleep");
+        const std::vector<std::wstring> commandLines(12, L"0.01");
+        CHECK(run_launches(commandLines, 3, true, spawner));
+        CHECK(spawner.GetSpawnedCount() == 12);
+        CHECK(spawner.GetMaxRunning() == 3);
+        CHECK(spawner.GetRunningCount() == 0);
+
+        posix_spawner::PosixSpawner missing("/nonexistent/handler");
+        // the child is spawned and fails to exec, or spawning fails: either way nothing is left behind
+        run_launches(commandLines, 3, true, missing);
+        missing.ReapAll();
+        CHECK(missing.GetRunningCount() == 0);
+    }
+#endif
+}
+
+int main() {
+    test_capped();
+    test_unlimited();
+    test_wait_for_all();
+    test_failures();
+#ifdef __linux__
+    test_posix_spawn();
+#endif
+    return check::report();
+}
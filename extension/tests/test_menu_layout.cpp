@@ -0,0 +1,241 @@
+#include "menu_fixtures.h"
+#include "check.h"
+
+#include <set>
+
+using namespace fixtures;
+using menu_layout::MenuLayout;
+
+namespace {
+
+    Handler handler(const std::wstring& name, uint64_t fingerprint = 0) {
+        return { name, fingerprint ? fingerprint : fnv(name) };
+    }
+
+    std::vector<std::wstring> draw(const MenuLayout& layout, const Source& source) {
+        TextBuilder builder = { source.added, {} };
+        layout.Materialize(builder);
+        return builder.lines;
+    }
+
+    void test_ordering() {
+        // a folder with its own handlers and two groups, one of them nested
+        Folder extension;
+        extension.handlers = { handler(L"a"), handler(L"b") };
+        Folder inner;
+        inner.handlers = { handler(L"d") };
+        Folder tools;
+        tools.handlers = { handler(L"c") };
+        tools.groups.emplace_back(L"Inner", inner);
+        extension.groups.emplace_back(L"Tools", tools);
+        extension.groups.emplace_back(L"Empty", Folder());
+        Folder all;
+        all.handlers = { handler(L"e") };
+
+        MenuLayout layout;
+        layout.Reset(100);
+        Source source;
+        layout.AddSection(source, extension);
+        layout.AddSection(source, all);
+
+        // offsets in the order handlers were added: a folder's own, then its groups', depth first
+        CHECK((source.added == std::vector<std::wstring>{ L"a", L"b", L"c", L"d", L"e" }));
+        // shown with groups ahead of a folder's own handlers, empty groups left out
+        const std::vector<std::wstring> expected = {
+            L"[Tools", L"[Inner", L"d #3", L"]", L"c #2", L"]", L"a #0", L"b #1", L"---",
+            L"e #4", L"---",
+            L"open #5"
+        };
+        CHECK(draw(layout, source) == expected);
+        CHECK(layout.GetHandlersCount() == 5);
+        CHECK(layout.GetUsedCommandsCount() == 6);
+        CHECK(layout.GetSectionsCount() == 2);
+        CHECK(!layout.IsTruncated());
+    }
+
+    void test_ranking() {
+        Folder folder;
+        folder.handlers = { handler(L"never"), handler(L"often"), handler(L"once"), handler(L"also never"), handler(L"twice") };
+        const std::unordered_map<std::wstring, double> scores = { { L"often", 10 }, { L"once", 1 }, { L"twice", 2 } };
+
+        MenuLayout layout;
+        layout.Reset(100);
+        Source source;
+        source.scores = &scores;
+        layout.AddSection(source, folder);
+        // most used first, never used ones in the order they are listed
+        CHECK((source.added == std::vector<std::wstring>{ L"often", L"twice", L"once", L"never", L"also never" }));
+
+        const std::vector<int> items = { 5, 1, 4, 2, 3 };
+        const auto sorted = menu_layout::rank_by_score(items, [](int item) { return item % 2 == 0 ? 1.0 : 0.0; });
+        CHECK((sorted == std::vector<int>{ 4, 2, 5, 1, 3 }));
+        CHECK(menu_layout::rank_by_score(std::vector<int>(), [](int) { return 0.0; }).empty());
+    }
+
+    void test_dedupe() {
+        // the same tool in a specific section and in a general one: the specific one stays
+        Folder specific;
+        specific.handlers = { handler(L"Edit with Notepad", 1), handler(L"Hex", 2) };
+        Folder general;
+        general.handlers = { handler(L"Notepad", 1), handler(L"Other", 3) };
+        Folder nested;
+        nested.handlers = { handler(L"Hex again", 2), handler(L"Other again", 3), handler(L"New", 4) };
+        general.groups.emplace_back(L"More", nested);
+        // a section of nothing but duplicates is no section
+        Folder duplicates;
+        duplicates.handlers = { handler(L"Notepad too", 1), handler(L"New too", 4) };
+        Folder last;
+        last.handlers = { handler(L"Last", 5) };
+
+        MenuLayout layout;
+        layout.Reset(100);
+        Source source;
+        layout.AddSection(source, specific);
+        layout.AddSection(source, general, L"General");
+        layout.AddSection(source, duplicates, L"Duplicates");
+        layout.AddSection(source, last);
+        CHECK((source.added == std::vector<std::wstring>{ L"Edit with Notepad", L"Hex", L"Other", L"New", L"Last" }));
+        CHECK(layout.GetSectionsCount() == 3);
+        const std::vector<std::wstring> expected = {
+            L"Edit with Notepad #0", L"Hex #1", L"---",
+            L"[General", L"[More", L"New #3", L"]", L"Other #2", L"]", L"---",
+            L"Last #4", L"---",
+            L"open #5"
+        };
+        CHECK(draw(layout, source) == expected);
+
+        // a menu after it starts with nothing shown
+        layout.Reset(100);
+        Source again;
+        layout.AddSection(again, duplicates);
+        CHECK((again.added == std::vector<std::wstring>{ L"Notepad too", L"New too" }));
+        CHECK(draw(layout, again) == (std::vector<std::wstring>{ L"Notepad too #0", L"New too #1", L"---", L"open #2" }));
+    }
+
+    void test_submenu_separators() {
+        // consecutive submenus aren't separated, a submenu and a plain section are
+        Folder one;
+        one.handlers = { handler(L"1") };
+        Folder two;
+        two.handlers = { handler(L"2") };
+        Folder three;
+        three.handlers = { handler(L"3") };
+        Folder four;
+        four.handlers = { handler(L"4") };
+
+        MenuLayout layout;
+        layout.Reset(100);
+        Source source;
+        layout.AddSection(source, one, L"One");
+        layout.AddSection(source, two, L"Two");
+        layout.AddSection(source, three);
+        layout.AddSection(source, four, L"Four");
+        const std::vector<std::wstring> expected = {
+            L"[One", L"1 #0", L"]",
+            L"[Two", L"2 #1", L"]", L"---",
+            L"3 #2", L"---",
+            L"[Four", L"4 #3", L"]", L"---",
+            L"open #4"
+        };
+        CHECK(draw(layout, source) == expected);
+
+        // nothing at all is just "Open handlers folder"
+        layout.Reset(100);
+        Source none;
+        layout.AddSection(none, Folder());
+        CHECK(draw(layout, none) == std::vector<std::wstring>{ L"open #0" });
+        CHECK(layout.GetUsedCommandsCount() == 1);
+    }
+
+    void test_truncation() {
+        Folder folder;
+        for (int i = 0; i < 10; i += 1) {
+            folder.handlers.push_back(handler(L"h" + std::to_wstring(i)));
+        }
+        Folder group;
+        group.handlers = { handler(L"g") };
+        folder.groups.emplace_back(L"Group", group);
+
+        // room for 4 commands: 3 handlers and "Open handlers folder"
+        MenuLayout layout;
+        layout.Reset(4);
+        Source source;
+        layout.AddSection(source, folder);
+        CHECK(layout.IsTruncated());
+        CHECK(layout.GetUsedCommandsCount() == 4);
+        CHECK(draw(layout, source) == (std::vector<std::wstring>{ L"h0 #0", L"h1 #1", L"h2 #2", L"---", L"open #3" }));
+
+        // duplicates don't take offsets, so they don't push others out
+        Folder duplicates;
+        duplicates.handlers = { handler(L"a", 1), handler(L"b", 1), handler(L"c", 1), handler(L"d", 2) };
+        layout.Reset(3);
+        Source fits;
+        layout.AddSection(fits, duplicates);
+        CHECK(!layout.IsTruncated());
+        CHECK((fits.added == std::vector<std::wstring>{ L"a", L"d" }));
+
+        // room for nothing but "Open handlers folder"
+        layout.Reset(1);
+        Source nothing;
+        layout.AddSection(nothing, folder);
+        CHECK(nothing.added.empty() && layout.IsTruncated());
+        CHECK(draw(layout, nothing) == std::vector<std::wstring>{ L"open #0" });
+    }
+
+    void test_offsets() {
+        // big menus: every offset is used once, in a row from 0, and the menu never takes more than it may
+        std::mt19937 random(19);
+        MenuLayout layout;
+        for (const size_t nHandlers : { 5, 300, 3000 }) {
+            for (const size_t maxCommands : { size_t(2), size_t(64), size_t(1024) }) {
+                const auto sections = make_sections(random, nHandlers, nHandlers / 3 + 1);
+                layout.Reset(maxCommands);
+                Source source;
+                for (size_t i = 0; i < sections.size(); i += 1) {
+                    layout.AddSection(source, sections[i], i % 3 == 0 ? L"section" + std::to_wstring(i) : std::wstring());
+                }
+                CHECK(source.added.size() == layout.GetHandlersCount());
+                CHECK(layout.GetUsedCommandsCount() == source.added.size() + 1);
+                CHECK(layout.GetUsedCommandsCount() <= maxCommands);
+
+                std::set<size_t> offsets;
+                size_t depth = 0;
+                size_t openOffset = 0;
+                TextBuilder builder = { source.added, {} };
+                layout.Materialize(builder);
+                for (const auto& line : builder.lines) {
+                    if (line[0] == L'[') {
+                        depth += 1;
+                    }
+                    else if (line == L"]") {
+                        CHECK(depth > 0);
+                        depth -= 1;
+                    }
+                    else if (line.compare(0, 6, L"open #") == 0) {
+                        openOffset = std::stoul(line.substr(6));
+                    }
+                    else if (line != L"---") {
+                        const size_t offset = std::stoul(line.substr(line.find(L'#') + 1));
+                        CHECK(offsets.insert(offset).second);
+                        CHECK(line.compare(0, line.find(L' '), source.added[offset]) == 0);
+                    }
+                }
+                CHECK(depth == 0);
+                CHECK(builder.lines.back().compare(0, 6, L"open #") == 0);
+                CHECK(offsets.size() == source.added.size());
+                CHECK(offsets.empty() || *offsets.rbegin() == offsets.size() - 1);
+                CHECK(openOffset == source.added.size());
+            }
+        }
+    }
+}
+
+int main() {
+    test_ordering();
+    test_ranking();
+    test_dedupe();
+    test_submenu_separators();
+    test_truncation();
+    test_offsets();
+    return check::report();
+}
@@ -0,0 +1,70 @@
+#include "path_arena.h"
+#include "check.h"
+
+#include <string>
+
+using namespace path_arena;
+
+namespace {
+
+    void test_store() {
+        PathArena arena;
+        CHECK(arena.empty() && arena.size() == 0);
+
+        arena.Append(L"C:\\a.txt", 8);
+        // written in place, the way ANSI paths are converted into it
+        wchar_t* space = arena.Allocate(3);
+        space[0] = L'x';
+        space[1] = L'y';
+        space[2] = L'z';
+        arena.Append(L"", 0);
+
+        CHECK(arena.size() == 3 && !arena.empty());
+        CHECK(arena[0] == L"C:\\a.txt");
+        CHECK(arena[1] == L"xyz");
+        CHECK(arena[2].empty());
+        // every path is 0 terminated
+        CHECK(std::wstring(arena.CStr(0)) == L"C:\\a.txt");
+        CHECK(std::wstring(arena.CStr(1)) == L"xyz");
+        CHECK(arena.CStr(2)[0] == 0);
+    }
+
+    void test_growth() {
+        PathArena arena;
+        const std::wstring longPath(3 * PathArena::INITIAL_CAPACITY, L'p');
+        std::wstring paths[1000];
+        for (size_t i = 0; i < 1000; i += 1) {
+            paths[i] = L"C:\\folder\\file" + std::to_wstring(i) + L".txt";
+            arena.Append(paths[i].data(), paths[i].size());
+        }
+        // a path longer than the whole buffer
+        arena.Append(longPath.data(), longPath.size());
+
+        // what was stored before a growth is still there
+        CHECK(arena.size() == 1001);
+        for (size_t i = 0; i < 1000; i += 1) {
+            CHECK(arena[i] == paths[i]);
+        }
+        CHECK(arena[1000] == longPath);
+        // growing doubles the buffers, so thousands of paths take a few allocations
+        CHECK(arena.GetAllocationsCount() > 0 && arena.GetAllocationsCount() < 40);
+        const size_t peakBytes = arena.GetPeakBytes();
+        CHECK(peakBytes >= (longPath.size() + 1000 * 20) * sizeof(wchar_t));
+
+        // the next selection reuses the memory
+        arena.Reset();
+        CHECK(arena.empty());
+        for (size_t i = 0; i < 1000; i += 1) {
+            arena.Append(paths[i].data(), paths[i].size());
+        }
+        CHECK(arena.GetAllocationsCount() == 0);
+        CHECK(arena.GetPeakBytes() == peakBytes);
+        CHECK(arena[999] == paths[999]);
+    }
+}
+
+int main() {
+    test_store();
+    test_growth();
+    return check::report();
+}
@@ -0,0 +1,142 @@
+#include "path_kernels.h"
+#include "check.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+    // one character at a time, the way the kernels are specified
+    template <typename Char>
+    path_kernels::PathMarks reference_marks(std::basic_string_view<Char> path) {
+        path_kernels::PathMarks marks;
+        for (size_t i = 0; i < path.size(); i += 1) {
+            if (path[i] == Char('\\') || path[i] == Char('/')) {
+                marks.lastSeparator = i;
+                marks.lastDot = std::string_view::npos;
+            }
+            else if (path[i] == Char('.')) {
+                marks.lastDot = i;
+            }
+        }
+        return marks;
+    }
+
+    bool is_ascii(std::u16string_view text) {
+        for (const char16_t c : text) {
+            if (c >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::u16string reference_fold(std::u16string_view text) {
+        std::u16string folded(text);
+        for (auto& c : folded) {
+            if (c >= u'a' && c <= u'z') {
+                c -= u'a' - u'A';
+            }
+        }
+        return folded;
+    }
+
+    bool same_marks(const path_kernels::PathMarks& a, const path_kernels::PathMarks& b) {
+        return a.lastSeparator == b.lastSeparator && a.lastDot == b.lastDot;
+    }
+
+    void check_path(std::u16string_view path) {
+        const auto expected = reference_marks(path);
+        CHECK(same_marks(path_kernels::find_path_marks(path), expected));
+
+        // 32 bit characters never take the SSE2 path
+        const std::u32string wide(path.begin(), path.end());
+        CHECK(same_marks(path_kernels::find_path_marks(std::u32string_view(wide)), expected));
+
+        CHECK(path_kernels::find_filename_start(path) == (expected.lastSeparator == std::u16string_view::npos ? 0 : expected.lastSeparator + 1));
+    }
+
+    void check_fold(std::u16string_view text) {
+        std::u16string folded(text);
+        const bool isAscii = path_kernels::fold_ascii(folded.data(), folded.size());
+        CHECK(isAscii == is_ascii(text));
+        if (isAscii) {
+            CHECK(folded == reference_fold(text));
+        }
+        else {
+            // whatever was touched is folded; nothing else changed
+            for (size_t i = 0; i < text.size(); i += 1) {
+                CHECK(folded[i] == text[i] || folded[i] == reference_fold(text.substr(i, 1))[0]);
+            }
+        }
+    }
+
+    void test_edge_cases() {
+        const std::u16string paths[] = {
+            u"",
+            u".",
+            u"\\",
+            u"/",
+            u"a",
+            u"C:\\folder\\file.txt",
+            u"C:/folder/file.tar.gz",
+            u"C:\\folder.d\\file",
+            u"C:\\folder.d\\.hidden",
+            u"C:\\folder\\",
+            u"file.",
+            u"no separator at all in here.txt",
+            // separators and dots at each side of an 8 character block
+            u"1234567\\",
+            u"\\1234567",
+            u"12345678\\1234567",
+            u"1234567.\\1234567",
+            u"\\.234567",
+            u"1234567\\.2345678",
+            u".2345678",
+            u"12345678.2345678",
+            u"a.b.c.d.e.f.g.h.i.j\\k.l.m.n.o.p.q.r.s",
+            u"C:\\very\\long\\path\\with\\many\\folders\\and\\a\\file\\name\\at\\the\\end\\of\\it.extension",
+            u"\\\\server\\share\\\u00e9t\u00e9.docx",
+            // the code units next to '.', '/' and '\' in both bytes
+            u"\u2e2e\u5c5c\u2f2f\u2e00\u005c\u012e\u015c\u012f.x",
+        };
+        for (const auto& path : paths) {
+            check_path(path);
+            check_fold(path);
+        }
+
+        check_fold(u"abcdefghijklmnopqrstuvwxyz0123456789");
+        check_fold(u"`{@[ az AZ");
+        check_fold(u"abcdefg\u00e9hijklmnop");
+        check_fold(u"abcdefgh\uff41");
+        check_fold(u"\u8061bcdefgh");
+        check_fold(u"\u0080");
+        check_fold(u"\u007f");
+        check_fold(u"\u0161"); // 'a' in the low byte
+        check_fold(u"\u0141abcdefgh");
+    }
+
+    void test_random_paths() {
+        const char16_t alphabet[] = { u'\\', u'/', u'.', u'a', u'z', u'A', u'Z', u'_', u'`', u'{', u'0',
+            0x7F, 0x80, 0xE9, 0x2E2E, 0x5C00, 0x002E | 0x100, 0xFF41, 0xFFFF, 0x8000, 0xD83D };
+        std::mt19937 random(1);
+        for (int round = 0; round < 20000; round += 1) {
+            std::u16string text(random() % 48, u'a');
+            for (auto& c : text) {
+                // mostly plain letters, as real paths are
+                c = random() % 4 == 0 ? alphabet[random() % std::size(alphabet)] : char16_t(u'a' + random() % 26);
+            }
+            // unaligned starts too
+            const std::u16string_view view = std::u16string_view(text).substr(std::min<size_t>(text.size(), random() % 3));
+            check_path(view);
+            check_fold(view);
+        }
+    }
+}
+
+int main() {
+    test_edge_cases();
+    test_random_paths();
+    return check::report();
+}
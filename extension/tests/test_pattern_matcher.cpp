@@ -0,0 +1,195 @@
+#include "pattern_matcher.h"
+#include "check.h"
+
+#include <random>
+
+using pattern_matcher::PatternMatcher;
+
+namespace {
+
+    // the glob matched by backtracking, the obvious way
+    bool naive_match(std::wstring_view pattern, std::wstring_view name) {
+        if (pattern.empty()) {
+            return name.empty();
+        }
+        const wchar_t p = pattern.front();
+        if (p == L'%' || p == L'*') {
+            for (size_t skip = 0; skip <= name.size(); skip += 1) {
+                if (naive_match(pattern.substr(1), name.substr(skip))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (name.empty()) {
+            return false;
+        }
+        if (p != L'?' && pattern_matcher::fold_ascii_char(p) != pattern_matcher::fold_ascii_char(name.front())) {
+            return false;
+        }
+        return naive_match(pattern.substr(1), name.substr(1));
+    }
+
+    std::vector<size_t> naive_common_matches(const std::vector<std::wstring>& patterns, const std::vector<std::wstring>& paths) {
+        std::vector<size_t> result;
+        for (size_t i = 0; i < patterns.size(); i += 1) {
+            bool all = true;
+            for (const auto& path : paths) {
+                const size_t separator = path.find_last_of(L"\\/");
+                all = all && naive_match(patterns[i], std::wstring_view(path).substr(separator == std::wstring::npos ? 0 : separator + 1));
+            }
+            if (all) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+
+    bool matches(PatternMatcher& matcher, const std::wstring& name) {
+        return !matcher.FindCommonMatches(std::vector<std::wstring>{ name }).empty();
+    }
+
+    bool matches(const std::wstring& pattern, const std::wstring& name) {
+        PatternMatcher matcher({ pattern });
+        return matches(matcher, name);
+    }
+
+    void test_wildcards() {
+        // any run, empty too
+        CHECK(matches(L"%.txt", L"a.txt"));
+        CHECK(matches(L"%.txt", L".txt"));
+        CHECK(matches(L"*.txt", L"a.b.txt"));
+        CHECK(matches(L"a%b%c", L"abc"));
+        CHECK(matches(L"a%b%c", L"a--b--c"));
+        CHECK(!matches(L"a%b%c", L"a--c--b"));
+        CHECK(matches(L"%", L""));
+        CHECK(matches(L"%%", L"anything"));
+        // any single character, not none
+        CHECK(matches(L"report-??.csv", L"report-01.csv"));
+        CHECK(!matches(L"report-??.csv", L"report-1.csv"));
+        CHECK(!matches(L"report-??.csv", L"report-123.csv"));
+        CHECK(matches(L"?%", L"x"));
+        CHECK(!matches(L"?%", L""));
+        // the empty pattern is the empty name only
+        CHECK(matches(L"", L""));
+        CHECK(!matches(L"", L"a"));
+    }
+
+    void test_case_folding() {
+        CHECK(matches(L"%.TXT", L"notes.txt"));
+        CHECK(matches(L"Makefile", L"MAKEFILE"));
+        CHECK(matches(L"makefile", L"MakeFile"));
+        CHECK(!matches(L"makefile", L"makefil"));
+
+        // beyond ASCII with the fold it's given
+        const std::vector<std::wstring> patterns = { L"\u00E9t\u00E9%" };
+        PatternMatcher ascii(patterns);
+        CHECK(matches(ascii, L"\u00E9t\u00E9.txt"));
+        CHECK(!matches(ascii, L"\u00C9T\u00C9.txt"));
+        PatternMatcher latin(patterns, [](wchar_t c) {
+            return (c >= 0xE0 && c <= 0xFE && c != 0xF7) ? static_cast<wchar_t>(c - 0x20) : pattern_matcher::fold_ascii_char(c);
+        });
+        CHECK(matches(latin, L"\u00C9T\u00C9.txt"));
+        CHECK(matches(latin, L"\u00E9t\u00E9.TXT"));
+    }
+
+    void test_anchoring() {
+        // the whole name, not a part of it
+        CHECK(!matches(L"a%", L"ba"));
+        CHECK(!matches(L"%.txt", L"a.txt.bak"));
+        CHECK(!matches(L"readme", L"readme.md"));
+        CHECK(!matches(L"readme", L"my readme"));
+        // the name, not the folders it's in
+        PatternMatcher matcher({ L"%dir%", L"file", L"C:%" });
+        CHECK(matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\dir\\file" }) == std::vector<size_t>{ 1 });
+        CHECK(matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:/some dir/file" }) == std::vector<size_t>{ 1 });
+        CHECK(matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\x\\subdir.txt" }) == std::vector<size_t>{ 0 });
+    }
+
+    void test_common_matches() {
+        const std::vector<std::wstring> patterns = { L"%.txt", L"notes%", L"%", L"%.md", L"?otes.txt" };
+        PatternMatcher matcher(patterns);
+        CHECK(matcher.GetPatternsCount() == 5);
+        CHECK((matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\notes.txt", L"D:\\x\\notes2.txt" }) == std::vector<size_t>{ 0, 1, 2 }));
+        CHECK((matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\notes.txt", L"C:\\votes.txt" }) == std::vector<size_t>{ 0, 2, 4 }));
+        CHECK((matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\a.txt", L"C:\\b.md" }) == std::vector<size_t>{ 2 }));
+        // nothing selected matches every pattern
+        CHECK((matcher.FindCommonMatches(std::vector<std::wstring>()) == std::vector<size_t>{ 0, 1, 2, 3, 4 }));
+
+        PatternMatcher none({});
+        CHECK(none.FindCommonMatches(std::vector<std::wstring>{ L"C:\\a.txt" }).empty());
+    }
+
+    void test_many_patterns() {
+        // more than 64 patterns, so the match bits take several words
+        std::vector<std::wstring> patterns;
+        for (int i = 0; i < 150; i += 1) {
+            patterns.push_back(L"%" + std::to_wstring(i) + L"%");
+        }
+        PatternMatcher matcher(patterns);
+        const auto found = matcher.FindCommonMatches(std::vector<std::wstring>{ L"C:\\file-149.txt" });
+        CHECK(found == naive_common_matches(patterns, { L"C:\\file-149.txt" }));
+        CHECK(found.size() == 6); // 1, 4, 9, 14, 49, 149
+    }
+
+    std::wstring random_text(std::mt19937& random, const wchar_t* alphabet, size_t maxLength) {
+        const size_t nLetters = std::wstring_view(alphabet).size();
+        std::wstring text(random() % (maxLength + 1), L' ');
+        for (auto& c : text) {
+            c = alphabet[random() % nLetters];
+        }
+        return text;
+    }
+
+    void test_against_naive() {
+        std::mt19937 random(16);
+        for (int round = 0; round < 300; round += 1) {
+            std::vector<std::wstring> patterns;
+            const size_t nPatterns = 1 + random() % 80;
+            for (size_t i = 0; i < nPatterns; i += 1) {
+                patterns.push_back(random_text(random, L"abAB.%?*", 8));
+            }
+            PatternMatcher matcher(patterns);
+            for (int selection = 0; selection < 20; selection += 1) {
+                std::vector<std::wstring> paths;
+                const size_t nPaths = 1 + random() % 3;
+                for (size_t i = 0; i < nPaths; i += 1) {
+                    paths.push_back(L"C:\\folder\\" + random_text(random, L"abcAB.", 10));
+                }
+                CHECK(matcher.FindCommonMatches(paths) == naive_common_matches(patterns, paths));
+            }
+        }
+    }
+
+    void test_state_cache_reset() {
+        // "a" followed by 15 of anything has to remember where the last 16 "a"s were: up to 2^16 states
+        const std::vector<std::wstring> patterns = { L"%a???????????????", L"%b" };
+        PatternMatcher matcher(patterns);
+        std::mt19937 random(17);
+        size_t mostStates = 0;
+        bool wasReset = false;
+        for (int round = 0; round < 3000; round += 1) {
+            const std::vector<std::wstring> paths = { random_text(random, L"ab", 60) };
+            const size_t before = matcher.GetStatesCount();
+            CHECK(matcher.FindCommonMatches(paths) == naive_common_matches(patterns, paths));
+            const size_t after = matcher.GetStatesCount();
+            wasReset = wasReset || after < before;
+            mostStates = std::max(mostStates, after);
+            // a name adds a state per character at most, to a cache that was within the limit or was dropped
+            CHECK(after <= PatternMatcher::MAX_CACHED_STATES + 1 + paths[0].size());
+        }
+        CHECK(wasReset);
+        CHECK(mostStates > PatternMatcher::MAX_CACHED_STATES);
+    }
+}
+
+int main() {
+    test_wildcards();
+    test_case_folding();
+    test_anchoring();
+    test_common_matches();
+    test_many_patterns();
+    test_against_naive();
+    test_state_cache_reset();
+    return check::report();
+}
@@ -0,0 +1,262 @@
+#include "prewarmer.h"
+#include "handler_catalog.h"
+#include "icon_cache.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+    std::atomic<int> g_nScopes{ 0 };
+
+    // Handler folders that never change: a section's folder holds its handlers
+    struct FakeFolders {
+        using Path = std::string;
+        using Snapshot = std::vector<std::wstring>;
+
+        struct Watch {};
+
+        const std::map<std::string, std::vector<std::wstring>> folders = {
+            { "Everything", { L"Everything\\notepad.lnk", L"Everything\\hex.lnk" } },
+            { "AllFiles", { L"AllFiles\\copy path.lnk" } },
+            { "Folders", { L"Folders\\terminal.lnk", L"Folders\\size.lnk", L"Folders\\git.lnk" } },
+        };
+        // menus and the warm-up list folders on their own threads
+        std::atomic<size_t> nScans{ 0 };
+
+        bool IsStale(const std::string&, const Watch&, const Snapshot&) const {
+            return false;
+        }
+
+        void Rearm(const std::string&, Watch&) {}
+
+        std::shared_ptr<const Snapshot> Scan(const std::string& folder, bool) {
+            nScans += 1;
+            return std::make_shared<const Snapshot>(folders.at(folder));
+        }
+
+        void Close(Watch&) {}
+    };
+
+    struct FakeIcon {
+        std::wstring path;
+    };
+
+    // the caches menus are built from, and what the warm-up fills
+    struct Caches {
+        handler_catalog::FolderCache<FakeFolders> folders;
+        icon_cache::IconCache<FakeIcon> icons{ 64 };
+        std::atomic<size_t> nExtracted{ 0 };
+
+        std::shared_ptr<const FakeIcon> GetIcon(const std::wstring& path) {
+            auto icon = icons.Find(path, 1);
+            if (!icon) {
+                icon = icons.Load(path, 1, [this, &path]() {
+                    nExtracted += 1;
+                    return std::make_shared<const FakeIcon>(FakeIcon{ path });
+                });
+            }
+            return icon;
+        }
+
+        size_t GetHandlersCount() {
+            size_t nHandlers = 0;
+            for (const auto& folder : folders.GetBackend().folders) {
+                nHandlers += folder.second.size();
+            }
+            return nHandlers;
+        }
+    };
+
+    // what MyExtension does: a menu item, with its icon, per handler of every section
+    size_t build_menu(Caches& caches) {
+        size_t nItems = 0;
+        for (const char* section : { "Everything", "AllFiles", "Folders" }) {
+            for (const auto& handler : *caches.folders.GetFolder(section)) {
+                nItems += caches.GetIcon(handler) ? 1 : 0;
+            }
+        }
+        return nItems;
+    }
+
+    class Gate {
+    public:
+        void Open() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isOpen = true;
+            m_opened.notify_all();
+        }
+
+        // false if it's still closed after the timeout
+        bool Wait(std::chrono::milliseconds timeout = 5s) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            return m_opened.wait_for(lock, timeout, [this]() { return m_isOpen; });
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_opened;
+        bool m_isOpen = false;
+    };
+
+    // CacheWarmUp's part: warms a section up, then waits at the gate before warming the others up
+    struct FakeWarmUp {
+        struct ThreadScope {
+            ThreadScope() {
+                g_nScopes += 1;
+            }
+        };
+
+        Caches* caches = nullptr;
+        Gate halfWay;
+        Gate resume;
+
+        void WarmUp() {
+            bool isFirst = true;
+            for (const char* section : { "Everything", "AllFiles", "Folders" }) {
+                for (const auto& handler : *caches->folders.GetFolder(section)) {
+                    caches->GetIcon(handler);
+                }
+                if (isFirst) {
+                    halfWay.Open();
+                    resume.Wait();
+                    isFirst = false;
+                }
+            }
+        }
+    };
+
+    using Prewarmer = prewarmer::Prewarmer<FakeWarmUp>;
+
+    void start(Prewarmer& prewarmer, Caches& caches) {
+        prewarmer.GetBackend().caches = &caches;
+        prewarmer.Start();
+        CHECK(prewarmer.GetBackend().halfWay.Wait());
+    }
+
+    void test_menu_during_warm_up_sees_warmed_state() {
+        Caches caches;
+        Prewarmer prewarmer;
+        start(prewarmer, caches);
+        CHECK(!prewarmer.TryShutdown());
+
+        // the menu comes in half way through the warm-up and waits for the rest of it
+        std::atomic<bool> wasResumed{ false };
+        std::thread warmUpResumer([&prewarmer, &wasResumed]() {
+            std::this_thread::sleep_for(20ms);
+            wasResumed = true;
+            prewarmer.GetBackend().resume.Open();
+        });
+        const bool isWarm = prewarmer.WaitUntilWarm(5s);
+        CHECK(isWarm && wasResumed);
+        warmUpResumer.join();
+
+        // everything the menu needs is there: not a folder listed, not an icon extracted by the menu
+        const size_t nScans = caches.folders.GetBackend().nScans;
+        const size_t nExtracted = caches.nExtracted;
+        CHECK(build_menu(caches) == caches.GetHandlersCount());
+        CHECK(caches.folders.GetBackend().nScans == nScans && nScans == 3);
+        CHECK(caches.nExtracted == nExtracted && nExtracted == caches.GetHandlersCount());
+        CHECK(caches.icons.GetMisses() == nExtracted);
+
+        CHECK(prewarmer.GetWarmMenus() == 1 && prewarmer.GetColdMenus() == 0);
+        CHECK(prewarmer.TryShutdown());
+    }
+
+    void test_menu_that_cannot_wait_is_built_cold() {
+        Caches caches;
+        Prewarmer prewarmer;
+        start(prewarmer, caches);
+
+        // the warm-up is stuck half way, the menu gives up on it
+        CHECK(!prewarmer.WaitUntilWarm(10ms));
+        CHECK(prewarmer.GetWarmMenus() == 0 && prewarmer.GetColdMenus() == 1);
+        // and loads what isn't warm yet itself: the section warmed up already is served from memory
+        CHECK(build_menu(caches) == caches.GetHandlersCount());
+        CHECK(caches.folders.GetBackend().nScans == 3);
+        CHECK(caches.nExtracted == caches.GetHandlersCount());
+        CHECK(!prewarmer.TryShutdown());
+
+        // the warm-up finishing after the menu doesn't extract anything again
+        prewarmer.GetBackend().resume.Open();
+        CHECK(prewarmer.WaitUntilWarm(5s));
+        CHECK(caches.folders.GetBackend().nScans == 3);
+        CHECK(caches.nExtracted == caches.GetHandlersCount());
+        CHECK(prewarmer.GetWarmMenus() == 1 && prewarmer.GetColdMenus() == 1);
+        CHECK(prewarmer.TryShutdown());
+    }
+
+    void test_concurrent_menus() {
+        const size_t N_MENUS = 8;
+        Caches caches;
+        Prewarmer prewarmer;
+        start(prewarmer, caches);
+
+        std::atomic<size_t> nWarm{ 0 };
+        std::atomic<size_t> nItems{ 0 };
+        std::vector<std::thread> menus;
+        for (size_t i = 0; i < N_MENUS; i += 1) {
+            menus.emplace_back([&]() {
+                if (prewarmer.WaitUntilWarm(5s)) {
+                    nWarm += 1;
+                }
+                nItems += build_menu(caches);
+            });
+        }
+        std::this_thread::sleep_for(10ms);
+        prewarmer.GetBackend().resume.Open();
+        for (auto& menu : menus) {
+            menu.join();
+        }
+
+        CHECK(nWarm == N_MENUS && prewarmer.GetWarmMenus() == N_MENUS);
+        CHECK(nItems == N_MENUS * caches.GetHandlersCount());
+        // listed and extracted once, by the warm-up
+        CHECK(caches.folders.GetBackend().nScans == 3);
+        CHECK(caches.nExtracted == caches.GetHandlersCount());
+        CHECK(prewarmer.TryShutdown());
+    }
+
+    void test_start_and_shutdown() {
+        const int nScopes = g_nScopes;
+        Caches caches;
+        Prewarmer prewarmer;
+
+        // nothing started, nothing to wait for or to shut down
+        CHECK(!prewarmer.WaitUntilWarm(5s));
+        CHECK(prewarmer.GetColdMenus() == 1);
+        CHECK(prewarmer.TryShutdown());
+
+        start(prewarmer, caches);
+        // only the first start counts
+        prewarmer.Start();
+        prewarmer.Start();
+        CHECK(!prewarmer.TryShutdown());
+        prewarmer.GetBackend().resume.Open();
+        CHECK(prewarmer.WaitUntilWarm(5s));
+        CHECK(g_nScopes == nScopes + 1);
+        CHECK(prewarmer.TryShutdown());
+        // and once it's done it stays done
+        prewarmer.Start();
+        CHECK(g_nScopes == nScopes + 1);
+        CHECK(prewarmer.TryShutdown());
+    }
+}
+
+int main() {
+    test_menu_during_warm_up_sees_warmed_state();
+    test_menu_that_cannot_wait_is_built_cold();
+    test_concurrent_menus();
+    test_start_and_shutdown();
+    return check::report();
+}
@@ -0,0 +1,241 @@
+#include "selection_classifier.h"
+#include "worker_pool.h"
+#include "fake_file_system.h"
+#include "check.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace selection_classifier;
+using fake_file_system::FakeFileSystem;
+using worker_pool::WorkerPool;
+
+namespace {
+
+    // runs every task on the calling thread
+    struct Inline {
+        template <typename Task>
+        void Run(size_t nTasks, size_t, Task task) {
+            for (size_t i = 0; i < nTasks; i += 1) {
+                task(i);
+            }
+        }
+    };
+
+    // extensions with handlers: what ExtensionIndex would give the classifier
+    struct Known {
+        ExtensionAtoms atoms{ fake_file_system::fold_ascii_text };
+        SuffixTrie extensions;
+
+        explicit Known(std::initializer_list<const wchar_t*> known) {
+            for (const auto extension : known) {
+                Atom atom;
+                atoms.Intern(extension, atom);
+                extensions.Insert(extension);
+            }
+        }
+
+        Atom Get(const wchar_t* extension) const {
+            Atom atom = 0;
+            CHECK(atoms.Find(extension, atom));
+            return atom;
+        }
+    };
+
+    const std::wstring FOLDER = L"C:\\Users\\someone\\Documents\\";
+
+    struct Selection {
+        FakeFileSystem fileSystem;
+        PathArena paths;
+
+        void Add(const std::wstring& folder, const std::wstring& name, bool isDirectory = false) {
+            fileSystem.Add(folder, name, isDirectory);
+            const std::wstring path = folder + name;
+            paths.Append(path.data(), path.size());
+        }
+    };
+
+    bool same_kinds(const SelectionKinds& a, const SelectionKinds& b) {
+        return a.haveExtensionlessFiles == b.haveExtensionlessFiles
+            && a.haveFolders == b.haveFolders
+            && a.haveFiles == b.haveFiles
+            && a.haveTooManyExtensions == b.haveTooManyExtensions
+            && a.haveExtensionsWithoutFolder == b.haveExtensionsWithoutFolder
+            && a.extensions == b.extensions;
+    }
+
+    void test_kinds() {
+        const Known known{ L".txt", L".tar.gz", L".gz", L".jpg" };
+        Inline runner;
+
+        Selection files;
+        files.Add(FOLDER, L"a.txt");
+        files.Add(FOLDER, L"b.TXT");
+        files.Add(FOLDER, L"backup.tar.gz");
+        auto kinds = SelectionClassifier::Classify(files.paths, known.extensions, known.atoms, files.fileSystem, runner);
+        CHECK(kinds.haveFiles && !kinds.haveFolders && !kinds.haveExtensionlessFiles && !kinds.haveExtensionsWithoutFolder);
+        CHECK(kinds.extensions == std::unordered_set<Atom>({ known.Get(L".txt"), known.Get(L".tar.gz") }));
+
+        Selection odd;
+        odd.Add(FOLDER, L"Makefile");
+        odd.Add(FOLDER, L"notes.md");
+        odd.Add(L"", L"relative.jpg");
+        odd.Add(L"C:\\folder.d\\", L"README");
+        kinds = SelectionClassifier::Classify(odd.paths, known.extensions, known.atoms, odd.fileSystem, runner);
+        CHECK(kinds.haveExtensionlessFiles && kinds.haveExtensionsWithoutFolder && !kinds.haveFolders);
+        CHECK(kinds.extensions == std::unordered_set<Atom>({ known.Get(L".jpg") }));
+
+        Selection folders;
+        folders.Add(FOLDER, L"photos", true);
+        folders.Add(FOLDER, L"photos.old", true);
+        kinds = SelectionClassifier::Classify(folders.paths, known.extensions, known.atoms, folders.fileSystem, runner);
+        CHECK(kinds.haveFolders && !kinds.haveFiles && kinds.extensions.empty());
+
+        Selection nothing;
+        kinds = SelectionClassifier::Classify(nothing.paths, known.extensions, known.atoms, nothing.fileSystem, runner);
+        CHECK(!kinds.haveFolders && !kinds.haveFiles);
+    }
+
+    void test_decided_early() {
+        // a folder and a file decide it: the rest isn't looked at
+        const Known known{ L".txt" };
+        Inline runner;
+        Selection selection;
+        selection.Add(FOLDER, L"photos", true);
+        selection.Add(FOLDER, L"a.txt");
+        for (int i = 0; i < 1000; i += 1) {
+            selection.Add(FOLDER, L"file" + std::to_wstring(i) + L".txt");
+        }
+        const auto kinds = SelectionClassifier::Classify(selection.paths, known.extensions, known.atoms, selection.fileSystem, runner);
+        CHECK(kinds.IsDecided());
+        CHECK(selection.fileSystem.nLookups == 2);
+    }
+
+    void test_siblings_listed() {
+        // a large run of siblings: the first ones one by one, the rest from one listing of their folder
+        const Known known{ L".txt" };
+        Inline runner;
+        Selection selection;
+        const size_t N_ITEMS = 3000;
+        for (size_t i = 0; i < N_ITEMS; i += 1) {
+            selection.Add(FOLDER, L"file" + std::to_wstring(i) + L".txt");
+        }
+        selection.Add(L"C:\\other\\", L"x.txt");
+        const auto kinds = SelectionClassifier::Classify(selection.paths, known.extensions, known.atoms, selection.fileSystem, runner);
+        CHECK(kinds.haveFiles && !kinds.haveFolders && kinds.extensions.size() == 1);
+        CHECK(selection.fileSystem.nListings == 1);
+        CHECK(selection.fileSystem.nLookups == SelectionClassifier::SIBLINGS_LISTING_THRESHOLD + 1);
+
+        // short runs aren't worth a listing
+        Selection small;
+        for (size_t i = 0; i < SelectionClassifier::SIBLINGS_LISTING_THRESHOLD; i += 1) {
+            small.Add(FOLDER, L"file" + std::to_wstring(i) + L".txt");
+        }
+        SelectionClassifier::Classify(small.paths, known.extensions, known.atoms, small.fileSystem, runner);
+        CHECK(small.fileSystem.nListings == 0);
+        CHECK(small.fileSystem.nLookups == SelectionClassifier::SIBLINGS_LISTING_THRESHOLD);
+    }
+
+    void test_not_listed() {
+        // names the listing doesn't have are looked up one by one
+        const Known known{ L".txt" };
+        Inline runner;
+        const size_t N_ITEMS = 200;
+
+        // made after its folder was listed
+        Selection late;
+        for (size_t i = 0; i < N_ITEMS; i += 1) {
+            late.Add(FOLDER, L"file" + std::to_wstring(i) + L".txt");
+        }
+        const std::wstring unlisted = FOLDER + L"unlisted";
+        late.paths.Append(unlisted.data(), unlisted.size());
+        auto kinds = SelectionClassifier::Classify(late.paths, known.extensions, known.atoms, late.fileSystem, runner);
+        CHECK(kinds.haveFiles && kinds.haveExtensionlessFiles);
+        CHECK(late.fileSystem.nListings == 1);
+        CHECK(late.fileSystem.nLookups == SelectionClassifier::SIBLINGS_LISTING_THRESHOLD + 1);
+
+        // past the listing's limit: a few items selected in a huge folder
+        Selection huge;
+        for (size_t i = 0; i < (N_ITEMS + 1) * SelectionClassifier::LISTED_ENTRIES_PER_ITEM; i += 1) {
+            huge.fileSystem.Add(FOLDER, L"other" + std::to_wstring(i), false);
+        }
+        for (size_t i = 0; i < N_ITEMS; i += 1) {
+            huge.Add(FOLDER, L"file" + std::to_wstring(i) + L".txt");
+        }
+        huge.Add(FOLDER, L"photos", true);
+        kinds = SelectionClassifier::Classify(huge.paths, known.extensions, known.atoms, huge.fileSystem, runner);
+        CHECK(kinds.haveFiles && kinds.haveFolders);
+        CHECK(huge.fileSystem.nListings == 1);
+        CHECK(huge.fileSystem.nLookups == N_ITEMS + 1);
+    }
+
+    void test_too_many_extensions() {
+        std::vector<std::wstring> extensions;
+        for (size_t i = 0; i < MAX_DISTINCT_EXTENSIONS + 10; i += 1) {
+            extensions.push_back(L".e" + std::to_wstring(i));
+        }
+        Known known{};
+        for (const auto& extension : extensions) {
+            Atom atom;
+            known.atoms.Intern(extension, atom);
+        }
+        Inline runner;
+        Selection selection;
+        for (const auto& extension : extensions) {
+            selection.Add(FOLDER, L"file" + extension);
+        }
+        const auto kinds = SelectionClassifier::Classify(selection.paths, known.extensions, known.atoms, selection.fileSystem, runner);
+        CHECK(kinds.haveTooManyExtensions);
+        CHECK(kinds.extensions.size() == MAX_DISTINCT_EXTENSIONS);
+
+        // merging chunks that have their own extensions counts the same, whichever of them are kept
+        SelectionKinds merged;
+        for (size_t first = 0; first < extensions.size(); first += 100) {
+            SelectionKinds chunk;
+            for (size_t i = first; i < first + 100 && i < extensions.size(); i += 1) {
+                chunk.AddFile(L"file" + extensions[i], known.extensions, known.atoms);
+            }
+            merged.Merge(chunk);
+        }
+        CHECK(merged.haveTooManyExtensions && merged.haveFiles && !merged.haveExtensionsWithoutFolder);
+        CHECK(merged.extensions.size() == MAX_DISTINCT_EXTENSIONS);
+    }
+
+    void test_parallel() {
+        // large selections over several folders: the same answer on the pool as on one thread
+        const Known known{ L".txt", L".jpg", L".tar.gz" };
+        const wchar_t* names[] = { L".txt", L".jpg", L".tar.gz", L".png", L"" };
+        std::mt19937 random(1);
+        WorkerPool pool(3);
+        Inline runner;
+        for (int round = 0; round < 20; round += 1) {
+            Selection selection;
+            const size_t nFolders = 1 + random() % 5;
+            const bool haveFolders = round % 4 == 0;
+            for (size_t folder = 0; folder < nFolders; folder += 1) {
+                const std::wstring path = L"C:\\data\\folder" + std::to_wstring(folder) + L"\\";
+                const size_t nItems = random() % 3000;
+                for (size_t i = 0; i < nItems; i += 1) {
+                    const bool isDirectory = haveFolders && random() % 1000 == 0;
+                    selection.Add(path, L"item" + std::to_wstring(i) + (isDirectory ? L"" : names[random() % 5]), isDirectory);
+                }
+            }
+
+            const auto serial = SelectionClassifier::Classify(selection.paths, known.extensions, known.atoms, selection.fileSystem, runner);
+            const auto parallel = SelectionClassifier::Classify(selection.paths, known.extensions, known.atoms, selection.fileSystem, pool);
+            // decided ones stop at different items, but both are decided
+            CHECK(serial.IsDecided() ? parallel.IsDecided() : same_kinds(serial, parallel));
+        }
+    }
+}
+
+int main() {
+    test_kinds();
+    test_decided_early();
+    test_siblings_listed();
+    test_not_listed();
+    test_too_many_extensions();
+    test_parallel();
+    return check::report();
+}
@@ -0,0 +1,266 @@
+#include "shell_link_fixtures.h"
+#include "check.h"
+
+#include <random>
+
+using namespace fixtures;
+
+namespace {
+
+    bool parse(const std::vector<uint8_t>& bytes, shell_link::ShellLink& link) {
+        return shell_link::parse(bytes.data(), bytes.size(), link);
+    }
+
+    void test_spec_example() {
+        const Built built = build(spec_example());
+        shell_link::ShellLink link;
+        CHECK(parse(built.bytes, link));
+        CHECK(link.targetPath == u"C:\\test\\a.txt");
+        CHECK(!link.targetHasVariables);
+        CHECK(link.relativePath == u".\\a.txt");
+        CHECK(link.workingDirectory == u"C:\\test");
+        CHECK(link.arguments.empty() && link.iconLocation.empty() && link.name.empty());
+        CHECK(link.fileAttributes == 0x20);
+        CHECK(link.showCommand == 1);
+    }
+
+    void test_handler_example() {
+        Link fixture = handler_example();
+        shell_link::ShellLink link;
+        CHECK(parse(build(fixture).bytes, link));
+        CHECK(link.targetPath == u"%TOOLS%\\app.exe");
+        CHECK(link.targetHasVariables);
+        CHECK(link.arguments == u"--open \"%1\"");
+        CHECK(link.workingDirectory == u"C:\\Work");
+        CHECK(link.iconLocation == u"C:\\Tools\\icons.dll");
+        CHECK(!link.iconHasVariables);
+        CHECK(link.iconIndex == -3);
+
+        // without HasExpString the environment block is stale, link info has the target
+        fixture.flags &= ~shell_link::HAS_EXP_STRING;
+        CHECK(parse(build(fixture).bytes, link));
+        CHECK(link.targetPath == u"C:\\Tools\\app.exe");
+        CHECK(!link.targetHasVariables);
+    }
+
+    void test_link_info() {
+        Link fixture = spec_example();
+        shell_link::ShellLink link;
+
+        fixture.linkInfo = local_link_info("C:\\", "Program Files\\app.exe");
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"C:\\Program Files\\app.exe");
+
+        const std::u16string unicodeBase = u"C:\\\u00c9diteurs";
+        const std::u16string unicodeSuffix = u"\u7de8\u96c6.exe";
+        fixture.linkInfo = local_link_info("C:\\?diteurs", "??.exe", &unicodeBase, &unicodeSuffix);
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"C:\\\u00c9diteurs\\\u7de8\u96c6.exe");
+
+        fixture.linkInfo = network_link_info("\\\\server\\share", "tools\\app.exe");
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"\\\\server\\share\\tools\\app.exe");
+
+        const std::u16string unicodeShare = u"\\\\server\\\u00e9quipe";
+        fixture.linkInfo = network_link_info("\\\\server\\?quipe", "app.exe", &unicodeShare);
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"\\\\server\\\u00e9quipe\\app.exe");
+
+        // a target known by its id list only
+        fixture.flags &= ~shell_link::HAS_LINK_INFO;
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath.empty());
+
+        // ForceNoLinkInfo: whatever is there is skipped unread
+        fixture.flags |= shell_link::HAS_LINK_INFO | shell_link::FORCE_NO_LINK_INFO;
+        fixture.linkInfo = local_link_info("C:\\x", "");
+        fixture.linkInfo[4] = 0x01;
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath.empty());
+    }
+
+    void test_ansi_strings() {
+        Link fixture = handler_example();
+        fixture.flags &= ~shell_link::IS_UNICODE;
+        fixture.arguments = u"caf\u00e9";
+        const Built built = build(fixture);
+
+        shell_link::ShellLink link;
+        CHECK(parse(built.bytes, link));
+        CHECK(link.arguments == u"caf\u00e9");
+        CHECK(link.workingDirectory == u"C:\\Work");
+
+        // the caller's code page decodes them
+        size_t nDecoded = 0;
+        auto decodeAnsi = [&nDecoded](const char* text, size_t length, std::u16string& to) {
+            nDecoded += 1;
+            for (size_t i = 0; i < length; i += 1) {
+                to.push_back(static_cast<unsigned char>(text[i]) == 0xE9 ? u'\u0439' : char16_t(text[i]));
+            }
+        };
+        CHECK(shell_link::parse(built.bytes.data(), built.bytes.size(), link, decodeAnsi));
+        CHECK(link.arguments == u"caf\u0439");
+        // working directory, arguments, icon location, link info base path and suffix; the environment block has Unicode
+        CHECK(nDecoded == 5);
+    }
+
+    void test_environment_blocks() {
+        Link fixture = handler_example();
+        shell_link::ShellLink link;
+
+        // the ANSI half is taken when the Unicode one is empty
+        fixture.extraBlocks = { environment_block(shell_link::ENVIRONMENT_VARIABLE_DATA_BLOCK, "%WINDIR%\\notepad.exe", u"") };
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"%WINDIR%\\notepad.exe" && link.targetHasVariables);
+
+        // both empty: link info stays
+        fixture.extraBlocks = { environment_block(shell_link::ENVIRONMENT_VARIABLE_DATA_BLOCK, "", u"") };
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"C:\\Tools\\app.exe" && !link.targetHasVariables);
+
+        // a path that fills the field has no terminator in it
+        fixture.extraBlocks = { environment_block(shell_link::ENVIRONMENT_VARIABLE_DATA_BLOCK, std::string(260, 'x'), std::u16string(260, u'x')) };
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"C:\\Tools\\app.exe");
+
+        fixture.extraBlocks = {
+            { 0x10, 0, 0, 0, 0x03, 0, 0, 0xA0, 1, 2, 3, 4, 5, 6, 7, 8 }, // some other block, skipped
+            environment_block(shell_link::ICON_ENVIRONMENT_DATA_BLOCK, "%ICONS%\\a.ico", u"%ICONS%\\a.ico"),
+            environment_block(shell_link::ENVIRONMENT_VARIABLE_DATA_BLOCK, "%TOOLS%\\b.exe", u"%TOOLS%\\b.exe"),
+        };
+        CHECK(parse(build(fixture).bytes, link));
+        CHECK(link.iconLocation == u"%ICONS%\\a.ico" && link.iconHasVariables);
+        CHECK(link.targetPath == u"%TOOLS%\\b.exe" && link.targetHasVariables);
+
+        // some writers leave the terminal block out
+        fixture.haveTerminalBlock = false;
+        CHECK(parse(build(fixture).bytes, link) && link.targetPath == u"%TOOLS%\\b.exe");
+    }
+
+    void check_rejected(const std::vector<uint8_t>& bytes) {
+        shell_link::ShellLink link;
+        link.arguments = u"untouched";
+        CHECK(!parse(bytes, link));
+        CHECK(link.arguments == u"untouched");
+    }
+
+    void test_malformed() {
+        const Built built = build(handler_example());
+        std::vector<uint8_t> bytes;
+
+        check_rejected({});
+
+        bytes = built.bytes;
+        bytes[0] = 0x4D;
+        check_rejected(bytes);
+
+        bytes = built.bytes;
+        bytes[19] ^= 1;
+        check_rejected(bytes);
+
+        // id list running past the end
+        bytes = built.bytes;
+        bytes[shell_link::HEADER_SIZE + 1] = 0xFF;
+        check_rejected(bytes);
+
+        Link fixture = handler_example();
+        fixture.linkInfo[0] = 0xFF;
+        fixture.linkInfo[1] = 0xFF;
+        check_rejected(build(fixture).bytes);
+
+        // LinkInfo header shorter than the fixed part of it
+        fixture = handler_example();
+        fixture.linkInfo[4] = 0x10;
+        check_rejected(build(fixture).bytes);
+
+        // base path offset past LinkInfo
+        fixture = handler_example();
+        fixture.linkInfo[16] = 0xF0;
+        check_rejected(build(fixture).bytes);
+
+        // suffix not terminated inside LinkInfo
+        fixture = handler_example();
+        fixture.linkInfo.back() = 'x';
+        check_rejected(build(fixture).bytes);
+
+        // network link bigger than LinkInfo
+        fixture = handler_example();
+        fixture.linkInfo = network_link_info("\\\\server\\share", "a.exe");
+        fixture.linkInfo[0x1C] = 0xF0;
+        check_rejected(build(fixture).bytes);
+
+        // string counts running past the end
+        fixture = handler_example();
+        fixture.haveTerminalBlock = false;
+        fixture.extraBlocks.clear();
+        bytes = build(fixture).bytes;
+        bytes.resize(bytes.size() - 1);
+        check_rejected(bytes);
+
+        // environment blocks are of one size only
+        fixture = handler_example();
+        fixture.extraBlocks[0].resize(shell_link::ENVIRONMENT_BLOCK_SIZE - 4);
+        fixture.extraBlocks[0][0] = static_cast<uint8_t>(shell_link::ENVIRONMENT_BLOCK_SIZE - 4);
+        check_rejected(build(fixture).bytes);
+
+        // extra block of 4 to 7 bytes, too small to have a signature
+        fixture = handler_example();
+        fixture.extraBlocks = { { 0x06, 0, 0, 0, 0, 0 } };
+        check_rejected(build(fixture).bytes);
+
+        // extra block past the end
+        fixture = handler_example();
+        fixture.extraBlocks[0][1] = 0x13;
+        check_rejected(build(fixture).bytes);
+    }
+
+    void test_truncated() {
+        // extra data may end anywhere a block does, and a link ends before it at the earliest
+        for (const Link& fixture : { spec_example(), handler_example() }) {
+            const Built built = build(fixture);
+            std::vector<size_t> blockEnds = { built.extraDataOffset };
+            for (const auto& block : fixture.extraBlocks) {
+                blockEnds.push_back(blockEnds.back() + block.size());
+            }
+            for (size_t size = 0; size < built.bytes.size(); size += 1) {
+                bool isComplete = false;
+                for (const size_t end : blockEnds) {
+                    isComplete = isComplete || (size >= end && size < end + 4);
+                }
+                shell_link::ShellLink link;
+                CHECK(shell_link::parse(built.bytes.data(), size, link) == isComplete);
+            }
+        }
+    }
+
+    void test_corrupted() {
+        // whatever is in the bytes, the parser stays inside them; run under a sanitizer to see it
+        for (const Link& fixture : { spec_example(), handler_example() }) {
+            const std::vector<uint8_t> bytes = build(fixture).bytes;
+            for (size_t i = 0; i < bytes.size(); i += 1) {
+                for (const uint8_t value : { 0x00, 0x01, 0x1C, 0x24, 0x7F, 0x80, 0xFE, 0xFF }) {
+                    std::vector<uint8_t> damaged = bytes;
+                    damaged[i] = value;
+                    shell_link::ShellLink link;
+                    if (shell_link::parse(damaged.data(), damaged.size(), link)) {
+                        CHECK(link.targetPath.size() <= damaged.size());
+                        CHECK(link.arguments.size() <= damaged.size());
+                    }
+                }
+            }
+
+            std::mt19937 random(3);
+            for (int round = 0; round < 20000; round += 1) {
+                std::vector<uint8_t> damaged = bytes;
+                for (int n = 0; n < 3; n += 1) {
+                    damaged[random() % damaged.size()] = static_cast<uint8_t>(random());
+                }
+                shell_link::ShellLink link;
+                shell_link::parse(damaged.data(), damaged.size() - random() % 16, link);
+            }
+        }
+    }
+}
+
+int main() {
+    test_spec_example();
+    test_handler_example();
+    test_link_info();
+    test_ansi_strings();
+    test_environment_blocks();
+    test_malformed();
+    test_truncated();
+    test_corrupted();
+    return check::report();
+}
@@ -0,0 +1,80 @@
+#include "suffix_trie.h"
+#include "check.h"
+
+using namespace suffix_trie;
+
+namespace {
+
+    SuffixTrie make_trie(std::initializer_list<const wchar_t*> suffixes, SuffixTrie::FoldChar foldChar = fold_ascii_char) {
+        SuffixTrie trie(foldChar);
+        for (const wchar_t* suffix : suffixes) {
+            trie.Insert(suffix);
+        }
+        return trie;
+    }
+
+    void test_longest_suffix() {
+        const auto trie = make_trie({ L".gz", L".tar.gz", L".txt" });
+        CHECK(trie.FindLongestSuffix(L"archive.tar.gz") == 7);
+        CHECK(trie.FindLongestSuffix(L"C:\\Downloads\\archive.tar.gz") == 7);
+        CHECK(trie.FindLongestSuffix(L"archive.gz") == 3);
+        // ".tar.gz" has ".r.gz" on its way, which isn't an extension of its own
+        CHECK(trie.FindLongestSuffix(L"archive.r.gz") == 3);
+        CHECK(trie.FindLongestSuffix(L"notes.txt") == 4);
+        CHECK(trie.FindLongestSuffix(L".gz") == 3);
+        CHECK(trie.FindLongestSuffix(L"notes.doc") == 0);
+        CHECK(trie.FindLongestSuffix(L"") == 0);
+
+        // only the compound one known: a plain ".gz" is not it
+        const auto compoundOnly = make_trie({ L".tar.gz" });
+        CHECK(compoundOnly.FindLongestSuffix(L"archive.tar.gz") == 7);
+        CHECK(compoundOnly.FindLongestSuffix(L"archive.gz") == 0);
+
+        // the order they are known in doesn't matter
+        const auto reversed = make_trie({ L".tar.gz", L".gz" });
+        CHECK(reversed.FindLongestSuffix(L"archive.tar.gz") == 7);
+        CHECK(reversed.FindLongestSuffix(L"archive.gz") == 3);
+
+        // ".gz" and ".tar.gz" share the nodes of ".gz"
+        CHECK(make_trie({ L".gz", L".tar.gz" }).GetNodesCount() == 1 + 7);
+    }
+
+    void test_no_partial_component() {
+        const auto trie = make_trie({ L".ts", L".gz", L".tar.gz" });
+        CHECK(trie.FindLongestSuffix(L"foo.ts") == 3);
+        CHECK(trie.FindLongestSuffix(L"foo.bats") == 0);
+        CHECK(trie.FindLongestSuffix(L"foo.tgz") == 0);
+        CHECK(trie.FindLongestSuffix(L"foo.star.gz") == 3);
+        CHECK(trie.FindLongestSuffix(L"ts") == 0);
+
+        // something not starting with a dot is never matched, as no match can start in the middle of a name
+        const auto dotless = make_trie({ L"ts" });
+        CHECK(dotless.FindLongestSuffix(L"foo.bats") == 0);
+        CHECK(dotless.FindLongestSuffix(L"foo.ts") == 0);
+    }
+
+    void test_case_folding() {
+        const auto trie = make_trie({ L".Tar.GZ", L".txt" });
+        CHECK(trie.FindLongestSuffix(L"ARCHIVE.TAR.GZ") == 7);
+        CHECK(trie.FindLongestSuffix(L"archive.tar.gz") == 7);
+        CHECK(trie.FindLongestSuffix(L"Notes.TxT") == 4);
+
+        // beyond ASCII it's the caller's folding
+        CHECK(trie.FindLongestSuffix(L"x.\u00E4") == 0);
+        const auto ascii = make_trie({ L".\u00E4" });
+        CHECK(ascii.FindLongestSuffix(L"x.\u00E4") == 2);
+        CHECK(ascii.FindLongestSuffix(L"x.\u00C4") == 0);
+        const auto folded = make_trie({ L".\u00E4" }, [](wchar_t c) {
+            return c == L'\u00E4' ? L'\u00C4' : fold_ascii_char(c);
+        });
+        CHECK(folded.FindLongestSuffix(L"x.\u00C4") == 2);
+        CHECK(folded.FindLongestSuffix(L"x.\u00E4") == 2);
+    }
+}
+
+int main() {
+    test_longest_suffix();
+    test_no_partial_component();
+    test_case_folding();
+    return check::report();
+}
@@ -0,0 +1,220 @@
+#include "usage_log.h"
+#include "check.h"
+
+#include <random>
+
+using namespace usage_log;
+
+namespace {
+
+    constexpr uint64_t NOW = 133000000000000000ULL;
+
+    UsageRecord make_record(uint64_t key, uint64_t time, uint32_t weight = WEIGHT_ONE) {
+        UsageRecord record;
+        record.key = key;
+        record.time = time;
+        record.weight = weight;
+        return record;
+    }
+
+    std::vector<UsageRecord> scan(const std::vector<uint8_t>& bytes, size_t& nScanned) {
+        std::vector<UsageRecord> records;
+        nScanned = scan_records(bytes.data(), bytes.size(), [&records](const UsageRecord& record) {
+            records.push_back(record);
+        });
+        return records;
+    }
+
+    bool same(const UsageRecord& a, const UsageRecord& b) {
+        return a.key == b.key && a.time == b.time && a.weight == b.weight;
+    }
+
+    void test_round_trip() {
+        const UsageRecord record = make_record(0x0123456789ABCDEFULL, NOW, 3 * WEIGHT_ONE / 2);
+        std::vector<uint8_t> bytes;
+        encode_record(record, bytes);
+        CHECK(bytes.size() == RECORD_SIZE);
+        UsageRecord decoded;
+        CHECK(decode_record(bytes.data(), decoded) && same(decoded, record));
+
+        // any single flipped bit is caught
+        for (size_t bit = 0; bit < RECORD_SIZE * 8; bit += 1) {
+            std::vector<uint8_t> damaged = bytes;
+            damaged[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+            CHECK(!decode_record(damaged.data(), decoded));
+        }
+    }
+
+    void test_torn_and_garbage() {
+        std::mt19937 random(12);
+        std::vector<UsageRecord> written;
+        std::vector<uint8_t> bytes;
+        for (int i = 0; i < 500; i += 1) {
+            switch (random() % 4) {
+            case 0: {
+                // a record torn by a crash: only its first bytes made it
+                std::vector<uint8_t> torn;
+                encode_record(make_record(random(), NOW), torn);
+                bytes.insert(bytes.end(), torn.begin(), torn.begin() + 1 + random() % (RECORD_SIZE - 1));
+                break;
+            }
+            case 1: {
+                // anything else
+                const size_t n = random() % (3 * RECORD_SIZE);
+                for (size_t j = 0; j < n; j += 1) {
+                    bytes.push_back(static_cast<uint8_t>(random()));
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            written.push_back(make_record(random(), NOW - random(), WEIGHT_ONE + static_cast<uint32_t>(random() % 100)));
+            encode_record(written.back(), bytes);
+        }
+
+        size_t nScanned = 0;
+        const auto records = scan(bytes, nScanned);
+        CHECK(records.size() == written.size());
+        for (size_t i = 0; i < records.size() && i < written.size(); i += 1) {
+            CHECK(same(records[i], written[i]));
+        }
+        CHECK(nScanned == bytes.size());
+    }
+
+    void test_partial_tail() {
+        // a record being appended right now is left for the next read, and found whole then
+        std::vector<uint8_t> bytes;
+        encode_record(make_record(1, NOW), bytes);
+        encode_record(make_record(2, NOW), bytes);
+        std::vector<uint8_t> third;
+        encode_record(make_record(3, NOW), third);
+        bytes.insert(bytes.end(), third.begin(), third.begin() + 10);
+
+        size_t nScanned = 0;
+        auto records = scan(bytes, nScanned);
+        CHECK(records.size() == 2);
+        CHECK(nScanned == 2 * RECORD_SIZE);
+
+        bytes.insert(bytes.end(), third.begin() + 10, third.end());
+        const std::vector<uint8_t> rest(bytes.begin() + nScanned, bytes.end());
+        records = scan(rest, nScanned);
+        CHECK(records.size() == 1 && records[0].key == 3);
+        CHECK(nScanned == RECORD_SIZE);
+
+        // too short for a record at all
+        CHECK(scan(std::vector<uint8_t>(RECORD_SIZE - 1, 0xFF), nScanned).empty() && nScanned == 0);
+        CHECK(scan(std::vector<uint8_t>(), nScanned).empty() && nScanned == 0);
+    }
+
+    void test_plan_read() {
+        const uint64_t MAX_READ = 1000 * RECORD_SIZE;
+        const FileIdentity none;
+        const FileIdentity log = { 7, 100 };
+        const FileIdentity compacted = { 7, 101 };
+
+        // no log, none read
+        CHECK(is_nothing_to_read(plan_read(none, 0, none, 0, MAX_READ)));
+        // first read is whole
+        ReadPlan plan = plan_read(none, 0, log, 10 * RECORD_SIZE, MAX_READ);
+        CHECK(plan.isWhole && plan.from == 0 && plan.length == 10 * RECORD_SIZE);
+        // unchanged
+        CHECK(is_nothing_to_read(plan_read(log, 10 * RECORD_SIZE, log, 10 * RECORD_SIZE, MAX_READ)));
+        // appended to: only what's new
+        plan = plan_read(log, 10 * RECORD_SIZE, log, 12 * RECORD_SIZE, MAX_READ);
+        CHECK(!plan.isWhole && plan.from == 10 * RECORD_SIZE && plan.length == 2 * RECORD_SIZE);
+
+        // compacted by another process and appended to since, to the very size read before: another file all the same
+        plan = plan_read(log, 10 * RECORD_SIZE, compacted, 10 * RECORD_SIZE, MAX_READ);
+        CHECK(plan.isWhole && plan.from == 0 && plan.length == 10 * RECORD_SIZE);
+        // or longer than it
+        plan = plan_read(log, 10 * RECORD_SIZE, compacted, 15 * RECORD_SIZE, MAX_READ);
+        CHECK(plan.isWhole && plan.from == 0 && plan.length == 15 * RECORD_SIZE);
+        // compacted to nothing: scores go, nothing is read
+        plan = plan_read(log, 10 * RECORD_SIZE, compacted, 0, MAX_READ);
+        CHECK(plan.isWhole && plan.length == 0 && !is_nothing_to_read(plan));
+        // deleted
+        plan = plan_read(log, 10 * RECORD_SIZE, none, 0, MAX_READ);
+        CHECK(plan.isWhole && plan.length == 0);
+        // the same file, shorter: truncated in place
+        plan = plan_read(log, 10 * RECORD_SIZE, log, 4 * RECORD_SIZE, MAX_READ);
+        CHECK(plan.isWhole && plan.from == 0 && plan.length == 4 * RECORD_SIZE);
+
+        // grown beyond any reason: only its end
+        plan = plan_read(log, 10 * RECORD_SIZE, log, 5000 * RECORD_SIZE, MAX_READ);
+        CHECK(plan.isWhole && plan.from == 4000 * RECORD_SIZE && plan.length == MAX_READ);
+        plan = plan_read(none, 0, log, 5000 * RECORD_SIZE + 5, MAX_READ);
+        CHECK(plan.isWhole && plan.from + plan.length == 5000 * RECORD_SIZE + 5 && plan.length == MAX_READ);
+    }
+
+    void test_score() {
+        const double HALF_LIFE_DAYS = 14;
+        CHECK(get_score(make_record(1, NOW), NOW, HALF_LIFE_DAYS) == 1.0);
+        CHECK(std::abs(get_score(make_record(1, NOW - 14 * TICKS_PER_DAY), NOW, HALF_LIFE_DAYS) - 0.5) < 1e-9);
+        CHECK(std::abs(get_score(make_record(1, NOW - 28 * TICKS_PER_DAY, 4 * WEIGHT_ONE), NOW, HALF_LIFE_DAYS) - 1.0) < 1e-9);
+        // recorded after the reference time (another process started later) weighs more, not less
+        CHECK(get_score(make_record(1, NOW + TICKS_PER_DAY), NOW, HALF_LIFE_DAYS) > 1.0);
+    }
+
+    void test_compaction() {
+        std::mt19937 random(13);
+        Scores scores;
+        for (uint64_t key = 1; key <= 3000; key += 1) {
+            scores[key * 0x9E3779B97F4A7C15ULL] = (random() % 100000) / 1000.0;
+        }
+        const double MIN_SCORE = 1.0 / 64;
+        const size_t MAX_KEPT = 1000;
+
+        std::vector<double> sorted;
+        for (const auto& score : scores) {
+            sorted.push_back(score.second);
+        }
+        std::sort(sorted.rbegin(), sorted.rend());
+
+        const auto records = compact_records(scores, NOW, MAX_KEPT, MIN_SCORE);
+        CHECK(records.size() == MAX_KEPT);
+        for (size_t i = 0; i < records.size(); i += 1) {
+            CHECK(records[i].time == NOW);
+            // the top entries, highest first, and the weight is the score within 16.16's precision
+            const double score = scores[records[i].key];
+            CHECK(score == sorted[i]);
+            CHECK(std::abs(double(records[i].weight) / WEIGHT_ONE - score) <= 1.0 / WEIGHT_ONE);
+            CHECK(i == 0 || records[i - 1].weight >= records[i].weight);
+        }
+
+        // scores read back from the compacted log are what they were (they are as of its time)
+        std::vector<uint8_t> bytes;
+        for (const auto& record : records) {
+            encode_record(record, bytes);
+        }
+        size_t nScanned = 0;
+        const auto readBack = scan(bytes, nScanned);
+        CHECK(readBack.size() == records.size());
+        for (const auto& record : readBack) {
+            CHECK(std::abs(get_score(record, NOW, 14) - scores[record.key]) <= 1.0 / WEIGHT_ONE);
+        }
+
+        // fewer than the cap: all of them but the forgotten ones
+        const Scores few = { { 1, 5.0 }, { 2, MIN_SCORE / 2 }, { 3, 1.0 }, { 4, MIN_SCORE } };
+        const auto kept = compact_records(few, NOW, MAX_KEPT, MIN_SCORE);
+        CHECK(kept.size() == 3);
+        CHECK(kept.size() == 3 && kept[0].key == 1 && kept[1].key == 3 && kept[2].key == 4);
+
+        // a score beyond what a record holds is kept at the most it holds
+        const auto huge = compact_records(Scores{ { 9, 1e12 } }, NOW, MAX_KEPT, MIN_SCORE);
+        CHECK(huge.size() == 1 && huge[0].weight == 0xFFFFFFFFu);
+
+        CHECK(compact_records(Scores(), NOW, MAX_KEPT, MIN_SCORE).empty());
+        CHECK(compact_records(few, NOW, 0, MIN_SCORE).empty());
+    }
+}
+
+int main() {
+    test_round_trip();
+    test_torn_and_garbage();
+    test_partial_tail();
+    test_plan_read();
+    test_score();
+    test_compaction();
+    return check::report();
+}
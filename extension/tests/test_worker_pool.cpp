@@ -0,0 +1,187 @@
+#include "worker_pool.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using worker_pool::WorkerPool;
+
+namespace {
+
+    // Lets tasks wait until enough of them run at once, without hanging the test if they never do
+    class Gate {
+    public:
+        explicit Gate(size_t nExpected)
+            : m_nExpected(nExpected)
+        {}
+
+        // false if the others didn't come in time
+        bool Arrive() {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_nArrived += 1;
+            m_wakeUp.notify_all();
+            return m_wakeUp.wait_for(lock, std::chrono::seconds(5), [this]() { return m_nArrived >= m_nExpected; });
+        }
+
+    private:
+        const size_t m_nExpected;
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        size_t m_nArrived = 0;
+    };
+
+    void check_runs_once(WorkerPool& pool, size_t nTasks, size_t maxThreads) {
+        std::vector<std::atomic<int>> nRuns(nTasks);
+        pool.Run(nTasks, maxThreads, [&nRuns](size_t i) {
+            nRuns[i] += 1;
+        });
+        for (const auto& n : nRuns) {
+            CHECK(n == 1);
+        }
+    }
+
+    void test_every_task_once() {
+        WorkerPool pool(3);
+        for (const size_t nTasks : { 0, 1, 2, 3, 7, 64, 1000 }) {
+            for (const size_t maxThreads : { 0, 1, 2, 4, 16 }) {
+                check_runs_once(pool, nTasks, maxThreads);
+            }
+        }
+        CHECK(pool.GetHelpersCount() <= 3);
+    }
+
+    void test_inline() {
+        // one thread is the caller alone: nothing is started
+        WorkerPool pool(3);
+        const auto caller = std::this_thread::get_id();
+        bool isOnCaller = true;
+        pool.Run(100, 1, [&](size_t) {
+            isOnCaller = isOnCaller && std::this_thread::get_id() == caller;
+        });
+        pool.Run(1, 4, [&](size_t) {
+            isOnCaller = isOnCaller && std::this_thread::get_id() == caller;
+        });
+        CHECK(isOnCaller);
+        CHECK(pool.GetStartedCount() == 0);
+    }
+
+    void test_parallel() {
+        // 4 tasks that only finish if they all run at once: the caller and 3 helpers
+        WorkerPool pool(3);
+        Gate gate(4);
+        std::atomic<size_t> nTogether{ 0 };
+        pool.Run(4, 4, [&](size_t) {
+            if (gate.Arrive()) {
+                nTogether += 1;
+            }
+        });
+        CHECK(nTogether == 4);
+        CHECK(pool.GetHelpersCount() == 3);
+    }
+
+    void test_reused() {
+        // once warm, right-clicks start no threads
+        WorkerPool pool(3);
+        check_runs_once(pool, 16, 4);
+        const size_t nStarted = pool.GetStartedCount();
+        CHECK(nStarted >= 1 && nStarted <= 3);
+        for (int i = 0; i < 1000; i += 1) {
+            check_runs_once(pool, 16, 4);
+        }
+        CHECK(pool.GetStartedCount() <= 3);
+        CHECK(pool.GetHelpersCount() == pool.GetStartedCount());
+    }
+
+    void test_concurrent_callers() {
+        WorkerPool pool(3);
+        const size_t N_CALLERS = 8;
+        const size_t N_RUNS = 200;
+        const size_t N_TASKS = 100;
+        std::atomic<size_t> nWrong{ 0 };
+        std::vector<std::thread> callers;
+        for (size_t caller = 0; caller < N_CALLERS; caller += 1) {
+            callers.emplace_back([&]() {
+                for (size_t run = 0; run < N_RUNS; run += 1) {
+                    std::vector<std::atomic<int>> nRuns(N_TASKS);
+                    pool.Run(N_TASKS, 4, [&nRuns](size_t i) {
+                        nRuns[i] += 1;
+                    });
+                    for (const auto& n : nRuns) {
+                        nWrong += n == 1 ? 0 : 1;
+                    }
+                }
+            });
+        }
+        for (auto& caller : callers) {
+            caller.join();
+        }
+        CHECK(nWrong == 0);
+        CHECK(pool.GetStartedCount() <= 3);
+    }
+
+    void test_nested() {
+        // a task running tasks of its own finishes even with every helper taken by the outer ones
+        WorkerPool pool(3);
+        std::vector<std::atomic<int>> nRuns(8 * 50);
+        pool.Run(8, 4, [&](size_t outer) {
+            pool.Run(50, 4, [&](size_t inner) {
+                nRuns[outer * 50 + inner] += 1;
+            });
+        });
+        for (const auto& n : nRuns) {
+            CHECK(n == 1);
+        }
+    }
+
+    void test_shutdown() {
+        WorkerPool pool(3);
+        CHECK(pool.TryShutdown());
+
+        check_runs_once(pool, 100, 4);
+        CHECK(pool.GetHelpersCount() > 0);
+        CHECK(pool.TryShutdown());
+        CHECK(pool.GetHelpersCount() == 0);
+
+        // helpers at work: not now
+        Gate started(3);
+        std::mutex lock;
+        std::condition_variable wakeUp;
+        bool isReleased = false;
+        std::thread caller([&]() {
+            pool.Run(2, 2, [&](size_t) {
+                started.Arrive();
+                std::unique_lock<std::mutex> guard(lock);
+                wakeUp.wait(guard, [&]() { return isReleased; });
+            });
+        });
+        CHECK(started.Arrive());
+        CHECK(!pool.TryShutdown());
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            isReleased = true;
+        }
+        wakeUp.notify_all();
+        caller.join();
+        CHECK(pool.TryShutdown());
+
+        // and started again by the next menu
+        CHECK(pool.GetHelpersCount() == 0);
+        check_runs_once(pool, 100, 4);
+        CHECK(pool.GetHelpersCount() > 0);
+    }
+}
+
+int main() {
+    test_every_task_once();
+    test_inline();
+    test_parallel();
+    test_reused();
+    test_concurrent_callers();
+    test_nested();
+    test_shutdown();
+    return check::report();
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+/*
+Records of the usage log: how often and how recently handlers were launched. Every launch is a checksummed record
+of fixed size appended to the log; compaction squashes them into one record per handler.
+
+Plain C++ with no Windows types in it, like catalog_format.h. The file itself is left to the caller, what is here
+is deciding what to read of it, reading records back out of the bytes and ranking them for compaction:
+
+    record      key (8 bytes), time (8, FILETIME as a number), weight (4, 16.16 fixed point), checksum of them (4)
+*/
+
+#include "catalog_format.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace usage_log {
+
+    // One use of a handler, or many of them squashed together by compaction
+    struct UsageRecord {
+        uint64_t key = 0;
+        uint64_t time = 0;   // FILETIME as a number
+        uint32_t weight = 0; // 16.16 fixed point, a single use weighs 1
+    };
+
+    constexpr size_t RECORD_SIZE = 24;
+    constexpr uint32_t WEIGHT_ONE = 0x10000;
+    constexpr uint64_t TICKS_PER_DAY = 24ULL * 60 * 60 * 10000000;
+
+    // usage key -> score, relative to some reference time; only ordering of scores means anything
+    using Scores = std::unordered_map<uint64_t, double>;
+
+    inline void encode_record(const UsageRecord& record, std::vector<uint8_t>& out) {
+        const size_t start = out.size();
+        catalog_format::put_u64(out, record.key);
+        catalog_format::put_u64(out, record.time);
+        catalog_format::put_u32(out, record.weight);
+        catalog_format::put_u32(out, catalog_format::checksum(out.data() + start, RECORD_SIZE - 4));
+    }
+
+    // false if there is no whole record at the position
+    inline bool decode_record(const uint8_t* at, UsageRecord& record) {
+        if (catalog_format::get_u32(at + RECORD_SIZE - 4) != catalog_format::checksum(at, RECORD_SIZE - 4)) {
+            return false;
+        }
+        record.key = catalog_format::get_u64(at);
+        record.time = catalog_format::get_u64(at + 8);
+        record.weight = catalog_format::get_u32(at + 16);
+        return true;
+    }
+
+    /*
+    Calls onRecord for every record in the bytes. A torn record (a crash in the middle of a write) or any other
+    garbage fails its checksum and is stepped over a byte at a time, until a record checks out again.
+    Returns how many bytes were gone through: a partial record at the very end is being written right now,
+    it's left for the next read.
+    */
+    template <typename OnRecord>
+    size_t scan_records(const uint8_t* bytes, size_t size, OnRecord onRecord) {
+        size_t position = 0;
+        while (position + RECORD_SIZE <= size) {
+            UsageRecord record;
+            if (decode_record(bytes + position, record)) {
+                onRecord(record);
+                position += RECORD_SIZE;
+            }
+            else {
+                position += 1;
+            }
+        }
+        return position;
+    }
+
+    // record's weight as of the reference time, halved every halfLifeDays
+    inline double get_score(const UsageRecord& record, uint64_t referenceTime, double halfLifeDays) {
+        const double age = (static_cast<double>(referenceTime) - static_cast<double>(record.time)) / (halfLifeDays * TICKS_PER_DAY);
+        return (static_cast<double>(record.weight) / WEIGHT_ONE) * std::exp2(-age);
+    }
+
+    // Which file the log is (volume and file index on Windows): compaction moves another file in its place,
+    // which may well be as long as what was read of the old one, or longer
+    struct FileIdentity {
+        uint64_t volume = 0;
+        uint64_t index = 0;
+
+        bool operator==(const FileIdentity& other) const {
+            return volume == other.volume && index == other.index;
+        }
+
+        bool operator!=(const FileIdentity& other) const {
+            return !(*this == other);
+        }
+    };
+
+    struct ReadPlan {
+        uint64_t from = 0;
+        uint64_t length = 0;
+        // scores so far are dropped and built from this read alone
+        bool isWhole = false;
+    };
+
+    // What to read of the log, given what was read of it before: nothing, what was appended since,
+    // or everything if it's another file now or it got shorter.
+    inline ReadPlan plan_read(const FileIdentity& readFile, uint64_t readSize, const FileIdentity& file, uint64_t fileSize, uint64_t maxReadSize) {
+        ReadPlan plan;
+        const bool isSameFile = file == readFile && fileSize >= readSize;
+        if (isSameFile && fileSize == readSize) {
+            return plan;
+        }
+        plan.from = isSameFile ? readSize : 0;
+        plan.isWhole = !isSameFile;
+        if (fileSize - plan.from > maxReadSize) {
+            // A log grown beyond any reason (compactions kept failing): only its last records are read,
+            // which are still far more than the log is meant to hold, so the next use compacts it.
+            plan.from = fileSize - maxReadSize;
+            plan.isWhole = true;
+        }
+        plan.length = fileSize - plan.from;
+        return plan;
+    }
+
+    inline bool is_nothing_to_read(const ReadPlan& plan) {
+        return !plan.isWhole && plan.length == 0;
+    }
+
+    /*
+    One record per handler, as of the given time, for the maxKept highest scores: the log has to shrink even if
+    every record is of a different handler. Handlers scored below minScore are forgotten.
+    Highest score first.
+    */
+    inline std::vector<UsageRecord> compact_records(const Scores& scores, uint64_t time, size_t maxKept, double minScore) {
+        std::vector<std::pair<double, uint64_t>> ranked;
+        for (const auto& score : scores) {
+            if (score.second >= minScore) {
+                ranked.emplace_back(score.second, score.first);
+            }
+        }
+        const size_t keep = std::min(ranked.size(), maxKept);
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+
+        std::vector<UsageRecord> records(keep);
+        for (size_t i = 0; i < keep; i += 1) {
+            records[i].key = ranked[i].second;
+            records[i].time = time;
+            records[i].weight = static_cast<uint32_t>(std::min(ranked[i].first, double(0xFFFFFFFFu) / WEIGHT_ONE) * WEIGHT_ONE);
+        }
+        return records;
+    }
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+/*
+Threads that split the work of one right-click: classifying a large selection, listing handler folders.
+Starting threads costs more than the few hundred lookups each of them does, so they are started once
+and then wait for the next menu.
+
+Plain C++ with no Windows types in it, like catalog_format.h.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace worker_pool {
+
+    /*
+    Helper threads kept between calls of Run, started as they are first needed and up to maxHelpers.
+    The calling thread works on its tasks too, so a Run always finishes even with every helper busy elsewhere,
+    and a task can Run more tasks of its own. Several threads can Run at once, helpers join whichever came first.
+    */
+    class WorkerPool final {
+    public:
+        explicit WorkerPool(size_t maxHelpers)
+            : m_maxHelpers(maxHelpers)
+        {}
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stopping = true;
+                m_wakeUp.notify_all();
+            }
+            for (auto& helper : m_helpers) {
+                helper.join();
+            }
+        }
+
+        // Runs task(i) for every i in [0, nTasks) on up to maxThreads threads, calling thread included.
+        template <typename Task>
+        void Run(size_t nTasks, size_t maxThreads, Task task) {
+            const size_t nThreads = maxThreads < nTasks ? maxThreads : nTasks;
+            if (nThreads <= 1) {
+                for (size_t i = 0; i < nTasks; i += 1) {
+                    task(i);
+                }
+                return;
+            }
+
+            // lives on the caller's stack: helpers are done with it before Run returns
+            Job job;
+            job.nTasks = nTasks;
+            job.context = &task;
+            job.run = [](void* context, size_t i) {
+                (*static_cast<Task*>(context))(i);
+            };
+            job.nHelpersWanted = nThreads - 1;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_jobs.push_back(&job);
+                m_nHelpersWanted += job.nHelpersWanted;
+                // while shutting down the caller does it all alone
+                while (!m_stopping && m_helpers.size() < m_maxHelpers && m_helpers.size() < m_nBusy + m_nHelpersWanted) {
+                    m_helpers.emplace_back(&WorkerPool::Help, this);
+                    m_nStarted += 1;
+                }
+                m_wakeUp.notify_all();
+            }
+
+            Work(job);
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            // helpers that haven't come by now aren't needed anymore
+            if (job.nHelpersWanted > 0) {
+                m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+                m_nHelpersWanted -= job.nHelpersWanted;
+                job.nHelpersWanted = 0;
+            }
+            m_jobDone.wait(lock, [&job]() { return job.nHelpersIn == 0; });
+        }
+
+        // Stops the helpers if none is busy, so the DLL can be unloaded.
+        // Returns false while some of them are at work, or wanted by a Run.
+        bool TryShutdown() {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_nBusy > 0 || !m_jobs.empty()) {
+                    return false;
+                }
+                if (m_helpers.empty()) {
+                    return true;
+                }
+                m_stopping = true;
+                m_wakeUp.notify_all();
+            }
+
+            // nobody starts helpers while stopping, so the list can be gone through unlocked
+            for (auto& helper : m_helpers) {
+                helper.join();
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_helpers.clear();
+            m_stopping = false;
+            return true;
+        }
+
+        // helpers running now
+        size_t GetHelpersCount() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_helpers.size();
+        }
+
+        // helpers ever started: stays put once the pool is warm
+        size_t GetStartedCount() {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_nStarted;
+        }
+
+    private:
+        struct Job {
+            size_t nTasks = 0;
+            std::atomic<size_t> nextTask{ 0 };
+            // the task, without a std::function allocating for it
+            void* context = nullptr;
+            void (*run)(void* context, size_t i) = nullptr;
+            // guarded by the pool's lock
+            size_t nHelpersWanted = 0;
+            size_t nHelpersIn = 0;
+        };
+
+        static void Work(Job& job) {
+            for (size_t i = job.nextTask++; i < job.nTasks; i = job.nextTask++) {
+                job.run(job.context, i);
+            }
+        }
+
+        void Help() {
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (true) {
+                m_wakeUp.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+
+                Job& job = *m_jobs.front();
+                job.nHelpersIn += 1;
+                job.nHelpersWanted -= 1;
+                m_nHelpersWanted -= 1;
+                if (job.nHelpersWanted == 0) {
+                    m_jobs.pop_front();
+                }
+                m_nBusy += 1;
+
+                lock.unlock();
+                Work(job);
+                lock.lock();
+
+                m_nBusy -= 1;
+                job.nHelpersIn -= 1;
+                if (job.nHelpersIn == 0) {
+                    m_jobDone.notify_all();
+                }
+            }
+        }
+
+        const size_t m_maxHelpers;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        std::condition_variable m_jobDone;
+        // jobs still wanting helpers, oldest first
+        std::deque<Job*> m_jobs;
+        std::vector<std::thread> m_helpers;
+        size_t m_nHelpersWanted = 0;
+        size_t m_nBusy = 0;
+        size_t m_nStarted = 0;
+        bool m_stopping = false;
+    };
+}
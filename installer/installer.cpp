@@ -7,6 +7,9 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
+
+#include "../extension/catalog_format.h"
 
 namespace {
 
@@ -196,6 +199,30 @@ namespace {
         return std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*>(pMyDocuments, CoTaskMemFree);
     }
 
+    std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*> GetUserLocalAppDataFolderPath() {
+        wchar_t* pLocalAppData = nullptr;
+        SHGetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_CREATE, 0, &pLocalAppData);
+        return std::unique_ptr<wchar_t, decltype(CoTaskMemFree)*>(pLocalAppData, CoTaskMemFree);
+    }
+
+    std::wstring get_catalog_folder() {
+        auto localAppData = GetUserLocalAppDataFolderPath();
+        if (!localAppData) {
+            return std::wstring();
+        }
+        std::wstring path(localAppData.get());
+        path.append(catalog_format::CATALOG_FOLDER_NAME);
+        return path;
+    }
+
+    void delete_handlers_catalog() {
+        std::wstring catalogPath = get_catalog_folder();
+        if (!catalogPath.empty()) {
+            catalogPath.append(catalog_format::CATALOG_FILE_NAME);
+            DeleteFileW(catalogPath.c_str());
+        }
+    }
+
     bool delete_folders_for_handlers(bool silent) {
         auto myDocuments = GetUserDocumentsFolderPath();
         std::wstring workingString(myDocuments.get());
@@ -222,6 +249,7 @@ namespace {
         bool allSucceeded = true;
         allSucceeded &= unregister_com_server(silent);
         allSucceeded &= unregister_shell_extension(silent);
+        delete_handlers_catalog();
         if (silent || ask(L"Move your handlers folder into Trash (Recycle Bin)?")) {
             allSucceeded &= delete_folders_for_handlers(silent);
         }
@@ -250,7 +278,7 @@ namespace {
 
         if (!create_folder_if_not_exists(workingString)) return false;
 
-        for (const wchar_t* folderName : { L"\\Everything", L"\\Folders", L"\\All files", L"\\Extensionless Files", L"\\Files by Extension" }) {
+        for (const wchar_t* folderName : { L"\\Everything", L"\\Folders", L"\\All files", L"\\Extensionless Files", L"\\Files by Extension", L"\\Files by Pattern", L"\\Files by Type" }) {
             workingString.append(folderName);
             if (!create_folder_if_not_exists(workingString)) return false;
             workingString.erase(rootLength);
@@ -259,6 +287,164 @@ namespace {
         return true;
     }
 
+    std::u16string to_u16(const std::wstring& text) {
+        return std::u16string(text.begin(), text.end());
+    }
+
+    uint64_t to_u64(const FILETIME& time) {
+        return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    }
+
+    // the same small icon the extension would get from the shell, as 32 bit BGRA top-down pixels
+    void render_handler_icon(const std::wstring& path, catalog_format::HandlerEntry& handler) {
+        SHFILEINFOW fileInfo = { 0 };
+        if (!SHGetFileInfoW(path.c_str(), 0, &fileInfo, sizeof(fileInfo), SHGFI_ICON | SHGFI_SMALLICON)) {
+            return;
+        }
+
+        ICONINFO iconInfo = { 0 };
+        if (GetIconInfo(fileInfo.hIcon, &iconInfo)) {
+            BITMAP bitmap = { 0 };
+            // icons of fewer bits are left to the extension, the shell knows better what to do with them
+            if (iconInfo.hbmColor
+                && GetObjectW(iconInfo.hbmColor, sizeof(bitmap), &bitmap)
+                && bitmap.bmBitsPixel == 32
+                && bitmap.bmWidth > 0 && bitmap.bmWidth <= 256
+                && bitmap.bmHeight > 0 && bitmap.bmHeight <= 256) {
+                BITMAPINFO info = { 0 };
+                info.bmiHeader.biSize = sizeof(info.bmiHeader);
+                info.bmiHeader.biWidth = bitmap.bmWidth;
+                info.bmiHeader.biHeight = -bitmap.bmHeight;
+                info.bmiHeader.biPlanes = 1;
+                info.bmiHeader.biBitCount = 32;
+                info.bmiHeader.biCompression = BI_RGB;
+
+                const size_t nPixels = size_t(bitmap.bmWidth) * bitmap.bmHeight;
+                std::vector<uint8_t> pixels(nPixels * 4);
+                std::vector<uint8_t> mask(nPixels * 4);
+                HDC screen = GetDC(NULL);
+                if (bitmap.bmHeight == GetDIBits(screen, iconInfo.hbmColor, 0, bitmap.bmHeight, pixels.data(), &info, DIB_RGB_COLORS)) {
+                    bool haveAlpha = false;
+                    for (size_t i = 0; i < nPixels && !haveAlpha; i += 1) {
+                        haveAlpha = pixels[4 * i + 3] != 0;
+                    }
+                    // Image lists hand out 32 bit icons with no alpha at all, their transparency is in the mask:
+                    // white in it is transparent, as the extension reads it too
+                    const bool isUsable = haveAlpha
+                        || (iconInfo.hbmMask && bitmap.bmHeight == GetDIBits(screen, iconInfo.hbmMask, 0, bitmap.bmHeight, mask.data(), &info, DIB_RGB_COLORS));
+                    for (size_t i = 0; i < nPixels && !haveAlpha && isUsable; i += 1) {
+                        pixels[4 * i + 3] = mask[4 * i] ? 0 : 255;
+                    }
+                    if (isUsable) {
+                        handler.iconWidth = bitmap.bmWidth;
+                        handler.iconHeight = bitmap.bmHeight;
+                        handler.iconPixels = std::move(pixels);
+                    }
+                }
+                ReleaseDC(NULL, screen);
+            }
+            if (iconInfo.hbmColor) {
+                DeleteObject(iconInfo.hbmColor);
+            }
+            DeleteObject(iconInfo.hbmMask);
+        }
+        DestroyIcon(fileInfo.hIcon);
+    }
+
+    // lists the folder the way the extension does, then its subfolders
+    bool list_handlers_folder(const std::wstring& root, const std::wstring& relativePath, size_t depth, std::vector<catalog_format::FolderEntry>& folders) {
+        constexpr size_t MAX_DEPTH = 8;
+
+        const std::wstring folder = relativePath.empty() ? root : root + L"\\" + relativePath;
+        WIN32_FILE_ATTRIBUTE_DATA folderData;
+        if (!GetFileAttributesExW(folder.c_str(), GetFileExInfoStandard, &folderData)) {
+            return false;
+        }
+
+        WIN32_FIND_DATAW findData;
+        HANDLE searchHandle = FindFirstFileExW((folder + L"\\*").c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (INVALID_HANDLE_VALUE == searchHandle) {
+            // the extension will list this one itself
+            return false;
+        }
+
+        catalog_format::FolderEntry entry;
+        entry.path = to_u16(relativePath);
+        entry.lastWriteTime = to_u64(folderData.ftLastWriteTime);
+        std::vector<std::wstring> subfoldersToList;
+        do {
+            const DWORD attributes = findData.dwFileAttributes;
+            const bool isDirectory = ((attributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY);
+            const bool isHidden = ((attributes & FILE_ATTRIBUTE_HIDDEN) == FILE_ATTRIBUTE_HIDDEN);
+            const std::wstring name(findData.cFileName);
+            if (isHidden || name == L"." || name == L"..") {
+                continue;
+            }
+
+            if (isDirectory) {
+                entry.subfolders.push_back(to_u16(name));
+                // junctions could lead us in circles
+                if ((attributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) {
+                    subfoldersToList.push_back(name);
+                }
+                continue;
+            }
+
+            catalog_format::HandlerEntry handler;
+            handler.name = to_u16(name);
+            handler.lastWriteTime = to_u64(findData.ftLastWriteTime);
+            render_handler_icon(folder + L"\\" + name, handler);
+            entry.handlers.push_back(std::move(handler));
+        } while (FindNextFileW(searchHandle, &findData));
+        FindClose(searchHandle);
+
+        folders.push_back(std::move(entry));
+        if (depth < MAX_DEPTH) {
+            for (const auto& subfolder : subfoldersToList) {
+                list_handlers_folder(root, relativePath.empty() ? subfolder : relativePath + L"\\" + subfolder, depth + 1, folders);
+            }
+        }
+        return true;
+    }
+
+    // Walks handler folders and writes what is there, icons included, for the extension to map into memory
+    bool compile_handlers_catalog() {
+        auto myDocuments = GetUserDocumentsFolderPath();
+        if (!myDocuments) {
+            return false;
+        }
+        std::wstring root(myDocuments.get());
+        root.append(L"\\Open With Handlers for");
+
+        std::vector<catalog_format::FolderEntry> folders;
+        if (!list_handlers_folder(root, std::wstring(), 0, folders)) {
+            return false;
+        }
+        const std::vector<uint8_t> catalog = catalog_format::write_catalog(to_u16(root), std::move(folders));
+
+        std::wstring catalogPath = get_catalog_folder();
+        if (catalogPath.empty() || !create_folder_if_not_exists(catalogPath)) {
+            return false;
+        }
+        catalogPath.append(catalog_format::CATALOG_FILE_NAME);
+
+        // written aside and moved in place, so the extension never sees a half written catalog
+        const std::wstring temporaryPath = catalogPath + L".new";
+        HANDLE file = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        DWORD written = 0;
+        const bool haveWritten = WriteFile(file, catalog.data(), static_cast<DWORD>(catalog.size()), &written, NULL) && written == catalog.size();
+        CloseHandle(file);
+
+        if (!haveWritten || !MoveFileExW(temporaryPath.c_str(), catalogPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
     bool install_extension(const std::wstring& server_path, std::wstring& pathToHandlersFolder) {
         if (!create_folders_for_handlers(pathToHandlersFolder)) {
             return false;
@@ -378,6 +564,8 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, wchar_t* lpC
 
                 std::wstring pathToHandlersFolder;
                 if (install_extension(processFullPath.c_str(), pathToHandlersFolder)) {
+                    // not having a catalog only makes the first menus slower
+                    compile_handlers_catalog();
                     if (ask(L"The extension was registered successfuly.\nWould you like to open handlers folders?")) {
                         ShellExecuteW(NULL, L"explore", pathToHandlersFolder.c_str(), NULL, NULL, SW_SHOWDEFAULT);
                     }
@@ -392,6 +580,12 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, wchar_t* lpC
                 };
             } break;
 
+            case L'c': {
+                if (!compile_handlers_catalog()) {
+                    error(L"Failed to compile handlers catalog");
+                }
+            } break;
+
             default: {
                 error(L"Invalid command line");
             }